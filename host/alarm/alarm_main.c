@@ -0,0 +1,272 @@
+/*
+ * Checks the alarm fire times (main/alarm_time.c) across DST transitions:
+ *
+ *   station_alarm
+ *   station_alarm --verbose
+ *
+ * Runs under a northern ("CET-1CEST,M3.5.0,M10.5.0/3") and a southern
+ * ("AEST-10AEDT,M10.1.0,M4.1.0/3") rule. Besides the fixed cases around
+ * the transitions, it follows every alarm the way alarm.c re-arms it, from
+ * one hour after each fire, over two years, for alarm times in and around
+ * the skipped and repeated hours: each local day of the mask must fire
+ * exactly once, at the alarm's local time or, in a skipped hour, one hour
+ * later. The exit code is 1 on any failure.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "alarm_time.h"
+#include "tz_rule.h"
+
+#define SECS_PER_DAY    86400
+#define REARM_S         3600    /* As alarm_timer_cb() */
+
+typedef struct local {
+    int32_t year;
+    uint32_t month, day;
+    int32_t wday;
+    int32_t sod;                /* Seconds of the local day */
+    int64_t days;               /* Local days since 1970-01-01 */
+} local_t;
+
+static bool verbose = false;
+static unsigned int failures = 0;
+static unsigned int checks = 0;
+
+static int64_t utc(int32_t year, uint32_t month, uint32_t day, int32_t hour, int32_t min)
+{
+    return (int64_t) tz_days_from_civil(year, month, day) * SECS_PER_DAY + hour * 3600 + min * 60;
+}
+
+static local_t to_local(const tz_rule_t *rule, int64_t t)
+{
+    local_t l;
+    int64_t local = t + tz_rule_utc_offset(rule, t, NULL, NULL);
+
+    l.days = local / SECS_PER_DAY - (local % SECS_PER_DAY < 0);
+    l.sod = (int32_t) (local - l.days * SECS_PER_DAY);
+    l.wday = (int32_t) (((l.days + 4) % 7 + 7) % 7);
+    tz_civil_from_days((int32_t) l.days, &l.year, &l.month, &l.day);
+
+    return l;
+}
+
+static void print_time(const tz_rule_t *rule, int64_t t)
+{
+    bool dst;
+    local_t l = to_local(rule, t);
+
+    tz_rule_utc_offset(rule, t, NULL, &dst);
+    printf("%" PRId64 " (%04" PRId32 "-%02" PRIu32 "-%02" PRIu32 " %02" PRId32 ":%02" PRId32 " %s)", t, l.year, l.month,
+           l.day, l.sod / 3600, l.sod / 60 % 60, dst ? rule->dst_name : rule->std_name);
+}
+
+static void check(const char *what, const tz_rule_t *rule, int64_t got, int64_t want)
+{
+    checks++;
+
+    if (got == want && !verbose) return;
+
+    printf("%s %s: got ", got == want ? "ok  " : "FAIL", what);
+    print_time(rule, got);
+    if (got != want) {
+        printf(", want ");
+        print_time(rule, want);
+        failures++;
+    }
+    printf("\n");
+}
+
+static alarm_t make_alarm(uint8_t hour, uint8_t min, uint8_t weekdays)
+{
+    return (alarm_t) { .hour = hour, .min = min, .weekdays = weekdays, .enabled = 1 };
+}
+
+static void check_cet(const tz_rule_t *cet)
+{
+    alarm_t a = make_alarm(2, 30, ALARM_EVERY_DAY);
+    int64_t t;
+
+    /* 2024-03-31 02:00 CET -> 03:00 CEST: 02:30 does not exist, fires at 03:30 CEST */
+    t = alarm_next_fire(&a, cet, utc(2024, 3, 30, 23, 0));
+    check("CET spring-forward, 02:30 in the gap", cet, t, utc(2024, 3, 31, 1, 30));
+    check("CET spring-forward, re-armed", cet, alarm_next_fire(&a, cet, t + REARM_S), utc(2024, 4, 1, 0, 30));
+
+    a = make_alarm(3, 0, ALARM_EVERY_DAY);
+    check("CET spring-forward, 03:00 right after the gap", cet, alarm_next_fire(&a, cet, utc(2024, 3, 30, 23, 0)),
+          utc(2024, 3, 31, 1, 0));
+
+    /* 2024-10-27 03:00 CEST -> 02:00 CET: 02:30 happens twice, fires at the first one only */
+    a = make_alarm(2, 30, ALARM_EVERY_DAY);
+    t = alarm_next_fire(&a, cet, utc(2024, 10, 26, 22, 0));
+    check("CET fall-back, 02:30 repeated", cet, t, utc(2024, 10, 27, 0, 30));
+    check("CET fall-back, re-armed on the repeat", cet, alarm_next_fire(&a, cet, t + REARM_S), utc(2024, 10, 28, 1, 30));
+    check("CET fall-back, between the two 02:30", cet, alarm_next_fire(&a, cet, utc(2024, 10, 27, 0, 45)),
+          utc(2024, 10, 28, 1, 30));
+
+    /* Weekday masks across the Saturday/Sunday wrap, 2024-06-08 is a Saturday */
+    a = make_alarm(7, 0, ALARM_WEEKEND);
+    check("CET weekend, Saturday after the alarm", cet, alarm_next_fire(&a, cet, utc(2024, 6, 8, 12, 0)),
+          utc(2024, 6, 9, 5, 0));
+    check("CET weekend, Sunday after the alarm", cet, alarm_next_fire(&a, cet, utc(2024, 6, 9, 12, 0)),
+          utc(2024, 6, 15, 5, 0));
+    a = make_alarm(7, 0, ALARM_WEEKDAYS);
+    check("CET weekdays, Friday after the alarm", cet, alarm_next_fire(&a, cet, utc(2024, 6, 7, 12, 0)),
+          utc(2024, 6, 10, 5, 0));
+    a = make_alarm(7, 0, 1 << 0);
+    check("CET Sunday only, Sunday after the alarm", cet, alarm_next_fire(&a, cet, utc(2024, 6, 9, 12, 0)),
+          utc(2024, 6, 16, 5, 0));
+    /* 00:30 local on Sunday is still Saturday in UTC */
+    a = make_alarm(0, 30, 1 << 0);
+    check("CET Sunday 00:30, Saturday evening", cet, alarm_next_fire(&a, cet, utc(2024, 6, 8, 20, 0)),
+          utc(2024, 6, 8, 22, 30));
+
+    /* ALARM_ONCE: the next occurrence whatever the day, never when disabled */
+    a = make_alarm(7, 0, ALARM_ONCE);
+    check("CET once, before the alarm", cet, alarm_next_fire(&a, cet, utc(2024, 6, 8, 4, 0)), utc(2024, 6, 8, 5, 0));
+    check("CET once, at the alarm", cet, alarm_next_fire(&a, cet, utc(2024, 6, 8, 5, 0)), utc(2024, 6, 9, 5, 0));
+    check("CET once, across spring-forward", cet, alarm_next_fire(&a, cet, utc(2024, 3, 30, 12, 0)),
+          utc(2024, 3, 31, 5, 0));
+    a.enabled = 0;
+    check("CET once, disabled", cet, alarm_next_fire(&a, cet, utc(2024, 6, 8, 4, 0)), 0);
+    a = make_alarm(7, 0, ALARM_EVERY_DAY);
+    a.enabled = 0;
+    check("CET every day, disabled", cet, alarm_next_fire(&a, cet, utc(2024, 6, 8, 4, 0)), 0);
+}
+
+static void check_aest(const tz_rule_t *aest)
+{
+    alarm_t a = make_alarm(2, 30, ALARM_EVERY_DAY);
+    int64_t t;
+
+    /* 2024-10-06 02:00 AEST -> 03:00 AEDT */
+    t = alarm_next_fire(&a, aest, utc(2024, 10, 5, 14, 0));
+    check("AEST spring-forward, 02:30 in the gap", aest, t, utc(2024, 10, 5, 16, 30));
+    check("AEST spring-forward, re-armed", aest, alarm_next_fire(&a, aest, t + REARM_S), utc(2024, 10, 6, 15, 30));
+
+    /* 2024-04-07 03:00 AEDT -> 02:00 AEST */
+    t = alarm_next_fire(&a, aest, utc(2024, 4, 6, 12, 0));
+    check("AEST fall-back, 02:30 repeated", aest, t, utc(2024, 4, 6, 15, 30));
+    check("AEST fall-back, re-armed on the repeat", aest, alarm_next_fire(&a, aest, t + REARM_S),
+          utc(2024, 4, 7, 16, 30));
+
+    /* DST across the new year: 2025-01-04 is a Saturday, 07:00 AEDT is 20:00 UTC the day before */
+    a = make_alarm(7, 0, ALARM_WEEKEND);
+    check("AEST weekend, Friday evening UTC", aest, alarm_next_fire(&a, aest, utc(2025, 1, 3, 12, 0)),
+          utc(2025, 1, 3, 20, 0));
+    check("AEST weekend, Sunday after the alarm", aest, alarm_next_fire(&a, aest, utc(2025, 1, 5, 0, 0)),
+          utc(2025, 1, 10, 20, 0));
+}
+
+/* Re-arms like alarm_timer_cb() for two years and checks every fire */
+static void follow(const char *zone, const tz_rule_t *rule, const alarm_t *a)
+{
+    /* From the first local midnight of 2024 to the first of 2026 */
+    int64_t start = utc(2024, 1, 1, 0, 0) - tz_rule_utc_offset(rule, utc(2024, 1, 1, 0, 0), NULL, NULL);
+    int64_t end = utc(2026, 1, 1, 0, 0) - tz_rule_utc_offset(rule, utc(2026, 1, 1, 0, 0), NULL, NULL);
+    int64_t t = alarm_next_fire(a, rule, start - 1), expected_days;
+    int64_t last_day = to_local(rule, start).days - 1;
+    int32_t want_sod = a->hour * 3600 + a->min * 60;
+    unsigned int fires = 0, errors = 0;
+    local_t l;
+
+    while (t != 0 && t < end) {
+        l = to_local(rule, t);
+        fires++;
+
+        /* Every masked day between the last fire and this one was skipped */
+        for (int64_t d = last_day + 1; d < l.days; d++) {
+            if (a->weekdays & (1 << ((d + 4) % 7))) {
+                if (errors++ < 3) printf("FAIL %s %02u:%02u mask %02x: day %" PRId64 " skipped\n", zone, a->hour,
+                                         a->min, a->weekdays, d);
+            }
+        }
+
+        if (l.days == last_day || !(a->weekdays & (1 << l.wday)) ||
+            (l.sod != want_sod && l.sod != want_sod + 3600)) {
+            if (errors++ < 3) {
+                printf("FAIL %s %02u:%02u mask %02x: fired at ", zone, a->hour, a->min, a->weekdays);
+                print_time(rule, t);
+                printf("%s\n", l.days == last_day ? ", twice that day" : "");
+            }
+        } else if (l.sod != want_sod && to_local(rule, t - 3600).sod == want_sod) {
+            /* One hour late is only right when the alarm time was skipped */
+            if (errors++ < 3) {
+                printf("FAIL %s %02u:%02u: late at ", zone, a->hour, a->min);
+                print_time(rule, t);
+                printf("\n");
+            }
+        }
+
+        last_day = l.days;
+        t = alarm_next_fire(a, rule, t + REARM_S);
+    }
+
+    expected_days = 0;
+    for (int64_t d = to_local(rule, start).days; d < to_local(rule, end).days; d++) {
+        expected_days += (a->weekdays & (1 << ((d + 4) % 7))) != 0;
+    }
+    if (fires != expected_days && errors++ < 3) {
+        printf("FAIL %s %02u:%02u mask %02x: %u fires, want %" PRId64 "\n", zone, a->hour, a->min, a->weekdays, fires,
+               expected_days);
+    }
+
+    checks++;
+    failures += errors != 0;
+
+    if (verbose && errors == 0) {
+        printf("ok   %s %02u:%02u mask %02x: %u fires over two years\n", zone, a->hour, a->min, a->weekdays, fires);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    static const struct {
+        const char *name;
+        const char *spec;
+    } zones[] = {
+        { "CET", "CET-1CEST,M3.5.0,M10.5.0/3" },
+        { "AEST", "AEST-10AEDT,M10.1.0,M4.1.0/3" },
+    };
+    static const uint8_t times[][2] = {
+        { 0, 0 }, { 1, 59 }, { 2, 0 }, { 2, 30 }, { 2, 59 }, { 3, 0 }, { 3, 30 }, { 7, 0 }, { 23, 59 },
+    };
+    static const uint8_t masks[] = { ALARM_EVERY_DAY, ALARM_WEEKDAYS, ALARM_WEEKEND, 1 << 0, 1 << 6 };
+    tz_rule_t rules[2];
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--verbose") == 0) {
+            verbose = true;
+        } else {
+            fprintf(stderr, "usage: %s [--verbose]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    for (size_t z = 0; z < 2; z++) {
+        if (!tz_rule_parse(zones[z].spec, &rules[z])) {
+            printf("FAIL cannot parse %s\n", zones[z].spec);
+            return 1;
+        }
+    }
+
+    check_cet(&rules[0]);
+    check_aest(&rules[1]);
+
+    for (size_t z = 0; z < 2; z++) {
+        for (size_t i = 0; i < sizeof(times) / sizeof(times[0]); i++) {
+            for (size_t m = 0; m < sizeof(masks); m++) {
+                alarm_t a = make_alarm(times[i][0], times[i][1], masks[m]);
+
+                follow(zones[z].name, &rules[z], &a);
+            }
+        }
+    }
+
+    printf("%u checks, %u failed\n", checks, failures);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,275 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "bench.h"
+
+#define BENCH_MAX_SAMPLES   101
+#define BENCH_MAX_BASELINE  64
+#define BENCH_NAME_LEN      48
+
+typedef struct bench_result {
+    const char *name;
+    uint32_t iterations;
+    uint32_t samples;
+    double median_ns;
+    double mad_ns;
+    double min_ns;
+    double max_ns;
+} bench_result_t;
+
+typedef struct baseline_entry {
+    char name[BENCH_NAME_LEN];
+    double median_ns;
+    double mad_ns;
+} baseline_entry_t;
+
+typedef struct bench_options {
+    const char *filter;
+    const char *json_path;
+    const char *baseline_path;
+    unsigned int samples;
+    unsigned int min_time_ms;
+    double threshold;
+} bench_options_t;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+
+    return (x > y) - (x < y);
+}
+
+static double median(double *v, unsigned int n)
+{
+    qsort(v, n, sizeof(*v), cmp_double);
+
+    return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+static uint64_t time_batch(const bench_case_t *c, uint32_t iterations)
+{
+    uint64_t start = now_ns();
+
+    c->fn(c->arg, iterations);
+
+    return now_ns() - start;
+}
+
+static void run_case(const bench_case_t *c, const bench_options_t *opt, bench_result_t *res)
+{
+    double per_iter[BENCH_MAX_SAMPLES];
+    double dev[BENCH_MAX_SAMPLES];
+    uint64_t min_batch_ns = (uint64_t) opt->min_time_ms * 1000000u;
+    uint32_t iterations = 1;
+    uint64_t t;
+
+    /* Grow the batch until it lasts long enough for the clock resolution; this doubles as warmup */
+    while ((t = time_batch(c, iterations)) < min_batch_ns && iterations < (1u << 30)) {
+        uint64_t scale = t ? min_batch_ns / t + 1 : 16;
+
+        iterations *= scale < 2 ? 2 : scale > 16 ? 16 : scale;
+    }
+
+    for (unsigned int i = 0; i < opt->samples; i++) {
+        per_iter[i] = (double) time_batch(c, iterations) / iterations;
+    }
+
+    res->name = c->name;
+    res->iterations = iterations;
+    res->samples = opt->samples;
+    res->median_ns = median(per_iter, opt->samples);
+    res->min_ns = per_iter[0];
+    res->max_ns = per_iter[opt->samples - 1];
+
+    for (unsigned int i = 0; i < opt->samples; i++) {
+        dev[i] = per_iter[i] > res->median_ns ? per_iter[i] - res->median_ns : res->median_ns - per_iter[i];
+    }
+
+    res->mad_ns = median(dev, opt->samples);
+}
+
+static int write_json(const char *path, const bench_result_t *results, size_t n)
+{
+    FILE *f = fopen(path, "w");
+
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    /* One case per line, which is all load_baseline() needs to parse */
+    fprintf(f, "{\n  \"benchmarks\": [\n");
+    for (size_t i = 0; i < n; i++) {
+        const bench_result_t *r = &results[i];
+
+        fprintf(f, "    {\"name\": \"%s\", \"iterations\": %u, \"samples\": %u, \"median_ns\": %.3f, "
+                "\"mad_ns\": %.3f, \"min_ns\": %.3f, \"max_ns\": %.3f}%s\n",
+                r->name, r->iterations, r->samples, r->median_ns, r->mad_ns, r->min_ns, r->max_ns,
+                i + 1 < n ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+static bool json_number(const char *line, const char *key, double *out)
+{
+    const char *p = strstr(line, key);
+
+    return p != NULL && sscanf(p + strlen(key), " : %lf", out) == 1;
+}
+
+static int load_baseline(const char *path, baseline_entry_t *entries, size_t max)
+{
+    FILE *f = fopen(path, "r");
+    char line[512];
+    int n = 0;
+
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), f) != NULL && (size_t) n < max) {
+        baseline_entry_t *e = &entries[n];
+        const char *name = strstr(line, "\"name\": \"");
+        const char *end;
+        size_t len;
+
+        if (name == NULL) continue;
+
+        name += strlen("\"name\": \"");
+        end = strchr(name, '"');
+        len = end ? (size_t) (end - name) : 0;
+
+        if (len == 0 || len >= sizeof(e->name)) continue;
+        if (!json_number(line, "\"median_ns\"", &e->median_ns)) continue;
+        if (!json_number(line, "\"mad_ns\"", &e->mad_ns)) continue;
+
+        memcpy(e->name, name, len);
+        e->name[len] = '\0';
+        n++;
+    }
+
+    fclose(f);
+
+    return n;
+}
+
+static const baseline_entry_t *find_baseline(const baseline_entry_t *entries, int n, const char *name)
+{
+    for (int i = 0; i < n; i++) {
+        if (strcmp(entries[i].name, name) == 0) return &entries[i];
+    }
+
+    return NULL;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [--filter SUBSTR] [--samples N] [--min-time-ms MS] [--json FILE]\n"
+            "          [--baseline FILE [--threshold FRACTION]] [--list]\n", prog);
+}
+
+int bench_main(const bench_case_t *cases, size_t n_cases, int argc, char **argv)
+{
+    static bench_result_t results[BENCH_MAX_BASELINE];
+    static baseline_entry_t baseline[BENCH_MAX_BASELINE];
+    bench_options_t opt = {
+        .samples = 21,
+        .min_time_ms = 10,
+        .threshold = 0.10,
+    };
+    int n_baseline = 0;
+    size_t n_results = 0;
+    int regressions = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (strcmp(arg, "--list") == 0) {
+            for (size_t c = 0; c < n_cases; c++) printf("%s\n", cases[c].name);
+            return 0;
+        }
+
+        if (val == NULL) {
+            usage(argv[0]);
+            return 2;
+        }
+
+        if (strcmp(arg, "--filter") == 0) opt.filter = val;
+        else if (strcmp(arg, "--json") == 0) opt.json_path = val;
+        else if (strcmp(arg, "--baseline") == 0) opt.baseline_path = val;
+        else if (strcmp(arg, "--samples") == 0) opt.samples = strtoul(val, NULL, 0);
+        else if (strcmp(arg, "--min-time-ms") == 0) opt.min_time_ms = strtoul(val, NULL, 0);
+        else if (strcmp(arg, "--threshold") == 0) opt.threshold = strtod(val, NULL);
+        else {
+            usage(argv[0]);
+            return 2;
+        }
+
+        i++;
+    }
+
+    if (opt.samples < 3 || opt.samples > BENCH_MAX_SAMPLES || opt.min_time_ms == 0 || opt.threshold < 0) {
+        fprintf(stderr, "--samples must be in 3..%d, --min-time-ms and --threshold positive\n", BENCH_MAX_SAMPLES);
+        return 2;
+    }
+
+    if (opt.baseline_path != NULL) {
+        n_baseline = load_baseline(opt.baseline_path, baseline, BENCH_MAX_BASELINE);
+        if (n_baseline < 0) return 2;
+    }
+
+    printf("%-28s %12s %10s %12s %12s %10s\n", "benchmark", "median ns", "mad ns", "min ns", "max ns", "vs base");
+
+    for (size_t c = 0; c < n_cases && n_results < BENCH_MAX_BASELINE; c++) {
+        bench_result_t *r = &results[n_results];
+        const baseline_entry_t *base;
+
+        if (opt.filter != NULL && strstr(cases[c].name, opt.filter) == NULL) continue;
+
+        run_case(&cases[c], &opt, r);
+        n_results++;
+
+        printf("%-28s %12.2f %10.2f %12.2f %12.2f", r->name, r->median_ns, r->mad_ns, r->min_ns, r->max_ns);
+
+        base = find_baseline(baseline, n_baseline, r->name);
+        if (base == NULL || base->median_ns <= 0) {
+            printf("\n");
+            continue;
+        }
+
+        double delta = r->median_ns / base->median_ns - 1;
+        double noise = 3 * (r->mad_ns > base->mad_ns ? r->mad_ns : base->mad_ns);
+
+        /* Only a change beyond both the threshold and the measured noise counts */
+        bool regressed = delta > opt.threshold && r->median_ns - base->median_ns > noise;
+
+        printf(" %+9.1f%%%s\n", 100 * delta, regressed ? "  REGRESSION" : "");
+        regressions += regressed;
+    }
+
+    if (opt.json_path != NULL && write_json(opt.json_path, results, n_results) != 0) return 2;
+
+    if (opt.baseline_path != NULL) {
+        printf("%d regression(s) over %.0f %% against %s\n", regressions, 100 * opt.threshold, opt.baseline_path);
+    }
+
+    return regressions ? 1 : 0;
+}
@@ -0,0 +1,38 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Microbenchmark harness.
+ *
+ * Each case runs `iterations` times per call; the harness calibrates the
+ * iteration count so that a sample lasts at least --min-time-ms, takes
+ * --samples samples after a warmup and reports the median and the median
+ * absolute deviation of the time per iteration, which are robust to the
+ * occasional preemption.
+ */
+
+typedef void (*bench_fn_t)(void *arg, uint32_t iterations);
+
+typedef struct bench_case {
+    const char *name;
+    bench_fn_t fn;
+    void *arg;
+} bench_case_t;
+
+/* Keeps the compiler from optimizing away the computation of `p` */
+static inline void bench_keep(const void *p)
+{
+    __asm__ volatile("" : : "g"(p) : "memory");
+}
+
+/*
+ * Runs the cases selected by the command line. With --baseline, compares
+ * against a previous --json output and returns 1 if any case regressed,
+ * otherwise 0 (2 on usage errors).
+ */
+int bench_main(const bench_case_t *cases, size_t n_cases, int argc, char **argv);
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef BENCH_CASES_H
+#define BENCH_CASES_H
+
+#include <stdint.h>
+
+/* Cases defined in bench_aht20.c */
+void bench_aht20_crc(void *arg, uint32_t iterations);
+void bench_aht20_read_float(void *arg, uint32_t iterations);
+void bench_aht20_read_i16(void *arg, uint32_t iterations);
+
+#endif
@@ -0,0 +1,293 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "screen_conv.h"
+#include "ui_format.h"
+#include "tz_rule.h"
+#include "timekeeping.h"
+#include "telemetry_frame.h"
+#include "history_codec.h"
+#include "derived.h"
+
+#include "esp_timer.h"
+
+#include "bench.h"
+#include "bench_cases.h"
+
+#define HOR_RES 128
+#define VER_RES 64
+
+static uint8_t frame_i1[HOR_RES * VER_RES / 8];
+static uint8_t frame_pages[HOR_RES * VER_RES / 8];
+
+static tz_rule_t tz_cet;
+
+/* An hour of minute samples, slowly warming with a little noise */
+static history_sample_t history_block[HISTORY_BLOCK_SAMPLES];
+static uint8_t history_encoded[HISTORY_BLOCK_MAX];
+
+static void bench_screen_conv_full(void *arg, uint32_t iterations)
+{
+    for (uint32_t i = 0; i < iterations; i++) {
+        screen_conv_i1_to_pages(frame_i1, HOR_RES, 0, 0, HOR_RES - 1, VER_RES - 1, frame_pages);
+        bench_keep(frame_pages);
+    }
+}
+
+/* The clock label alone, the typical partial refresh once per second */
+static void bench_screen_conv_label(void *arg, uint32_t iterations)
+{
+    for (uint32_t i = 0; i < iterations; i++) {
+        screen_conv_i1_to_pages(frame_i1, HOR_RES, 16, 0, 111, 23, frame_pages);
+        bench_keep(frame_pages);
+    }
+}
+
+static void bench_ui_format_time(void *arg, uint32_t iterations)
+{
+    char buf[16];
+    clock_time_t t = { .hour = 23, .min = 59, .sec = 0 };
+
+    for (uint32_t i = 0; i < iterations; i++) {
+        t.sec = i % 60;
+        ui_format_time(buf, sizeof(buf), &t);
+        bench_keep(buf);
+    }
+}
+
+static void bench_ui_format_temperature(void *arg, uint32_t iterations)
+{
+    char buf[16];
+
+    for (uint32_t i = 0; i < iterations; i++) {
+        ui_format_temperature(buf, sizeof(buf), -12.5f + (i & 63) * 0.7f);
+        bench_keep(buf);
+    }
+}
+
+static void bench_ui_format_humidity(void *arg, uint32_t iterations)
+{
+    char buf[16];
+
+    for (uint32_t i = 0; i < iterations; i++) {
+        ui_format_humidity(buf, sizeof(buf), (i & 63) * 1.5f);
+        bench_keep(buf);
+    }
+}
+
+static void bench_ui_format_pressure(void *arg, uint32_t iterations)
+{
+    char buf[16];
+
+    for (uint32_t i = 0; i < iterations; i++) {
+        ui_format_pressure(buf, sizeof(buf), 950.0f + (i & 127));
+        bench_keep(buf);
+    }
+}
+
+static void bench_tz_utc_offset(void *arg, uint32_t iterations)
+{
+    int64_t utc = 1704067200;   /* 2024-01-01T00:00:00Z */
+    int64_t next;
+    bool is_dst;
+
+    for (uint32_t i = 0; i < iterations; i++) {
+        /* Step by a bit less than a day to walk across both transitions */
+        int32_t offset = tz_rule_utc_offset(&tz_cet, utc + (int64_t) (i % 400) * 86389, &next, &is_dst);
+        bench_keep(&offset);
+    }
+}
+
+/*
+ * One call per second of the monotonic clock, as the clock screen refreshes.
+ * The cached day is recomputed once per simulated day, so the time per call
+ * includes that share.
+ */
+static void bench_timekeeping_localtime(void *arg, uint32_t iterations)
+{
+    struct tm timeinfo;
+
+    for (uint32_t i = 0; i < iterations; i++) {
+        host_time_advance_us(1000000);
+        timekeeping_localtime(&timeinfo);
+        bench_keep(&timeinfo);
+    }
+}
+
+/* What timekeeping_localtime() replaces, under the same rule through TZ */
+static void bench_libc_localtime_r(void *arg, uint32_t iterations)
+{
+    struct tm timeinfo;
+    time_t t = 1704067200;
+
+    for (uint32_t i = 0; i < iterations; i++) {
+        t++;
+        localtime_r(&t, &timeinfo);
+        bench_keep(&timeinfo);
+    }
+}
+
+/* What a sensor read costs on the telemetry path, against the two log lines it replaces */
+static void bench_telemetry_sample_frame(void *arg, uint32_t iterations)
+{
+    uint8_t payload[TELEMETRY_SAMPLE_SIZE];
+    uint8_t frame[TELEMETRY_FRAME_MAX];
+    telemetry_header_t hdr = { .type = TELEMETRY_SAMPLE };
+    telemetry_sample_t sample = { .flags = TELEMETRY_SAMPLE_OK, .pressure = 1013.25f, .read_us = 82920 };
+
+    for (uint32_t i = 0; i < iterations; i++) {
+        hdr.seq = i;
+        hdr.time_ms = i * 10000;
+        sample.temperature = -12.5f + (i & 63) * 0.7f;
+        sample.humidity = (i & 63) * 1.5f;
+        telemetry_frame_encode(&hdr, payload, telemetry_sample_pack(&sample, payload), frame);
+        bench_keep(frame);
+    }
+}
+
+static void bench_log_sample_lines(void *arg, uint32_t iterations)
+{
+    char buf[64];
+
+    for (uint32_t i = 0; i < iterations; i++) {
+        snprintf(buf, sizeof(buf), "Humidity      : %2.2f %%", (i & 63) * 1.5f);
+        bench_keep(buf);
+        snprintf(buf, sizeof(buf), "Temperature   : %2.2f degC", -12.5f + (i & 63) * 0.7f);
+        bench_keep(buf);
+    }
+}
+
+static void bench_telemetry_frame_decode(void *arg, uint32_t iterations)
+{
+    uint8_t payload[TELEMETRY_PAYLOAD_MAX];
+    uint8_t frame[TELEMETRY_FRAME_MAX];
+    telemetry_header_t hdr = { .type = TELEMETRY_SAMPLE, .seq = 1234, .time_ms = 86400000 };
+    telemetry_sample_t sample = { .flags = TELEMETRY_SAMPLE_OK, .temperature = 21.5f, .humidity = 45.0f,
+                                  .pressure = 1013.25f, .read_us = 82920 };
+    size_t n = telemetry_frame_encode(&hdr, payload, telemetry_sample_pack(&sample, payload), frame);
+    size_t len;
+
+    for (uint32_t i = 0; i < iterations; i++) {
+        /* Between the delimiters, as the decoder sees it */
+        bool ok = telemetry_frame_decode(frame + 1, n - 2, &hdr, payload, &len) &&
+                  telemetry_sample_unpack(payload, len, &sample);
+        bench_keep(&ok);
+        bench_keep(&sample);
+    }
+}
+
+static void bench_history_encode_block(void *arg, uint32_t iterations)
+{
+    for (uint32_t i = 0; i < iterations; i++) {
+        size_t n = history_codec_encode_block(history_block, HISTORY_BLOCK_SAMPLES, history_encoded);
+        bench_keep(&n);
+        bench_keep(history_encoded);
+    }
+}
+
+static void bench_history_decode_block(void *arg, uint32_t iterations)
+{
+    history_sample_t samples[HISTORY_BLOCK_SAMPLES];
+    size_t len = history_codec_encode_block(history_block, HISTORY_BLOCK_SAMPLES, history_encoded);
+    size_t count;
+
+    for (uint32_t i = 0; i < iterations; i++) {
+        size_t n = history_codec_decode_block(history_encoded, len, samples, &count);
+        bench_keep(&n);
+        bench_keep(samples);
+    }
+}
+
+static void bench_derived_compute(void *arg, uint32_t iterations)
+{
+    derived_input_t in = { .pressure = 95000, .altitude = 500 };
+    derived_metrics_t out;
+
+    for (uint32_t i = 0; i < iterations; i++) {
+        in.temperature = -1000 + (i & 1023) * 4;
+        in.humidity = 2000 + (i & 255) * 30;
+        derived_compute(&in, &out);
+        bench_keep(&out);
+    }
+}
+
+/* The same metrics in float, as the firmware would compute them with soft-float libm */
+static void bench_derived_float(void *arg, uint32_t iterations)
+{
+    float out[4];
+
+    for (uint32_t i = 0; i < iterations; i++) {
+        float t = -10 + (i & 1023) * 0.04f;
+        float rh = 20 + (i & 255) * 0.3f;
+        float g = logf(rh / 100) + 17.62f * t / (243.12f + t);
+        float f = t * 1.8f + 32;
+
+        out[0] = 243.12f * g / (17.62f - g);
+        out[1] = 2.16679f * 611.2f * expf(g) / (t + 273.15f);
+        out[2] = 0.5f * (f + 61 + (f - 68) * 1.2f + rh * 0.094f);
+        if ((out[2] + f) / 2 >= 80) {
+            out[2] = -42.379f + 2.04901523f * f + 10.14333127f * rh - 0.22475541f * f * rh -
+                     0.00683783f * f * f - 0.05481717f * rh * rh + 0.00122874f * f * f * rh +
+                     0.00085282f * f * rh * rh - 0.00000199f * f * f * rh * rh;
+        }
+        out[3] = 95000 * expf(9.80665f * 500 / (287.05f * (t + 273.15f + 1.625f)));
+        bench_keep(out);
+    }
+}
+
+static const bench_case_t cases[] = {
+    { "screen_conv_full_frame", bench_screen_conv_full, NULL },
+    { "screen_conv_clock_label", bench_screen_conv_label, NULL },
+    { "ui_format_time", bench_ui_format_time, NULL },
+    { "ui_format_temperature", bench_ui_format_temperature, NULL },
+    { "ui_format_humidity", bench_ui_format_humidity, NULL },
+    { "ui_format_pressure", bench_ui_format_pressure, NULL },
+    { "tz_rule_utc_offset", bench_tz_utc_offset, NULL },
+    { "timekeeping_localtime", bench_timekeeping_localtime, NULL },
+    { "libc_localtime_r", bench_libc_localtime_r, NULL },
+    { "aht20_calc_crc", bench_aht20_crc, NULL },
+    { "aht20_read_float", bench_aht20_read_float, NULL },
+    { "aht20_read_i16", bench_aht20_read_i16, NULL },
+    { "telemetry_sample_frame", bench_telemetry_sample_frame, NULL },
+    { "log_sample_lines", bench_log_sample_lines, NULL },
+    { "telemetry_frame_decode", bench_telemetry_frame_decode, NULL },
+    { "history_encode_block", bench_history_encode_block, NULL },
+    { "history_decode_block", bench_history_decode_block, NULL },
+    { "derived_compute", bench_derived_compute, NULL },
+    { "derived_float", bench_derived_float, NULL },
+};
+
+int main(int argc, char **argv)
+{
+    uint32_t x = 0x12345678;
+
+    /* Fixed pseudo-random frame so that every run converts the same pixels */
+    for (size_t i = 0; i < sizeof(frame_i1); i++) {
+        x = x * 1664525 + 1013904223;
+        frame_i1[i] = x >> 24;
+    }
+
+    for (size_t i = 0; i < HISTORY_BLOCK_SAMPLES; i++) {
+        x = x * 1664525 + 1013904223;
+        history_block[i] = (history_sample_t) {
+            .time = 1704067200 + i * 60,
+            .temperature = 1250 + i + (x >> 30),
+            .humidity = 5500 - i + (x >> 29 & 3),
+            .pressure = 101325 + (x >> 28 & 7),
+        };
+    }
+
+    if (!tz_rule_parse("CET-1CEST,M3.5.0,M10.5.0/3", &tz_cet)) {
+        fprintf(stderr, "failed to parse the time zone rule\n");
+        return 2;
+    }
+
+    /* Also sets TZ for localtime_r() */
+    timekeeping_init("CET-1CEST,M3.5.0,M10.5.0/3");
+
+    return bench_main(cases, sizeof(cases) / sizeof(cases[0]), argc, argv);
+}
@@ -0,0 +1,221 @@
+/*
+ * Checks the fixed-point derived metrics (main/derived.c) against the same
+ * formulas in double precision over the station's operating range, and
+ * times both:
+ *
+ *   station_derived
+ *   station_derived --verbose
+ *
+ * The grid covers -40 to +60 °C by 0.05 °C, 1 to 100 %RH by 0.25 % and, for
+ * the sea-level pressure, 500 to 1100 hPa at altitudes up to 4000 m. The
+ * exit code is 1 when an error exceeds the bound documented in derived.h.
+ * On the host the double versions run on an FPU; on the C3 they would be
+ * soft-float calls, so the timings only compare the fixed-point code with
+ * itself across changes.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <time.h>
+
+#include "derived.h"
+
+#define MAGNUS_B 17.62
+#define MAGNUS_C 243.12
+
+typedef struct error_stat {
+    const char *name;
+    const char *unit;
+    double scale;           /* Fixed-point units per unit */
+    double bound;           /* In units */
+    double max;
+    double at_t, at_rh, at_x;
+    uint64_t count;
+} error_stat_t;
+
+static double ref_vapour(double t, double rh)
+{
+    return 611.2 * exp(MAGNUS_B * t / (MAGNUS_C + t)) * rh / 100;
+}
+
+static double ref_dew_point(double t, double rh)
+{
+    double g = log(ref_vapour(t, rh) / 611.2);
+
+    return MAGNUS_C * g / (MAGNUS_B - g);
+}
+
+static double ref_absolute_humidity(double t, double rh)
+{
+    return 2.16679 * ref_vapour(t, rh) / (t + 273.15);
+}
+
+/* Mean of Steadman and T in °F, which selects the heat index regression */
+static double ref_heat_index_switch(double t, double rh)
+{
+    double f = t * 9 / 5 + 32;
+
+    return (0.5 * (f + 61 + (f - 68) * 1.2 + rh * 0.094) + f) / 2;
+}
+
+static double ref_heat_index(double t, double rh)
+{
+    double f = t * 9 / 5 + 32;
+    double hi = 0.5 * (f + 61 + (f - 68) * 1.2 + rh * 0.094);
+
+    if ((hi + f) / 2 >= 80) {
+        hi = -42.379 + 2.04901523 * f + 10.14333127 * rh - 0.22475541 * f * rh - 0.00683783 * f * f -
+             0.05481717 * rh * rh + 0.00122874 * f * f * rh + 0.00085282 * f * rh * rh -
+             0.00000199 * f * f * rh * rh;
+
+        if (rh < 13 && f >= 80 && f <= 112) {
+            hi -= (13 - rh) / 4 * sqrt((17 - fabs(f - 95)) / 17);
+        } else if (rh > 85 && f >= 80 && f <= 87) {
+            hi += (rh - 85) / 10 * (87 - f) / 5;
+        }
+    }
+
+    return (hi - 32) * 5 / 9;
+}
+
+static double ref_sea_level_pressure(double p, double t, double h)
+{
+    return p * exp(9.80665 * h / (287.05 * (t + 273.15 + 0.00325 * h)));
+}
+
+static void record(error_stat_t *s, double fixed, double ref, double t, double rh, double x)
+{
+    double err = fabs(fixed / s->scale - ref);
+
+    s->count++;
+    if (err > s->max) {
+        s->max = err;
+        s->at_t = t;
+        s->at_rh = rh;
+        s->at_x = x;
+    }
+}
+
+static double elapsed_ns(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - start->tv_sec) * 1e9 + (now.tv_nsec - start->tv_nsec);
+}
+
+static volatile int32_t sink_i;
+static volatile double sink_d;
+
+/* Mean ns per call of derived_compute() and of the double formulas, over the grid */
+static void time_both(double *fixed_ns, double *double_ns)
+{
+    struct timespec start;
+    uint64_t calls = 0;
+    double ns;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do {
+        for (int32_t t = -4000; t <= 6000; t += 37) {
+            for (int32_t rh = 100; rh <= 10000; rh += 97) {
+                const derived_input_t in = { t, rh, 95000 + rh, 500 };
+                derived_metrics_t out;
+
+                derived_compute(&in, &out);
+                sink_i = out.dew_point + out.absolute_humidity + out.heat_index + out.sea_level_pressure;
+                calls++;
+            }
+        }
+        ns = elapsed_ns(&start);
+    } while (ns < 2e8);
+    *fixed_ns = ns / calls;
+
+    calls = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do {
+        for (int32_t t = -4000; t <= 6000; t += 37) {
+            for (int32_t rh = 100; rh <= 10000; rh += 97) {
+                sink_d = ref_dew_point(t / 100.0, rh / 100.0) + ref_absolute_humidity(t / 100.0, rh / 100.0) +
+                         ref_heat_index(t / 100.0, rh / 100.0) + ref_sea_level_pressure(95000 + rh, t / 100.0, 500);
+                calls++;
+            }
+        }
+        ns = elapsed_ns(&start);
+    } while (ns < 2e8);
+    *double_ns = ns / calls;
+}
+
+int main(int argc, char **argv)
+{
+    error_stat_t stats[] = {
+        { .name = "dew point", .unit = "°C", .scale = 100, .bound = 0.02 },
+        { .name = "absolute humidity", .unit = "g/m³", .scale = 100, .bound = 0.01 },
+        { .name = "heat index", .unit = "°C", .scale = 100, .bound = 0.02 },
+        { .name = "sea-level pressure", .unit = "Pa", .scale = 1, .bound = 5 },
+    };
+    bool verbose = false;
+    bool ok = true;
+    double fixed_ns, double_ns;
+    uint64_t on_switch = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--verbose") == 0) {
+            verbose = true;
+        } else {
+            fprintf(stderr, "usage: %s [--verbose]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    for (int32_t t = -4000; t <= 6000; t += 5) {
+        for (int32_t rh = 100; rh <= 10000; rh += 25) {
+            double td = t / 100.0, rhd = rh / 100.0;
+
+            record(&stats[0], derived_dew_point(t, rh), ref_dew_point(td, rhd), td, rhd, 0);
+            record(&stats[1], derived_absolute_humidity(t, rh), ref_absolute_humidity(td, rhd), td, rhd, 0);
+            /*
+             * The NOAA procedure jumps by up to 1.3 °C where it switches to the
+             * regression; on the switch itself rounding picks either side
+             */
+            if (fabs(ref_heat_index_switch(td, rhd) - 80) < 0.001) {
+                on_switch++;
+            } else {
+                record(&stats[2], derived_heat_index(t, rh), ref_heat_index(td, rhd), td, rhd, 0);
+            }
+        }
+
+        for (int32_t h = 0; h <= 4000; h += 50) {
+            for (int32_t p = 50000; p <= 110000; p += 2500) {
+                record(&stats[3], derived_sea_level_pressure(p, t, h), ref_sea_level_pressure(p, t / 100.0, h),
+                       t / 100.0, 0, h);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < sizeof(stats) / sizeof(stats[0]); i++) {
+        const error_stat_t *s = &stats[i];
+        bool pass = s->max <= s->bound;
+
+        printf("%-18s max error %.4f %s (bound %g) over %llu points%s\n", s->name, s->max, s->unit, s->bound,
+               (unsigned long long) s->count, pass ? "" : "  FAIL");
+        if (verbose || !pass) {
+            if (s->at_x) {
+                printf("%18s at %.2f °C, %.0f m\n", "", s->at_t, s->at_x);
+            } else {
+                printf("%18s at %.2f °C, %.2f %%RH\n", "", s->at_t, s->at_rh);
+            }
+        }
+        ok &= pass;
+    }
+
+    printf("heat index skipped at %llu points on the 80 °F switch\n", (unsigned long long) on_switch);
+
+    time_both(&fixed_ns, &double_ns);
+    printf("derived_compute %.1f ns/call, double precision formulas %.1f ns/call (host FPU)\n", fixed_ns,
+           double_ns);
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,253 @@
+/*
+ * Decodes a history export ("history export" console output, or the binary
+ * stream) into CSV, or measures the codec on synthetic weather:
+ *
+ *   station_history monitor.log > history.csv
+ *   station_history --synthetic 100000
+ *
+ * The synthetic mode encodes a day-long temperature cycle with sensor noise
+ * sampled every minute, checks that it decodes back exactly and reports the
+ * compression ratio and the encode and decode throughput.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "history_codec.h"
+
+#define RAW_SAMPLE_SIZE 12  /* sizeof(history_sample_t) in the ring */
+
+typedef struct byte_buf {
+    uint8_t *data;
+    size_t len;
+    size_t cap;
+} byte_buf_t;
+
+static int append(byte_buf_t *b, const uint8_t *data, size_t len)
+{
+    if (b->len + len > b->cap) {
+        size_t cap = b->cap ? b->cap : 4096;
+        uint8_t *p;
+
+        while (cap < b->len + len) cap *= 2;
+        p = realloc(b->data, cap);
+        if (p == NULL) return -1;
+        b->data = p;
+        b->cap = cap;
+    }
+
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+
+    return 0;
+}
+
+static int hex_nibble(int c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static int load(const char *path, byte_buf_t *b)
+{
+    FILE *f = fopen(path, "rb");
+    uint8_t chunk[4096];
+    size_t n;
+    int rc = 0;
+
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    n = fread(chunk, 1, HISTORY_CODEC_HEADER_SIZE, f);
+    if (history_codec_check_header(chunk, n) >= 0) {
+        rc = append(b, chunk, n);
+        while (rc == 0 && (n = fread(chunk, 1, sizeof(chunk), f)) > 0) rc = append(b, chunk, n);
+    } else {
+        char line[512];
+
+        /* The "H:" lines of the console export, anywhere in a monitor log */
+        rewind(f);
+        while (rc == 0 && fgets(line, sizeof(line), f)) {
+            char *p = strstr(line, "H:");
+
+            if (p == NULL) continue;
+
+            for (p += 2; rc == 0 && hex_nibble(p[0]) >= 0 && hex_nibble(p[1]) >= 0; p += 2) {
+                uint8_t byte = hex_nibble(p[0]) << 4 | hex_nibble(p[1]);
+
+                rc = append(b, &byte, 1);
+            }
+        }
+    }
+
+    fclose(f);
+
+    if (rc != 0) fprintf(stderr, "%s: out of memory\n", path);
+
+    return rc;
+}
+
+static int decode(const char *path)
+{
+    byte_buf_t b = { 0 };
+    history_sample_t samples[HISTORY_BLOCK_SAMPLES];
+    size_t pos = HISTORY_CODEC_HEADER_SIZE;
+    uint32_t total = 0;
+    int version;
+
+    if (load(path, &b) != 0) return 2;
+
+    version = history_codec_check_header(b.data, b.len);
+    if (version < 0) {
+        fprintf(stderr, "%s: not a history export\n", path);
+        return 2;
+    }
+    if (version != HISTORY_CODEC_VERSION) {
+        fprintf(stderr, "%s: unsupported history version %d\n", path, version);
+        return 2;
+    }
+
+    printf("time,temperature,humidity,pressure\n");
+
+    while (pos < b.len) {
+        size_t count;
+        size_t n = history_codec_decode_block(b.data + pos, b.len - pos, samples, &count);
+
+        if (n == 0) {
+            fprintf(stderr, "%s: malformed block at offset %zu\n", path, pos);
+            free(b.data);
+            return 1;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            printf("%u,%.2f,%.2f,%.2f\n", samples[i].time, samples[i].temperature / 100.0,
+                   samples[i].humidity / 100.0, samples[i].pressure / 100.0);
+        }
+
+        total += count;
+        pos += n;
+    }
+
+    fprintf(stderr, "%u samples in %zu B (%.2f B/sample, %.1fx smaller than the ring)\n", total, b.len,
+            total ? (double) b.len / total : 0.0, b.len ? (double) total * RAW_SAMPLE_SIZE / b.len : 0.0);
+
+    free(b.data);
+
+    return 0;
+}
+
+static double elapsed_s(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static int synthetic(uint32_t count)
+{
+    history_sample_t *samples = calloc(count, sizeof(*samples));
+    uint8_t *encoded = malloc((count / HISTORY_BLOCK_SAMPLES + 1) * HISTORY_BLOCK_MAX + HISTORY_CODEC_HEADER_SIZE);
+    history_sample_t block[HISTORY_BLOCK_SAMPLES];
+    struct timespec start;
+    double encode_s, decode_s;
+    uint32_t x = 1;
+    size_t size, pos, n;
+    int rounds = 0;
+
+    if (samples == NULL || encoded == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 2;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        double day = i / 1440.0;
+
+        /* xorshift noise of about the sensors' resolution */
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+
+        samples[i].time = 1704067200 + i * 60 + (x % 50 == 0);
+        samples[i].temperature = lround((12.0 + 6.0 * sin(2 * M_PI * day)) * 100) + (int) (x % 3) - 1;
+        samples[i].humidity = lround((60.0 - 15.0 * sin(2 * M_PI * day)) * 100) + (int) (x >> 8) % 5 - 2;
+        samples[i].pressure = lround((1013.25 + 8.0 * sin(2 * M_PI * day / 5)) * 100) + (int) (x >> 16) % 7 - 3;
+    }
+
+    /* Repeat until the measurement lasts long enough to be meaningful */
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do {
+        size = history_codec_header(encoded);
+        for (uint32_t i = 0; i < count; i += HISTORY_BLOCK_SAMPLES) {
+            n = count - i < HISTORY_BLOCK_SAMPLES ? count - i : HISTORY_BLOCK_SAMPLES;
+            size += history_codec_encode_block(samples + i, n, encoded + size);
+        }
+        rounds++;
+        encode_s = elapsed_s(&start);
+    } while (encode_s < 0.2);
+    encode_s /= rounds;
+
+    rounds = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do {
+        uint32_t checked = 0;
+
+        for (pos = HISTORY_CODEC_HEADER_SIZE; pos < size; pos += n) {
+            size_t k;
+
+            n = history_codec_decode_block(encoded + pos, size - pos, block, &k);
+            if (n == 0 || memcmp(block, samples + checked, k * sizeof(*block)) != 0) {
+                fprintf(stderr, "round trip mismatch in the block at offset %zu\n", pos);
+                return 1;
+            }
+            checked += k;
+        }
+        rounds++;
+        decode_s = elapsed_s(&start);
+    } while (decode_s < 0.2);
+    decode_s /= rounds;
+
+    printf("%u samples: %zu B, %.2f B/sample, %.1fx smaller than the ring (%u B)\n", count, size,
+           (double) size / count, (double) count * RAW_SAMPLE_SIZE / size, count * RAW_SAMPLE_SIZE);
+    printf("encode %.1f Msamples/s (%.0f ns/sample), decode %.1f Msamples/s\n", count / encode_s / 1e6,
+           encode_s / count * 1e9, count / decode_s / 1e6);
+
+    free(samples);
+    free(encoded);
+
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s EXPORT | --synthetic SAMPLES\n"
+                    "EXPORT is a monitor log with \"history export\" output or a binary export\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc == 3 && strcmp(argv[1], "--synthetic") == 0) {
+        uint32_t count = strtoul(argv[2], NULL, 0);
+
+        if (count == 0) {
+            usage(argv[0]);
+            return 2;
+        }
+
+        return synthetic(count);
+    }
+
+    if (argc != 2 || argv[1][0] == '-') {
+        usage(argv[0]);
+        return 2;
+    }
+
+    return decode(argv[1]);
+}
@@ -0,0 +1,164 @@
+/*
+ * Runs the firmware's burst oversampling (main/oversample.c) on synthetic
+ * sensor conversions with normal noise and occasional spikes, and compares
+ * single conversions, fixed bursts and the adaptive bursts by their error
+ * against the true value and their bus cost per published reading:
+ *
+ *   station_oversample
+ *   station_oversample --readings 100000 --spikes 0.01 --noise 2 --seed 7
+ *
+ * The noise levels are the data sheet typicals, --noise scales them. The
+ * bus cost of a conversion is the mean read time of the replayed day trace
+ * (82.9 ms for the AHT20 including its conversion wait, 1.5 ms for the
+ * BMP280), so the costs are those of the firmware's poll tasks.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include "oversample.h"
+
+/* Within this many sigmas of the truth a reading is not a published spike */
+#define SPIKE_PUBLISHED_SIGMAS  6
+
+typedef struct sensor_profile {
+    const char *name;
+    const char *channel[OVERSAMPLE_CHANNELS];
+    float noise[OVERSAMPLE_CHANNELS];           /* Standard deviation of one conversion */
+    float target[OVERSAMPLE_CHANNELS];          /* The firmware's Kconfig defaults */
+    float swing[OVERSAMPLE_CHANNELS];           /* Daily amplitude of the true value */
+    float conversion_ms;                        /* Bus time per conversion */
+    unsigned int max;                           /* Burst limit */
+} sensor_profile_t;
+
+typedef struct strategy {
+    const char *name;
+    oversample_reduce_t reduce;
+    bool adaptive;
+    unsigned int fixed;                         /* Burst size when not adaptive */
+} strategy_t;
+
+typedef struct options {
+    unsigned long readings;
+    double spikes;                              /* Probability of a spike per conversion */
+    double noise;
+    uint32_t seed;
+} options_t;
+
+static const sensor_profile_t profiles[] = {
+    { "aht20", { "temperature", "humidity" }, { 0.03f, 0.1f }, { 0.05f, 0.2f }, { 8, 25 }, 82.9f, 8 },
+    { "bmp280", { "temperature", "pressure" }, { 0.01f, 2.5f }, { 0.05f, 2 }, { 8, 1500 }, 1.5f, 8 },
+};
+
+static const strategy_t strategies[] = {
+    { "single", OVERSAMPLE_MEDIAN, false, 1 },
+    { "median x8", OVERSAMPLE_MEDIAN, false, 8 },
+    { "adaptive median", OVERSAMPLE_MEDIAN, true, 0 },
+    { "adaptive trimmed", OVERSAMPLE_TRIMMED_MEAN, true, 0 },
+};
+
+static uint64_t rng_state;
+
+static double uniform(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+
+    return (rng_state >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double gaussian(void)
+{
+    double u = uniform(), v = uniform();
+
+    return sqrt(-2 * log(u + 1e-300)) * cos(2 * M_PI * v);
+}
+
+static void run(const sensor_profile_t *p, const strategy_t *s, const options_t *opt)
+{
+    oversample_t os;
+    double sq[OVERSAMPLE_CHANNELS] = { 0 };
+    unsigned long published_spikes = 0;
+    uint64_t conversions = 0;
+
+    rng_state = opt->seed * 0x9E3779B97F4A7C15ULL + 1;
+    oversample_init(&os, s->reduce, OVERSAMPLE_CHANNELS, p->target, s->adaptive ? p->max : s->fixed);
+
+    for (unsigned long r = 0; r < opt->readings; r++) {
+        /* A reading every 10 s, the default sensors_ms */
+        double day = r * 10 / 86400.0;
+        float truth[OVERSAMPLE_CHANNELS], out[OVERSAMPLE_CHANNELS];
+        bool spike = false;
+
+        for (int c = 0; c < OVERSAMPLE_CHANNELS; c++) truth[c] = p->swing[c] * sin(2 * M_PI * day);
+
+        oversample_begin(&os, s->adaptive ? p->max : s->fixed);
+        if (!s->adaptive) os.planned = s->fixed;
+
+        for (bool done = false; !done;) {
+            float v[OVERSAMPLE_CHANNELS];
+
+            for (int c = 0; c < OVERSAMPLE_CHANNELS; c++) {
+                v[c] = truth[c] + p->noise[c] * opt->noise * gaussian();
+                if (uniform() < opt->spikes) v[c] += (uniform() < 0.5 ? -1 : 1) * p->noise[c] * 50;
+            }
+            conversions++;
+            done = oversample_add(&os, v);
+        }
+
+        oversample_end(&os, out);
+
+        for (int c = 0; c < OVERSAMPLE_CHANNELS; c++) {
+            double err = out[c] - truth[c];
+
+            sq[c] += err * err;
+            spike |= fabs(err) > SPIKE_PUBLISHED_SIGMAS * p->noise[c] * opt->noise;
+        }
+        published_spikes += spike;
+    }
+
+    printf("%-7s %-17s %9.2f %9.1f", p->name, s->name, (double) conversions / opt->readings,
+           conversions * p->conversion_ms / opt->readings);
+    for (int c = 0; c < OVERSAMPLE_CHANNELS; c++) printf(" %12.4f", sqrt(sq[c] / opt->readings));
+    printf(" %8lu\n", published_spikes);
+}
+
+int main(int argc, char **argv)
+{
+    options_t opt = { .readings = 8640 * 7, .spikes = 0.002, .noise = 1, .seed = 1 };
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--readings") == 0 && i + 1 < argc) {
+            opt.readings = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--spikes") == 0 && i + 1 < argc) {
+            opt.spikes = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--noise") == 0 && i + 1 < argc) {
+            opt.noise = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            opt.seed = strtoul(argv[++i], NULL, 0);
+        } else {
+            fprintf(stderr, "usage: %s [--readings N] [--spikes P] [--noise SCALE] [--seed N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (opt.readings == 0) opt.readings = 1;
+
+    for (size_t i = 0; i < sizeof(profiles) / sizeof(profiles[0]); i++) {
+        const sensor_profile_t *p = &profiles[i];
+
+        printf("%-7s %-17s %9s %9s %12s %12s %8s\n", "sensor", "strategy", "conv", "bus ms", p->channel[0],
+               p->channel[1], "spikes");
+        for (size_t j = 0; j < sizeof(strategies) / sizeof(strategies[0]); j++) run(p, &strategies[j], &opt);
+        printf("\n");
+    }
+
+    printf("%lu readings, rms error per channel, spikes: readings off by more than %d sigmas\n", opt.readings,
+           SPIKE_PUBLISHED_SIGMAS);
+
+    return 0;
+}
@@ -0,0 +1,46 @@
+/*
+ * Parts of the firmware weather.c calls into: memory accounting, the light
+ * sleep locks and the boot phase marks, which have no meaning on the host,
+ * and the settings, at their factory defaults.
+ */
+#include <stddef.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "boot.h"
+#include "memory.h"
+#include "power.h"
+#include "settings.h"
+
+void memory_account(const char *subsystem, const char *name, size_t size)
+{
+}
+
+void memory_account_task(const char *subsystem, TaskHandle_t task, size_t size)
+{
+}
+
+void boot_mark(boot_phase_t phase)
+{
+}
+
+void power_lock_acquire(power_lock_t lock)
+{
+}
+
+void power_lock_release(power_lock_t lock)
+{
+}
+
+/* The factory defaults of descs[] in settings.c; the burst size depends on the poll interval */
+uint32_t settings_get(setting_id_t id)
+{
+    switch (id) {
+        case SETTING_SENSORS_REFRESH_MS: return SETTING_SENSORS_REFRESH_MS_DEFAULT;
+        case SETTING_SCREEN_REFRESH_MS: return CONFIG_WEATHER_SCREEN_REFRESH_RATE_MS;
+        case SETTING_SNOOZE_MIN: return CONFIG_STATION_ALARM_SNOOZE_MIN;
+        case SETTING_ALTITUDE_M: return CONFIG_STATION_ALTITUDE_M;
+        default: return 0;
+    }
+}
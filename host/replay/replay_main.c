@@ -0,0 +1,538 @@
+/*
+ * Replays a sensor trace captured by the firmware (CONFIG_STATION_SENSOR_TRACE)
+ * through weather.c on the simulated bus, on virtual time, so a day of
+ * recorded weather runs in a fraction of a second.
+ *
+ * The AHT20 and BMP280 models serve the recorded frames and registers
+ * verbatim, hence the drivers and weather.c see the bytes the real chips
+ * sent. weather.c is built with the device's default oversampling, so each
+ * poll takes the consecutive conversions of one recorded burst; once they
+ * are used up, the sensor stops acknowledging until the next poll, which
+ * ends the burst where the device's ended. The values after each reading
+ * are hashed into a digest: the same trace always gives the same digest,
+ * and a change to the acquisition path that alters any value shows up as a
+ * different one.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "driver/i2c_master.h"
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "sensor_trace.h"
+#include "telemetry.h"
+#include "telemetry_frame.h"
+#include "weather.h"
+
+#include "sim_i2c.h"
+#include "sim_aht20.h"
+#include "sim_bmp280.h"
+
+#define FNV_OFFSET  0xcbf29ce484222325ULL
+#define FNV_PRIME   0x100000001b3ULL
+
+/* Conversions of a burst follow each other closer than this, polls are at least 1 s apart */
+#define BURST_GAP_MS    500
+
+#if CONFIG_STATION_OVERSAMPLE
+#define BURST_MAX       CONFIG_STATION_OVERSAMPLE_MAX
+#else
+#define BURST_MAX       1
+#endif
+
+typedef struct replay_options {
+    const char *trace;
+    const char *csv;        /* Values after each record */
+    const char *telemetry;  /* Telemetry stream of the samples */
+    bool verbose;           /* Firmware logs */
+} replay_options_t;
+
+typedef struct trace_buf {
+    uint8_t *data;
+    size_t len;
+    size_t cap;
+} trace_buf_t;
+
+typedef struct trace_record {
+    uint8_t type;
+    int64_t t_ms;           /* Since the start of the trace */
+    const uint8_t *payload;
+} trace_record_t;
+
+/* The conversions of one sensor in trace order, served to its model */
+typedef struct burst_source {
+    i2c_master_bus_handle_t bus;
+    uint16_t addr;
+    const trace_record_t **conv;
+    size_t n_conv;
+    size_t next;            /* Next conversion to serve */
+    size_t end;             /* End of the current burst */
+} burst_source_t;
+
+static sim_aht20_t aht20_model;
+static sim_bmp280_t bmp280_model;
+
+static FILE *telemetry_out;
+static uint16_t telemetry_seq;
+
+/* The firmware's hook in weather.c, writing the frames the device would send */
+void telemetry_sample(weather_sensor_t sensor, esp_err_t rc, float temperature, float humidity, float pressure,
+                      uint32_t read_us)
+{
+    uint8_t payload[TELEMETRY_SAMPLE_SIZE];
+    uint8_t frame[TELEMETRY_FRAME_MAX];
+    telemetry_header_t hdr = {
+        .type = TELEMETRY_SAMPLE,
+        .seq = telemetry_seq++,
+        .time_ms = esp_timer_get_time() / 1000,
+    };
+    telemetry_sample_t sample = {
+        .sensor = sensor,
+        .flags = rc == ESP_OK ? TELEMETRY_SAMPLE_OK : 0,
+        .temperature = temperature,
+        .humidity = humidity,
+        .pressure = pressure,
+        .read_us = read_us,
+    };
+
+    if (telemetry_out == NULL) return;
+
+    fwrite(frame, 1, telemetry_frame_encode(&hdr, payload, telemetry_sample_pack(&sample, payload), frame),
+           telemetry_out);
+}
+
+static int append(trace_buf_t *tb, const uint8_t *data, size_t len)
+{
+    if (tb->len + len > tb->cap) {
+        size_t cap = tb->cap ? tb->cap : 4096;
+        uint8_t *p;
+
+        while (cap < tb->len + len) cap *= 2;
+        p = realloc(tb->data, cap);
+        if (p == NULL) return -1;
+        tb->data = p;
+        tb->cap = cap;
+    }
+
+    memcpy(tb->data + tb->len, data, len);
+    tb->len += len;
+
+    return 0;
+}
+
+static int hex_nibble(int c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/* The "T:" lines of a "trace dump", anywhere in a monitor log */
+static int parse_log(FILE *f, trace_buf_t *tb)
+{
+    char line[512];
+
+    while (fgets(line, sizeof(line), f)) {
+        char *p = strstr(line, "T:");
+
+        if (p == NULL) continue;
+
+        for (p += 2; hex_nibble(p[0]) >= 0 && hex_nibble(p[1]) >= 0; p += 2) {
+            uint8_t b = hex_nibble(p[0]) << 4 | hex_nibble(p[1]);
+
+            if (append(tb, &b, 1) != 0) return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int load_trace(const char *path, trace_buf_t *tb)
+{
+    FILE *f = fopen(path, "rb");
+    uint8_t chunk[4096];
+    size_t n;
+    int rc = 0;
+
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    n = fread(chunk, 1, SENSOR_TRACE_HEADER_SIZE, f);
+    if (n == SENSOR_TRACE_HEADER_SIZE && memcmp(chunk, SENSOR_TRACE_MAGIC, 4) == 0) {
+        rc = append(tb, chunk, n);
+        while (rc == 0 && (n = fread(chunk, 1, sizeof(chunk), f)) > 0) rc = append(tb, chunk, n);
+    } else {
+        rewind(f);
+        rc = parse_log(f, tb);
+    }
+
+    fclose(f);
+
+    if (rc != 0) {
+        fprintf(stderr, "%s: out of memory\n", path);
+        return -1;
+    }
+
+    if (tb->len < SENSOR_TRACE_HEADER_SIZE || memcmp(tb->data, SENSOR_TRACE_MAGIC, 4) != 0) {
+        fprintf(stderr, "%s: not a sensor trace\n", path);
+        return -1;
+    }
+
+    if (tb->data[4] != SENSOR_TRACE_VERSION) {
+        fprintf(stderr, "%s: unsupported trace version %u\n", path, tb->data[4]);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Returns the record size, 0 at the end of the trace or -1 if it is malformed */
+static int next_record(const trace_buf_t *tb, size_t pos, uint8_t *type, uint32_t *delta_ms, const uint8_t **payload)
+{
+    size_t p = pos;
+    unsigned int shift = 0;
+    size_t size;
+
+    if (p == tb->len) return 0;
+
+    *type = tb->data[p++];
+    size = sensor_trace_payload_size(*type);
+    if (size == 0) return -1;
+
+    *delta_ms = 0;
+    do {
+        if (p == tb->len || shift > 28) return -1;
+        *delta_ms |= (uint32_t) (tb->data[p] & 0x7F) << shift;
+        shift += 7;
+    } while (tb->data[p++] & 0x80);
+
+    if (p + size > tb->len) return -1;
+    *payload = tb->data + p;
+
+    return p + size - pos;
+}
+
+/* Dumps of a restarted capture repeat the header; the time base then restarts at the new header */
+static size_t skip_header(const trace_buf_t *tb, size_t pos)
+{
+    while (tb->len - pos >= SENSOR_TRACE_HEADER_SIZE && memcmp(tb->data + pos, SENSOR_TRACE_MAGIC, 4) == 0) {
+        pos += SENSOR_TRACE_HEADER_SIZE;
+    }
+
+    return pos;
+}
+
+/* Records in trace order, timed from the start; returns 0 at the end of the trace or -1 at a malformed record */
+static int index_trace(const trace_buf_t *tb, trace_record_t *records, size_t *n_records, size_t *pos)
+{
+    const uint8_t *payload;
+    uint32_t delta_ms;
+    uint8_t type;
+    int64_t t_ms = 0;
+    int n;
+
+    *n_records = 0;
+    *pos = skip_header(tb, 0);
+
+    while ((n = next_record(tb, *pos, &type, &delta_ms, &payload)) > 0) {
+        t_ms += delta_ms;
+        records[(*n_records)++] = (trace_record_t) { .type = type, .t_ms = t_ms, .payload = payload };
+        *pos = skip_header(tb, *pos + n);
+    }
+
+    return n;
+}
+
+/* The first calibration of the trace, which the driver has to read at init */
+static const uint8_t *find_calibration(const trace_record_t *records, size_t n_records)
+{
+    for (size_t i = 0; i < n_records; i++) {
+        if (records[i].type == SENSOR_TRACE_BMP280_CALIB) return records[i].payload;
+    }
+
+    return NULL;
+}
+
+static int source_init(burst_source_t *src, i2c_master_bus_handle_t bus, uint16_t addr, uint8_t type,
+                       const trace_record_t *records, size_t n_records)
+{
+    *src = (burst_source_t) { .bus = bus, .addr = addr };
+
+    src->conv = calloc(n_records + 1, sizeof(src->conv[0]));
+    if (src->conv == NULL) return -1;
+
+    for (size_t i = 0; i < n_records; i++) {
+        if (records[i].type == type) src->conv[src->n_conv++] = &records[i];
+    }
+
+    return 0;
+}
+
+static bool source_starts_burst(const burst_source_t *src, const trace_record_t *record)
+{
+    return src->next < src->n_conv && src->conv[src->next] == record;
+}
+
+/* The burst starting at the next conversion: those that follow it without a pause */
+static void source_begin(burst_source_t *src)
+{
+    const sim_faults_t none = { 0 };
+
+    src->end = src->next + 1;
+    while (src->end < src->n_conv && src->conv[src->end]->t_ms - src->conv[src->end - 1]->t_ms < BURST_GAP_MS) {
+        src->end++;
+    }
+
+    sim_i2c_set_faults(src->bus, src->addr, &none);
+}
+
+/* Called by the model for each result read */
+static const uint8_t *source_next(void *arg)
+{
+    const sim_faults_t nack = { .nack_permille = 1000 };
+    burst_source_t *src = arg;
+
+    if (src->next == src->end) return NULL;
+
+    /* Past its last conversion the device's burst ended, so does this one at the next transaction */
+    if (src->next + 1 == src->end) sim_i2c_set_faults(src->bus, src->addr, &nack);
+
+    return src->conv[src->next++]->payload;
+}
+
+static uint32_t source_nacks(const burst_source_t *src)
+{
+    sim_device_stats_t stats;
+
+    return sim_i2c_get_stats(src->bus, src->addr, &stats) == ESP_OK ? stats.nacks : 0;
+}
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+
+    for (size_t i = 0; i < len; i++) {
+        hash ^= p[i];
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s TRACE [--csv FILE] [--telemetry FILE] [--verbose 1]\n"
+                    "TRACE is a binary trace or a monitor log with \"trace dump\" output\n", prog);
+}
+
+static int parse_options(int argc, char **argv, replay_options_t *opt)
+{
+    for (int i = 1; i < argc; i++) {
+        const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (argv[i][0] != '-') {
+            if (opt->trace) return -1;
+            opt->trace = argv[i];
+            continue;
+        }
+
+        if (val == NULL) return -1;
+
+        if (strcmp(argv[i], "--csv") == 0) opt->csv = val;
+        else if (strcmp(argv[i], "--telemetry") == 0) opt->telemetry = val;
+        else if (strcmp(argv[i], "--verbose") == 0) opt->verbose = strtoul(val, NULL, 0);
+        else return -1;
+
+        i++;
+    }
+
+    return opt->trace ? 0 : -1;
+}
+
+int main(int argc, char **argv)
+{
+    replay_options_t opt = { 0 };
+    trace_buf_t tb = { 0 };
+    trace_record_t *records;
+    burst_source_t aht20_src, bmp280_src;
+    i2c_master_bus_handle_t bus;
+    const uint8_t *calib;
+    struct timespec wall_start, wall_end;
+    uint32_t counts[SENSOR_TRACE_BMP280_ADC + 1] = { 0 };
+    uint32_t readings = 0, cut_short = 0, ended_early = 0;
+    uint64_t digest = FNV_OFFSET;
+    int64_t start_us, t_us;
+    unsigned int trace_burst;
+    FILE *csv = NULL;
+    size_t n_records, pos;
+    int n;
+
+    if (parse_options(argc, argv, &opt) != 0) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    esp_log_level_set("*", opt.verbose ? ESP_LOG_WARN : ESP_LOG_NONE);
+
+    if (load_trace(opt.trace, &tb) != 0) return 2;
+
+    /* A record takes at least 8 bytes */
+    records = malloc((tb.len / 8 + 1) * sizeof(records[0]));
+    if (records == NULL) {
+        fprintf(stderr, "%s: out of memory\n", opt.trace);
+        return 2;
+    }
+    n = index_trace(&tb, records, &n_records, &pos);
+
+    trace_burst = tb.data[SENSOR_TRACE_HEADER_BURST];
+    if (trace_burst == 0) {
+        fprintf(stderr, "%s: the trace does not tell its burst size, readings may differ from the device's\n",
+                opt.trace);
+    } else if (trace_burst > BURST_MAX) {
+        fprintf(stderr, "%s: recorded with up to %u conversions per reading, the replay takes %u\n", opt.trace,
+                trace_burst, BURST_MAX);
+    }
+
+    if (opt.csv) {
+        csv = fopen(opt.csv, "w");
+        if (csv == NULL) {
+            perror(opt.csv);
+            return 2;
+        }
+        fprintf(csv, "t_s,sensor,temperature,humidity,pressure\n");
+    }
+
+    if (opt.telemetry) {
+        telemetry_out = fopen(opt.telemetry, "wb");
+        if (telemetry_out == NULL) {
+            perror(opt.telemetry);
+            return 2;
+        }
+    }
+
+    bus = sim_i2c_bus_new(1);
+    if (source_init(&aht20_src, bus, SENSOR_TRACE_AHT20_ADDR, SENSOR_TRACE_AHT20_FRAME, records, n_records) != 0 ||
+        source_init(&bmp280_src, bus, SENSOR_TRACE_BMP280_ADDR_HI, SENSOR_TRACE_BMP280_ADC, records, n_records) != 0) {
+        fprintf(stderr, "%s: out of memory\n", opt.trace);
+        return 2;
+    }
+
+    sim_aht20_init(&aht20_model);
+    sim_bmp280_init(&bmp280_model);
+    ESP_ERROR_CHECK(sim_aht20_attach(&aht20_model, bus, SENSOR_TRACE_AHT20_ADDR));
+    ESP_ERROR_CHECK(sim_bmp280_attach(&bmp280_model, bus, SENSOR_TRACE_BMP280_ADDR_HI));
+
+    /* The results only make sense with the calibration of the chip that produced them */
+    calib = find_calibration(records, n_records);
+    if (calib) sim_bmp280_set_calibration(&bmp280_model, calib);
+    else fprintf(stderr, "%s: no BMP280 calibration, using the default one\n", opt.trace);
+
+    ESP_ERROR_CHECK(weather_init_sensors(bus, 0, 1));
+
+    sim_aht20_set_source(&aht20_model, source_next, &aht20_src);
+    sim_bmp280_set_source(&bmp280_model, source_next, &bmp280_src);
+
+    clock_gettime(CLOCK_MONOTONIC, &wall_start);
+
+    start_us = esp_timer_get_time();
+
+    for (size_t i = 0; i < n_records; i++) {
+        const trace_record_t *record = &records[i];
+        burst_source_t *src;
+        weather_sensor_t sensor;
+        uint32_t nacks;
+        float values[3];
+
+        counts[record->type]++;
+
+        if (record->type == SENSOR_TRACE_AHT20_FRAME) {
+            src = &aht20_src;
+            sensor = WEATHER_SENSOR_AHT20;
+        } else if (record->type == SENSOR_TRACE_BMP280_ADC) {
+            src = &bmp280_src;
+            sensor = WEATHER_SENSOR_BMP280;
+        } else {
+            continue;
+        }
+
+        /* The other conversions of a burst were served by the poll at its first one */
+        if (!source_starts_burst(src, record)) continue;
+
+        /* Polls take time on the bus, so the clock may already be past the record */
+        t_us = start_us + record->t_ms * 1000;
+        if (t_us > esp_timer_get_time()) host_time_advance_us(t_us - esp_timer_get_time());
+
+        source_begin(src);
+        nacks = source_nacks(src);
+
+        weather_poll(sensor);
+        readings++;
+
+        /* Fewer conversions than the device's burst only when it is set up differently */
+        cut_short += source_nacks(src) != nacks;
+        if (src->next < src->end) {
+            ended_early++;
+            src->next = src->end;
+        }
+
+        values[0] = weather_get_temperature();
+        values[1] = weather_get_humidity();
+        values[2] = weather_get_pressure();
+        digest = fnv1a(digest, values, sizeof(values));
+
+        if (csv) {
+            fprintf(csv, "%.3f,%s,%.2f,%.2f,%.2f\n", record->t_ms / 1e3,
+                    sensor == WEATHER_SENSOR_AHT20 ? "aht20" : "bmp280", values[0], values[1], values[2]);
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &wall_end);
+
+    if (n < 0) fprintf(stderr, "%s: malformed record at offset %zu, replay stopped there\n", opt.trace, pos);
+
+    double wall_s = (wall_end.tv_sec - wall_start.tv_sec) + (wall_end.tv_nsec - wall_start.tv_nsec) / 1e9;
+    double span_s = (esp_timer_get_time() - start_us) / 1e6;
+    uint32_t polls = counts[SENSOR_TRACE_AHT20_FRAME] + counts[SENSOR_TRACE_BMP280_ADC];
+
+    printf("%u AHT20 frames, %u BMP280 results, %u calibrations over %.1f h\n", counts[SENSOR_TRACE_AHT20_FRAME],
+           counts[SENSOR_TRACE_BMP280_ADC], counts[SENSOR_TRACE_BMP280_CALIB], span_s / 3600);
+    printf("%u readings of up to %u conversions, trace of up to %u\n", readings, BURST_MAX, trace_burst);
+    printf("replayed in %.3f s (%.0fx real time, %.0f polls/s)\n", wall_s, wall_s > 0 ? span_s / wall_s : 0,
+           wall_s > 0 ? polls / wall_s : 0);
+
+    /* With a smaller burst in the trace every reading is cut short, as intended */
+    if (cut_short && trace_burst >= BURST_MAX) {
+        fprintf(stderr, "%s: %u readings took more conversions than the device's\n", opt.trace, cut_short);
+    }
+    if (ended_early) {
+        fprintf(stderr, "%s: %u readings took fewer conversions than the device's\n", opt.trace, ended_early);
+    }
+
+    for (weather_sensor_t s = 0; s < WEATHER_SENSOR_MAX; s++) {
+        weather_sensor_stats_t stats;
+
+        weather_get_stats(s, &stats);
+        printf("%-6s %u reads, %u errors, %.0f us mean bus time\n", s == WEATHER_SENSOR_AHT20 ? "aht20" : "bmp280",
+               stats.reads, stats.errors, stats.reads ? (double) stats.total_us / stats.reads : 0);
+    }
+
+    printf("digest %016llx\n", (unsigned long long) digest);
+
+    if (csv) fclose(csv);
+    if (telemetry_out) fclose(telemetry_out);
+    free(aht20_src.conv);
+    free(bmp280_src.conv);
+    free(records);
+    free(tb.data);
+    sim_i2c_bus_del(bus);
+
+    return n < 0 ? 1 : 0;
+}
@@ -0,0 +1,435 @@
+/*
+ * Converts a scheduler trace ("sched dump" console output, or the binary
+ * trace) into Chrome trace JSON, which Perfetto (ui.perfetto.dev) and
+ * chrome://tracing open, and prints a CPU share and span summary:
+ *
+ *   station_sched monitor.log > sched.json
+ *
+ * The "cpu" track shows which task ran when; each task's track shows its
+ * spans (sensor reads, render, flush, alarm, tone, button). Cycle counts
+ * become time through the latest sync record, so frequency changes and
+ * light sleep keep the timeline right. Every "sched start" of the log is
+ * a process of its own.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "sched_trace.h"
+
+#define MAX_TASKS       256
+#define NAME_SIZE       (SCHED_TRACE_NAME_WORDS * 4 + 1)
+#define CPU_TID         0
+
+typedef struct byte_buf {
+    uint8_t *data;
+    size_t len;
+    size_t cap;
+} byte_buf_t;
+
+typedef struct task {
+    char name[NAME_SIZE];
+    double run_us;
+    double longest_us;
+    unsigned long switches;
+} task_t;
+
+typedef struct span {
+    char name[NAME_SIZE];
+    double begin_us;
+    unsigned int tid;
+    bool open;
+    unsigned long count;
+    double total_us;
+    double max_us;
+} span_t;
+
+typedef struct capture {
+    unsigned int pid;
+    task_t tasks[MAX_TASKS];
+    span_t spans[SCHED_SPAN_MAX];
+    bool synced;
+    uint32_t sync_cycles;
+    double sync_us;
+    uint32_t mhz;
+    double first_us;
+    double last_us;
+    unsigned int running;       /* Task index, 0 before the first switch */
+    double slice_us;            /* Start of the running task's slice */
+    unsigned long dropped;
+    bool in_gap;                /* Records were dropped, no task known to run until the next switch */
+    double gap_us;
+    double lost_us;             /* Time of the gaps left by dropped records */
+} capture_t;
+
+static FILE *out;
+static bool first_event = true;
+
+static int append(byte_buf_t *b, const uint8_t *data, size_t len)
+{
+    if (b->len + len > b->cap) {
+        size_t cap = b->cap ? b->cap : 4096;
+        uint8_t *p;
+
+        while (cap < b->len + len) cap *= 2;
+        p = realloc(b->data, cap);
+        if (p == NULL) return -1;
+        b->data = p;
+        b->cap = cap;
+    }
+
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+
+    return 0;
+}
+
+static int hex_nibble(int c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/* The "S:" lines of "sched dump" at the start of a line or after the console prompt, in place */
+static size_t parse_hex_lines(uint8_t *text, size_t len)
+{
+    size_t n = 0;
+
+    for (size_t i = 0; i + 1 < len; i++) {
+        uint8_t *p = text + i;
+
+        if (p[0] != 'S' || p[1] != ':' || (i > 0 && p[-1] != '>' && p[-1] != '\n' && p[-1] != ' ')) continue;
+
+        for (i += 2; i + 1 < len && hex_nibble(text[i]) >= 0 && hex_nibble(text[i + 1]) >= 0; i += 2) {
+            text[n++] = hex_nibble(text[i]) << 4 | hex_nibble(text[i + 1]);
+        }
+    }
+
+    return n;
+}
+
+static int load(const char *path, byte_buf_t *b)
+{
+    FILE *f = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    uint8_t chunk[4096];
+    size_t n;
+    int rc = 0;
+
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    while (rc == 0 && (n = fread(chunk, 1, sizeof(chunk), f)) > 0) rc = append(b, chunk, n);
+
+    if (f != stdin) fclose(f);
+
+    if (rc != 0) {
+        fprintf(stderr, "%s: out of memory\n", path);
+        return rc;
+    }
+
+    /* A monitor log rather than a binary trace: the bytes decoded never overtake the text */
+    if (b->len < 4 || memcmp(b->data, SCHED_TRACE_MAGIC, 4) != 0) b->len = parse_hex_lines(b->data, b->len);
+
+    return 0;
+}
+
+static uint32_t word(const uint8_t *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+static void name_of(const uint8_t *p, char *name)
+{
+    memcpy(name, p, NAME_SIZE - 1);
+    name[NAME_SIZE - 1] = '\0';
+}
+
+/* Names come from the device, keep the JSON valid whatever they hold */
+static void put_string(const char *s)
+{
+    fputc('"', out);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') {
+            fprintf(out, "\\%c", *s);
+        } else if ((unsigned char) *s < 0x20) {
+            fprintf(out, "\\u%04x", *s);
+        } else {
+            fputc(*s, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static void begin_event(void)
+{
+    fputs(first_event ? "\n" : ",\n", out);
+    first_event = false;
+}
+
+static void metadata(unsigned int pid, unsigned int tid, const char *what, const char *name)
+{
+    begin_event();
+    fprintf(out, "{\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"name\":\"%s\",\"args\":{\"name\":", pid, tid, what);
+    put_string(name);
+    fputs("}}", out);
+}
+
+static void complete(unsigned int pid, unsigned int tid, const char *name, double begin_us, double end_us)
+{
+    begin_event();
+    fprintf(out, "{\"ph\":\"X\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"name\":", pid, tid, begin_us,
+            end_us - begin_us);
+    put_string(name);
+    fputc('}', out);
+}
+
+static const char *task_name(capture_t *cap, unsigned int idx)
+{
+    task_t *t = &cap->tasks[idx];
+
+    if (t->name[0] == '\0') snprintf(t->name, sizeof(t->name), "task %u", idx);
+
+    return t->name;
+}
+
+/* Time of a cycle count, never going back: a record may be stamped just before a switch recorded ahead of it */
+static double to_us(capture_t *cap, uint32_t cycles)
+{
+    double us = cap->sync_us + (double) (int32_t) (cycles - cap->sync_cycles) / cap->mhz;
+
+    if (us < cap->last_us) us = cap->last_us;
+    cap->last_us = us;
+
+    return us;
+}
+
+static void end_slice(capture_t *cap, double now)
+{
+    task_t *t;
+
+    if (cap->running == 0) return;
+
+    t = &cap->tasks[cap->running];
+    t->run_us += now - cap->slice_us;
+    if (now - cap->slice_us > t->longest_us) t->longest_us = now - cap->slice_us;
+    complete(cap->pid, CPU_TID, task_name(cap, cap->running), cap->slice_us, now);
+}
+
+static void record(capture_t *cap, const uint8_t *p)
+{
+    uint32_t cycles = word(p), type = p[7], value = word(p + 4) & 0xFFFFFF;
+    double before, now;
+
+    switch (type) {
+        case SCHED_TRACE_TASK_NAME:
+            if (value < MAX_TASKS) name_of(p + 8, cap->tasks[value].name);
+            return;
+        case SCHED_TRACE_SPAN_NAME:
+            if (value < SCHED_SPAN_MAX) name_of(p + 8, cap->spans[value].name);
+            return;
+        case SCHED_TRACE_SYNC: {
+            double sync_us = (double) (int64_t) ((uint64_t) word(p + 12) << 32 | word(p + 8));
+
+            /* Without the first sync no time is known, the records before it were never written */
+            if (!cap->synced) {
+                cap->first_us = sync_us;
+                cap->last_us = sync_us;
+            }
+            if (value != cap->mhz) {
+                begin_event();
+                fprintf(out, "{\"ph\":\"C\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"name\":\"cpu MHz\",\"args\":{\"MHz\":%u}}",
+                        cap->pid, CPU_TID, sync_us > cap->last_us ? sync_us : cap->last_us, value);
+            }
+            cap->synced = true;
+            cap->sync_cycles = cycles;
+            cap->sync_us = sync_us;
+            cap->mhz = value ? value : 1;
+            return;
+        }
+        default:
+            break;
+    }
+
+    if (!cap->synced) return;
+
+    before = cap->last_us;
+    now = to_us(cap, cycles);
+
+    switch (type) {
+        case SCHED_TRACE_SWITCH:
+            if (value >= MAX_TASKS) break;
+            end_slice(cap, now);
+            if (cap->in_gap) cap->lost_us += now - cap->gap_us;
+            cap->in_gap = false;
+            cap->running = value;
+            cap->slice_us = now;
+            cap->tasks[value].switches++;
+            break;
+        case SCHED_TRACE_BEGIN:
+            if (value >= SCHED_SPAN_MAX) break;
+            cap->spans[value].open = true;
+            cap->spans[value].begin_us = now;
+            cap->spans[value].tid = cap->running;
+            break;
+        case SCHED_TRACE_END: {
+            span_t *s;
+
+            if (value >= SCHED_SPAN_MAX || !cap->spans[value].open) break;
+
+            s = &cap->spans[value];
+            s->open = false;
+            s->count++;
+            s->total_us += now - s->begin_us;
+            if (now - s->begin_us > s->max_us) s->max_us = now - s->begin_us;
+            complete(cap->pid, s->tid, s->name[0] ? s->name : "span", s->begin_us, now);
+            break;
+        }
+        case SCHED_TRACE_DROPPED:
+            /* Who ran in the gap is unknown, and so are the ends of the spans open across it */
+            end_slice(cap, before);
+            cap->running = 0;
+            for (unsigned int i = 0; i < SCHED_SPAN_MAX; i++) cap->spans[i].open = false;
+            if (!cap->in_gap) cap->gap_us = before;
+            cap->in_gap = true;
+            cap->dropped += value;
+            begin_event();
+            fprintf(out, "{\"ph\":\"i\",\"s\":\"p\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"name\":\"%u records dropped\"}",
+                    cap->pid, CPU_TID, now, value);
+            break;
+        default:
+            break;
+    }
+}
+
+static void finish(capture_t *cap)
+{
+    double total_us = cap->last_us - cap->first_us - cap->lost_us;
+    char name[32];
+    unsigned long switches = 0;
+
+    end_slice(cap, cap->last_us);
+    if (cap->in_gap) cap->lost_us += cap->last_us - cap->gap_us;
+
+    snprintf(name, sizeof(name), "capture %u", cap->pid);
+    metadata(cap->pid, 0, "process_name", name);
+    metadata(cap->pid, CPU_TID, "thread_name", "cpu");
+    for (unsigned int i = 1; i < MAX_TASKS; i++) {
+        if (cap->tasks[i].switches || cap->tasks[i].name[0]) metadata(cap->pid, i, "thread_name", task_name(cap, i));
+        switches += cap->tasks[i].switches;
+    }
+
+    fprintf(stderr, "capture %u: %.1f ms, %lu switches, %lu records dropped over %.1f ms\n", cap->pid, total_us / 1000,
+            switches, cap->dropped, cap->lost_us / 1000);
+    fprintf(stderr, "  %-16s %7s %9s %11s\n", "task", "cpu %", "switches", "longest us");
+    for (unsigned int i = 1; i < MAX_TASKS; i++) {
+        const task_t *t = &cap->tasks[i];
+
+        if (t->switches == 0) continue;
+        fprintf(stderr, "  %-16s %7.2f %9lu %11.1f\n", t->name, total_us > 0 ? 100 * t->run_us / total_us : 0.0,
+                t->switches, t->longest_us);
+    }
+
+    fprintf(stderr, "  %-16s %7s %9s %11s\n", "span", "count", "avg us", "max us");
+    for (unsigned int i = 0; i < SCHED_SPAN_MAX; i++) {
+        const span_t *s = &cap->spans[i];
+
+        if (s->count == 0) continue;
+        fprintf(stderr, "  %-16s %7lu %9.1f %11.1f\n", s->name, s->count, s->total_us / s->count, s->max_us);
+    }
+}
+
+static int convert(const char *path)
+{
+    byte_buf_t b = { 0 };
+    capture_t *cap = NULL;
+    unsigned int captures = 0;
+    size_t pos = 0;
+    int rc = 0;
+
+    if (load(path, &b) != 0) return 2;
+
+    if (b.len < 8 || memcmp(b.data, SCHED_TRACE_MAGIC, 4) != 0) {
+        fprintf(stderr, "%s: no scheduler trace\n", path);
+        free(b.data);
+        return 2;
+    }
+
+    fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", out);
+
+    while (pos + 8 <= b.len) {
+        const uint8_t *p = b.data + pos;
+        size_t n;
+
+        /* Each "sched start" begins with the magic and the version */
+        if (memcmp(p, SCHED_TRACE_MAGIC, 4) == 0) {
+            if (word(p + 4) != SCHED_TRACE_VERSION) {
+                fprintf(stderr, "%s: unsupported trace version %u\n", path, word(p + 4));
+                rc = 1;
+                break;
+            }
+            if (cap) finish(cap);
+            free(cap);
+            cap = calloc(1, sizeof(*cap));
+            if (cap == NULL) {
+                fprintf(stderr, "out of memory\n");
+                rc = 2;
+                break;
+            }
+            cap->pid = ++captures;
+            pos += 8;
+            continue;
+        }
+
+        n = sched_trace_record_words(p[7]) * 4;
+        if (cap == NULL || n == 0 || pos + n > b.len) {
+            fprintf(stderr, "%s: malformed record at offset %zu\n", path, pos);
+            rc = 1;
+            break;
+        }
+
+        record(cap, p);
+        pos += n;
+    }
+
+    if (cap) finish(cap);
+    free(cap);
+    free(b.data);
+
+    fputs("\n]}\n", out);
+
+    return rc;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s TRACE|- [OUT.json]\n"
+                    "TRACE is a monitor log with \"sched dump\" output or a binary trace\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    int rc;
+
+    if (argc < 2 || argc > 3 || (argv[1][0] == '-' && argv[1][1] != '\0')) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    out = stdout;
+    if (argc == 3 && (out = fopen(argv[2], "w")) == NULL) {
+        perror(argv[2]);
+        return 2;
+    }
+
+    rc = convert(argv[1]);
+
+    if (out != stdout) fclose(out);
+
+    return rc;
+}
@@ -0,0 +1,212 @@
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "driver/i2c_master.h"
+
+#include "esp_err.h"
+#include "esp_check.h"
+
+#include "bmp280.h"
+
+#define REG_CALIB       0x88
+#define REG_ID          0xD0
+#define REG_RESET       0xE0
+#define REG_STATUS      0xF3
+#define REG_CTRL_MEAS   0xF4
+#define REG_CONFIG      0xF5
+#define REG_PRESS_MSB   0xF7
+
+#define BMP280_CHIP_ID  0x58
+#define BMP280_RESET    0xB6
+
+#define STATUS_MEASURING 0x08
+#define STATUS_IM_UPDATE 0x01
+
+#define BMP280_TIMEOUT_MS   100
+#define BMP280_POLLS        50
+
+static const char *TAG = "bmp280";
+
+struct bmp280_context_s {
+    i2c_master_dev_handle_t dev;
+    bmp280_config_t config;
+    uint16_t dig_t1;
+    int16_t dig_t2, dig_t3;
+    uint16_t dig_p1;
+    int16_t dig_p2, dig_p3, dig_p4, dig_p5, dig_p6, dig_p7, dig_p8, dig_p9;
+};
+
+static esp_err_t read_regs(struct bmp280_context_s *ctx, uint8_t reg, uint8_t *data, size_t len)
+{
+    return i2c_master_transmit_receive(ctx->dev, &reg, 1, data, len, BMP280_TIMEOUT_MS);
+}
+
+static esp_err_t write_reg(struct bmp280_context_s *ctx, uint8_t reg, uint8_t value)
+{
+    uint8_t buf[2] = { reg, value };
+
+    return i2c_master_transmit(ctx->dev, buf, sizeof(buf), BMP280_TIMEOUT_MS);
+}
+
+static esp_err_t wait_status_clear(struct bmp280_context_s *ctx, uint8_t mask)
+{
+    uint8_t status;
+
+    for (int i = 0; i < BMP280_POLLS; i++) {
+        ESP_RETURN_ON_ERROR(read_regs(ctx, REG_STATUS, &status, 1), TAG, "read status failed");
+        if ((status & mask) == 0) return ESP_OK;
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+
+    return ESP_ERR_TIMEOUT;
+}
+
+static esp_err_t read_calibration(struct bmp280_context_s *ctx)
+{
+    uint8_t c[24];
+
+    ESP_RETURN_ON_ERROR(read_regs(ctx, REG_CALIB, c, sizeof(c)), TAG, "read calibration failed");
+
+#define U16(i) ((uint16_t) (c[i] | c[(i) + 1] << 8))
+    ctx->dig_t1 = U16(0);
+    ctx->dig_t2 = U16(2);
+    ctx->dig_t3 = U16(4);
+    ctx->dig_p1 = U16(6);
+    ctx->dig_p2 = U16(8);
+    ctx->dig_p3 = U16(10);
+    ctx->dig_p4 = U16(12);
+    ctx->dig_p5 = U16(14);
+    ctx->dig_p6 = U16(16);
+    ctx->dig_p7 = U16(18);
+    ctx->dig_p8 = U16(20);
+    ctx->dig_p9 = U16(22);
+#undef U16
+
+    return ESP_OK;
+}
+
+/* Integer compensation of the datasheet (section 3.11.3), returns t_fine */
+static int32_t compensate_t(const struct bmp280_context_s *ctx, int32_t adc_t, int32_t *t_centi)
+{
+    int32_t v1 = ((((adc_t >> 3) - ((int32_t) ctx->dig_t1 << 1))) * ctx->dig_t2) >> 11;
+    int32_t v2 = (((((adc_t >> 4) - (int32_t) ctx->dig_t1) * ((adc_t >> 4) - (int32_t) ctx->dig_t1)) >> 12) *
+                  ctx->dig_t3) >> 14;
+    int32_t t_fine = v1 + v2;
+
+    *t_centi = (t_fine * 5 + 128) >> 8;
+
+    return t_fine;
+}
+
+/* Pressure in Pa as Q24.8 */
+static uint32_t compensate_p(const struct bmp280_context_s *ctx, int32_t adc_p, int32_t t_fine)
+{
+    int64_t v1 = (int64_t) t_fine - 128000;
+    int64_t v2 = v1 * v1 * ctx->dig_p6;
+    int64_t p;
+
+    v2 = v2 + ((v1 * ctx->dig_p5) << 17);
+    v2 = v2 + ((int64_t) ctx->dig_p4 << 35);
+    v1 = ((v1 * v1 * ctx->dig_p3) >> 8) + ((v1 * ctx->dig_p2) << 12);
+    v1 = (((int64_t) 1 << 47) + v1) * ctx->dig_p1 >> 33;
+
+    if (v1 == 0) return 0;
+
+    p = 1048576 - adc_p;
+    p = (((p << 31) - v2) * 3125) / v1;
+    v1 = ((int64_t) ctx->dig_p9 * (p >> 13) * (p >> 13)) >> 25;
+    v2 = ((int64_t) ctx->dig_p8 * p) >> 19;
+
+    return ((p + v1 + v2) >> 8) + ((int64_t) ctx->dig_p7 << 4);
+}
+
+static uint8_t ctrl_meas(const bmp280_config_t *cfg)
+{
+    return cfg->temperature_oversampling << 5 | cfg->pressure_oversampling << 2 | cfg->power_mode;
+}
+
+esp_err_t bmp280_init(i2c_master_bus_handle_t master_handle, const bmp280_config_t *bmp280_config,
+                      bmp280_handle_t *bmp280_handle)
+{
+    esp_err_t ret = ESP_OK;
+    uint8_t id;
+
+    ESP_RETURN_ON_FALSE(master_handle && bmp280_config && bmp280_handle, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+
+    *bmp280_handle = NULL;
+
+    struct bmp280_context_s *ctx = calloc(1, sizeof(*ctx));
+
+    ESP_RETURN_ON_FALSE(ctx, ESP_ERR_NO_MEM, TAG, "no memory");
+
+    ctx->config = *bmp280_config;
+
+    i2c_device_config_t dev_cfg = {
+        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+        .device_address = bmp280_config->i2c_address,
+        .scl_speed_hz = bmp280_config->i2c_clock_speed,
+    };
+
+    ESP_GOTO_ON_ERROR(i2c_master_bus_add_device(master_handle, &dev_cfg, &ctx->dev), err, TAG, "add device failed");
+    ESP_GOTO_ON_ERROR(read_regs(ctx, REG_ID, &id, 1), err_dev, TAG, "read chip id failed");
+    ESP_GOTO_ON_FALSE(id == BMP280_CHIP_ID, ESP_ERR_INVALID_VERSION, err_dev, TAG, "unexpected chip id 0x%02x", id);
+    ESP_GOTO_ON_ERROR(write_reg(ctx, REG_RESET, BMP280_RESET), err_dev, TAG, "reset failed");
+    vTaskDelay(pdMS_TO_TICKS(2));
+    ESP_GOTO_ON_ERROR(wait_status_clear(ctx, STATUS_IM_UPDATE), err_dev, TAG, "NVM copy not finished");
+    ESP_GOTO_ON_ERROR(read_calibration(ctx), err_dev, TAG, "");
+    ESP_GOTO_ON_ERROR(write_reg(ctx, REG_CONFIG, bmp280_config->standby_time << 5 | bmp280_config->iir_filter << 2),
+                      err_dev, TAG, "write config failed");
+    ESP_GOTO_ON_ERROR(write_reg(ctx, REG_CTRL_MEAS, ctrl_meas(bmp280_config)), err_dev, TAG, "write ctrl_meas failed");
+
+    *bmp280_handle = ctx;
+
+    return ESP_OK;
+
+err_dev:
+    i2c_master_bus_rm_device(ctx->dev);
+err:
+    free(ctx);
+    return ret;
+}
+
+esp_err_t bmp280_get_measurements(bmp280_handle_t handle, float *const temperature, float *const pressure)
+{
+    uint8_t raw[6];
+    int32_t adc_p, adc_t, t_centi, t_fine;
+
+    ESP_RETURN_ON_FALSE(handle && temperature && pressure, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+
+    if (handle->config.power_mode == BMP280_POWER_MODE_FORCED) {
+        ESP_RETURN_ON_ERROR(write_reg(handle, REG_CTRL_MEAS, ctrl_meas(&handle->config)), TAG, "trigger failed");
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+
+    /* In normal mode this skips reading while a conversion updates the result registers */
+    ESP_RETURN_ON_ERROR(wait_status_clear(handle, STATUS_MEASURING), TAG, "conversion not finished");
+    ESP_RETURN_ON_ERROR(read_regs(handle, REG_PRESS_MSB, raw, sizeof(raw)), TAG, "read data failed");
+
+    adc_p = raw[0] << 12 | raw[1] << 4 | raw[2] >> 4;
+    adc_t = raw[3] << 12 | raw[4] << 4 | raw[5] >> 4;
+
+    /* 0x80000 is reported while no conversion has completed */
+    ESP_RETURN_ON_FALSE(adc_t != 0x80000 && adc_p != 0x80000, ESP_ERR_INVALID_STATE, TAG, "no data yet");
+
+    t_fine = compensate_t(handle, adc_t, &t_centi);
+    *temperature = t_centi / 100.0f;
+    *pressure = compensate_p(handle, adc_p, t_fine) / 256.0f;
+
+    return ESP_OK;
+}
+
+esp_err_t bmp280_delete(bmp280_handle_t handle)
+{
+    ESP_RETURN_ON_FALSE(handle, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+
+    i2c_master_bus_rm_device(handle->dev);
+    free(handle);
+
+    return ESP_OK;
+}
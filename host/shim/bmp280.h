@@ -0,0 +1,85 @@
+#ifndef HOST_BMP280_H
+#define HOST_BMP280_H
+
+#include <stdint.h>
+
+#include "driver/i2c_master.h"
+
+#include "esp_err.h"
+
+/*
+ * Host stand-in for the subset of the k0i05/esp_bmp280 managed component
+ * used by weather.c, which is not available outside an IDF build. It talks
+ * to the chip through i2c_master_* like the original, so it runs against
+ * the simulated bus.
+ */
+
+#define I2C_BMP280_DEV_ADDR_LO      0x76
+#define I2C_BMP280_DEV_ADDR_HI      0x77
+#define I2C_BMP280_DATA_RATE_HZ     100000
+
+typedef enum bmp280_power_modes_e {
+    BMP280_POWER_MODE_SLEEP = 0,
+    BMP280_POWER_MODE_FORCED = 1,
+    BMP280_POWER_MODE_NORMAL = 3,
+} bmp280_power_modes_t;
+
+typedef enum bmp280_iir_filters_e {
+    BMP280_IIR_FILTER_OFF = 0,
+    BMP280_IIR_FILTER_2,
+    BMP280_IIR_FILTER_4,
+    BMP280_IIR_FILTER_8,
+    BMP280_IIR_FILTER_16,
+} bmp280_iir_filters_t;
+
+typedef enum bmp280_oversampling_e {
+    BMP280_OVERSAMPLING_SKIPPED = 0,
+    BMP280_OVERSAMPLING_1X,
+    BMP280_OVERSAMPLING_2X,
+    BMP280_OVERSAMPLING_4X,
+    BMP280_OVERSAMPLING_8X,
+    BMP280_OVERSAMPLING_16X,
+} bmp280_oversampling_t;
+
+typedef enum bmp280_standby_times_e {
+    BMP280_STANDBY_TIME_0_5MS = 0,
+    BMP280_STANDBY_TIME_62_5MS,
+    BMP280_STANDBY_TIME_125MS,
+    BMP280_STANDBY_TIME_250MS,
+    BMP280_STANDBY_TIME_500MS,
+    BMP280_STANDBY_TIME_1000MS,
+    BMP280_STANDBY_TIME_2000MS,
+    BMP280_STANDBY_TIME_4000MS,
+} bmp280_standby_times_t;
+
+typedef struct bmp280_config_s {
+    uint16_t i2c_address;
+    uint32_t i2c_clock_speed;
+    bmp280_power_modes_t power_mode;
+    bmp280_iir_filters_t iir_filter;
+    bmp280_oversampling_t pressure_oversampling;
+    bmp280_oversampling_t temperature_oversampling;
+    bmp280_standby_times_t standby_time;
+} bmp280_config_t;
+
+#define I2C_BMP280_CONFIG_DEFAULT {                                 \
+        .i2c_address = I2C_BMP280_DEV_ADDR_HI,                      \
+        .i2c_clock_speed = I2C_BMP280_DATA_RATE_HZ,                 \
+        .power_mode = BMP280_POWER_MODE_NORMAL,                     \
+        .iir_filter = BMP280_IIR_FILTER_OFF,                        \
+        .pressure_oversampling = BMP280_OVERSAMPLING_4X,            \
+        .temperature_oversampling = BMP280_OVERSAMPLING_1X,         \
+        .standby_time = BMP280_STANDBY_TIME_250MS,                  \
+    }
+
+typedef struct bmp280_context_s *bmp280_handle_t;
+
+esp_err_t bmp280_init(i2c_master_bus_handle_t master_handle, const bmp280_config_t *bmp280_config,
+                      bmp280_handle_t *bmp280_handle);
+
+/* Temperature in degC, pressure in Pa */
+esp_err_t bmp280_get_measurements(bmp280_handle_t handle, float *const temperature, float *const pressure);
+
+esp_err_t bmp280_delete(bmp280_handle_t handle);
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef HOST_ESP_LOG_H
+#define HOST_ESP_LOG_H
+
+#include <stdio.h>
+
+/* Errors and warnings go to stderr, the other levels are compiled out */
+
+typedef enum {
+    ESP_LOG_NONE = 0,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE,
+} esp_log_level_t;
+
+extern esp_log_level_t host_log_level;
+
+/* The level applies to all tags on the host */
+void esp_log_level_set(const char *tag, esp_log_level_t level);
+
+#define ESP_LOGE(tag, fmt, ...) do {                                        \
+        if (host_log_level >= ESP_LOG_ERROR) fprintf(stderr, "E %s: " fmt "\n", tag, ##__VA_ARGS__); \
+    } while (0)
+#define ESP_LOGW(tag, fmt, ...) do {                                        \
+        if (host_log_level >= ESP_LOG_WARN) fprintf(stderr, "W %s: " fmt "\n", tag, ##__VA_ARGS__); \
+    } while (0)
+#define ESP_LOGI(tag, fmt, ...) do { (void) (tag); } while (0)
+#define ESP_LOGD(tag, fmt, ...) do { (void) (tag); } while (0)
+#define ESP_LOGV(tag, fmt, ...) do { (void) (tag); } while (0)
+
+#endif
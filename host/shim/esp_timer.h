@@ -0,0 +1,15 @@
+#ifndef HOST_ESP_TIMER_H
+#define HOST_ESP_TIMER_H
+
+#include <stdint.h>
+
+/*
+ * Virtual monotonic clock in microseconds. It only moves when the code
+ * under test delays (vTaskDelay) or when a harness calls
+ * host_time_advance_us(), which keeps host runs deterministic.
+ */
+int64_t esp_timer_get_time(void);
+
+void host_time_advance_us(int64_t us);
+
+#endif
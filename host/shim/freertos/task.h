@@ -0,0 +1,24 @@
+#ifndef HOST_FREERTOS_TASK_H
+#define HOST_FREERTOS_TASK_H
+
+#include "freertos/FreeRTOS.h"
+
+typedef uint8_t StackType_t;
+typedef struct { int unused; } StaticTask_t;
+typedef StaticTask_t *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *arg);
+
+/* Advances the virtual clock of esp_timer.h instead of sleeping */
+void vTaskDelay(TickType_t ticks);
+
+TickType_t xTaskGetTickCount(void);
+
+/*
+ * Host programs are single threaded and call the work of a task
+ * themselves, so the task is never started.
+ */
+TaskHandle_t xTaskCreateStatic(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg,
+                               UBaseType_t priority, StackType_t *stack, StaticTask_t *tcb);
+void vTaskDelete(TaskHandle_t task);
+
+#endif
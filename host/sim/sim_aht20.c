@@ -0,0 +1,151 @@
+#include <string.h>
+
+#include "esp_timer.h"
+
+#include "sim_aht20.h"
+
+#define AHT20_CMD_TRIGGER   0xAC
+#define AHT20_CMD_INIT      0xBE
+#define AHT20_CMD_RESET     0xBA
+
+#define AHT20_STATUS_BUSY   0x80
+#define AHT20_STATUS_CAL    0x08
+#define AHT20_STATUS_CRC    0x10
+
+static uint8_t crc8(const uint8_t *data, size_t len)
+{
+    uint8_t crc = 0xFF;
+
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int b = 0; b < 8; b++) {
+            crc = crc & 0x80 ? (crc << 1) ^ 0x31 : crc << 1;
+        }
+    }
+
+    return crc;
+}
+
+static uint32_t to_raw(float value, float offset, float span)
+{
+    float raw = (value + offset) / span * (1 << 20);
+
+    if (raw < 0) return 0;
+    if (raw > (1 << 20) - 1) return (1 << 20) - 1;
+
+    return (uint32_t) (raw + 0.5f);
+}
+
+static uint8_t status(const sim_aht20_t *dev)
+{
+    uint8_t s = AHT20_STATUS_CRC;
+
+    if (dev->calibrated) s |= AHT20_STATUS_CAL;
+    if (esp_timer_get_time() < dev->ready_at_us) s |= AHT20_STATUS_BUSY;
+
+    return s;
+}
+
+static void trigger(sim_aht20_t *dev)
+{
+    dev->ready_at_us = esp_timer_get_time() + dev->conversion_us;
+    dev->conversions++;
+
+    if (dev->source) return;
+
+    uint32_t hum = to_raw(dev->humidity, 0, 100);
+    uint32_t temp = to_raw(dev->temperature, 50, 200);
+    uint8_t *f = dev->frame;
+
+    /* The result registers are only updated once the conversion is done,
+       but nothing reads them before that without seeing the busy bit */
+    f[1] = hum >> 12;
+    f[2] = hum >> 4;
+    f[3] = (hum << 4) | (temp >> 16);
+    f[4] = temp >> 8;
+    f[5] = temp;
+}
+
+static void aht20_write(void *ctx, const uint8_t *data, size_t len)
+{
+    sim_aht20_t *dev = ctx;
+
+    if (len == 0) return;
+
+    switch (data[0]) {
+        case AHT20_CMD_TRIGGER:
+            if (len == 3 && data[1] == 0x33 && data[2] == 0x00) trigger(dev);
+            break;
+        case AHT20_CMD_INIT:
+            dev->calibrated = true;
+            break;
+        case AHT20_CMD_RESET:
+            dev->ready_at_us = esp_timer_get_time() + 20000;
+            break;
+        default:
+            break;
+    }
+}
+
+static void aht20_read(void *ctx, uint8_t *data, size_t len)
+{
+    sim_aht20_t *dev = ctx;
+    uint8_t s = status(dev);
+    const uint8_t *frame = dev->frame;
+
+    if (dev->source && !(s & AHT20_STATUS_BUSY)) {
+        const uint8_t *next = len >= sizeof(dev->raw) ? dev->source(dev->source_arg) : NULL;
+
+        if (next) {
+            memcpy(dev->raw, next, sizeof(dev->raw));
+            dev->raw_valid = true;
+        }
+    }
+
+    if (dev->raw_valid && !(s & AHT20_STATUS_BUSY)) {
+        /* A replayed frame keeps its recorded status and CRC; status polls see the last one */
+        frame = dev->raw;
+    } else {
+        dev->frame[0] = s;
+        dev->frame[6] = crc8(dev->frame, 6);
+    }
+
+    /* Past the CRC the sensor keeps sending 0xFF */
+    for (size_t i = 0; i < len; i++) {
+        data[i] = i < sizeof(dev->frame) ? frame[i] : 0xFF;
+    }
+}
+
+static const sim_device_ops_t aht20_ops = {
+    .write = aht20_write,
+    .read = aht20_read,
+};
+
+void sim_aht20_init(sim_aht20_t *dev)
+{
+    memset(dev, 0, sizeof(*dev));
+    dev->conversion_us = SIM_AHT20_CONVERSION_US;
+    dev->calibrated = true;
+    dev->temperature = 20;
+    dev->humidity = 50;
+}
+
+esp_err_t sim_aht20_attach(sim_aht20_t *dev, i2c_master_bus_handle_t bus, uint16_t addr)
+{
+    return sim_i2c_attach(bus, addr, &aht20_ops, dev);
+}
+
+void sim_aht20_set(sim_aht20_t *dev, float temperature, float humidity)
+{
+    dev->temperature = temperature;
+    dev->humidity = humidity;
+    dev->source = NULL;
+    dev->raw_valid = false;
+}
+
+void sim_aht20_set_source(sim_aht20_t *dev, sim_aht20_source_t source, void *arg)
+{
+    dev->source = source;
+    dev->source_arg = arg;
+    dev->raw_valid = false;
+}
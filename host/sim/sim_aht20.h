@@ -0,0 +1,50 @@
+#ifndef SIM_AHT20_H
+#define SIM_AHT20_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+
+#include "sim_i2c.h"
+
+/*
+ * AHT20 model: a 0xAC trigger starts a conversion that keeps the busy bit
+ * (7) of the status set for `conversion_us`; reads return the status byte,
+ * then the 20-bit humidity and temperature and the CRC-8 (0x31) of the
+ * first six bytes, as the sensor does. For replay, recorded frames can be
+ * returned instead, one per result read.
+ */
+
+#define SIM_AHT20_CONVERSION_US 80000   /* Datasheet typical */
+
+/* Next recorded frame for a replay, NULL to repeat the last one */
+typedef const uint8_t *(*sim_aht20_source_t)(void *arg);
+
+typedef struct sim_aht20 {
+    uint32_t conversion_us;
+    float temperature;          /* Applied at the next trigger */
+    float humidity;
+    bool calibrated;            /* Status bit 3 */
+    /* Internal */
+    sim_aht20_source_t source;
+    void *source_arg;
+    uint8_t raw[7];             /* Last frame of the source */
+    bool raw_valid;
+    int64_t ready_at_us;
+    uint8_t frame[7];
+    uint32_t conversions;
+} sim_aht20_t;
+
+void sim_aht20_init(sim_aht20_t *dev);
+esp_err_t sim_aht20_attach(sim_aht20_t *dev, i2c_master_bus_handle_t bus, uint16_t addr);
+
+void sim_aht20_set(sim_aht20_t *dev, float temperature, float humidity);
+
+/*
+ * Each read of a result, once its conversion is done, returns the next frame
+ * of `source` verbatim, CRC included; until sim_aht20_set().
+ */
+void sim_aht20_set_source(sim_aht20_t *dev, sim_aht20_source_t source, void *arg);
+
+#endif
@@ -0,0 +1,304 @@
+#include <string.h>
+
+#include "esp_timer.h"
+
+#include "sim_bmp280.h"
+
+#define REG_CALIB       0x88
+#define REG_ID          0xD0
+#define REG_RESET       0xE0
+#define REG_STATUS      0xF3
+#define REG_CTRL_MEAS   0xF4
+#define REG_CONFIG      0xF5
+#define REG_PRESS_MSB   0xF7
+#define REG_TEMP_MSB    0xFA
+
+#define BMP280_CHIP_ID  0x58
+#define BMP280_RESET    0xB6
+
+#define STATUS_MEASURING 0x08
+#define STATUS_IM_UPDATE 0x01
+
+#define MODE_SLEEP      0
+#define MODE_NORMAL     3
+
+#define ADC_SKIPPED     0x80000
+
+/* Calibration example of the datasheet (section 3.12): dig_T1..dig_T3, dig_P1..dig_P9 */
+static const int32_t default_calib[12] = {
+    27504, 26435, -1000, 36477, -10685, 3024, 2855, 140, -7, 15500, -14600, 6000,
+};
+
+static const uint32_t standby_us[8] = { 500, 62500, 125000, 250000, 500000, 1000000, 2000000, 4000000 };
+
+/* Calibration word n as stored in the NVM, dig_T1 and dig_P1 are unsigned */
+static double dig(const sim_bmp280_t *dev, unsigned int n)
+{
+    uint16_t w = dev->calib[2 * n] | dev->calib[2 * n + 1] << 8;
+
+    return n == 0 || n == 3 ? (double) w : (double) (int16_t) w;
+}
+
+/* Floating point compensation of the datasheet (section 8.1) */
+static double t_fine_of(const sim_bmp280_t *dev, uint32_t adc_t)
+{
+    double dig_t1 = dig(dev, 0), dig_t2 = dig(dev, 1), dig_t3 = dig(dev, 2);
+    double v1 = (adc_t / 16384.0 - dig_t1 / 1024.0) * dig_t2;
+    double v2 = (adc_t / 131072.0 - dig_t1 / 8192.0) * (adc_t / 131072.0 - dig_t1 / 8192.0) * dig_t3;
+
+    return v1 + v2;
+}
+
+static double pressure_of(const sim_bmp280_t *dev, uint32_t adc_p, double t_fine)
+{
+    double dig_p1 = dig(dev, 3), dig_p2 = dig(dev, 4), dig_p3 = dig(dev, 5), dig_p4 = dig(dev, 6), dig_p5 = dig(dev, 7),
+           dig_p6 = dig(dev, 8), dig_p7 = dig(dev, 9), dig_p8 = dig(dev, 10), dig_p9 = dig(dev, 11);
+    double v1 = t_fine / 2.0 - 64000.0;
+    double v2 = v1 * v1 * dig_p6 / 32768.0;
+    double p;
+
+    v2 = v2 + v1 * dig_p5 * 2.0;
+    v2 = v2 / 4.0 + dig_p4 * 65536.0;
+    v1 = (dig_p3 * v1 * v1 / 524288.0 + dig_p2 * v1) / 524288.0;
+    v1 = (1.0 + v1 / 32768.0) * dig_p1;
+
+    p = 1048576.0 - adc_p;
+    p = (p - v2 / 4096.0) * 6250.0 / v1;
+    v1 = dig_p9 * p * p / 2147483648.0;
+    v2 = p * dig_p8 / 32768.0;
+
+    return p + (v1 + v2 + dig_p7) / 16.0;
+}
+
+/* Temperature grows and pressure falls with the raw value, so both invert by bisection */
+static void invert(sim_bmp280_t *dev)
+{
+    uint32_t lo = 0, hi = (1 << 20) - 1;
+    double t_fine;
+
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+
+        if (t_fine_of(dev, mid) / 5120.0 < dev->temperature) lo = mid + 1;
+        else hi = mid;
+    }
+    dev->adc_t = lo;
+    t_fine = t_fine_of(dev, lo);
+
+    lo = 0;
+    hi = (1 << 20) - 1;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+
+        if (pressure_of(dev, mid, t_fine) > dev->pressure) lo = mid + 1;
+        else hi = mid;
+    }
+    dev->adc_p = lo;
+}
+
+static unsigned int oversampling(unsigned int osrs)
+{
+    return osrs == 0 ? 0 : osrs >= 5 ? 16 : 1 << (osrs - 1);
+}
+
+/* Typical measurement time of the datasheet (section 3.8.1) */
+static uint32_t measure_us(const sim_bmp280_t *dev)
+{
+    uint8_t ctrl = dev->regs[REG_CTRL_MEAS];
+    unsigned int os_t = oversampling(ctrl >> 5);
+    unsigned int os_p = oversampling((ctrl >> 2) & 7);
+
+    return 1000 + 2000 * os_t + 2000 * os_p + (os_p ? 500 : 0);
+}
+
+static void put20(uint8_t *reg, uint32_t value)
+{
+    reg[0] = value >> 12;
+    reg[1] = value >> 4;
+    reg[2] = (value & 0xF) << 4;
+}
+
+static uint32_t filter(uint32_t prev, uint32_t sample, unsigned int coeff)
+{
+    return coeff <= 1 ? sample : (prev * (coeff - 1) + sample) / coeff;
+}
+
+/* End of a conversion: the result registers take the new (filtered) values */
+static void latch(sim_bmp280_t *dev)
+{
+    uint8_t ctrl = dev->regs[REG_CTRL_MEAS];
+    unsigned int iir = (dev->regs[REG_CONFIG] >> 2) & 7;
+    unsigned int coeff = iir == 0 ? 1 : 1 << (iir > 4 ? 4 : iir);
+
+    if (dev->source) {
+        /* Replayed registers were already filtered by the real chip */
+        dev->conversions++;
+        return;
+    }
+
+    invert(dev);
+
+    if (!dev->filter_primed) {
+        dev->filt_t = dev->adc_t;
+        dev->filt_p = dev->adc_p;
+        dev->filter_primed = true;
+    } else {
+        dev->filt_t = filter(dev->filt_t, dev->adc_t, coeff);
+        dev->filt_p = filter(dev->filt_p, dev->adc_p, coeff);
+    }
+
+    put20(&dev->regs[REG_TEMP_MSB], ctrl >> 5 ? dev->filt_t : ADC_SKIPPED);
+    put20(&dev->regs[REG_PRESS_MSB], (ctrl >> 2) & 7 ? dev->filt_p : ADC_SKIPPED);
+    dev->conversions++;
+}
+
+/* Brings the model up to the current virtual time before any access */
+static void update(sim_bmp280_t *dev)
+{
+    int64_t now = esp_timer_get_time();
+    uint8_t mode = dev->regs[REG_CTRL_MEAS] & 3;
+    uint8_t status = 0;
+
+    if (dev->converting && mode != MODE_NORMAL && now >= dev->busy_until_us) {
+        latch(dev);
+        dev->converting = false;
+        dev->regs[REG_CTRL_MEAS] &= ~3;     /* Back to sleep after a forced conversion */
+    }
+
+    if (mode == MODE_NORMAL) {
+        int64_t period = measure_us(dev) + standby_us[dev->regs[REG_CONFIG] >> 5];
+        int64_t elapsed = now - dev->cycle_start_us;
+        int64_t done = elapsed >= measure_us(dev) ? (elapsed - measure_us(dev)) / period + 1 : 0;
+
+        /* Conversions missed between two accesses all went through the filter */
+        for (uint32_t n = 0; dev->cycles_done < done && n < 16; n++) latch(dev);
+        dev->cycles_done = done;
+
+        if (elapsed % period < measure_us(dev)) status |= STATUS_MEASURING;
+    } else if (dev->converting) {
+        status |= STATUS_MEASURING;
+    }
+
+    if (!dev->converting && now < dev->busy_until_us) status |= STATUS_IM_UPDATE;
+
+    dev->regs[REG_STATUS] = status;
+}
+
+static void load_defaults(sim_bmp280_t *dev)
+{
+    memset(dev->regs, 0, sizeof(dev->regs));
+
+    memcpy(&dev->regs[REG_CALIB], dev->calib, sizeof(dev->calib));
+    dev->regs[REG_ID] = BMP280_CHIP_ID;
+    put20(&dev->regs[REG_TEMP_MSB], ADC_SKIPPED);
+    put20(&dev->regs[REG_PRESS_MSB], ADC_SKIPPED);
+    dev->converting = false;
+    dev->filter_primed = false;
+}
+
+static void write_reg(sim_bmp280_t *dev, uint8_t reg, uint8_t value)
+{
+    int64_t now = esp_timer_get_time();
+
+    switch (reg) {
+        case REG_RESET:
+            if (value != BMP280_RESET) break;
+            load_defaults(dev);
+            dev->busy_until_us = now + 2000;    /* NVM copy */
+            break;
+        case REG_CTRL_MEAS:
+            dev->regs[reg] = value;
+            if ((value & 3) == MODE_NORMAL) {
+                dev->cycle_start_us = now;
+                dev->cycles_done = 0;
+                dev->converting = false;
+            } else if ((value & 3) != MODE_SLEEP) {
+                dev->converting = true;
+                dev->busy_until_us = now + measure_us(dev);
+            }
+            break;
+        case REG_CONFIG:
+            dev->regs[reg] = value;
+            break;
+        default:
+            /* Other registers are read-only */
+            break;
+    }
+}
+
+static void bmp280_write(void *ctx, const uint8_t *data, size_t len)
+{
+    sim_bmp280_t *dev = ctx;
+
+    if (len == 0) return;
+
+    update(dev);
+
+    /* A lone register address sets the read pointer, otherwise (address, value) pairs follow */
+    dev->ptr = data[0];
+    for (size_t i = 0; i + 1 < len; i += 2) {
+        write_reg(dev, data[i], data[i + 1]);
+    }
+
+    update(dev);
+}
+
+static void bmp280_read(void *ctx, uint8_t *data, size_t len)
+{
+    sim_bmp280_t *dev = ctx;
+
+    update(dev);
+
+    if (dev->source && dev->ptr == REG_PRESS_MSB && len >= 6) {
+        const uint8_t *next = dev->source(dev->source_arg);
+
+        if (next) memcpy(&dev->regs[REG_PRESS_MSB], next, 6);
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        data[i] = dev->regs[dev->ptr++];
+    }
+}
+
+static const sim_device_ops_t bmp280_ops = {
+    .write = bmp280_write,
+    .read = bmp280_read,
+};
+
+void sim_bmp280_init(sim_bmp280_t *dev)
+{
+    memset(dev, 0, sizeof(*dev));
+
+    for (size_t i = 0; i < sizeof(default_calib) / sizeof(default_calib[0]); i++) {
+        dev->calib[2 * i] = (uint16_t) default_calib[i];
+        dev->calib[2 * i + 1] = (uint16_t) default_calib[i] >> 8;
+    }
+
+    dev->temperature = 20;
+    dev->pressure = 101325;
+    load_defaults(dev);
+}
+
+esp_err_t sim_bmp280_attach(sim_bmp280_t *dev, i2c_master_bus_handle_t bus, uint16_t addr)
+{
+    return sim_i2c_attach(bus, addr, &bmp280_ops, dev);
+}
+
+void sim_bmp280_set(sim_bmp280_t *dev, float temperature, float pressure)
+{
+    dev->temperature = temperature;
+    dev->pressure = pressure;
+    dev->source = NULL;
+}
+
+void sim_bmp280_set_calibration(sim_bmp280_t *dev, const uint8_t calib[24])
+{
+    memcpy(dev->calib, calib, sizeof(dev->calib));
+    memcpy(&dev->regs[REG_CALIB], calib, sizeof(dev->calib));
+}
+
+void sim_bmp280_set_source(sim_bmp280_t *dev, sim_bmp280_source_t source, void *arg)
+{
+    dev->source = source;
+    dev->source_arg = arg;
+}
@@ -0,0 +1,59 @@
+#ifndef SIM_BMP280_H
+#define SIM_BMP280_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+
+#include "sim_i2c.h"
+
+/*
+ * BMP280 model with the register map of the datasheet: chip id, soft reset,
+ * calibration words (the datasheet example set), ctrl_meas/config with
+ * forced and normal modes, the measuring/im_update status bits, the IIR
+ * filter and the 20-bit raw ADC values. The raw values are derived from the
+ * physical values by inverting the datasheet compensation, so a correct
+ * driver reads back what was set. For replay, recorded calibration and result
+ * registers can be loaded instead.
+ */
+
+/* Next recorded result registers for a replay, NULL to repeat the last ones */
+typedef const uint8_t *(*sim_bmp280_source_t)(void *arg);
+
+typedef struct sim_bmp280 {
+    float temperature;          /* degC, applied at the next conversion */
+    float pressure;             /* Pa */
+    /* Internal */
+    uint8_t calib[24];          /* NVM, copied to 0x88..0x9F at reset */
+    sim_bmp280_source_t source;
+    void *source_arg;
+    uint8_t regs[256];
+    uint8_t ptr;
+    int64_t busy_until_us;      /* End of the forced conversion or of the NVM copy after reset */
+    int64_t cycle_start_us;     /* Normal mode */
+    uint32_t cycles_done;
+    bool converting;
+    uint32_t adc_t;
+    uint32_t adc_p;
+    uint32_t filt_t;
+    uint32_t filt_p;
+    bool filter_primed;
+    uint32_t conversions;
+} sim_bmp280_t;
+
+void sim_bmp280_init(sim_bmp280_t *dev);
+esp_err_t sim_bmp280_attach(sim_bmp280_t *dev, i2c_master_bus_handle_t bus, uint16_t addr);
+
+void sim_bmp280_set(sim_bmp280_t *dev, float temperature, float pressure);
+
+/* Calibration registers 0x88..0x9F of a real chip, before the driver reads them */
+void sim_bmp280_set_calibration(sim_bmp280_t *dev, const uint8_t calib[24]);
+
+/*
+ * Each read of the result registers 0xF7..0xFC returns the next registers
+ * of `source`, until sim_bmp280_set().
+ */
+void sim_bmp280_set_source(sim_bmp280_t *dev, sim_bmp280_source_t source, void *arg);
+
+#endif
@@ -0,0 +1,276 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "driver/i2c_master.h"
+
+#include "esp_err.h"
+#include "esp_check.h"
+#include "esp_timer.h"
+
+#include "sim_i2c.h"
+
+#define SIM_XFER_MAX 1100   /* Largest transaction, a full 128x64 frame plus its control byte */
+
+static const char *TAG = "sim_i2c";
+
+typedef struct sim_slot {
+    uint16_t addr;
+    const sim_device_ops_t *ops;
+    void *ctx;
+    sim_faults_t faults;
+    sim_device_stats_t stats;
+} sim_slot_t;
+
+struct i2c_master_bus_t {
+    uint32_t rng;
+    sim_slot_t slots[SIM_I2C_MAX_DEVICES];
+    unsigned int n_slots;
+    sim_read_observer_t observer;
+};
+
+struct i2c_master_dev_t {
+    struct i2c_master_bus_t *bus;
+    uint16_t addr;
+    uint32_t scl_speed_hz;
+};
+
+typedef enum sim_outcome {
+    SIM_OK = 0,
+    SIM_NACK,
+    SIM_TIMEOUT,
+} sim_outcome_t;
+
+static uint32_t next_random(struct i2c_master_bus_t *bus)
+{
+    /* xorshift32, never seeded with 0 */
+    uint32_t x = bus->rng;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+
+    return bus->rng = x;
+}
+
+static bool chance(struct i2c_master_bus_t *bus, uint16_t permille)
+{
+    return permille != 0 && next_random(bus) % 1000 < permille;
+}
+
+static sim_slot_t *find_slot(struct i2c_master_bus_t *bus, uint16_t addr)
+{
+    for (unsigned int i = 0; i < bus->n_slots; i++) {
+        if (bus->slots[i].addr == addr) return &bus->slots[i];
+    }
+
+    return NULL;
+}
+
+/* Start, address byte, `bytes` data bytes with their ACK bits and stop */
+static int64_t wire_time_us(const struct i2c_master_dev_t *dev, size_t bytes)
+{
+    uint64_t bits = 1 + 9 + 9 * (uint64_t) bytes + 1;
+
+    return (bits * 1000000 + dev->scl_speed_hz - 1) / dev->scl_speed_hz;
+}
+
+/*
+ * Draws the fault of one addressing phase and advances the clock by its
+ * duration. Reads and writes of a combined transaction each go through here.
+ */
+static sim_outcome_t begin(const struct i2c_master_dev_t *dev, sim_slot_t *slot, size_t bytes, int xfer_timeout_ms)
+{
+    struct i2c_master_bus_t *bus = dev->bus;
+    int64_t duration_us;
+
+    if (slot == NULL || chance(bus, slot->faults.nack_permille)) {
+        /* The master gives up after the address byte */
+        host_time_advance_us(wire_time_us(dev, 0));
+        if (slot) slot->stats.nacks++;
+        return SIM_NACK;
+    }
+
+    if (chance(bus, slot->faults.timeout_permille)) {
+        duration_us = (int64_t) (xfer_timeout_ms > 0 ? xfer_timeout_ms : 1000) * 1000;
+        host_time_advance_us(duration_us);
+        slot->stats.timeouts++;
+        slot->stats.busy_us += duration_us;
+        return SIM_TIMEOUT;
+    }
+
+    duration_us = wire_time_us(dev, bytes) + slot->faults.latency_us;
+    host_time_advance_us(duration_us);
+    slot->stats.busy_us += duration_us;
+
+    return SIM_OK;
+}
+
+static esp_err_t outcome_to_err(sim_outcome_t outcome)
+{
+    switch (outcome) {
+        case SIM_NACK: return ESP_ERR_INVALID_STATE;
+        case SIM_TIMEOUT: return ESP_ERR_TIMEOUT;
+        default: return ESP_OK;
+    }
+}
+
+static esp_err_t do_write(struct i2c_master_dev_t *dev, const uint8_t *data, size_t len, int xfer_timeout_ms)
+{
+    sim_slot_t *slot = find_slot(dev->bus, dev->addr);
+    sim_outcome_t outcome = begin(dev, slot, len, xfer_timeout_ms);
+
+    if (outcome == SIM_OK) slot->ops->write(slot->ctx, data, len);
+
+    return outcome_to_err(outcome);
+}
+
+static esp_err_t do_read(struct i2c_master_dev_t *dev, const uint8_t *write, size_t write_size,
+                         uint8_t *data, size_t len, int xfer_timeout_ms)
+{
+    sim_slot_t *slot = find_slot(dev->bus, dev->addr);
+    sim_outcome_t outcome = begin(dev, slot, len, xfer_timeout_ms);
+
+    if (outcome != SIM_OK) return outcome_to_err(outcome);
+
+    slot->ops->read(slot->ctx, data, len);
+
+    if (len > 0 && chance(dev->bus, slot->faults.corrupt_permille)) {
+        uint32_t r = next_random(dev->bus);
+
+        data[(r >> 3) % len] ^= 1 << (r & 7);
+        slot->stats.corruptions++;
+    }
+
+    if (dev->bus->observer) dev->bus->observer(dev->addr, write, write_size, data, len);
+
+    return ESP_OK;
+}
+
+i2c_master_bus_handle_t sim_i2c_bus_new(uint32_t seed)
+{
+    struct i2c_master_bus_t *bus = calloc(1, sizeof(*bus));
+
+    if (bus != NULL) bus->rng = seed ? seed : 1;
+
+    return bus;
+}
+
+void sim_i2c_bus_del(i2c_master_bus_handle_t bus)
+{
+    free(bus);
+}
+
+esp_err_t sim_i2c_attach(i2c_master_bus_handle_t bus, uint16_t addr, const sim_device_ops_t *ops, void *ctx)
+{
+    ESP_RETURN_ON_FALSE(bus && ops && ops->write && ops->read, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    ESP_RETURN_ON_FALSE(find_slot(bus, addr) == NULL, ESP_ERR_INVALID_STATE, TAG, "0x%02x already attached", addr);
+    ESP_RETURN_ON_FALSE(bus->n_slots < SIM_I2C_MAX_DEVICES, ESP_ERR_NO_MEM, TAG, "too many devices");
+
+    bus->slots[bus->n_slots++] = (sim_slot_t) {
+        .addr = addr,
+        .ops = ops,
+        .ctx = ctx,
+    };
+
+    return ESP_OK;
+}
+
+void sim_i2c_set_read_observer(i2c_master_bus_handle_t bus, sim_read_observer_t observer)
+{
+    bus->observer = observer;
+}
+
+esp_err_t sim_i2c_set_faults(i2c_master_bus_handle_t bus, uint16_t addr, const sim_faults_t *faults)
+{
+    sim_slot_t *slot = find_slot(bus, addr);
+
+    ESP_RETURN_ON_FALSE(slot, ESP_ERR_NOT_FOUND, TAG, "no device at 0x%02x", addr);
+
+    slot->faults = *faults;
+
+    return ESP_OK;
+}
+
+esp_err_t sim_i2c_get_stats(i2c_master_bus_handle_t bus, uint16_t addr, sim_device_stats_t *stats)
+{
+    sim_slot_t *slot = find_slot(bus, addr);
+
+    ESP_RETURN_ON_FALSE(slot, ESP_ERR_NOT_FOUND, TAG, "no device at 0x%02x", addr);
+
+    *stats = slot->stats;
+
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_bus_add_device(i2c_master_bus_handle_t bus_handle, const i2c_device_config_t *dev_config,
+                                    i2c_master_dev_handle_t *ret_handle)
+{
+    ESP_RETURN_ON_FALSE(bus_handle && dev_config && ret_handle, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+
+    struct i2c_master_dev_t *dev = calloc(1, sizeof(*dev));
+
+    ESP_RETURN_ON_FALSE(dev, ESP_ERR_NO_MEM, TAG, "no memory");
+
+    dev->bus = bus_handle;
+    dev->addr = dev_config->device_address;
+    dev->scl_speed_hz = dev_config->scl_speed_hz ? dev_config->scl_speed_hz : 100000;
+    *ret_handle = dev;
+
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_bus_rm_device(i2c_master_dev_handle_t handle)
+{
+    ESP_RETURN_ON_FALSE(handle, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+
+    free(handle);
+
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_transmit(i2c_master_dev_handle_t i2c_dev, const uint8_t *write_buffer, size_t write_size,
+                              int xfer_timeout_ms)
+{
+    ESP_RETURN_ON_FALSE(i2c_dev && (write_buffer || write_size == 0), ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+
+    return do_write(i2c_dev, write_buffer, write_size, xfer_timeout_ms);
+}
+
+esp_err_t i2c_master_receive(i2c_master_dev_handle_t i2c_dev, uint8_t *read_buffer, size_t read_size,
+                             int xfer_timeout_ms)
+{
+    ESP_RETURN_ON_FALSE(i2c_dev && read_buffer, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+
+    return do_read(i2c_dev, NULL, 0, read_buffer, read_size, xfer_timeout_ms);
+}
+
+/* Write, repeated start, read */
+esp_err_t i2c_master_transmit_receive(i2c_master_dev_handle_t i2c_dev, const uint8_t *write_buffer, size_t write_size,
+                                      uint8_t *read_buffer, size_t read_size, int xfer_timeout_ms)
+{
+    ESP_RETURN_ON_FALSE(i2c_dev && write_buffer && read_buffer, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    esp_err_t rc = do_write(i2c_dev, write_buffer, write_size, xfer_timeout_ms);
+
+    return rc != ESP_OK ? rc : do_read(i2c_dev, write_buffer, write_size, read_buffer, read_size, xfer_timeout_ms);
+}
+
+/* The buffers are sent back to back in one transaction, as the panel IO does */
+esp_err_t i2c_master_multi_buffer_transmit(i2c_master_dev_handle_t i2c_dev,
+                                           i2c_master_transmit_multi_buffer_info_t *buffer_info_array,
+                                           size_t array_size, int xfer_timeout_ms)
+{
+    static uint8_t xfer[SIM_XFER_MAX];
+    size_t len = 0;
+
+    ESP_RETURN_ON_FALSE(i2c_dev && buffer_info_array, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+
+    for (size_t i = 0; i < array_size; i++) {
+        ESP_RETURN_ON_FALSE(len + buffer_info_array[i].buffer_size <= sizeof(xfer), ESP_ERR_INVALID_SIZE, TAG,
+                            "transaction too large");
+        memcpy(xfer + len, buffer_info_array[i].write_buffer, buffer_info_array[i].buffer_size);
+        len += buffer_info_array[i].buffer_size;
+    }
+
+    return do_write(i2c_dev, xfer, len, xfer_timeout_ms);
+}
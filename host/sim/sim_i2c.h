@@ -0,0 +1,65 @@
+#ifndef SIM_I2C_H
+#define SIM_I2C_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "driver/i2c_master.h"
+
+#include "esp_err.h"
+
+/*
+ * Simulated I2C bus implementing the i2c_master_* API for host builds.
+ *
+ * Device models are attached by address and see the raw bytes of every
+ * transaction, like the real chip. Each transaction advances the virtual
+ * clock of esp_timer_get_time() by its time on the wire at the device's
+ * SCL speed plus a configurable latency, so the timing of the drivers is
+ * reproduced without sleeping. Faults are drawn from a PRNG seeded per bus,
+ * hence runs with the same seed are identical.
+ */
+
+#define SIM_I2C_MAX_DEVICES 8
+
+typedef struct sim_device_ops {
+    /* Bytes written by the master in one transaction */
+    void (*write)(void *ctx, const uint8_t *data, size_t len);
+    /* Bytes read by the master in one transaction */
+    void (*read)(void *ctx, uint8_t *data, size_t len);
+} sim_device_ops_t;
+
+typedef struct sim_faults {
+    uint32_t latency_us;        /* Added to every transaction, e.g. clock stretching */
+    uint16_t nack_permille;     /* Address not acknowledged, ESP_ERR_INVALID_STATE */
+    uint16_t timeout_permille;  /* Bus stuck until the transfer timeout, ESP_ERR_TIMEOUT */
+    uint16_t corrupt_permille;  /* One bit of a read flipped */
+} sim_faults_t;
+
+typedef struct sim_device_stats {
+    uint32_t transactions;
+    uint32_t nacks;
+    uint32_t timeouts;
+    uint32_t corruptions;
+    uint64_t busy_us;
+} sim_device_stats_t;
+
+/*
+ * Sees every successful read, after fault injection, with the bytes written
+ * before it in the same transaction (e.g. the register address), like the
+ * firmware's I2C tracer does.
+ */
+typedef void (*sim_read_observer_t)(uint16_t addr, const uint8_t *write, size_t write_size,
+                                    const uint8_t *read, size_t read_size);
+
+i2c_master_bus_handle_t sim_i2c_bus_new(uint32_t seed);
+void sim_i2c_bus_del(i2c_master_bus_handle_t bus);
+
+/* Transactions to an address without a model are not acknowledged */
+esp_err_t sim_i2c_attach(i2c_master_bus_handle_t bus, uint16_t addr, const sim_device_ops_t *ops, void *ctx);
+
+esp_err_t sim_i2c_set_faults(i2c_master_bus_handle_t bus, uint16_t addr, const sim_faults_t *faults);
+void sim_i2c_set_read_observer(i2c_master_bus_handle_t bus, sim_read_observer_t observer);
+
+esp_err_t sim_i2c_get_stats(i2c_master_bus_handle_t bus, uint16_t addr, sim_device_stats_t *stats);
+
+#endif
@@ -0,0 +1,412 @@
+/*
+ * Drives the AHT20 driver, the BMP280 driver and the panel flush sequence
+ * on the simulated bus over a span of virtual time, checking every value
+ * read back and every frame captured by the panel model against what was
+ * put in. The panel effects of main/screen_cmd.c are checked against the
+ * model once after the bring-up. Faults can be injected per device from the
+ * command line.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "driver/i2c_master.h"
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "aht20.h"
+#include "bmp280.h"
+#include "screen_cmd.h"
+#include "memory.h"
+#include "screen_conv.h"
+#include "sensor_trace.h"
+
+#include "sim_i2c.h"
+#include "sim_aht20.h"
+#include "sim_bmp280.h"
+#include "sim_ssd1306.h"
+
+#define PANEL_ADDR          0x3C
+#define PANEL_HOR_RES       128
+#define PANEL_VER_RES       64
+#define PANEL_TIMEOUT_MS    -1
+
+/* Data and control byte, plus the column and page range commands */
+#define PANEL_FRAME_BUS_BYTES   (PANEL_HOR_RES * PANEL_VER_RES / 8 + 1 + 2 * 4)
+
+#define SENSOR_PERIOD_US    (10 * 1000000LL)    /* SENSORS_REFRESH_RATE of weather.c */
+#define FRAME_PERIOD_US     (1 * 1000000LL)     /* CONFIG_WEATHER_SCREEN_REFRESH_RATE_MS */
+
+typedef struct sim_options {
+    uint32_t seed;
+    double hours;
+    sim_faults_t faults;
+    bool verbose;           /* Driver error logs */
+    const char *record;     /* Sensor trace output */
+} sim_options_t;
+
+typedef struct sensor_result {
+    uint32_t reads;
+    uint32_t errors;
+    uint32_t wrong;         /* Read succeeded with a value other than the one simulated */
+    int64_t total_us;
+    int64_t max_us;
+} sensor_result_t;
+
+static sim_aht20_t aht20_model;
+static sim_bmp280_t bmp280_model;
+static sim_ssd1306_t panel_model;
+
+static uint8_t frame_i1[PANEL_HOR_RES * PANEL_VER_RES / 8];
+static uint8_t frame_pages[PANEL_HOR_RES * PANEL_VER_RES / 8];
+
+/* For sensor_trace.c; there is no memory report on the host */
+void memory_account(const char *subsystem, const char *name, size_t size)
+{
+}
+
+/* Deterministic weather: a daily temperature cycle and a slow pressure wave */
+static void weather_at(int64_t t_us, float *temperature, float *humidity, float *pressure)
+{
+    double day = t_us / 86400e6;
+
+    *temperature = 12 + 8 * sin(2 * M_PI * (day - 0.375));
+    *humidity = 60 - 25 * sin(2 * M_PI * (day - 0.375));
+    *pressure = 101325 + 1500 * sin(2 * M_PI * day / 3.7);
+}
+
+static void account(sensor_result_t *res, int64_t start_us, esp_err_t rc, bool ok)
+{
+    int64_t duration_us = esp_timer_get_time() - start_us;
+
+    res->reads++;
+    res->errors += rc != ESP_OK;
+    res->wrong += rc == ESP_OK && !ok;
+    res->total_us += duration_us;
+    if (duration_us > res->max_us) res->max_us = duration_us;
+}
+
+/* Command transaction of the panel IO: control byte 0x00, command, parameters */
+static esp_err_t panel_tx_param(i2c_master_dev_handle_t panel, uint8_t cmd, const uint8_t *param, size_t len)
+{
+    uint8_t ctrl = 0x00;
+    i2c_master_transmit_multi_buffer_info_t bufs[3] = {
+        { &ctrl, 1 },
+        { &cmd, 1 },
+        { (uint8_t *) param, len },
+    };
+
+    return i2c_master_multi_buffer_transmit(panel, bufs, param ? 3 : 2, PANEL_TIMEOUT_MS);
+}
+
+/* Same sequence as esp_lcd_panel_draw_bitmap() of the SSD1306 driver */
+static esp_err_t panel_draw_bitmap(i2c_master_dev_handle_t panel, int x_start, int y_start, int x_end, int y_end,
+                                   const uint8_t *data)
+{
+    uint8_t cols[2] = { x_start, x_end - 1 };
+    uint8_t pages[2] = { y_start / 8, (y_end - 1) / 8 };
+    uint8_t ctrl = 0x40;
+    i2c_master_transmit_multi_buffer_info_t bufs[2] = {
+        { &ctrl, 1 },
+        { (uint8_t *) data, (x_end - x_start) * (y_end - y_start) / 8 },
+    };
+    esp_err_t rc;
+
+    if ((rc = panel_tx_param(panel, 0x21, cols, 2)) != ESP_OK) return rc;
+    if ((rc = panel_tx_param(panel, 0x22, pages, 2)) != ESP_OK) return rc;
+
+    return i2c_master_multi_buffer_transmit(panel, bufs, 2, PANEL_TIMEOUT_MS);
+}
+
+static esp_err_t panel_init(i2c_master_dev_handle_t panel)
+{
+    static const uint8_t seq[][3] = {
+        /* cmd, number of parameters, parameter */
+        { 0xAE, 0, 0 },     /* Display off */
+        { 0x20, 1, 0x00 },  /* Horizontal addressing */
+        { 0xA8, 1, 0x3F },  /* 64 rows */
+        { 0x8D, 1, 0x14 },  /* Charge pump on */
+        { 0xA1, 0, 0 },     /* Segment remap */
+        { 0xC8, 0, 0 },     /* COM scan reversed */
+        { 0xAF, 0, 0 },     /* Display on */
+    };
+    esp_err_t rc;
+
+    for (size_t i = 0; i < sizeof(seq) / sizeof(seq[0]); i++) {
+        rc = panel_tx_param(panel, seq[i][0], seq[i][1] ? &seq[i][2] : NULL, seq[i][1]);
+        if (rc != ESP_OK) return rc;
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t panel_send(i2c_master_dev_handle_t panel, const screen_cmd_t *cmds, size_t count)
+{
+    esp_err_t rc = ESP_OK;
+
+    for (size_t i = 0; i < count && rc == ESP_OK; i++) {
+        rc = panel_tx_param(panel, cmds[i].cmd, cmds[i].len ? cmds[i].params : NULL, cmds[i].len);
+    }
+
+    return rc;
+}
+
+/*
+ * Sends each effect as screen.c does and checks the model's state, and that
+ * none of them touched the GDDRAM. Prints the bus cost next to a frame's.
+ */
+static bool check_effects(i2c_master_dev_handle_t panel)
+{
+    screen_cmd_t contrast, invert, line, stop, scroll[SCREEN_CMD_SCROLL_CMDS];
+    uint32_t data_bytes = panel_model.data_bytes;
+    size_t n = screen_cmd_scroll(scroll, true, 2, 5, SCREEN_SCROLL_2_FRAMES);
+    bool ok = true;
+
+    screen_cmd_contrast(&contrast, SCREEN_CONTRAST_DIM);
+    screen_cmd_invert(&invert, true);
+    screen_cmd_start_line(&line, 40);
+    screen_cmd_scroll_stop(&stop);
+
+    ok &= panel_send(panel, &contrast, 1) == ESP_OK && panel_model.contrast == SCREEN_CONTRAST_DIM;
+    ok &= panel_send(panel, &invert, 1) == ESP_OK && panel_model.inverted;
+    ok &= panel_send(panel, &line, 1) == ESP_OK && panel_model.start_line == 40;
+    ok &= panel_send(panel, scroll, n) == ESP_OK && panel_model.scrolling && panel_model.scroll_left &&
+          panel_model.scroll_first == 2 && panel_model.scroll_last == 5 &&
+          panel_model.scroll_interval == SCREEN_SCROLL_2_FRAMES;
+    ok &= panel_send(panel, &stop, 1) == ESP_OK && !panel_model.scrolling;
+
+    /* Back to the state of the bring-up */
+    screen_cmd_contrast(&contrast, SCREEN_CONTRAST_NORMAL);
+    screen_cmd_invert(&invert, false);
+    screen_cmd_start_line(&line, 0);
+    ok &= panel_send(panel, &contrast, 1) == ESP_OK && panel_send(panel, &invert, 1) == ESP_OK &&
+          panel_send(panel, &line, 1) == ESP_OK;
+
+    ok &= panel_model.data_bytes == data_bytes && panel_model.unknown_commands == 0;
+
+    printf("effects: contrast %zu B, invert %zu B, start line %zu B, scroll %zu B + stop %zu B; frame %d B%s\n",
+           screen_cmd_bus_bytes(&contrast, 1), screen_cmd_bus_bytes(&invert, 1), screen_cmd_bus_bytes(&line, 1),
+           screen_cmd_bus_bytes(scroll, n), screen_cmd_bus_bytes(&stop, 1), PANEL_FRAME_BUS_BYTES,
+           ok ? "" : ", MODEL MISMATCH");
+
+    return ok;
+}
+
+/* A frame whose content changes every second, as the clock label does */
+static void render(uint32_t n)
+{
+    uint32_t x = 0x9E3779B9u ^ n;
+
+    for (size_t i = 0; i < sizeof(frame_i1); i++) {
+        x = x * 1664525 + 1013904223;
+        frame_i1[i] = x >> 24;
+    }
+}
+
+static bool frame_matches(void)
+{
+    return memcmp(panel_model.gddram, frame_pages, sizeof(frame_pages)) == 0;
+}
+
+/* Writes out what the firmware's trace capture buffered so far */
+static int drain_trace(FILE *f)
+{
+    uint8_t chunk[256];
+    size_t n;
+
+    while ((n = sensor_trace_read(chunk, sizeof(chunk))) > 0) {
+        if (fwrite(chunk, 1, n, f) != n) return -1;
+    }
+
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [--hours H] [--seed N] [--latency-us US] [--nack PERMILLE] [--timeout PERMILLE]\n"
+                    "          [--corrupt PERMILLE] [--record TRACE] [--verbose 1]\n", prog);
+}
+
+static int parse_options(int argc, char **argv, sim_options_t *opt)
+{
+    for (int i = 1; i < argc; i++) {
+        const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (val == NULL) return -1;
+
+        if (strcmp(argv[i], "--hours") == 0) opt->hours = strtod(val, NULL);
+        else if (strcmp(argv[i], "--seed") == 0) opt->seed = strtoul(val, NULL, 0);
+        else if (strcmp(argv[i], "--latency-us") == 0) opt->faults.latency_us = strtoul(val, NULL, 0);
+        else if (strcmp(argv[i], "--nack") == 0) opt->faults.nack_permille = strtoul(val, NULL, 0);
+        else if (strcmp(argv[i], "--timeout") == 0) opt->faults.timeout_permille = strtoul(val, NULL, 0);
+        else if (strcmp(argv[i], "--corrupt") == 0) opt->faults.corrupt_permille = strtoul(val, NULL, 0);
+        else if (strcmp(argv[i], "--verbose") == 0) opt->verbose = strtoul(val, NULL, 0);
+        else if (strcmp(argv[i], "--record") == 0) opt->record = val;
+        else return -1;
+
+        i++;
+    }
+
+    return opt->hours > 0 ? 0 : -1;
+}
+
+static void print_result(const char *name, const sensor_result_t *res, uint16_t addr, i2c_master_bus_handle_t bus)
+{
+    sim_device_stats_t st;
+
+    sim_i2c_get_stats(bus, addr, &st);
+
+    printf("%-8s %8u reads %6u errors %6u wrong, avg %6lld us, max %7lld us | bus: %u nacks, %u timeouts, %u corrupted\n",
+           name, res->reads, res->errors, res->wrong, res->reads ? (long long) (res->total_us / res->reads) : 0,
+           (long long) res->max_us, st.nacks, st.timeouts, st.corruptions);
+}
+
+int main(int argc, char **argv)
+{
+    sim_options_t opt = { .seed = 1, .hours = 24 };
+    i2c_master_bus_handle_t bus;
+    aht20_dev_handle_t aht20 = NULL;
+    bmp280_handle_t bmp280 = NULL;
+    i2c_master_dev_handle_t panel = NULL;
+    sensor_result_t aht20_res = { 0 }, bmp280_res = { 0 }, panel_res = { 0 };
+    bmp280_config_t bmp280_cfg = I2C_BMP280_CONFIG_DEFAULT;
+    i2c_aht20_config_t aht20_cfg = {
+        .i2c_config.device_address = AHT20_ADDRESS_0,
+        .i2c_config.scl_speed_hz = 100000,
+        .i2c_timeout = 100,
+    };
+    i2c_device_config_t panel_cfg = {
+        .device_address = PANEL_ADDR,
+        .scl_speed_hz = 400000,
+    };
+    struct timespec wall_start, wall_end;
+    FILE *trace = NULL;
+    int64_t end_us, next_sensor_us, next_frame_us;
+    uint32_t frame_no = 0;
+
+    if (parse_options(argc, argv, &opt) != 0) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    esp_log_level_set("*", opt.verbose ? ESP_LOG_WARN : ESP_LOG_NONE);
+
+    bus = sim_i2c_bus_new(opt.seed);
+    sim_aht20_init(&aht20_model);
+    sim_bmp280_init(&bmp280_model);
+    sim_ssd1306_init(&panel_model);
+    ESP_ERROR_CHECK(sim_aht20_attach(&aht20_model, bus, AHT20_ADDRESS_0));
+    ESP_ERROR_CHECK(sim_bmp280_attach(&bmp280_model, bus, bmp280_cfg.i2c_address));
+    ESP_ERROR_CHECK(sim_ssd1306_attach(&panel_model, bus, PANEL_ADDR));
+
+    if (opt.record != NULL) {
+        trace = fopen(opt.record, "wb");
+        if (trace == NULL) {
+            perror(opt.record);
+            return 2;
+        }
+
+        /* The capture sees the reads as the I2C tracer does on the device */
+        sim_i2c_set_read_observer(bus, sensor_trace_capture);
+    }
+
+    /* Faults start after the bring-up, which the firmware does not retry */
+    ESP_ERROR_CHECK(aht20_new_sensor(bus, &aht20_cfg, &aht20));
+    ESP_ERROR_CHECK(bmp280_init(bus, &bmp280_cfg, &bmp280));
+    ESP_ERROR_CHECK(i2c_master_bus_add_device(bus, &panel_cfg, &panel));
+    ESP_ERROR_CHECK(panel_init(panel));
+
+    if (!check_effects(panel)) {
+        fprintf(stderr, "panel effects differ from the model's state\n");
+        return 1;
+    }
+
+    ESP_ERROR_CHECK(sim_i2c_set_faults(bus, AHT20_ADDRESS_0, &opt.faults));
+    ESP_ERROR_CHECK(sim_i2c_set_faults(bus, bmp280_cfg.i2c_address, &opt.faults));
+    ESP_ERROR_CHECK(sim_i2c_set_faults(bus, PANEL_ADDR, &opt.faults));
+
+    if (trace) sensor_trace_start();
+
+    clock_gettime(CLOCK_MONOTONIC, &wall_start);
+
+    next_sensor_us = next_frame_us = esp_timer_get_time();
+    end_us = next_sensor_us + (int64_t) (opt.hours * 3600e6);
+
+    while (esp_timer_get_time() < end_us) {
+        int64_t now = esp_timer_get_time();
+        int64_t next = next_sensor_us < next_frame_us ? next_sensor_us : next_frame_us;
+        float t, h, p, rt, rh, rp;
+        int64_t start;
+        esp_err_t rc;
+
+        if (now < next) {
+            host_time_advance_us(next - now);
+            continue;
+        }
+
+        if (now >= next_sensor_us) {
+            weather_at(now, &t, &h, &p);
+            sim_aht20_set(&aht20_model, t, h);
+            sim_bmp280_set(&bmp280_model, t, p);
+
+            start = esp_timer_get_time();
+            rc = aht20_read_float(aht20, &rt, &rh);
+            account(&aht20_res, start, rc, fabsf(rt - t) < 0.01f && fabsf(rh - h) < 0.01f);
+
+            start = esp_timer_get_time();
+            rc = bmp280_get_measurements(bmp280, &rt, &rp);
+            account(&bmp280_res, start, rc, fabsf(rt - t) < 0.02f && fabsf(rp - p) < 2.0f);
+
+            next_sensor_us += SENSOR_PERIOD_US;
+
+            if (trace && drain_trace(trace) != 0) {
+                perror(opt.record);
+                return 2;
+            }
+        }
+
+        if (now >= next_frame_us) {
+            render(frame_no++);
+            screen_conv_i1_to_pages(frame_i1, PANEL_HOR_RES, 0, 0, PANEL_HOR_RES - 1, PANEL_VER_RES - 1, frame_pages);
+
+            start = esp_timer_get_time();
+            rc = panel_draw_bitmap(panel, 0, 0, PANEL_HOR_RES, PANEL_VER_RES, frame_pages);
+            account(&panel_res, start, rc, frame_matches());
+
+            next_frame_us += FRAME_PERIOD_US;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &wall_end);
+
+    if (trace) {
+        sensor_trace_status_t status;
+
+        sensor_trace_get_status(&status);
+        if (drain_trace(trace) != 0 || fclose(trace) != 0) {
+            perror(opt.record);
+            return 2;
+        }
+        printf("trace: %u records, %u dropped, written to %s\n", status.records, status.dropped, opt.record);
+    }
+
+    double wall_s = (wall_end.tv_sec - wall_start.tv_sec) + (wall_end.tv_nsec - wall_start.tv_nsec) / 1e9;
+
+    printf("%.1f h simulated in %.2f s (%.0fx real time), seed %u\n", opt.hours, wall_s,
+           wall_s > 0 ? opt.hours * 3600 / wall_s : 0, opt.seed);
+    print_result("aht20", &aht20_res, AHT20_ADDRESS_0, bus);
+    print_result("bmp280", &bmp280_res, bmp280_cfg.i2c_address, bus);
+    print_result("ssd1306", &panel_res, PANEL_ADDR, bus);
+
+    /* Without injected corruption every successful read must return the simulated value */
+    if (opt.faults.corrupt_permille == 0 && aht20_res.wrong + bmp280_res.wrong + panel_res.wrong != 0) {
+        fprintf(stderr, "values read back differ from the simulated ones\n");
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,176 @@
+#include <string.h>
+
+#include "sim_ssd1306.h"
+
+#define CTRL_CO 0x80
+#define CTRL_DC 0x40
+
+/* Parameter bytes following each command byte */
+static uint8_t params_of(uint8_t cmd)
+{
+    switch (cmd) {
+        case 0x20:                          /* Memory addressing mode */
+        case 0x81:                          /* Contrast */
+        case 0x8D:                          /* Charge pump */
+        case 0xA8:                          /* Multiplex ratio */
+        case 0xD3:                          /* Display offset */
+        case 0xD5:                          /* Clock divide */
+        case 0xD9:                          /* Pre-charge period */
+        case 0xDA:                          /* COM pins */
+        case 0xDB:                          /* VCOMH deselect level */
+            return 1;
+        case 0x21:                          /* Column range */
+        case 0x22:                          /* Page range */
+        case 0xA3:                          /* Vertical scroll area */
+            return 2;
+        case 0x29:
+        case 0x2A:                          /* Vertical and horizontal scroll */
+            return 5;
+        case 0x26:
+        case 0x27:                          /* Horizontal scroll */
+            return 6;
+        default:
+            return 0;
+    }
+}
+
+static bool known(uint8_t cmd)
+{
+    return params_of(cmd) != 0 || cmd <= 0x1F || (cmd >= 0x40 && cmd <= 0x7F) || (cmd >= 0xB0 && cmd <= 0xB7) ||
+           cmd == 0x2E || cmd == 0x2F || cmd == 0xA0 || cmd == 0xA1 || cmd == 0xA4 || cmd == 0xA5 ||
+           cmd == 0xA6 || cmd == 0xA7 || cmd == 0xAE || cmd == 0xAF || cmd == 0xC0 || cmd == 0xC8 || cmd == 0xE3;
+}
+
+static void execute(sim_ssd1306_t *dev)
+{
+    const uint8_t *c = dev->cmd;
+
+    dev->commands++;
+
+    if (!known(c[0])) {
+        dev->unknown_commands++;
+        return;
+    }
+
+    switch (c[0]) {
+        case 0x20: dev->addr_mode = c[1] & 3; return;
+        case 0x21:
+            dev->col_start = dev->col = c[1] & 0x7F;
+            dev->col_end = c[2] & 0x7F;
+            return;
+        case 0x22:
+            dev->page_start = dev->page = c[1] & 7;
+            dev->page_end = c[2] & 7;
+            return;
+        case 0x81: dev->contrast = c[1]; return;
+        case 0x2E: dev->scrolling = false; return;
+        case 0x2F: dev->scrolling = true; return;
+        case 0x26:
+        case 0x27:
+            dev->scroll_left = c[0] == 0x27;
+            dev->scroll_first = c[2] & 7;
+            dev->scroll_interval = c[3] & 7;
+            dev->scroll_last = c[4] & 7;
+            return;
+        case 0xA6: dev->inverted = false; return;
+        case 0xA7: dev->inverted = true; return;
+        case 0xAE: dev->display_on = false; return;
+        case 0xAF: dev->display_on = true; return;
+        default: break;
+    }
+
+    if (c[0] <= 0x0F) {
+        dev->col = (dev->col & 0xF0) | c[0];            /* Page mode lower column nibble */
+    } else if (c[0] <= 0x1F) {
+        dev->col = ((c[0] & 7) << 4) | (dev->col & 0x0F);
+    } else if (c[0] >= 0x40 && c[0] <= 0x7F) {
+        dev->start_line = c[0] & 0x3F;
+    } else if (c[0] >= 0xB0 && c[0] <= 0xB7) {
+        dev->page = c[0] & 7;
+    }
+}
+
+static void command_byte(sim_ssd1306_t *dev, uint8_t byte)
+{
+    if (dev->cmd_len == 0) dev->cmd_need = params_of(byte);
+
+    dev->cmd[dev->cmd_len++] = byte;
+
+    if (dev->cmd_len > dev->cmd_need) {
+        execute(dev);
+        dev->cmd_len = 0;
+    }
+}
+
+static void data_byte(sim_ssd1306_t *dev, uint8_t byte)
+{
+    dev->gddram[dev->page & 7][dev->col & 0x7F] = byte;
+    dev->data_bytes++;
+
+    switch (dev->addr_mode) {
+        case 0:     /* Horizontal */
+            if (dev->col++ >= dev->col_end) {
+                dev->col = dev->col_start;
+                dev->page = dev->page >= dev->page_end ? dev->page_start : dev->page + 1;
+            }
+            break;
+        case 1:     /* Vertical */
+            if (dev->page++ >= dev->page_end) {
+                dev->page = dev->page_start;
+                dev->col = dev->col >= dev->col_end ? dev->col_start : dev->col + 1;
+            }
+            break;
+        default:    /* Page, the column wraps within the page */
+            dev->col = (dev->col + 1) & 0x7F;
+            break;
+    }
+}
+
+static void ssd1306_write(void *ctx, const uint8_t *data, size_t len)
+{
+    sim_ssd1306_t *dev = ctx;
+    size_t i = 0;
+
+    while (i < len) {
+        uint8_t ctrl = data[i++];
+        /* With Co set a single byte follows, then another control byte */
+        size_t end = ctrl & CTRL_CO ? (i < len ? i + 1 : i) : len;
+
+        for (; i < end; i++) {
+            if (ctrl & CTRL_DC) data_byte(dev, data[i]);
+            else command_byte(dev, data[i]);
+        }
+    }
+}
+
+static void ssd1306_read(void *ctx, uint8_t *data, size_t len)
+{
+    sim_ssd1306_t *dev = ctx;
+
+    /* Status byte: bit 6 is set while the display is off */
+    memset(data, dev->display_on ? 0x00 : 0x40, len);
+}
+
+static const sim_device_ops_t ssd1306_ops = {
+    .write = ssd1306_write,
+    .read = ssd1306_read,
+};
+
+void sim_ssd1306_init(sim_ssd1306_t *dev)
+{
+    memset(dev, 0, sizeof(*dev));
+    dev->contrast = 0x7F;
+    dev->addr_mode = 2;
+    dev->col_end = SIM_SSD1306_WIDTH - 1;
+    dev->page_end = SIM_SSD1306_PAGES - 1;
+}
+
+esp_err_t sim_ssd1306_attach(sim_ssd1306_t *dev, i2c_master_bus_handle_t bus, uint16_t addr)
+{
+    return sim_i2c_attach(bus, addr, &ssd1306_ops, dev);
+}
+
+bool sim_ssd1306_pixel(const sim_ssd1306_t *dev, unsigned int x, unsigned int y)
+{
+    return dev->gddram[(y >> 3) & 7][x & 0x7F] & (1 << (y & 7));
+}
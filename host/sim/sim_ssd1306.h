@@ -0,0 +1,48 @@
+#ifndef SIM_SSD1306_H
+#define SIM_SSD1306_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+
+#include "sim_i2c.h"
+
+/*
+ * SSD1306 model: parses the control byte protocol (Co and D/C bits), the
+ * fundamental, addressing, scrolling and hardware configuration commands,
+ * and captures data writes into the 128x64 GDDRAM following the page,
+ * horizontal or vertical addressing mode.
+ */
+
+#define SIM_SSD1306_WIDTH 128
+#define SIM_SSD1306_PAGES 8
+
+typedef struct sim_ssd1306 {
+    uint8_t gddram[SIM_SSD1306_PAGES][SIM_SSD1306_WIDTH];
+    bool display_on;
+    bool inverted;
+    bool scrolling;
+    uint8_t contrast;
+    uint8_t start_line;
+    bool scroll_left;           /* Horizontal scroll setup */
+    uint8_t scroll_first, scroll_last, scroll_interval;
+    uint8_t addr_mode;          /* 0 horizontal, 1 vertical, 2 page */
+    uint32_t data_bytes;        /* Written to GDDRAM */
+    uint32_t commands;
+    uint32_t unknown_commands;
+    /* Internal */
+    uint8_t col, page;
+    uint8_t col_start, col_end, page_start, page_end;
+    uint8_t cmd[8];
+    uint8_t cmd_len;
+    uint8_t cmd_need;
+} sim_ssd1306_t;
+
+void sim_ssd1306_init(sim_ssd1306_t *dev);
+esp_err_t sim_ssd1306_attach(sim_ssd1306_t *dev, i2c_master_bus_handle_t bus, uint16_t addr);
+
+/* GDDRAM bit of the pixel, before any remapping or inversion */
+bool sim_ssd1306_pixel(const sim_ssd1306_t *dev, unsigned int x, unsigned int y);
+
+#endif
@@ -0,0 +1,214 @@
+/*
+ * Decodes the binary telemetry stream of CONFIG_STATION_TELEMETRY, read
+ * from a capture file, a serial device or stdin, into one line per message.
+ * Anything between frames that is not one, e.g. console text on the same
+ * port or a frame cut by a dropped byte, is skipped and counted; gaps in
+ * the sequence numbers count the frames the device dropped. Frames of
+ * another TELEMETRY_VERSION, such as version 1 captures with their 32-bit
+ * time, count as invalid.
+ *
+ * With --csv the columns after time, type and sequence number depend on the
+ * type: sensor, ok, temperature, humidity, pressure and read time for
+ * samples; uptime, free heap, minimum free heap, frames sent and dropped
+ * for health; sensor, reads, errors, last and max read time for metrics.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "telemetry_frame.h"
+
+typedef struct decode_options {
+    const char *input;
+    bool csv;
+} decode_options_t;
+
+typedef struct decode_stats {
+    uint32_t frames;
+    uint32_t unknown;       /* Valid frames of a type this decoder does not know */
+    uint32_t invalid;       /* Chunks between delimiters that are not a frame */
+    uint64_t skipped_bytes;
+    uint32_t lost;          /* Sequence number gaps */
+    bool have_seq;
+    uint16_t next_seq;
+} decode_stats_t;
+
+static const char *sensor_name(uint8_t sensor)
+{
+    switch (sensor) {
+        case 0: return "aht20";
+        case 1: return "bmp280";
+        default: return "unknown";
+    }
+}
+
+static void print_sample(const decode_options_t *opt, const telemetry_header_t *hdr, const telemetry_sample_t *s)
+{
+    if (opt->csv) {
+        printf("%.3f,sample,%u,%s,%d,%.2f,%.2f,%.2f,%u\n", hdr->time_ms / 1e3, hdr->seq, sensor_name(s->sensor),
+               s->flags & TELEMETRY_SAMPLE_OK ? 1 : 0, s->temperature, s->humidity, s->pressure, s->read_us);
+        return;
+    }
+
+    printf("%10.3f #%-5u sample  %-6s", hdr->time_ms / 1e3, hdr->seq, sensor_name(s->sensor));
+
+    if (!(s->flags & TELEMETRY_SAMPLE_OK)) {
+        printf(" read failed");
+    } else {
+        if (!isnan(s->temperature)) printf(" %.2f °C", s->temperature);
+        if (!isnan(s->humidity)) printf(" %.2f %%", s->humidity);
+        if (!isnan(s->pressure)) printf(" %.2f hPa", s->pressure);
+    }
+
+    printf(" (%u us)\n", s->read_us);
+}
+
+static void print_health(const decode_options_t *opt, const telemetry_header_t *hdr, const telemetry_health_t *h)
+{
+    if (opt->csv) {
+        printf("%.3f,health,%u,%u,%u,%u,%u,%u\n", hdr->time_ms / 1e3, hdr->seq, h->uptime_s, h->heap_free,
+               h->heap_min_free, h->frames_sent, h->frames_dropped);
+        return;
+    }
+
+    printf("%10.3f #%-5u health  up %u s, heap %u B free (min %u), %u frames sent, %u dropped\n",
+           hdr->time_ms / 1e3, hdr->seq, h->uptime_s, h->heap_free, h->heap_min_free, h->frames_sent,
+           h->frames_dropped);
+}
+
+static void print_metrics(const decode_options_t *opt, const telemetry_header_t *hdr, const telemetry_metrics_t *m)
+{
+    for (int i = 0; i < TELEMETRY_METRICS_SENSORS; i++) {
+        if (opt->csv) {
+            printf("%.3f,metrics,%u,%s,%u,%u,%u,%u\n", hdr->time_ms / 1e3, hdr->seq, sensor_name(i),
+                   m->sensor[i].reads, m->sensor[i].errors, m->sensor[i].last_us, m->sensor[i].max_us);
+        } else {
+            printf("%10.3f #%-5u metrics %-6s %u reads, %u errors, last %u us, max %u us\n", hdr->time_ms / 1e3,
+                   hdr->seq, sensor_name(i), m->sensor[i].reads, m->sensor[i].errors, m->sensor[i].last_us,
+                   m->sensor[i].max_us);
+        }
+    }
+}
+
+static void handle_chunk(const decode_options_t *opt, decode_stats_t *st, const uint8_t *chunk, size_t len)
+{
+    uint8_t payload[TELEMETRY_PAYLOAD_MAX];
+    telemetry_header_t hdr;
+    size_t payload_len;
+    bool ok;
+
+    if (len == 0) return;
+
+    if (!telemetry_frame_decode(chunk, len, &hdr, payload, &payload_len)) {
+        st->invalid++;
+        st->skipped_bytes += len;
+        return;
+    }
+
+    if (st->have_seq && hdr.seq != st->next_seq) st->lost += (uint16_t) (hdr.seq - st->next_seq);
+    st->have_seq = true;
+    st->next_seq = hdr.seq + 1;
+    st->frames++;
+
+    switch (hdr.type) {
+        case TELEMETRY_SAMPLE: {
+            telemetry_sample_t sample;
+
+            ok = telemetry_sample_unpack(payload, payload_len, &sample);
+            if (ok) print_sample(opt, &hdr, &sample);
+            break;
+        }
+        case TELEMETRY_HEALTH: {
+            telemetry_health_t health;
+
+            ok = telemetry_health_unpack(payload, payload_len, &health);
+            if (ok) print_health(opt, &hdr, &health);
+            break;
+        }
+        case TELEMETRY_METRICS: {
+            telemetry_metrics_t metrics;
+
+            ok = telemetry_metrics_unpack(payload, payload_len, &metrics);
+            if (ok) print_metrics(opt, &hdr, &metrics);
+            break;
+        }
+        default:
+            ok = false;
+            break;
+    }
+
+    if (!ok) st->unknown++;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [--csv] [INPUT]\n"
+                    "INPUT is a capture file or serial device, stdin by default\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    decode_options_t opt = { 0 };
+    decode_stats_t st = { 0 };
+    /* Longer chunks cannot be frames; only their length is kept */
+    uint8_t chunk[TELEMETRY_FRAME_MAX];
+    size_t len = 0;
+    uint64_t total = 0;
+    FILE *in = stdin;
+    int c;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--csv") == 0) {
+            opt.csv = true;
+        } else if (argv[i][0] != '-' && opt.input == NULL) {
+            opt.input = argv[i];
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (opt.input) {
+        in = fopen(opt.input, "rb");
+        if (in == NULL) {
+            perror(opt.input);
+            return 2;
+        }
+    }
+
+    while ((c = getc(in)) != EOF) {
+        total++;
+
+        if (c != 0) {
+            if (len < sizeof(chunk)) {
+                chunk[len] = c;
+            }
+            len++;
+            continue;
+        }
+
+        if (len > sizeof(chunk)) {
+            st.invalid++;
+            st.skipped_bytes += len;
+        } else {
+            handle_chunk(&opt, &st, chunk, len);
+        }
+        len = 0;
+    }
+
+    /* A chunk still open at the end is a frame cut short */
+    if (len > 0) {
+        st.invalid++;
+        st.skipped_bytes += len;
+    }
+
+    if (in != stdin) fclose(in);
+    fflush(stdout);
+
+    fprintf(stderr, "%u frames (%u of unknown type), %u lost, %u invalid chunks, %llu of %llu bytes skipped\n",
+            st.frames, st.unknown, st.lost, st.invalid, (unsigned long long) st.skipped_bytes,
+            (unsigned long long) total);
+
+    return 0;
+}
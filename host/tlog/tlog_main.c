@@ -0,0 +1,372 @@
+/*
+ * Turns the "L:" lines of the tokenized logging (main/tlog.h) back into log
+ * lines, using the firmware ELF for the format strings, the tags and the %s
+ * arguments. The other lines of the monitor log are copied unchanged, so
+ * the output reads like the log without CONFIG_STATION_TLOG:
+ *
+ *   station_tlog build/station.elf monitor.log
+ *   idf.py monitor | station_tlog build/station.elf -
+ *
+ * Each record is the format string's address in the .tlog_fmt section, the
+ * level and argument count, the low 32 bits of esp_timer in us, the tag's
+ * address and one 32-bit word per argument, little endian.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+
+#define TLOG_HEADER_WORDS   4
+#define TLOG_ARGS_MAX       8
+#define TLOG_SECTION        ".tlog_fmt"
+
+#define SHF_ALLOC           0x2
+#define SHT_NOBITS          8
+
+typedef struct section {
+    uint64_t addr;
+    uint64_t offset;
+    uint64_t size;
+    bool loaded;                /* Has contents in the image */
+} section_t;
+
+typedef struct elf {
+    uint8_t *data;
+    size_t size;
+    section_t *sections;
+    size_t n_sections;
+    const section_t *formats;
+} elf_t;
+
+typedef struct decoder {
+    const elf_t *elf;
+    uint64_t time_us;           /* Unwrapped from the 32-bit record times */
+    uint32_t last_time;
+    bool started;
+    unsigned long records;
+    unsigned long unknown;
+} decoder_t;
+
+static uint64_t get(const uint8_t *p, size_t len)
+{
+    uint64_t v = 0;
+
+    for (size_t i = len; i-- > 0;) v = v << 8 | p[i];
+
+    return v;
+}
+
+static int load_elf(const char *path, elf_t *elf)
+{
+    FILE *f = fopen(path, "rb");
+    const uint8_t *h;
+    uint64_t shoff;
+    size_t shentsize, shnum, shstrndx;
+    bool is64;
+
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    fseek(f, 0, SEEK_END);
+    elf->size = ftell(f);
+    rewind(f);
+    elf->data = malloc(elf->size);
+    if (elf->data == NULL || fread(elf->data, 1, elf->size, f) != elf->size) {
+        fprintf(stderr, "%s: read failed\n", path);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+
+    h = elf->data;
+    if (elf->size < 52 || memcmp(h, "\x7f" "ELF", 4) != 0 || h[5] != 1) {
+        fprintf(stderr, "%s: not a little-endian ELF file\n", path);
+        return -1;
+    }
+
+    is64 = h[4] == 2;
+    shoff = is64 ? get(h + 0x28, 8) : get(h + 0x20, 4);
+    shentsize = get(h + (is64 ? 0x3A : 0x2E), 2);
+    shnum = get(h + (is64 ? 0x3C : 0x30), 2);
+    shstrndx = get(h + (is64 ? 0x3E : 0x32), 2);
+
+    if (shoff + shnum * shentsize > elf->size || shstrndx >= shnum) {
+        fprintf(stderr, "%s: truncated section headers\n", path);
+        return -1;
+    }
+
+    elf->sections = calloc(shnum, sizeof(section_t));
+    elf->n_sections = shnum;
+
+    for (size_t i = 0; i < shnum; i++) {
+        const uint8_t *s = h + shoff + i * shentsize;
+        section_t *sec = &elf->sections[i];
+        uint32_t type = get(s + 4, 4);
+        uint64_t flags = is64 ? get(s + 8, 8) : get(s + 8, 4);
+
+        sec->addr = is64 ? get(s + 0x10, 8) : get(s + 0x0C, 4);
+        sec->offset = is64 ? get(s + 0x18, 8) : get(s + 0x10, 4);
+        sec->size = is64 ? get(s + 0x20, 8) : get(s + 0x14, 4);
+        sec->loaded = (flags & SHF_ALLOC) && type != SHT_NOBITS;
+
+        if (type == SHT_NOBITS || sec->offset + sec->size > elf->size) {
+            sec->loaded = false;
+            sec->size = 0;
+        }
+    }
+
+    const section_t *strtab = &elf->sections[shstrndx];
+
+    for (size_t i = 0; i < shnum; i++) {
+        const uint8_t *s = h + shoff + i * shentsize;
+        uint32_t name = get(s, 4);
+
+        if (name < strtab->size && strcmp((const char *) h + strtab->offset + name, TLOG_SECTION) == 0) {
+            elf->formats = &elf->sections[i];
+        }
+    }
+
+    if (elf->formats == NULL) {
+        fprintf(stderr, "%s: no %s section, was it built with CONFIG_STATION_TLOG?\n", path, TLOG_SECTION);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* NUL-terminated string at `addr` of `sec`, NULL when outside */
+static const char *string_in(const elf_t *elf, const section_t *sec, uint32_t addr)
+{
+    uint64_t off;
+
+    /* Host builds have 64-bit addresses, the records keep their low half */
+    if ((uint32_t) (addr - (uint32_t) sec->addr) >= sec->size) return NULL;
+
+    off = sec->offset + (uint32_t) (addr - (uint32_t) sec->addr);
+    if (memchr(elf->data + off, 0, sec->offset + sec->size - off) == NULL) return NULL;
+
+    return (const char *) elf->data + off;
+}
+
+static const char *constant_string(const elf_t *elf, uint32_t addr)
+{
+    const char *s;
+
+    for (size_t i = 0; i < elf->n_sections; i++) {
+        if (elf->sections[i].loaded && (s = string_in(elf, &elf->sections[i], addr)) != NULL) return s;
+    }
+
+    return NULL;
+}
+
+static float word_float(uint32_t w)
+{
+    float v;
+
+    memcpy(&v, &w, sizeof(v));
+
+    return v;
+}
+
+/* printf() on the host with the arguments as the device stored them */
+static void format(const elf_t *elf, const char *fmt, const uint32_t *args, unsigned int n, char *out, size_t size)
+{
+    size_t len = 0;
+    unsigned int next = 0;
+
+#define OUT(...) do {                                                               \
+        int r = snprintf(out + len, size - len, __VA_ARGS__);                       \
+        if (r > 0) len = len + r < size ? len + r : size - 1;                       \
+    } while (0)
+
+    out[0] = '\0';
+
+    while (*fmt && len + 1 < size) {
+        char spec[32];
+        size_t k = 0;
+        char conv;
+
+        if (*fmt != '%') {
+            out[len++] = *fmt++;
+            out[len] = '\0';
+            continue;
+        }
+
+        spec[k++] = *fmt++;
+        if (*fmt == '%') {
+            OUT("%%");
+            fmt++;
+            continue;
+        }
+
+        /* Flags, width and precision are kept; '*' takes an argument like printf */
+        while (*fmt && strchr("-+ #0123456789.*", *fmt) && k < sizeof(spec) - 12) {
+            if (*fmt == '*') {
+                k += snprintf(spec + k, sizeof(spec) - k, "%d", next < n ? (int32_t) args[next] : 0);
+                next++;
+                fmt++;
+            } else {
+                spec[k++] = *fmt++;
+            }
+        }
+
+        /* Length modifiers are dropped: every argument is one word */
+        while (*fmt && strchr("hljztLq", *fmt)) fmt++;
+
+        conv = *fmt;
+        if (conv == '\0') break;
+        fmt++;
+
+        if (next >= n) {
+            OUT("<?>");
+            continue;
+        }
+
+        uint32_t w = args[next++];
+
+        switch (conv) {
+            case 'd': case 'i': case 'c':
+                spec[k++] = conv;
+                spec[k] = '\0';
+                OUT(spec, (int32_t) w);
+                break;
+            case 'u': case 'o': case 'x': case 'X':
+                spec[k++] = conv;
+                spec[k] = '\0';
+                OUT(spec, w);
+                break;
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+                spec[k++] = conv;
+                spec[k] = '\0';
+                OUT(spec, (double) word_float(w));
+                break;
+            case 's': {
+                const char *s = constant_string(elf, w);
+
+                spec[k++] = 's';
+                spec[k] = '\0';
+                if (s) {
+                    OUT(spec, s);
+                } else {
+                    OUT("<str@0x%08x>", w);
+                }
+                break;
+            }
+            case 'p':
+                OUT("0x%08x", w);
+                break;
+            default:
+                OUT("<%%%c?>", conv);
+                break;
+        }
+    }
+
+#undef OUT
+}
+
+static void decode(decoder_t *dec, const uint32_t *w, size_t n_words, FILE *out)
+{
+    static const char levels[] = "NEWIDV";
+    unsigned int level = w[1] & 0xF, n = (w[1] >> 4) & 0xF;
+    const char *fmt, *tag;
+    char text[1024];
+
+    if (n_words < TLOG_HEADER_WORDS + n) {
+        fprintf(out, "<truncated record>\n");
+        return;
+    }
+
+    dec->time_us += dec->started ? (uint32_t) (w[2] - dec->last_time) : w[2];
+    dec->last_time = w[2];
+    dec->started = true;
+    dec->records++;
+
+    if (w[0] == 0) {
+        fprintf(out, "W (%llu) tlog: %u records dropped, ring full\n", (unsigned long long) (dec->time_us / 1000),
+                n ? w[4] : 0);
+        return;
+    }
+
+    fmt = string_in(dec->elf, dec->elf->formats, w[0]);
+    tag = constant_string(dec->elf, w[3]);
+
+    if (fmt == NULL) {
+        dec->unknown++;
+        fprintf(out, "%c (%llu) %s: <unknown token 0x%08x, ELF of another build?>\n", levels[level % 6],
+                (unsigned long long) (dec->time_us / 1000), tag ? tag : "?", w[0]);
+        return;
+    }
+
+    format(dec->elf, fmt, w + TLOG_HEADER_WORDS, n, text, sizeof(text));
+    fprintf(out, "%c (%llu) %s: %s\n", levels[level % 6], (unsigned long long) (dec->time_us / 1000),
+            tag ? tag : "?", text);
+}
+
+static int hex_nibble(int c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/* The record of an "L:" line at the start of a line or after the console prompt */
+static size_t parse_line(const char *line, uint32_t *words, size_t max)
+{
+    const char *p = strstr(line, "L:");
+    uint8_t bytes[4];
+    size_t n = 0, nb = 0;
+
+    if (p == NULL || (p != line && p[-1] != '>' && p[-1] != ' ')) return 0;
+
+    for (p += 2; hex_nibble(p[0]) >= 0 && hex_nibble(p[1]) >= 0 && n < max; p += 2) {
+        bytes[nb++] = hex_nibble(p[0]) << 4 | hex_nibble(p[1]);
+        if (nb == 4) {
+            words[n++] = get(bytes, 4);
+            nb = 0;
+        }
+    }
+
+    return n;
+}
+
+int main(int argc, char **argv)
+{
+    elf_t elf = { 0 };
+    decoder_t dec = { .elf = &elf };
+    uint32_t words[TLOG_HEADER_WORDS + TLOG_ARGS_MAX];
+    char line[1024];
+    FILE *in;
+    size_t n;
+
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s FIRMWARE.elf LOG|-\n", argv[0]);
+        return 2;
+    }
+
+    if (load_elf(argv[1], &elf) != 0) return 2;
+
+    in = strcmp(argv[2], "-") == 0 ? stdin : fopen(argv[2], "r");
+    if (in == NULL) {
+        perror(argv[2]);
+        return 2;
+    }
+
+    while (fgets(line, sizeof(line), in)) {
+        if ((n = parse_line(line, words, sizeof(words) / sizeof(words[0]))) >= TLOG_HEADER_WORDS) {
+            decode(&dec, words, n, stdout);
+        } else {
+            fputs(line, stdout);
+        }
+        fflush(stdout);
+    }
+
+    if (in != stdin) fclose(in);
+
+    fprintf(stderr, "%lu records, %lu with an unknown token\n", dec.records, dec.unknown);
+
+    return dec.unknown ? 1 : 0;
+}
@@ -0,0 +1,168 @@
+/*
+ * Checks the compiled POSIX TZ rules (main/tz_rule.c) against glibc's
+ * localtime_r() under the same TZ string:
+ *
+ *   station_tz
+ *   station_tz --verbose
+ *
+ * For each rule it walks 2000 to 2040 in steps of a little under half an
+ * hour and compares the UTC offset, the DST flag and the local calendar
+ * fields. Each next_change that tz_rule reports must be an instant where
+ * glibc's offset changes, and both sides of it must agree as well.
+ * The exit code is 1 on any mismatch.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "tz_rule.h"
+
+#define SECS_PER_DAY    86400
+#define STEP_S          1799
+#define MAX_REPORTED    10
+
+static const char *const zones[] = {
+    "CET-1CEST,M3.5.0,M10.5.0/3",       /* The firmware default */
+    "EST5EDT,M3.2.0,M11.1.0",
+    "WET0WEST,M3.5.0/1,M10.5.0",
+    "AEST-10AEDT,M10.1.0,M4.1.0/3",     /* Southern, DST across the new year */
+    "NZST-12NZDT,M9.5.0,M4.1.0/3",
+    "<-03>3<-02>,M3.5.0/-2,M10.5.0/-1", /* Negative transition times */
+    "XST5XDT,J60,J300",
+    "YST5YDT,59/3,299",
+    "<+0530>-5:30",                     /* Fixed offset */
+    "UTC0",
+};
+
+static bool verbose = false;
+static unsigned int failures = 0;
+static uint64_t checks = 0;
+
+static int64_t utc(int32_t year, uint32_t month, uint32_t day)
+{
+    return (int64_t) tz_days_from_civil(year, month, day) * SECS_PER_DAY;
+}
+
+static void libc_local(int64_t t, struct tm *tm)
+{
+    time_t tt = (time_t) t;
+
+    localtime_r(&tt, tm);
+}
+
+static void fail(const char *zone, int64_t t, const char *fmt, long got, long want)
+{
+    failures++;
+
+    if (failures > MAX_REPORTED && !verbose) return;
+
+    printf("FAIL %s at %" PRId64 ": ", zone, t);
+    printf(fmt, got, want);
+    printf("\n");
+}
+
+/* Offset, DST flag and calendar fields at one instant */
+static void check_instant(const char *zone, const tz_rule_t *rule, int64_t t)
+{
+    struct tm want;
+    int64_t local, days, sod;
+    int32_t offset, year;
+    uint32_t month, mday;
+    bool is_dst;
+
+    checks++;
+
+    libc_local(t, &want);
+    offset = tz_rule_utc_offset(rule, t, NULL, &is_dst);
+
+    if (offset != want.tm_gmtoff) {
+        fail(zone, t, "offset %ld, glibc %ld", (long) offset, want.tm_gmtoff);
+        return;
+    }
+
+    if (is_dst != (want.tm_isdst > 0)) {
+        fail(zone, t, "is_dst %ld, glibc %ld", (long) is_dst, (long) (want.tm_isdst > 0));
+        return;
+    }
+
+    local = t + offset;
+    days = local / SECS_PER_DAY - (local % SECS_PER_DAY < 0);
+    sod = local - days * SECS_PER_DAY;
+    tz_civil_from_days((int32_t) days, &year, &month, &mday);
+
+    if (year - 1900 != want.tm_year || (int) month - 1 != want.tm_mon || (int) mday != want.tm_mday ||
+        sod != want.tm_hour * 3600 + want.tm_min * 60 + want.tm_sec ||
+        ((days + 4) % 7 + 7) % 7 != want.tm_wday ||
+        days - tz_days_from_civil(year, 1, 1) != want.tm_yday) {
+        fail(zone, t, "local time %ld, glibc %ld", (long) local, (long) timegm(&want));
+    }
+}
+
+static void check_zone(const char *zone, int64_t from, int64_t to)
+{
+    tz_rule_t rule;
+    struct tm before, after;
+    int64_t t, change;
+    unsigned int transitions = 0, failures_before = failures;
+
+    if (!tz_rule_parse(zone, &rule)) {
+        printf("FAIL %s: not parsed\n", zone);
+        failures++;
+        return;
+    }
+
+    setenv("TZ", zone, 1);
+    tzset();
+
+    for (t = from; t < to; t += STEP_S) {
+        check_instant(zone, &rule, t);
+    }
+
+    /* Every reported transition must be one for glibc too */
+    for (t = from; t < to; t = change) {
+        tz_rule_utc_offset(&rule, t, &change, NULL);
+        if (change == INT64_MAX) break;
+
+        checks++;
+        libc_local(change - 1, &before);
+        libc_local(change, &after);
+        if (before.tm_gmtoff == after.tm_gmtoff) {
+            fail(zone, change, "glibc offset %ld on both sides of next_change, want %ld", after.tm_gmtoff,
+                 (long) tz_rule_utc_offset(&rule, change, NULL, NULL));
+        }
+
+        check_instant(zone, &rule, change - 1);
+        check_instant(zone, &rule, change);
+
+        transitions++;
+    }
+
+    if (verbose || failures != failures_before) {
+        printf("%s %s: %u transitions\n", failures == failures_before ? "ok  " : "FAIL", zone, transitions);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int64_t from = utc(2000, 1, 1), to = utc(2040, 1, 1);
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--verbose") == 0) {
+            verbose = true;
+        } else {
+            fprintf(stderr, "usage: %s [--verbose]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    for (size_t i = 0; i < sizeof(zones) / sizeof(zones[0]); i++) {
+        check_zone(zones[i], from, to);
+    }
+
+    printf("%" PRIu64 " checks, %u failed\n", checks, failures);
+
+    return failures ? 1 : 0;
+}
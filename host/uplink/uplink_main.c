@@ -0,0 +1,491 @@
+/*
+ * Runs the firmware's uplink logic (uplink_core.c) on the virtual clock
+ * against a real MQTT broker or HTTP server, e.g. a local Mosquitto:
+ *
+ *   station_uplink --mqtt localhost:1883 --hours 48 --outage 10:6
+ *   station_uplink --http localhost:8080 --path /history --save sent.whst
+ *
+ * A synthetic sample is spooled every --sample-s seconds and a session runs
+ * every --period-s seconds, or after the backoff when one failed. Opening a
+ * session stands for the Wi-Fi association and costs --assoc-ms of virtual
+ * time; the real time spent talking to the server is added on top, so the
+ * radio-on time per batch reflects the actual round trips. During an
+ * --outage (start and duration in hours) the association times out.
+ *
+ * Every acknowledged payload is decoded again and checked: samples must
+ * arrive in order, exactly once, and everything produced must be sent,
+ * pending or counted as dropped. --save writes what was sent as one history
+ * stream for station_history.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/time.h>
+
+#include "esp_err.h"
+#include "esp_timer.h"
+
+#include "history_codec.h"
+#include "uplink_core.h"
+
+#define START_TIME 1704067200   /* 2024-01-01, the first sample's Unix time */
+
+typedef struct link {
+    char host[128];
+    char port[16];
+    bool http;
+    const char *topic;
+    const char *path;
+    uint32_t assoc_ms;
+    uint32_t timeout_ms;
+    int64_t outage_start_us;
+    int64_t outage_end_us;
+    int fd;
+    uint16_t packet_id;
+    FILE *save;
+    /* Check of the acknowledged samples */
+    uint32_t received;
+    uint32_t last_time;
+    uint32_t misordered;
+    bool verbose;
+} link_t;
+
+static struct timespec op_start;
+
+/* Real time spent on the network is charged to the virtual clock */
+static void op_begin(void)
+{
+    clock_gettime(CLOCK_MONOTONIC, &op_start);
+}
+
+static void op_end(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    host_time_advance_us((now.tv_sec - op_start.tv_sec) * 1000000LL + (now.tv_nsec - op_start.tv_nsec) / 1000);
+}
+
+static int tcp_connect(link_t *l)
+{
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+    struct addrinfo *res, *ai;
+    struct timeval tv = { .tv_sec = l->timeout_ms / 1000, .tv_usec = l->timeout_ms % 1000 * 1000 };
+    int one = 1;
+    int fd = -1;
+
+    if (getaddrinfo(l->host, l->port, &hints, &res) != 0) return -1;
+
+    for (ai = res; ai != NULL; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) continue;
+
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        /* Header and payload go out in separate writes */
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) break;
+
+        close(fd);
+        fd = -1;
+    }
+
+    freeaddrinfo(res);
+
+    return fd;
+}
+
+static bool send_all(int fd, const uint8_t *data, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+
+        if (n <= 0) return false;
+        data += n;
+        len -= n;
+    }
+
+    return true;
+}
+
+static bool recv_all(int fd, uint8_t *data, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = recv(fd, data, len, 0);
+
+        if (n <= 0) return false;
+        data += n;
+        len -= n;
+    }
+
+    return true;
+}
+
+/* MQTT 3.1.1: fixed header with the remaining length as a varint */
+static size_t mqtt_header(uint8_t *out, uint8_t type, size_t remaining)
+{
+    size_t n = 0;
+
+    out[n++] = type;
+    do {
+        out[n] = remaining & 0x7F;
+        remaining >>= 7;
+        if (remaining) out[n] |= 0x80;
+        n++;
+    } while (remaining);
+
+    return n;
+}
+
+static size_t mqtt_string(uint8_t *out, const char *s)
+{
+    size_t len = strlen(s);
+
+    out[0] = len >> 8;
+    out[1] = len;
+    memcpy(out + 2, s, len);
+
+    return len + 2;
+}
+
+static esp_err_t mqtt_connect(link_t *l)
+{
+    uint8_t body[64], packet[80], connack[4];
+    size_t n = 0, m;
+
+    n += mqtt_string(body, "MQTT");
+    body[n++] = 4;          /* Protocol level 3.1.1 */
+    body[n++] = 0x02;       /* Clean session */
+    body[n++] = 0;
+    body[n++] = 60;         /* Keep alive, s */
+    n += mqtt_string(body + n, "station-uplink");
+
+    m = mqtt_header(packet, 0x10, n);
+    memcpy(packet + m, body, n);
+
+    l->fd = tcp_connect(l);
+    if (l->fd < 0) return ESP_FAIL;
+
+    if (!send_all(l->fd, packet, m + n) || !recv_all(l->fd, connack, sizeof(connack))) return ESP_ERR_TIMEOUT;
+    if (connack[0] != 0x20 || connack[3] != 0) return ESP_ERR_INVALID_RESPONSE;
+
+    return ESP_OK;
+}
+
+/* QoS 1 publish, done once the PUBACK for its packet id came back */
+static esp_err_t mqtt_publish(link_t *l, const uint8_t *payload, size_t len)
+{
+    size_t topic_len = strlen(l->topic);
+    uint8_t header[8 + 2 + 256 + 2];
+    uint8_t puback[4];
+    size_t n;
+
+    if (topic_len > 256) return ESP_ERR_INVALID_ARG;
+
+    l->packet_id = l->packet_id == 0xFFFF ? 1 : l->packet_id + 1;
+
+    n = mqtt_header(header, 0x32, 2 + topic_len + 2 + len);
+    n += mqtt_string(header + n, l->topic);
+    header[n++] = l->packet_id >> 8;
+    header[n++] = l->packet_id;
+
+    if (!send_all(l->fd, header, n) || !send_all(l->fd, payload, len)) return ESP_FAIL;
+    if (!recv_all(l->fd, puback, sizeof(puback))) return ESP_ERR_TIMEOUT;
+    if (puback[0] != 0x40 || (puback[2] << 8 | puback[3]) != l->packet_id) return ESP_ERR_INVALID_RESPONSE;
+
+    return ESP_OK;
+}
+
+/* One connection per POST, as esp_http_client does with Connection: close */
+static esp_err_t http_post(link_t *l, const uint8_t *payload, size_t len)
+{
+    char request[512], response[64];
+    size_t got = 0;
+    ssize_t n;
+    int status = 0;
+    int fd = tcp_connect(l);
+
+    if (fd < 0) return ESP_FAIL;
+
+    snprintf(request, sizeof(request),
+             "POST %s HTTP/1.1\r\nHost: %s:%s\r\nContent-Type: application/octet-stream\r\n"
+             "Content-Length: %zu\r\nConnection: close\r\n\r\n", l->path, l->host, l->port, len);
+
+    if (!send_all(fd, (const uint8_t *) request, strlen(request)) || !send_all(fd, payload, len)) {
+        close(fd);
+        return ESP_FAIL;
+    }
+
+    while (got < sizeof(response) - 1 && (n = recv(fd, response + got, sizeof(response) - 1 - got, 0)) > 0) {
+        got += n;
+        if (memchr(response, '\n', got)) break;
+    }
+    response[got] = '\0';
+    close(fd);
+
+    if (sscanf(response, "HTTP/1.%*d %d", &status) != 1) return ESP_ERR_TIMEOUT;
+
+    return status >= 200 && status < 300 ? ESP_OK : ESP_ERR_INVALID_RESPONSE;
+}
+
+static void check_payload(link_t *l, const uint8_t *payload, size_t len)
+{
+    history_sample_t samples[HISTORY_BLOCK_SAMPLES];
+    size_t count, n;
+
+    n = history_codec_decode_block(payload + HISTORY_CODEC_HEADER_SIZE, len - HISTORY_CODEC_HEADER_SIZE, samples,
+                                   &count);
+    if (history_codec_check_header(payload, len) != HISTORY_CODEC_VERSION || n == 0) {
+        l->misordered++;
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (l->received > 0 && samples[i].time <= l->last_time) l->misordered++;
+        l->last_time = samples[i].time;
+        l->received++;
+    }
+
+    if (l->save) {
+        /* One stream: the header once, then the blocks */
+        if (ftell(l->save) == 0) fwrite(payload, 1, HISTORY_CODEC_HEADER_SIZE, l->save);
+        fwrite(payload + HISTORY_CODEC_HEADER_SIZE, 1, n, l->save);
+    }
+}
+
+static esp_err_t link_open(void *ctx)
+{
+    link_t *l = ctx;
+    int64_t now = esp_timer_get_time();
+    esp_err_t rc = ESP_OK;
+
+    if (now >= l->outage_start_us && now < l->outage_end_us) {
+        host_time_advance_us((int64_t) l->timeout_ms * 1000);
+        return ESP_ERR_TIMEOUT;
+    }
+
+    host_time_advance_us((int64_t) l->assoc_ms * 1000);
+
+    if (!l->http) {
+        op_begin();
+        rc = mqtt_connect(l);
+        op_end();
+    }
+
+    return rc;
+}
+
+static esp_err_t link_send(void *ctx, const uint8_t *payload, size_t len)
+{
+    link_t *l = ctx;
+    esp_err_t rc;
+
+    op_begin();
+    rc = l->http ? http_post(l, payload, len) : mqtt_publish(l, payload, len);
+    op_end();
+
+    if (rc == ESP_OK) check_payload(l, payload, len);
+
+    return rc;
+}
+
+static void link_close(void *ctx)
+{
+    link_t *l = ctx;
+    static const uint8_t disconnect[] = { 0xE0, 0x00 };
+
+    if (l->fd >= 0) {
+        send_all(l->fd, disconnect, sizeof(disconnect));
+        close(l->fd);
+        l->fd = -1;
+    }
+}
+
+static history_sample_t synthetic_sample(uint32_t i, uint32_t sample_s)
+{
+    double day = (double) i * sample_s / 86400;
+
+    return (history_sample_t) {
+        .time = START_TIME + i * sample_s,
+        .temperature = lround((12.0 + 6.0 * sin(2 * M_PI * day)) * 100) + (int) (i % 3) - 1,
+        .humidity = lround((60.0 - 15.0 * sin(2 * M_PI * day)) * 100),
+        .pressure = lround((1013.25 + 8.0 * sin(2 * M_PI * day / 5)) * 100),
+    };
+}
+
+static bool split_host_port(const char *arg, link_t *l)
+{
+    const char *colon = strrchr(arg, ':');
+
+    if (colon == NULL || colon == arg || (size_t) (colon - arg) >= sizeof(l->host) ||
+        strlen(colon + 1) >= sizeof(l->port)) {
+        return false;
+    }
+
+    memcpy(l->host, arg, colon - arg);
+    l->host[colon - arg] = '\0';
+    strcpy(l->port, colon + 1);
+
+    return true;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s --mqtt HOST:PORT [--topic TOPIC] | --http HOST:PORT [--path PATH]\n"
+                    "          [--hours H] [--period-s S] [--sample-s S] [--spool N] [--batch N]\n"
+                    "          [--backoff-s MIN:MAX] [--assoc-ms MS] [--timeout-ms MS] [--outage START_H:DUR_H]\n"
+                    "          [--save FILE] [--verbose]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    link_t l = { .topic = "station/history", .path = "/history", .assoc_ms = 1500, .timeout_ms = 10000, .fd = -1 };
+    uplink_config_t config = { .period_ms = 900000, .backoff_min_ms = 30000, .backoff_max_ms = 3600000 };
+    double hours = 24, outage_start = 0, outage_hours = 0;
+    uint32_t sample_s = 60, spool_size = 1440;
+    bool have_server = false;
+    const char *save_path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+        uint32_t min_s, max_s;
+
+        if (strcmp(arg, "--verbose") == 0) {
+            l.verbose = true;
+            continue;
+        }
+        if (val == NULL) {
+            usage(argv[0]);
+            return 2;
+        }
+        i++;
+
+        if (strcmp(arg, "--mqtt") == 0 || strcmp(arg, "--http") == 0) {
+            l.http = arg[2] == 'h';
+            have_server = split_host_port(val, &l);
+            if (!have_server) {
+                usage(argv[0]);
+                return 2;
+            }
+        } else if (strcmp(arg, "--topic") == 0) {
+            l.topic = val;
+        } else if (strcmp(arg, "--path") == 0) {
+            l.path = val;
+        } else if (strcmp(arg, "--hours") == 0) {
+            hours = atof(val);
+        } else if (strcmp(arg, "--period-s") == 0) {
+            config.period_ms = strtoul(val, NULL, 0) * 1000;
+        } else if (strcmp(arg, "--sample-s") == 0) {
+            sample_s = strtoul(val, NULL, 0);
+        } else if (strcmp(arg, "--spool") == 0) {
+            spool_size = strtoul(val, NULL, 0);
+        } else if (strcmp(arg, "--batch") == 0) {
+            config.batch_samples = strtoul(val, NULL, 0);
+        } else if (strcmp(arg, "--backoff-s") == 0 && sscanf(val, "%u:%u", &min_s, &max_s) == 2) {
+            config.backoff_min_ms = min_s * 1000;
+            config.backoff_max_ms = max_s * 1000;
+        } else if (strcmp(arg, "--assoc-ms") == 0) {
+            l.assoc_ms = strtoul(val, NULL, 0);
+        } else if (strcmp(arg, "--timeout-ms") == 0) {
+            l.timeout_ms = strtoul(val, NULL, 0);
+        } else if (strcmp(arg, "--outage") == 0 && sscanf(val, "%lf:%lf", &outage_start, &outage_hours) == 2) {
+            continue;
+        } else if (strcmp(arg, "--save") == 0) {
+            save_path = val;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (!have_server || hours <= 0 || sample_s == 0 || spool_size == 0 || config.period_ms == 0) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    if (save_path) {
+        l.save = fopen(save_path, "wb");
+        if (l.save == NULL) {
+            perror(save_path);
+            return 2;
+        }
+    }
+
+    history_sample_t *spool = calloc(spool_size, sizeof(*spool));
+    const uplink_transport_t transport = { .open = link_open, .send = link_send, .close = link_close, .ctx = &l };
+    uplink_t uplink;
+    uplink_stats_t stats;
+    int64_t end_us = (int64_t) (hours * 3600e6);
+    int64_t next_sample_us = 0, next_session_us = (int64_t) config.period_ms * 1000;
+    uint32_t produced = 0;
+
+    if (spool == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 2;
+    }
+
+    l.outage_start_us = (int64_t) (outage_start * 3600e6);
+    l.outage_end_us = (int64_t) ((outage_start + outage_hours) * 3600e6);
+
+    uplink_core_init(&uplink, &config, spool, spool_size);
+
+    while (next_sample_us < end_us || next_session_us < end_us) {
+        int64_t now = esp_timer_get_time();
+
+        if (next_sample_us <= next_session_us) {
+            history_sample_t sample = synthetic_sample(produced++, sample_s);
+
+            if (next_sample_us > now) host_time_advance_us(next_sample_us - now);
+            uplink_core_push(&uplink, &sample);
+            next_sample_us += (int64_t) sample_s * 1000000;
+            continue;
+        }
+
+        if (next_session_us > now) host_time_advance_us(next_session_us - now);
+
+        uint32_t delay_ms = uplink_core_session(&uplink, &transport);
+
+        uplink_core_get_stats(&uplink, &stats);
+        if (l.verbose) {
+            printf("%8.3f h  %-22s %3u batches  radio %6.0f ms  %4zu pending  next in %u s\n",
+                   next_session_us / 3600e6, stats.last_error == ESP_OK ? "ok" : esp_err_to_name(stats.last_error),
+                   stats.last_batches, stats.last_radio_on_us / 1e3, uplink_core_pending(&uplink),
+                   delay_ms / 1000);
+        }
+        /* Sessions start on the schedule; the time spent in one does not shift the next */
+        next_session_us += (int64_t) delay_ms * 1000;
+        if (next_session_us <= esp_timer_get_time()) next_session_us = esp_timer_get_time() + 1;
+    }
+
+    uplink_core_get_stats(&uplink, &stats);
+
+    printf("%.1f h, %u samples produced: %u sent in %u batches, %zu pending, %u dropped\n", hours, produced,
+           stats.samples_sent, stats.batches, uplink_core_pending(&uplink), stats.dropped);
+    printf("%u B sent (%.2f B/sample), %u sessions, %u failed\n", stats.bytes_sent,
+           stats.samples_sent ? (double) stats.bytes_sent / stats.samples_sent : 0.0, stats.sessions,
+           stats.failures);
+    printf("radio on %.1f s in total, %.0f ms per batch, %.1f ms per sample\n", stats.radio_on_us / 1e6,
+           stats.batches ? stats.radio_on_us / 1e3 / stats.batches : 0.0,
+           stats.samples_sent ? stats.radio_on_us / 1e3 / stats.samples_sent : 0.0);
+
+    if (l.save) fclose(l.save);
+    free(spool);
+
+    if (l.misordered > 0 || l.received != stats.samples_sent ||
+        produced != stats.samples_sent + uplink_core_pending(&uplink) + stats.dropped) {
+        fprintf(stderr, "check failed: %u acknowledged samples received, %u out of order or undecodable\n",
+                l.received, l.misordered);
+        return 1;
+    }
+
+    return 0;
+}
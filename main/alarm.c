@@ -0,0 +1,368 @@
+#include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
+#include <sys/lock.h>
+#include <sys/param.h>
+#include <sys/time.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "nvs.h"
+
+#include "esp_check.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "alarm.h"
+#include "memory.h"
+#include "settings.h"
+#include "timekeeping.h"
+
+#define ALARM_NVS_NAMESPACE "alarm"
+#define ALARM_NVS_KEY       "alarms"
+#define ALARM_NVS_VERSION   1
+#define ALARM_PACKED_SZ     3
+#define ALARM_BLOB_SZ       (2 + ALARM_MAX * ALARM_PACKED_SZ)
+
+/* Heap entries with this id are snoozes of `snooze_id` */
+#define ALARM_SNOOZE_ID     ALARM_MAX
+
+typedef struct alarm_event {
+    time_t when;
+    uint8_t id;
+} alarm_event_t;
+
+static const char *TAG = "ALARM";
+
+static alarm_t alarms[ALARM_MAX];
+
+/* Min-heap of pending fire times: one entry per enabled alarm plus the snooze */
+static alarm_event_t heap[ALARM_MAX + 1];
+static unsigned int heap_len = 0;
+
+static time_t snooze_until = 0;
+static uint8_t snooze_id = 0;
+static int last_tripped = -1;
+static uint32_t fired_count = 0;
+
+static bool armed = false;
+
+static _lock_t alarm_lock;
+static esp_timer_handle_t alarm_timer = NULL;
+static alarm_trip_cb_t trip_cb = NULL;
+
+static void heap_push(time_t when, uint8_t id)
+{
+    unsigned int i = heap_len++;
+
+    while (i > 0) {
+        unsigned int parent = (i - 1) / 2;
+        if (heap[parent].when <= when) break;
+        heap[i] = heap[parent];
+        i = parent;
+    }
+
+    heap[i].when = when;
+    heap[i].id = id;
+}
+
+static alarm_event_t heap_pop(void)
+{
+    alarm_event_t top = heap[0];
+    alarm_event_t last = heap[--heap_len];
+    unsigned int i = 0;
+
+    for (;;) {
+        unsigned int child = 2 * i + 1;
+        if (child >= heap_len) break;
+        if (child + 1 < heap_len && heap[child + 1].when < heap[child].when) child++;
+        if (last.when <= heap[child].when) break;
+        heap[i] = heap[child];
+        i = child;
+    }
+
+    if (heap_len > 0) {
+        heap[i] = last;
+    }
+
+    return top;
+}
+
+/* Must be called with alarm_lock held */
+static void rebuild_heap(time_t now)
+{
+    time_t t;
+
+    heap_len = 0;
+
+    for (unsigned int id = 0; id < ALARM_MAX; id++) {
+        t = alarm_next_fire(&alarms[id], timekeeping_get_rule(), now);
+        if (t) heap_push(t, id);
+    }
+
+    if (snooze_until > now) {
+        heap_push(snooze_until, ALARM_SNOOZE_ID);
+    } else {
+        snooze_until = 0;
+    }
+}
+
+/* Must be called with alarm_lock held */
+static void arm_timer(void)
+{
+    struct timeval now;
+    int64_t delay_us;
+
+    esp_timer_stop(alarm_timer);
+
+    if (!armed || heap_len == 0) return;
+
+    gettimeofday(&now, NULL);
+
+    delay_us = (int64_t) (heap[0].when - now.tv_sec) * 1000000 - now.tv_usec;
+    if (delay_us < 0) delay_us = 0;
+
+    ESP_LOGI(TAG, "Next alarm (#%u) in %" PRId64 " s", heap[0].id, delay_us / 1000000);
+
+    esp_timer_start_once(alarm_timer, delay_us);
+}
+
+static esp_err_t alarm_save(void)
+{
+    nvs_handle_t nvs;
+    uint8_t blob[ALARM_BLOB_SZ];
+    esp_err_t rc;
+
+    blob[0] = ALARM_NVS_VERSION;
+    blob[1] = ALARM_MAX;
+
+    _lock_acquire(&alarm_lock);
+    for (unsigned int id = 0; id < ALARM_MAX; id++) {
+        alarm_pack(&alarms[id], &blob[2 + id * ALARM_PACKED_SZ]);
+    }
+    _lock_release(&alarm_lock);
+
+    /* NVS allocates its handles */
+    memory_allow_alloc_begin();
+
+    rc = nvs_open(ALARM_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (rc == ESP_OK) {
+        rc = nvs_set_blob(nvs, ALARM_NVS_KEY, blob, sizeof(blob));
+        if (rc == ESP_OK) {
+            rc = nvs_commit(nvs);
+        }
+
+        nvs_close(nvs);
+    }
+
+    memory_allow_alloc_end();
+
+    ESP_RETURN_ON_ERROR(rc, TAG, "alarm_save: writing NVS failed");
+
+    return ESP_OK;
+}
+
+static esp_err_t alarm_load(void)
+{
+    nvs_handle_t nvs;
+    uint8_t blob[ALARM_BLOB_SZ];
+    size_t len = sizeof(blob);
+    unsigned int count;
+    esp_err_t rc;
+
+    rc = nvs_open(ALARM_NVS_NAMESPACE, NVS_READONLY, &nvs);
+    if (rc != ESP_OK) return rc;
+
+    rc = nvs_get_blob(nvs, ALARM_NVS_KEY, blob, &len);
+    nvs_close(nvs);
+
+    if (rc != ESP_OK) return rc;
+
+    ESP_RETURN_ON_FALSE(len >= 2 && blob[0] == ALARM_NVS_VERSION, ESP_ERR_INVALID_VERSION, TAG, "alarm_load: unsupported alarm blob");
+
+    count = MIN(blob[1], (len - 2) / ALARM_PACKED_SZ);
+    count = MIN(count, ALARM_MAX);
+
+    for (unsigned int id = 0; id < count; id++) {
+        alarm_unpack(&blob[2 + id * ALARM_PACKED_SZ], &alarms[id]);
+    }
+
+    return ESP_OK;
+}
+
+static void alarm_timer_cb(void *arg)
+{
+    uint8_t fired[ALARM_MAX + 1];
+    unsigned int n_fired = 0;
+    bool disabled_once = false;
+    alarm_event_t ev;
+    time_t now, next;
+    unsigned int id;
+
+    _lock_acquire(&alarm_lock);
+
+    now = time(NULL);
+
+    /*
+     * If the wall clock moved backwards since arming, the top is still in the
+     * future and the loop below does nothing but re-arm. Each entry is
+     * re-pushed after `now`, so it pops at most once; the bound on `fired`
+     * is a safeguard.
+     */
+    while (n_fired < sizeof(fired) / sizeof(fired[0]) && heap_len > 0 && heap[0].when <= now) {
+        ev = heap_pop();
+
+        if (ev.id == ALARM_SNOOZE_ID) {
+            id = snooze_id;
+            snooze_until = 0;
+        } else {
+            id = ev.id;
+
+            if (alarms[id].weekdays == ALARM_ONCE) {
+                alarms[id].enabled = 0;
+                disabled_once = true;
+            } else {
+                /*
+                 * Start one hour after the fire time so that the repeated hour
+                 * of a fall-back transition never fires the alarm twice, and
+                 * after now if the callback ran late or the clock jumped forward.
+                 */
+                next = alarm_next_fire(&alarms[id], timekeeping_get_rule(), MAX(ev.when, now) + 3600);
+                if (next) heap_push(next, id);
+            }
+        }
+
+        fired[n_fired++] = id;
+        last_tripped = id;
+        fired_count++;
+    }
+
+    arm_timer();
+
+    _lock_release(&alarm_lock);
+
+    if (disabled_once) {
+        alarm_save();
+    }
+
+    for (unsigned int i = 0; i < n_fired; i++) {
+        if (trip_cb) trip_cb(fired[i]);
+    }
+}
+
+esp_err_t alarm_get(unsigned int id, alarm_t *alarm)
+{
+    ESP_RETURN_ON_FALSE(id < ALARM_MAX, ESP_ERR_INVALID_ARG, TAG, "alarm_get: invalid alarm id");
+    ESP_RETURN_ON_FALSE(alarm != NULL, ESP_ERR_INVALID_ARG, TAG, "alarm_get: Pointer argument is NULL");
+
+    _lock_acquire(&alarm_lock);
+    *alarm = alarms[id];
+    _lock_release(&alarm_lock);
+
+    return ESP_OK;
+}
+
+esp_err_t alarm_set(unsigned int id, const alarm_t *alarm)
+{
+    bool changed;
+
+    ESP_RETURN_ON_FALSE(id < ALARM_MAX, ESP_ERR_INVALID_ARG, TAG, "alarm_set: invalid alarm id");
+    ESP_RETURN_ON_FALSE(alarm != NULL, ESP_ERR_INVALID_ARG, TAG, "alarm_set: Pointer argument is NULL");
+    ESP_RETURN_ON_FALSE(alarm->hour < 24 && alarm->min < 60 && alarm->weekdays <= ALARM_EVERY_DAY,
+                        ESP_ERR_INVALID_ARG, TAG, "alarm_set: invalid alarm");
+
+    _lock_acquire(&alarm_lock);
+    changed = memcmp(&alarms[id], alarm, sizeof(alarm_t)) != 0;
+    alarms[id] = *alarm;
+    rebuild_heap(time(NULL));
+    arm_timer();
+    _lock_release(&alarm_lock);
+
+    /* Leaving set-alarm mode without changes must not wear the flash */
+    return changed ? alarm_save() : ESP_OK;
+}
+
+void alarm_set_armed(bool is_armed)
+{
+    _lock_acquire(&alarm_lock);
+
+    armed = is_armed;
+
+    if (!armed) {
+        snooze_until = 0;
+        last_tripped = -1;
+    }
+
+    rebuild_heap(time(NULL));
+    arm_timer();
+
+    _lock_release(&alarm_lock);
+}
+
+bool alarm_is_armed(void)
+{
+    return armed;
+}
+
+void alarm_snooze(void)
+{
+    _lock_acquire(&alarm_lock);
+
+    if (armed && last_tripped >= 0) {
+        snooze_id = last_tripped;
+        snooze_until = time(NULL) + settings_get(SETTING_SNOOZE_MIN) * 60;
+        rebuild_heap(time(NULL));
+        arm_timer();
+    }
+
+    _lock_release(&alarm_lock);
+}
+
+void alarm_reschedule(void)
+{
+    _lock_acquire(&alarm_lock);
+    rebuild_heap(time(NULL));
+    arm_timer();
+    _lock_release(&alarm_lock);
+}
+
+void alarm_get_status(alarm_status_t *status)
+{
+    _lock_acquire(&alarm_lock);
+
+    status->armed = armed;
+    status->pending = heap_len;
+    status->next_when = heap_len > 0 ? heap[0].when : 0;
+    status->next_id = heap_len > 0 ? heap[0].id : -1;
+    status->snooze_until = snooze_until;
+    status->fired = fired_count;
+
+    _lock_release(&alarm_lock);
+}
+
+esp_err_t alarm_init(alarm_trip_cb_t cb)
+{
+    esp_err_t rc;
+
+    trip_cb = cb;
+
+    /* Defaults match the former single daily alarm */
+    memset(alarms, 0, sizeof(alarms));
+    alarms[0].weekdays = ALARM_EVERY_DAY;
+    alarms[0].enabled = 1;
+
+    rc = alarm_load();
+    if (rc == ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGI(TAG, "No stored alarms, using defaults");
+    } else if (rc != ESP_OK) {
+        ESP_LOGW(TAG, "Loading alarms failed (%s), using defaults", esp_err_to_name(rc));
+    }
+
+    const esp_timer_create_args_t alarm_timer_args = {
+        .callback = &alarm_timer_cb,
+        .name = "alarm"
+    };
+
+    return esp_timer_create(&alarm_timer_args, &alarm_timer);
+}
@@ -0,0 +1,52 @@
+#ifndef ALARM_H
+#define ALARM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "esp_err.h"
+
+#include "alarm_time.h"
+
+#define ALARM_MAX 8
+
+typedef struct alarm_status {
+    bool armed;
+    unsigned int pending;   /* Scheduled fire times, snooze included */
+    time_t next_when;       /* 0 if nothing is scheduled */
+    int next_id;            /* ALARM_MAX for the snooze, -1 if nothing is scheduled */
+    time_t snooze_until;    /* 0 if not snoozed */
+    uint32_t fired;         /* Since boot */
+} alarm_status_t;
+
+/*
+ * Called from the esp_timer task when an alarm (or a snooze) fires.
+ * Must not block.
+ */
+typedef void (*alarm_trip_cb_t)(unsigned int id);
+
+esp_err_t alarm_get(unsigned int id, alarm_t *alarm);
+esp_err_t alarm_set(unsigned int id, const alarm_t *alarm);
+
+/*
+ * Master switch. Alarms only fire while armed.
+ */
+void alarm_set_armed(bool armed);
+bool alarm_is_armed(void);
+
+/*
+ * Postpones the last tripped alarm by CONFIG_STATION_ALARM_SNOOZE_MIN minutes.
+ */
+void alarm_snooze(void);
+
+/*
+ * Recomputes every fire time. Must be called after the wall clock changed.
+ */
+void alarm_reschedule(void);
+
+void alarm_get_status(alarm_status_t *status);
+
+esp_err_t alarm_init(alarm_trip_cb_t trip_cb);
+
+#endif
@@ -0,0 +1,76 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "alarm_time.h"
+
+#define SECS_PER_DAY 86400
+
+/* UTC instant of a local time, see alarm_next_fire() for the ambiguous and skipped ones */
+static int64_t local_to_utc(const tz_rule_t *rule, int64_t local)
+{
+    int32_t hi = rule->std_offset, lo = rule->std_offset;
+    int64_t early, late;
+
+    if (rule->has_dst) {
+        if (rule->dst_offset > hi) hi = rule->dst_offset;
+        if (rule->dst_offset < lo) lo = rule->dst_offset;
+    }
+
+    early = local - hi;
+    late = local - lo;
+
+    if (tz_rule_utc_offset(rule, early, NULL, NULL) == hi) return early;
+
+    /* Either valid under the lower offset, or skipped: the offset before the gap is the lower one too */
+    return late;
+}
+
+int64_t alarm_next_fire(const alarm_t *alarm, const tz_rule_t *rule, int64_t now)
+{
+    int64_t local, days, t;
+    int32_t wday;
+
+    if (alarm == NULL || !alarm->enabled) return 0;
+
+    local = now + tz_rule_utc_offset(rule, now, NULL, NULL);
+    days = local / SECS_PER_DAY - (local % SECS_PER_DAY < 0);
+
+    /* Today if still ahead, else up to the same weekday next week */
+    for (int day = 0; day <= 7; day++) {
+        t = local_to_utc(rule, (days + day) * SECS_PER_DAY + alarm->hour * 3600 + alarm->min * 60);
+        if (t <= now) continue;
+
+        /* 1970-01-01 was a Thursday */
+        wday = (int32_t) (((days + day + 4) % 7 + 7) % 7);
+
+        if (alarm->weekdays == ALARM_ONCE || (alarm->weekdays & (1 << wday))) {
+            return t;
+        }
+    }
+
+    return 0;
+}
+
+void alarm_pack(const alarm_t *alarm, uint8_t out[3])
+{
+    uint32_t minute_of_day = alarm->hour * 60 + alarm->min;
+    uint32_t packed = (minute_of_day & 0x7FF) |
+                      ((uint32_t) (alarm->weekdays & 0x7F) << 11) |
+                      ((uint32_t) (alarm->enabled ? 1 : 0) << 18);
+
+    out[0] = packed & 0xFF;
+    out[1] = (packed >> 8) & 0xFF;
+    out[2] = (packed >> 16) & 0xFF;
+}
+
+void alarm_unpack(const uint8_t in[3], alarm_t *alarm)
+{
+    uint32_t packed = in[0] | ((uint32_t) in[1] << 8) | ((uint32_t) in[2] << 16);
+    uint32_t minute_of_day = (packed & 0x7FF) % (24 * 60);
+
+    alarm->hour = minute_of_day / 60;
+    alarm->min = minute_of_day % 60;
+    alarm->weekdays = (packed >> 11) & 0x7F;
+    alarm->enabled = (packed >> 18) & 1;
+}
@@ -0,0 +1,44 @@
+#ifndef ALARM_TIME_H
+#define ALARM_TIME_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "tz_rule.h"
+
+/*
+ * Fire time computation of the alarms against a compiled TZ rule, without
+ * any libc time zone state, so that it runs and is tested on the host.
+ */
+
+/* Weekday recurrence mask, bit n is tm_wday n (0 = Sunday) */
+#define ALARM_WEEKDAYS  0x3E
+#define ALARM_WEEKEND   0x41
+#define ALARM_EVERY_DAY 0x7F
+/* An alarm with an empty mask fires once and disables itself */
+#define ALARM_ONCE      0x00
+
+typedef struct alarm {
+    uint8_t hour;
+    uint8_t min;
+    uint8_t weekdays;
+    uint8_t enabled;
+} alarm_t;
+
+/*
+ * Returns the first UTC instant strictly after `now` at which the local
+ * time is the alarm's, on a day of its mask, or 0 if the alarm can never
+ * fire. A local time repeated by a fall-back transition resolves to its
+ * first occurrence; one skipped by a spring-forward is pushed past the gap
+ * by the length of the gap.
+ */
+int64_t alarm_next_fire(const alarm_t *alarm, const tz_rule_t *rule, int64_t now);
+
+/*
+ * Compact 3 bytes encoding used for persistence:
+ * minute of day (11 bits), weekday mask (7 bits), enabled (1 bit).
+ */
+void alarm_pack(const alarm_t *alarm, uint8_t out[3]);
+void alarm_unpack(const uint8_t in[3], alarm_t *alarm);
+
+#endif
@@ -0,0 +1,95 @@
+#include <inttypes.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "boot.h"
+
+static const char *TAG = "BOOT";
+
+static const char *phase_names[BOOT_PHASE_MAX] = {
+    [BOOT_PHASE_APP_MAIN] = "app_main",
+    [BOOT_PHASE_STORAGE] = "storage",
+    [BOOT_PHASE_CLOCK] = "clock",
+    [BOOT_PHASE_DISPLAY] = "display",
+    [BOOT_PHASE_FIRST_FRAME] = "first frame",
+    [BOOT_PHASE_INPUT] = "input",
+    [BOOT_PHASE_SERVICES] = "services",
+    [BOOT_PHASE_SENSORS] = "sensors",
+    [BOOT_PHASE_FIRST_READING] = "first reading",
+};
+
+static int64_t phase_us[BOOT_PHASE_MAX];
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+static StaticEventGroup_t events_buf;
+static EventGroupHandle_t events = NULL;
+
+void boot_mark(boot_phase_t phase)
+{
+    int64_t now;
+    bool first;
+
+    /* Unlocked fast path for the per-frame and per-read marks */
+    if (phase >= BOOT_PHASE_MAX || phase_us[phase] != 0) return;
+
+    now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&lock);
+    first = phase_us[phase] == 0;
+    if (first) phase_us[phase] = now;
+    portEXIT_CRITICAL(&lock);
+
+    if (first && events) xEventGroupSetBits(events, 1 << phase);
+}
+
+int64_t boot_phase_us(boot_phase_t phase)
+{
+    int64_t us;
+
+    if (phase >= BOOT_PHASE_MAX) return 0;
+
+    portENTER_CRITICAL(&lock);
+    us = phase_us[phase];
+    portEXIT_CRITICAL(&lock);
+
+    return us;
+}
+
+bool boot_wait(boot_phase_t phase, uint32_t timeout_ms)
+{
+    if (phase >= BOOT_PHASE_MAX || events == NULL) return false;
+
+    return xEventGroupWaitBits(events, 1 << phase, pdFALSE, pdTRUE, pdMS_TO_TICKS(timeout_ms)) & (1 << phase);
+}
+
+void boot_report(void)
+{
+    int64_t prev_us = 0;
+
+    for (unsigned int i = 0; i < BOOT_PHASE_MAX; i++) {
+        int64_t us = boot_phase_us(i);
+
+        if (us == 0) {
+            ESP_LOGI(TAG, "%-14s        -", phase_names[i]);
+            continue;
+        }
+
+        /* The phases overlap, so a later phase can end before an earlier one */
+        ESP_LOGI(TAG, "%-14s %5" PRId64 " ms (%+" PRId64 " ms)", phase_names[i], us / 1000, (us - prev_us) / 1000);
+        prev_us = us;
+    }
+}
+
+esp_err_t boot_init(void)
+{
+    events = xEventGroupCreateStatic(&events_buf);
+    boot_mark(BOOT_PHASE_APP_MAIN);
+
+    return events ? ESP_OK : ESP_FAIL;
+}
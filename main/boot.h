@@ -0,0 +1,45 @@
+#ifndef BOOT_H
+#define BOOT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+
+/*
+ * Boot phase timestamps.
+ *
+ * app_main() brings the display and the clock up first and probes the
+ * sensors in the background, so the phases overlap; each one is stamped
+ * with esp_timer time (since the application started) when it completes.
+ * Only the first mark of a phase counts, which lets hot paths mark
+ * FIRST_FRAME and FIRST_READING unconditionally.
+ */
+
+typedef enum boot_phase {
+    BOOT_PHASE_APP_MAIN = 0,
+    BOOT_PHASE_STORAGE,         /* NVS and settings */
+    BOOT_PHASE_CLOCK,
+    BOOT_PHASE_DISPLAY,         /* Panel and LVGL initialized */
+    BOOT_PHASE_FIRST_FRAME,     /* First frame on the panel */
+    BOOT_PHASE_INPUT,
+    BOOT_PHASE_SERVICES,        /* app_main() done */
+    BOOT_PHASE_SENSORS,         /* Sensor probes done */
+    BOOT_PHASE_FIRST_READING,   /* First valid sensor reading */
+    BOOT_PHASE_MAX
+} boot_phase_t;
+
+void boot_mark(boot_phase_t phase);
+
+/* Time of `phase` in us, 0 if not reached yet */
+int64_t boot_phase_us(boot_phase_t phase);
+
+/* Blocks until `phase` is reached or `timeout_ms` elapsed */
+bool boot_wait(boot_phase_t phase, uint32_t timeout_ms);
+
+/* Logs the timeline of the phases reached so far */
+void boot_report(void);
+
+esp_err_t boot_init(void);
+
+#endif
@@ -0,0 +1,212 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "driver/gpio.h"
+
+#include "esp_check.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "buttons.h"
+#include "power.h"
+
+#define BUTTONS_DEBOUNCE_MS        15
+#define BUTTONS_LONG_PRESS_MS      600
+#define BUTTONS_REPEAT_START_MS    250
+#define BUTTONS_REPEAT_MIN_MS      40
+
+enum button_phase {
+    PHASE_IDLE = 0,     /* Waiting for the level interrupt */
+    PHASE_EDGE,         /* Interrupt fired, edge to be reported */
+    PHASE_SETTLE,       /* Debouncing, pin ignored */
+};
+
+typedef struct button {
+    uint32_t gpio;
+    bool pressed;
+    bool repeat;
+    uint8_t phase;
+    uint16_t repeats;
+    uint32_t repeat_ms;
+    int64_t edge_us;
+    esp_timer_handle_t debounce_timer;
+    esp_timer_handle_t hold_timer;
+} button_t;
+
+static const char *TAG = "BUTTONS";
+
+static button_t buttons[BUTTON_MAX];
+static buttons_event_cb_t event_cb = NULL;
+
+static void emit(button_id_t id, button_event_type_t type, uint16_t repeat, int64_t timestamp_us)
+{
+    button_event_t event = {
+        .button = id,
+        .type = type,
+        .repeat = repeat,
+        .timestamp_us = timestamp_us,
+    };
+
+    if (event_cb) event_cb(&event);
+}
+
+/*
+ * Waits for the opposite of the stable level. Level (not edge) interrupts
+ * are used because they are also the only ones able to wake the chip from
+ * light sleep.
+ */
+static void arm(button_t *b)
+{
+    int level = b->pressed ? 1 : 0;
+
+    b->phase = PHASE_IDLE;
+    gpio_set_intr_type(b->gpio, level ? GPIO_INTR_HIGH_LEVEL : GPIO_INTR_LOW_LEVEL);
+    power_enable_gpio_wakeup(b->gpio, level);
+    gpio_intr_enable(b->gpio);
+}
+
+static void set_pressed(button_id_t id, bool pressed, int64_t timestamp_us)
+{
+    button_t *b = &buttons[id];
+
+    b->pressed = pressed;
+
+    if (pressed) {
+        b->repeats = 0;
+        b->repeat_ms = BUTTONS_REPEAT_START_MS;
+        esp_timer_start_once(b->hold_timer, BUTTONS_LONG_PRESS_MS * 1000);
+        emit(id, BUTTON_EVENT_PRESS, 0, timestamp_us);
+    } else {
+        esp_timer_stop(b->hold_timer);
+        emit(id, BUTTON_EVENT_RELEASE, 0, timestamp_us);
+    }
+}
+
+static void button_isr(void *arg)
+{
+    button_t *b = &buttons[(uintptr_t) arg];
+
+    gpio_intr_disable(b->gpio);
+
+    b->edge_us = esp_timer_get_time();
+    b->phase = PHASE_EDGE;
+
+    esp_timer_start_once(b->debounce_timer, 0);
+}
+
+static void debounce_timer_cb(void *arg)
+{
+    button_id_t id = (button_id_t) (uintptr_t) arg;
+    button_t *b = &buttons[id];
+    bool pressed;
+
+    switch (b->phase) {
+        case PHASE_EDGE:
+            /* The interrupt only fires on the opposite level, report it right away */
+            set_pressed(id, !b->pressed, b->edge_us);
+            b->phase = PHASE_SETTLE;
+            esp_timer_start_once(b->debounce_timer, BUTTONS_DEBOUNCE_MS * 1000);
+            break;
+        case PHASE_SETTLE:
+            pressed = !gpio_get_level(b->gpio);
+
+            if (pressed != b->pressed) {
+                /* Released (or pressed again) within the debounce period */
+                set_pressed(id, pressed, esp_timer_get_time());
+                esp_timer_start_once(b->debounce_timer, BUTTONS_DEBOUNCE_MS * 1000);
+                break;
+            }
+
+            arm(b);
+            break;
+        default:
+            break;
+    }
+}
+
+static void hold_timer_cb(void *arg)
+{
+    button_id_t id = (button_id_t) (uintptr_t) arg;
+    button_t *b = &buttons[id];
+    int64_t now = esp_timer_get_time();
+
+    if (!b->pressed) return;
+
+    if (b->repeats == 0) {
+        emit(id, BUTTON_EVENT_LONG_PRESS, 0, now);
+    }
+
+    if (!b->repeat) return;
+
+    emit(id, BUTTON_EVENT_REPEAT, ++b->repeats, now);
+
+    /* Speed up by 20% on each repeat */
+    b->repeat_ms = MAX(BUTTONS_REPEAT_MIN_MS, b->repeat_ms * 4 / 5);
+    esp_timer_start_once(b->hold_timer, b->repeat_ms * 1000);
+}
+
+bool buttons_is_pressed(button_id_t button)
+{
+    return button < BUTTON_MAX && buttons[button].pressed;
+}
+
+esp_err_t buttons_init(const buttons_config_t *config, buttons_event_cb_t cb)
+{
+    ESP_RETURN_ON_FALSE(config != NULL, ESP_ERR_INVALID_ARG, TAG, "buttons_init: Pointer argument is NULL");
+
+    gpio_config_t io_conf = {
+        .pin_bit_mask = 0,
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = GPIO_PULLUP_ENABLE,
+        .pull_down_en = GPIO_PULLDOWN_DISABLE,
+        .intr_type = GPIO_INTR_DISABLE,
+    };
+
+    for (uint32_t id = 0; id < BUTTON_MAX; id++) {
+        io_conf.pin_bit_mask |= 1ULL << config->gpio[id];
+    }
+
+    ESP_RETURN_ON_ERROR(gpio_config(&io_conf), TAG, "buttons_init: gpio_config failed");
+
+    event_cb = cb;
+
+    esp_err_t rc = gpio_install_isr_service(0);
+    ESP_RETURN_ON_FALSE(rc == ESP_OK || rc == ESP_ERR_INVALID_STATE, rc, TAG, "buttons_init: gpio_install_isr_service failed");
+
+    for (uint32_t id = 0; id < BUTTON_MAX; id++) {
+        button_t *b = &buttons[id];
+
+        b->gpio = config->gpio[id];
+        b->repeat = config->repeat_mask & (1 << id);
+        b->pressed = !gpio_get_level(b->gpio);
+
+        const esp_timer_create_args_t debounce_timer_args = {
+            .callback = &debounce_timer_cb,
+            .arg = (void *) (uintptr_t) id,
+            .name = "btn_debounce"
+        };
+        ESP_RETURN_ON_ERROR(esp_timer_create(&debounce_timer_args, &b->debounce_timer), TAG, "buttons_init: esp_timer_create failed");
+
+        const esp_timer_create_args_t hold_timer_args = {
+            .callback = &hold_timer_cb,
+            .arg = (void *) (uintptr_t) id,
+            .name = "btn_hold"
+        };
+        ESP_RETURN_ON_ERROR(esp_timer_create(&hold_timer_args, &b->hold_timer), TAG, "buttons_init: esp_timer_create failed");
+
+        ESP_RETURN_ON_ERROR(gpio_isr_handler_add(b->gpio, button_isr, (void *) (uintptr_t) id), TAG, "buttons_init: gpio_isr_handler_add failed");
+
+        /* Report the initial state of buttons held (or switch on) at boot */
+        if (b->pressed) {
+            emit(id, BUTTON_EVENT_PRESS, 0, esp_timer_get_time());
+        }
+
+        arm(b);
+    }
+
+    return ESP_OK;
+}
@@ -0,0 +1,53 @@
+#ifndef BUTTONS_H
+#define BUTTONS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+
+/*
+ * Interrupt driven push buttons and switch, active low.
+ *
+ * An edge is reported as soon as its interrupt fires, the pin is then
+ * ignored for the debounce period. Held buttons report a long press and,
+ * for the buttons with auto-repeat, accelerating repeats.
+ */
+
+typedef enum button_id {
+    BUTTON_CTRL = 0,
+    BUTTON_UP,
+    BUTTON_DOWN,
+    BUTTON_SWITCH,
+    BUTTON_MAX
+} button_id_t;
+
+typedef enum button_event_type {
+    BUTTON_EVENT_PRESS = 0,
+    BUTTON_EVENT_RELEASE,
+    BUTTON_EVENT_LONG_PRESS,
+    BUTTON_EVENT_REPEAT,
+} button_event_type_t;
+
+typedef struct button_event {
+    uint8_t button;         /* button_id_t */
+    uint8_t type;           /* button_event_type_t */
+    uint16_t repeat;        /* Number of repeats so far for BUTTON_EVENT_REPEAT */
+    int64_t timestamp_us;   /* Time of the edge (or of the repeat) */
+} button_event_t;
+
+/*
+ * Called from the esp_timer task for each event. Must not block.
+ */
+typedef void (*buttons_event_cb_t)(const button_event_t *event);
+
+typedef struct buttons_config {
+    uint32_t gpio[BUTTON_MAX];
+    uint32_t repeat_mask;   /* Bit n enables auto-repeat on button n */
+} buttons_config_t;
+
+bool buttons_is_pressed(button_id_t button);
+
+esp_err_t buttons_init(const buttons_config_t *config, buttons_event_cb_t event_cb);
+
+#endif
@@ -1,52 +1,129 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
+#include <sys/param.h>
 
-#include "driver/gpio.h"
+#include "freertos/FreeRTOS.h"
 
+#include "driver/ledc.h"
+
+#include "esp_check.h"
 #include "esp_err.h"
 #include "esp_log.h"
-#include "esp_rom_sys.h"
+#include "esp_timer.h"
 
 #include "buzzer.h"
+#include "power.h"
+
+#define BUZZER_LEDC_MODE     LEDC_LOW_SPEED_MODE
+#define BUZZER_LEDC_TIMER    LEDC_TIMER_0
+#define BUZZER_LEDC_CHANNEL  LEDC_CHANNEL_0
+#define BUZZER_DUTY_RES      LEDC_TIMER_10_BIT
+/* 50% duty cycle gives the loudest square wave */
+#define BUZZER_DUTY_ON       (1 << (BUZZER_DUTY_RES - 1))
+#define BUZZER_DEFAULT_FREQ  1000
+/*
+ * APB drops to the XTAL frequency whenever DFS lowers the CPU clock, which
+ * would halve the pitch mid-tone. The XTAL (40 MHz) is not scaled; at 10 bits
+ * its divider covers about 38 Hz to 39 kHz.
+ */
+#define BUZZER_LEDC_CLK      LEDC_USE_XTAL_CLK
+
+static const char *TAG = "BUZZER";
+
+static esp_timer_handle_t stop_timer = NULL;
+static portMUX_TYPE tone_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool tone_on = false;
+
+static void buzzer_off(void)
+{
+    bool was_on;
+
+    ledc_set_duty(BUZZER_LEDC_MODE, BUZZER_LEDC_CHANNEL, 0);
+    ledc_update_duty(BUZZER_LEDC_MODE, BUZZER_LEDC_CHANNEL);
 
-static uint32_t bz_gpio = -1;
+    portENTER_CRITICAL(&tone_lock);
+    was_on = tone_on;
+    tone_on = false;
+    portEXIT_CRITICAL(&tone_lock);
+
+    /* The LEDC clock stops in light sleep */
+    if (was_on) {
+        power_lock_release(POWER_LOCK_BUZZER);
+    }
+}
+
+static void stop_timer_cb(void *arg)
+{
+    buzzer_off();
+}
 
 esp_err_t buzzer_init(uint32_t buzzer_gpio)
 {
-    bz_gpio = buzzer_gpio;
-
-    gpio_config_t io_conf = {
-        .pin_bit_mask = (1ULL << buzzer_gpio),
-        .mode = GPIO_MODE_OUTPUT,
-        .pull_up_en = GPIO_PULLUP_ENABLE,
-        .pull_down_en = GPIO_PULLDOWN_DISABLE,
-        .intr_type = GPIO_INTR_DISABLE,
+    ledc_timer_config_t timer_config = {
+        .speed_mode = BUZZER_LEDC_MODE,
+        .duty_resolution = BUZZER_DUTY_RES,
+        .timer_num = BUZZER_LEDC_TIMER,
+        .freq_hz = BUZZER_DEFAULT_FREQ,
+        .clk_cfg = BUZZER_LEDC_CLK,
     };
 
-    return gpio_config(&io_conf);
+    ESP_RETURN_ON_ERROR(ledc_timer_config(&timer_config), TAG, "buzzer_init: ledc_timer_config failed");
+
+    ledc_channel_config_t channel_config = {
+        .gpio_num = buzzer_gpio,
+        .speed_mode = BUZZER_LEDC_MODE,
+        .channel = BUZZER_LEDC_CHANNEL,
+        .intr_type = LEDC_INTR_DISABLE,
+        .timer_sel = BUZZER_LEDC_TIMER,
+        .duty = 0,
+        .hpoint = 0,
+    };
+
+    ESP_RETURN_ON_ERROR(ledc_channel_config(&channel_config), TAG, "buzzer_init: ledc_channel_config failed");
+
+    const esp_timer_create_args_t stop_timer_args = {
+        .callback = &stop_timer_cb,
+        .name = "buzzer_stop"
+    };
+
+    return esp_timer_create(&stop_timer_args, &stop_timer);
 }
 
 void buzzer_stop(void)
 {
-    gpio_set_level(bz_gpio, 0);
+    esp_timer_stop(stop_timer);
+    buzzer_off();
 }
 
 void buzzer_beep(uint32_t frequency, uint32_t time)
 {
-    if (frequency == 0 || time == 0) {
-        gpio_set_level(bz_gpio, 0);
+    buzzer_tone(frequency, time, 100);
+}
+
+void buzzer_tone(uint32_t frequency, uint32_t time, uint8_t volume)
+{
+    bool was_on;
+
+    if (frequency == 0 || time == 0 || volume == 0) {
+        buzzer_stop();
         return;
     }
 
-    uint32_t half_period_us = 1000000 / (frequency * 2);
-    uint32_t cycles = (frequency * time) / 1000;
+    esp_timer_stop(stop_timer);
 
-    for (uint32_t i = 0; i < cycles; i++) {
-        gpio_set_level(bz_gpio, 1);
-        esp_rom_delay_us(half_period_us);
+    portENTER_CRITICAL(&tone_lock);
+    was_on = tone_on;
+    tone_on = true;
+    portEXIT_CRITICAL(&tone_lock);
 
-        gpio_set_level(bz_gpio, 0);
-        esp_rom_delay_us(half_period_us);
+    if (!was_on) {
+        power_lock_acquire(POWER_LOCK_BUZZER);
     }
+
+    ledc_set_freq(BUZZER_LEDC_MODE, BUZZER_LEDC_TIMER, frequency);
+    ledc_set_duty(BUZZER_LEDC_MODE, BUZZER_LEDC_CHANNEL, BUZZER_DUTY_ON * MIN(volume, 100) / 100);
+    ledc_update_duty(BUZZER_LEDC_MODE, BUZZER_LEDC_CHANNEL);
+
+    esp_timer_start_once(stop_timer, (uint64_t) time * 1000);
 }
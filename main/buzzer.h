@@ -11,7 +11,14 @@ void buzzer_stop(void);
 
 /*
  * Beeps the buzzer at given frequency (in Hz) for the given duration (in ms).
+ * The tone is generated by the LEDC peripheral and stopped by a timer, so the
+ * call returns immediately. A new beep replaces the current one.
  */
 void buzzer_beep(uint32_t frequency, uint32_t time);
 
+/*
+ * Same as buzzer_beep() at the given volume (in percent of the maximum).
+ */
+void buzzer_tone(uint32_t frequency, uint32_t time, uint8_t volume);
+
 #endif
\ No newline at end of file
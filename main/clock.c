@@ -16,11 +16,15 @@
 
 #include "lwip/sys.h"
 
+#include "alarm.h"
 #include "buzzer.h"
 #include "clock.h"
+#include "sched_trace.h"
+#include "settings.h"
+#include "tone.h"
+#include "timekeeping.h"
 
 static esp_err_t clock_set_time(void);
-static void ring_alarm_task(void *arg);
 
 static const char *TAG = "CLOCK";
 
@@ -29,6 +33,8 @@ static clock_time_t clock_alarm_time = { 0 };
 
 static uint8_t is_set_time_mode = 0;
 static uint8_t is_set_alarm_mode = 0;
+/* Restored when the set-alarm mode is cancelled */
+static alarm_t alarm_before_set;
 
 static int alarm_status = 0;
 static int has_alarm_tripped = 0;
@@ -48,14 +54,32 @@ int clock_is_alarm_ringing(void)
 void clock_enable_alarm(void)
 {
     alarm_status = 1;
+    alarm_set_armed(true);
 }
 
 void clock_disable_alarm(void)
 {
+    if (alarm_status) {
+        alarm_set_armed(false);
+    }
+
+    if (has_alarm_tripped) {
+        tone_stop(&tone_pattern_alarm);
+    }
+
     alarm_status = 0;
     has_alarm_tripped = 0;
 }
 
+void clock_snooze_alarm(void)
+{
+    if (!clock_is_alarm_ringing()) return;
+
+    has_alarm_tripped = 0;
+    tone_stop(&tone_pattern_alarm);
+    alarm_snooze();
+}
+
 void clock_enter_set_time(void)
 {
     gpio_set_level(status_led_gpio, 1);
@@ -69,6 +93,7 @@ void clock_exit_set_time(void)
     gpio_set_level(status_led_gpio, 0);
     clock_set_time();
     is_set_time_mode = false;
+    alarm_reschedule();
 }
 
 void clock_adjust_time_min(int32_t delta)
@@ -97,15 +122,51 @@ void clock_adjust_time_hour(int32_t delta)
 
 void clock_enter_set_alarm(void)
 {
+    alarm_t alarm;
+
     gpio_set_level(status_led_gpio, 1);
-    memset(&clock_alarm_time, 0, sizeof(clock_time_t));
+
+    /* The set-alarm mode edits the first alarm slot */
+    alarm_get(0, &alarm);
+    alarm_before_set = alarm;
+    clock_alarm_time.sec = 0;
+    clock_alarm_time.min = alarm.min;
+    clock_alarm_time.hour = alarm.hour;
+
     is_set_alarm_mode = true;
 }
 
+void clock_cancel_set_alarm(void)
+{
+    esp_err_t rc;
+
+    gpio_set_level(status_led_gpio, 0);
+    is_set_alarm_mode = false;
+
+    /* The edit is thrown away; alarm_set() does not write the flash when nothing changed */
+    rc = alarm_set(0, &alarm_before_set);
+    if (rc) {
+        ESP_LOGE(TAG, "Restoring alarm failed. (%s)", esp_err_to_name(rc));
+    }
+}
+
 void clock_exit_set_alarm(void)
 {
+    alarm_t alarm;
+    esp_err_t rc;
+
     gpio_set_level(status_led_gpio, 0);
     is_set_alarm_mode = false;
+
+    alarm_get(0, &alarm);
+    alarm.min = clock_alarm_time.min;
+    alarm.hour = clock_alarm_time.hour;
+    alarm.enabled = 1;
+
+    rc = alarm_set(0, &alarm);
+    if (rc) {
+        ESP_LOGE(TAG, "Saving alarm failed. (%s)", esp_err_to_name(rc));
+    }
 }
 
 void clock_adjust_alarm_min(int32_t delta)
@@ -154,30 +215,14 @@ esp_err_t clock_get_time(clock_time_t *stime, bool *is_being_modified)
         return ESP_OK;
     }
 
-    time_t now;
     struct tm timeinfo;
 
-    time(&now);
-    localtime_r(&now, &timeinfo);
+    timekeeping_localtime(&timeinfo);
 
     stime->sec = timeinfo.tm_sec;
     stime->min = timeinfo.tm_min;
     stime->hour = timeinfo.tm_hour;
 
-    /*
-     * Trip the alarm for 2 seconds.
-     * This shall leave plenty of time given the frequency at which this
-     * function is normally called.
-     */
-    if (timeinfo.tm_min == clock_alarm_time.min &&
-        timeinfo.tm_hour == clock_alarm_time.hour &&
-        timeinfo.tm_sec < 2) {
-        if (!has_alarm_tripped) {
-            has_alarm_tripped = 1;
-            xTaskCreate(ring_alarm_task, "ring_alarm_task", configMINIMAL_STACK_SIZE, NULL, 10, NULL);
-        }
-    }
-
     return ESP_OK;
 }
 
@@ -197,35 +242,28 @@ static esp_err_t clock_set_time(void)
     struct timeval new_now = { .tv_sec = temp, .tv_usec = 0 };
 
     settimeofday(&new_now, NULL);
+    timekeeping_invalidate();
 
     return ESP_OK;
 }
 
-static void ring_alarm_task(void *arg)
+static void alarm_note_cb(bool on)
 {
-    while (clock_is_alarm_ringing()) {
-        gpio_set_level(status_led_gpio, 1);
-        buzzer_beep(1000, 200);
-        gpio_set_level(status_led_gpio, 0);
-        vTaskDelay(pdMS_TO_TICKS(100));
-
-        gpio_set_level(status_led_gpio, 1);
-        buzzer_beep(1000, 200);
-        gpio_set_level(status_led_gpio, 0);
-        vTaskDelay(pdMS_TO_TICKS(100));
-
-        gpio_set_level(status_led_gpio, 1);
-        buzzer_beep(1000, 200);
-        gpio_set_level(status_led_gpio, 0);
-        vTaskDelay(pdMS_TO_TICKS(100));
-
-        vTaskDelay(pdMS_TO_TICKS(500));
-    }
+    gpio_set_level(status_led_gpio, on);
+}
 
-    buzzer_stop();
-    gpio_set_level(status_led_gpio, 0);
+static void clock_alarm_tripped(unsigned int id)
+{
+    if (!alarm_status || is_set_alarm_mode) return;
+
+    sched_trace_begin(SCHED_SPAN_ALARM);
+    ESP_LOGI(TAG, "Alarm #%u tripped", id);
 
-    vTaskDelete(NULL);
+    if (!has_alarm_tripped) {
+        has_alarm_tripped = 1;
+        tone_play(&tone_pattern_alarm, TONE_PRIO_ALARM, alarm_note_cb);
+    }
+    sched_trace_end(SCHED_SPAN_ALARM);
 }
 
 esp_err_t init_status_led(uint32_t gpio)
@@ -246,12 +284,17 @@ esp_err_t init_status_led(uint32_t gpio)
 
 esp_err_t clock_init(uint32_t status_led_gpio, uint32_t buzzer_gpio)
 {
+    char tz[SETTINGS_TIMEZONE_MAX];
     esp_err_t rc;
     
     ESP_LOGI(TAG, "Initializing time");
 
-    setenv("TZ", "Europe/Zurich", 1);
-    tzset();
+    settings_get_timezone(tz, sizeof(tz));
+    rc = timekeeping_init(tz);
+    if (rc) {
+        ESP_LOGE(TAG, "Timekeeping initialization failed. (%s)", esp_err_to_name(rc));
+        return rc;
+    }
 
     srand(time(NULL));
 
@@ -261,11 +304,23 @@ esp_err_t clock_init(uint32_t status_led_gpio, uint32_t buzzer_gpio)
         return rc;
     }
 
+    rc = tone_init();
+    if (rc) {
+        ESP_LOGE(TAG, "Tone sequencer initialization failed. (%s)", esp_err_to_name(rc));
+        return rc;
+    }
+
     rc = init_status_led(status_led_gpio);
     if (rc) {
         ESP_LOGE(TAG, "Status LED initialization failed. (%s)", esp_err_to_name(rc));
         return rc;
     }
 
+    rc = alarm_init(clock_alarm_tripped);
+    if (rc) {
+        ESP_LOGE(TAG, "Alarm initialization failed. (%s)", esp_err_to_name(rc));
+        return rc;
+    }
+
     return ESP_OK;
 }
@@ -2,6 +2,7 @@
 #define CLOCK_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 #include "esp_err.h"
 
@@ -18,6 +19,8 @@ void clock_adjust_time_hour(int32_t delta);
 
 void clock_enter_set_alarm(void);
 void clock_exit_set_alarm(void);
+/* Leaves the set-alarm mode without storing the edited alarm */
+void clock_cancel_set_alarm(void);
 void clock_adjust_alarm_min(int32_t delta);
 void clock_adjust_alarm_hour(int32_t delta);
 
@@ -25,6 +28,7 @@ int clock_is_alarm_on(void);
 int clock_is_alarm_ringing(void);
 void clock_enable_alarm(void);
 void clock_disable_alarm(void);
+void clock_snooze_alarm(void);
 
 esp_err_t clock_get_time(clock_time_t *stime, bool *time_is_being_modified);
 
@@ -0,0 +1,482 @@
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_check.h"
+#include "esp_console.h"
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "alarm.h"
+#include "boot.h"
+#include "console.h"
+#include "frame_prof.h"
+#include "history.h"
+#include "i2c_trace.h"
+#include "memory.h"
+#include "power.h"
+#include "sched_trace.h"
+#include "screen.h"
+#include "sensor_trace.h"
+#include "settings.h"
+#include "tlog.h"
+#include "uplink.h"
+#include "weather.h"
+
+#define CONSOLE_MAX_TASKS 24
+
+#if CONFIG_STATION_CONSOLE
+
+static const char *TAG = "CONSOLE";
+
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY && CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+/* Kept between calls so the CPU share covers the time since the last call */
+static TaskStatus_t task_status[CONSOLE_MAX_TASKS];
+static struct {
+    TaskHandle_t task;
+    uint32_t run_time;
+} prev_run_time[CONSOLE_MAX_TASKS];
+static uint32_t prev_total_run_time = 0;
+
+static uint32_t task_prev_run_time(TaskHandle_t task)
+{
+    for (int i = 0; i < CONSOLE_MAX_TASKS; i++) {
+        if (prev_run_time[i].task == task) return prev_run_time[i].run_time;
+    }
+
+    return 0;
+}
+
+static int cmd_tasks(int argc, char **argv)
+{
+    uint32_t total_run_time, elapsed;
+    UBaseType_t n;
+
+    n = uxTaskGetSystemState(task_status, CONSOLE_MAX_TASKS, &total_run_time);
+    if (n == 0) {
+        printf("More than %d tasks\n", CONSOLE_MAX_TASKS);
+        return 1;
+    }
+
+    elapsed = total_run_time - prev_total_run_time;
+
+    printf("%-16s %4s %6s %10s\n", "task", "prio", "cpu %", "stack free");
+
+    for (UBaseType_t i = 0; i < n; i++) {
+        const TaskStatus_t *t = &task_status[i];
+        uint32_t run_time = t->ulRunTimeCounter - task_prev_run_time(t->xHandle);
+
+        printf("%-16s %4u %6.1f %10" PRIu32 "\n", t->pcTaskName, (unsigned int) t->uxCurrentPriority,
+               elapsed ? 100.0 * run_time / elapsed : 0.0, (uint32_t) t->usStackHighWaterMark);
+    }
+
+    memset(prev_run_time, 0, sizeof(prev_run_time));
+    for (UBaseType_t i = 0; i < n; i++) {
+        prev_run_time[i].task = task_status[i].xHandle;
+        prev_run_time[i].run_time = task_status[i].ulRunTimeCounter;
+    }
+    prev_total_run_time = total_run_time;
+
+    return 0;
+}
+#endif
+
+static int cmd_heap(int argc, char **argv)
+{
+    printf("internal: %u B total, %u B free, %u B minimum free, %u B largest block\n",
+           (unsigned int) heap_caps_get_total_size(MALLOC_CAP_INTERNAL),
+           (unsigned int) heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
+           (unsigned int) heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL),
+           (unsigned int) heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL));
+
+    if (memory_get_dropped_entries()) {
+        printf("%u static allocations not accounted, the table is full\n", memory_get_dropped_entries());
+    }
+
+    return 0;
+}
+
+static int cmd_sensors(int argc, char **argv)
+{
+    static const char *names[WEATHER_SENSOR_MAX] = {
+        [WEATHER_SENSOR_AHT20] = "aht20",
+        [WEATHER_SENSOR_BMP280] = "bmp280",
+    };
+    weather_sensor_stats_t stats;
+    derived_metrics_t derived;
+
+    printf("%-8s %8s %8s %6s %6s %10s %10s %10s\n", "sensor", "reads", "errors", "conv", "last", "last us",
+           "avg us", "max us");
+
+    /* conv: mean conversions per read, last: in the last burst; the times are per read */
+    for (int i = 0; i < WEATHER_SENSOR_MAX; i++) {
+        weather_get_stats(i, &stats);
+
+        printf("%-8s %8" PRIu32 " %8" PRIu32 " %6.2f %6" PRIu32 " %10" PRIu32 " %10" PRIu64 " %10" PRIu32 "\n",
+               names[i], stats.reads, stats.errors, stats.reads ? (double) stats.conversions / stats.reads : 0.0,
+               stats.last_conversions, stats.last_us, stats.reads ? stats.total_us / stats.reads : 0, stats.max_us);
+    }
+
+    printf("temperature %.2f degC, humidity %.2f %%, pressure %.2f hPa\n",
+           weather_get_temperature(), weather_get_humidity(), weather_get_pressure());
+
+    if (weather_get_derived(&derived)) {
+        printf("dew point %.2f degC, absolute humidity %.2f g/m3, heat index %.2f degC, sea level %.2f hPa\n",
+               derived.dew_point / 100.0, derived.absolute_humidity / 100.0, derived.heat_index / 100.0,
+               derived.sea_level_pressure / 100.0);
+    }
+
+    return 0;
+}
+
+static int cmd_frames(int argc, char **argv)
+{
+    screen_stats_t stats;
+
+    screen_get_stats(&stats);
+
+    printf("flushes %" PRIu32 ", flush errors %" PRIu32 "\n", stats.frames, stats.flush_errors);
+    printf("frames %" PRIu32 " B, %" PRIu32 " B per flush; effects %" PRIu32 " in %" PRIu32 " B, %" PRIu32 " errors\n",
+           stats.frame_bytes, stats.frames ? stats.frame_bytes / stats.frames : 0, stats.effects, stats.effect_bytes,
+           stats.effect_errors);
+
+    frame_prof_report();
+
+    return 0;
+}
+
+static int cmd_panel(int argc, char **argv)
+{
+    uint32_t a = argc > 2 ? strtoul(argv[2], NULL, 0) : 0;
+    uint32_t b = argc > 3 ? strtoul(argv[3], NULL, 0) : 0;
+    esp_err_t rc;
+
+    if (argc == 3 && strcmp(argv[1], "contrast") == 0) {
+        rc = screen_set_contrast(a);
+    } else if (argc == 3 && strcmp(argv[1], "invert") == 0) {
+        rc = screen_set_inverted(a != 0);
+    } else if (argc == 4 && (strcmp(argv[1], "left") == 0 || strcmp(argv[1], "right") == 0)) {
+        rc = screen_scroll_start(argv[1][0] == 'l', a, b, SCREEN_SCROLL_2_FRAMES);
+    } else if (argc == 2 && strcmp(argv[1], "stop") == 0) {
+        rc = screen_scroll_stop();
+    } else if (argc == 3 && strcmp(argv[1], "line") == 0) {
+        rc = screen_set_start_line(a);
+    } else {
+        printf("usage: panel contrast N | invert 0|1 | left|right FIRST_PAGE LAST_PAGE | stop | line N\n");
+        return 1;
+    }
+
+    ESP_RETURN_ON_ERROR(rc, TAG, "panel: %s failed", argv[1]);
+
+    return 0;
+}
+
+static int cmd_i2c(int argc, char **argv)
+{
+    static const char *ops[] = { "tx", "rx", "tx/rx" };
+    i2c_trace_record_t records[16];
+    weather_sensor_stats_t aht20, bmp280;
+    screen_stats_t screen;
+    size_t n;
+
+    if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+        i2c_trace_reset();
+        return 0;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "log") == 0) {
+        n = i2c_trace_snapshot(records, sizeof(records) / sizeof(records[0]));
+
+        for (size_t i = 0; i < n; i++) {
+            printf("%12" PRId64 " us 0x%02x %-5s %4u B %6" PRIu32 " us %s\n", records[i].start_us, records[i].addr,
+                   ops[records[i].op], records[i].bytes, records[i].duration_us, esp_err_to_name(records[i].rc));
+        }
+
+        return 0;
+    }
+
+    weather_get_stats(WEATHER_SENSOR_AHT20, &aht20);
+    weather_get_stats(WEATHER_SENSOR_BMP280, &bmp280);
+    screen_get_stats(&screen);
+
+    printf("errors: aht20 %" PRIu32 "/%" PRIu32 ", bmp280 %" PRIu32 "/%" PRIu32 ", panel %" PRIu32 "/%" PRIu32 "\n",
+           aht20.errors, aht20.reads, bmp280.errors, bmp280.reads, screen.flush_errors, screen.frames);
+
+    i2c_trace_report();
+
+    return 0;
+}
+
+#if CONFIG_STATION_SENSOR_TRACE
+static int cmd_trace(int argc, char **argv)
+{
+    sensor_trace_status_t status;
+    uint8_t chunk[32];
+    size_t n;
+
+    if (argc > 1 && strcmp(argv[1], "start") == 0) {
+        sensor_trace_start();
+    } else if (argc > 1 && strcmp(argv[1], "stop") == 0) {
+        sensor_trace_stop();
+    } else if (argc > 1 && strcmp(argv[1], "dump") == 0) {
+        /* Hex lines prefixed with "T:" so that the replay tool can pick them out of a monitor log */
+        while ((n = sensor_trace_read(chunk, sizeof(chunk))) > 0) {
+            printf("T:");
+            for (size_t i = 0; i < n; i++) printf("%02x", chunk[i]);
+            printf("\n");
+        }
+    }
+
+    sensor_trace_get_status(&status);
+
+    printf("%s, %" PRIu32 " records, %" PRIu32 " dropped, %u/%u B buffered\n", status.recording ? "recording" : "stopped",
+           status.records, status.dropped, (unsigned int) status.used, (unsigned int) status.size);
+
+    return 0;
+}
+#endif
+
+#if CONFIG_STATION_HISTORY
+/* Same "prefix and hex" lines as the sensor trace, "H:" for the history decoder */
+static void history_write_hex(void *ctx, const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i += 32) {
+        printf("H:");
+        for (size_t j = i; j < len && j < i + 32; j++) printf("%02x", data[j]);
+        printf("\n");
+    }
+}
+
+static int cmd_history(int argc, char **argv)
+{
+    history_export_stats_t stats;
+
+    if (argc > 1 && strcmp(argv[1], "export") == 0) {
+        ESP_RETURN_ON_ERROR(history_export(history_write_hex, NULL, &stats), TAG, "history export failed");
+
+        printf("%" PRIu32 " samples in %" PRIu32 " B (%.2f B/sample), %" PRIu32 " overwritten, %" PRIu32 " us\n",
+               stats.samples, stats.bytes, stats.samples ? (double) stats.bytes / stats.samples : 0.0,
+               stats.skipped, stats.duration_us);
+        return 0;
+    }
+
+    printf("%u samples stored\n", (unsigned int) history_count());
+
+    return 0;
+}
+#endif
+
+static int cmd_boot(int argc, char **argv)
+{
+    boot_report();
+
+    return 0;
+}
+
+static int cmd_config(int argc, char **argv)
+{
+    char tz[SETTINGS_TIMEZONE_MAX];
+    settings_stats_t stats;
+    setting_id_t id;
+
+    if (argc == 3 && strcmp(argv[1], "timezone") == 0) {
+        ESP_RETURN_ON_ERROR(settings_set_timezone(argv[2]), TAG, "config: invalid time zone");
+        printf("timezone takes effect after a restart\n");
+        return 0;
+    }
+
+    if (argc == 3) {
+        id = settings_find(argv[1]);
+        ESP_RETURN_ON_FALSE(id < SETTING_COUNT, 1, TAG, "config: unknown setting %s", argv[1]);
+        ESP_RETURN_ON_ERROR(settings_set(id, strtoul(argv[2], NULL, 0)), TAG, "config: invalid value");
+        return 0;
+    }
+
+    if (argc == 2 && strcmp(argv[1], "save") == 0) {
+        ESP_RETURN_ON_ERROR(settings_flush(), TAG, "config: save failed");
+        return 0;
+    }
+
+    for (id = 0; id < SETTING_COUNT; id++) {
+        const setting_desc_t *desc = settings_desc(id);
+
+        printf("%-12s %8" PRIu32 " %-4s (%" PRIu32 "..%" PRIu32 ", default %" PRIu32 ")\n", desc->name,
+               settings_get(id), desc->unit, desc->min, desc->max, desc->def);
+    }
+
+    settings_get_timezone(tz, sizeof(tz));
+    printf("%-12s %s\n", "timezone", tz);
+
+    settings_get_stats(&stats);
+    printf("%" PRIu32 " changes, %" PRIu32 " saves (%" PRIu32 " keys), %" PRIu32 " errors\n", stats.sets,
+           stats.saves, stats.keys_written, stats.errors);
+
+    return 0;
+}
+
+#if CONFIG_STATION_UPLINK
+static int cmd_uplink(int argc, char **argv)
+{
+    uplink_stats_t stats;
+
+    uplink_get_stats(&stats);
+
+    printf("%" PRIu32 " sessions, %" PRIu32 " failed, last: %s\n", stats.sessions, stats.failures,
+           esp_err_to_name(stats.last_error));
+    printf("%" PRIu32 " batches, %" PRIu32 " samples in %" PRIu32 " B, %u pending, %" PRIu32 " dropped\n",
+           stats.batches, stats.samples_sent, stats.bytes_sent, (unsigned int) uplink_pending(), stats.dropped);
+    printf("radio on %" PRIu64 " ms in total, %" PRIu64 " ms per batch\n", stats.radio_on_us / 1000,
+           stats.batches ? stats.radio_on_us / 1000 / stats.batches : 0);
+
+    return 0;
+}
+#endif
+
+static int cmd_alarm(int argc, char **argv)
+{
+    alarm_status_t status;
+    struct tm tm;
+    char buf[32];
+
+    alarm_get_status(&status);
+
+    printf("%s, %u pending, %" PRIu32 " fired since boot\n", status.armed ? "armed" : "disarmed",
+           status.pending, status.fired);
+
+    if (status.next_when) {
+        localtime_r(&status.next_when, &tm);
+        strftime(buf, sizeof(buf), "%a %Y-%m-%d %H:%M", &tm);
+
+        if (status.next_id == ALARM_MAX) {
+            printf("next: snooze at %s\n", buf);
+        } else {
+            printf("next: #%d at %s\n", status.next_id, buf);
+        }
+    }
+
+    return 0;
+}
+
+#if CONFIG_STATION_TLOG
+static int cmd_tlog(int argc, char **argv)
+{
+    tlog_stats_t stats;
+
+    tlog_get_stats(&stats);
+
+    printf("%" PRIu32 " records, %" PRIu32 " dropped, %" PRIu32 " B written\n", stats.records, stats.dropped,
+           stats.drained_bytes);
+
+    return 0;
+}
+#endif
+
+#if CONFIG_STATION_SCHED_TRACE
+static int cmd_sched(int argc, char **argv)
+{
+    sched_trace_status_t status;
+    uint8_t chunk[32];
+    size_t n;
+
+    if (argc > 1 && strcmp(argv[1], "start") == 0) {
+        sched_trace_start();
+    } else if (argc > 1 && strcmp(argv[1], "stop") == 0) {
+        sched_trace_stop();
+    } else if (argc > 1 && strcmp(argv[1], "dump") == 0) {
+        /* "S:" lines for host/sched, like the sensor trace */
+        while ((n = sched_trace_read(chunk, sizeof(chunk))) > 0) {
+            printf("S:");
+            for (size_t i = 0; i < n; i++) printf("%02x", chunk[i]);
+            printf("\n");
+        }
+    }
+
+    sched_trace_get_status(&status);
+
+    printf("%s, %" PRIu32 " records, %" PRIu32 " dropped, %u/%u B buffered\n", status.recording ? "recording" : "stopped",
+           status.records, status.dropped, (unsigned int) status.used, (unsigned int) status.size);
+
+    return 0;
+}
+#endif
+
+static int cmd_power(int argc, char **argv)
+{
+    power_report();
+
+    return 0;
+}
+
+static const esp_console_cmd_t commands[] = {
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY && CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    { .command = "tasks", .help = "CPU share since the last call and stack high-water mark per task", .func = cmd_tasks },
+#endif
+    { .command = "heap", .help = "Heap free, minimum free and largest block", .func = cmd_heap },
+    { .command = "sensors", .help = "Sensor read counts and latencies", .func = cmd_sensors },
+    { .command = "frames", .help = "Display pipeline p50/p90 per stage and frame budget overruns", .func = cmd_frames },
+    { .command = "panel", .help = "Panel effects done by the controller: \"panel contrast N\", \"panel invert 0|1\", \"panel left|right FIRST LAST\" scrolls pages, \"panel stop\", \"panel line N\" sets the start line", .func = cmd_panel },
+    { .command = "i2c", .help = "I2C errors, latency histograms and bus utilization; \"i2c log\" lists the last transactions, \"i2c reset\" restarts the statistics", .func = cmd_i2c },
+#if CONFIG_STATION_SENSOR_TRACE
+    { .command = "trace", .help = "Raw sensor trace: \"trace start\", \"trace stop\", \"trace dump\" drains the buffer as hex", .func = cmd_trace },
+#endif
+#if CONFIG_STATION_HISTORY
+    { .command = "history", .help = "Sample history; \"history export\" streams it compressed as hex", .func = cmd_history },
+#endif
+    { .command = "boot", .help = "Boot phase timeline, time to first frame and first sensor reading", .func = cmd_boot },
+    { .command = "config", .help = "Runtime settings; \"config NAME VALUE\" changes one, \"config save\" writes the pending changes now", .func = cmd_config },
+#if CONFIG_STATION_UPLINK
+    { .command = "uplink", .help = "Upload sessions, batches, spooled samples and radio-on time", .func = cmd_uplink },
+#endif
+    { .command = "alarm", .help = "Alarm scheduler state", .func = cmd_alarm },
+#if CONFIG_STATION_TLOG
+    { .command = "tlog", .help = "Tokenized log records, drops and bytes written as \"L:\" lines", .func = cmd_tlog },
+#endif
+#if CONFIG_STATION_SCHED_TRACE
+    { .command = "sched", .help = "Scheduler trace: \"sched start\", \"sched stop\", \"sched dump\" drains the buffer as hex", .func = cmd_sched },
+#endif
+    { .command = "power", .help = "Light sleep share and power lock hold times", .func = cmd_power },
+};
+
+esp_err_t console_init(void)
+{
+    esp_console_repl_t *repl = NULL;
+    esp_console_repl_config_t repl_config = ESP_CONSOLE_REPL_CONFIG_DEFAULT();
+
+    repl_config.prompt = "station>";
+
+#if CONFIG_ESP_CONSOLE_USB_SERIAL_JTAG
+    esp_console_dev_usb_serial_jtag_config_t hw_config = ESP_CONSOLE_DEV_USB_SERIAL_JTAG_CONFIG_DEFAULT();
+    ESP_RETURN_ON_ERROR(esp_console_new_repl_usb_serial_jtag(&hw_config, &repl_config, &repl), TAG, "console_init: creating REPL failed");
+#elif CONFIG_ESP_CONSOLE_UART
+    esp_console_dev_uart_config_t hw_config = ESP_CONSOLE_DEV_UART_CONFIG_DEFAULT();
+    ESP_RETURN_ON_ERROR(esp_console_new_repl_uart(&hw_config, &repl_config, &repl), TAG, "console_init: creating REPL failed");
+#else
+    ESP_LOGW(TAG, "No console port, REPL disabled");
+    return ESP_OK;
+#endif
+
+    /* Commands can only be registered once the REPL initialized esp_console */
+    for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+        ESP_RETURN_ON_ERROR(esp_console_cmd_register(&commands[i]), TAG, "console_init: registering %s failed", commands[i].command);
+    }
+
+    ESP_RETURN_ON_ERROR(esp_console_register_help_command(), TAG, "console_init: registering help failed");
+
+    return esp_console_start_repl(repl);
+}
+
+#else /* !CONFIG_STATION_CONSOLE */
+
+esp_err_t console_init(void)
+{
+    return ESP_OK;
+}
+
+#endif
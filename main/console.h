@@ -0,0 +1,15 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include "esp_err.h"
+
+/*
+ * Diagnostic REPL on the console port (CONFIG_STATION_CONSOLE).
+ *
+ * Commands only read counters maintained by the subsystems, so they can
+ * be used on a running station without disturbing it.
+ */
+
+esp_err_t console_init(void);
+
+#endif
@@ -0,0 +1,230 @@
+#include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+#include "esp_check.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "buttons.h"
+#include "clock.h"
+#include "controller.h"
+#include "memory.h"
+#include "sched_trace.h"
+#include "tlog.h"
+#include "tone.h"
+
+#define CONTROLLER_QUEUE_LEN 8
+/* Room for the NVS write done when leaving the set alarm mode */
+#define CONTROLLER_TASK_STACK_SIZE (3 * 1024)
+
+typedef enum ui_state {
+    UI_NORMAL = 0,
+    UI_SET_TIME_HOUR,
+    UI_SET_TIME_MIN,
+    UI_SET_ALARM_HOUR,
+    UI_SET_ALARM_MIN,
+} ui_state_t;
+
+typedef enum ui_input {
+    INPUT_NONE = 0,
+    INPUT_CTRL,
+    INPUT_UP,
+    INPUT_DOWN,
+    INPUT_SWITCH_ON,
+    INPUT_SWITCH_OFF,
+} ui_input_t;
+
+typedef struct transition {
+    ui_state_t state;
+    ui_input_t input;
+    bool (*guard)(void);        /* NULL always passes */
+    void (*action)(void);       /* NULL does nothing */
+    ui_state_t next;
+} transition_t;
+
+static const char *TAG = "CONTROLLER";
+
+static QueueHandle_t event_queue = NULL;
+static StaticQueue_t event_queue_buf;
+static uint8_t event_queue_storage[CONTROLLER_QUEUE_LEN * sizeof(button_event_t)];
+
+static StackType_t controller_stack[CONTROLLER_TASK_STACK_SIZE];
+static StaticTask_t controller_tcb;
+
+/* Only accessed from the controller task */
+static ui_state_t state = UI_NORMAL;
+/* The switch edges are not handled while setting the time, its level is applied when done */
+static bool resync_switch = false;
+
+static bool alarm_ringing(void)
+{
+    return clock_is_alarm_ringing();
+}
+
+static bool alarm_off(void)
+{
+    return !clock_is_alarm_on();
+}
+
+static void click(void)
+{
+    tone_play(&tone_pattern_click, TONE_PRIO_CLICK, NULL);
+}
+
+static void time_hour_up(void)   { click(); clock_adjust_time_hour(1); }
+static void time_hour_down(void) { click(); clock_adjust_time_hour(-1); }
+static void time_min_up(void)    { click(); clock_adjust_time_min(1); }
+static void time_min_down(void)  { click(); clock_adjust_time_min(-1); }
+
+static void alarm_hour_up(void)   { click(); clock_adjust_alarm_hour(1); }
+static void alarm_hour_down(void) { click(); clock_adjust_alarm_hour(-1); }
+static void alarm_min_up(void)    { click(); clock_adjust_alarm_min(1); }
+static void alarm_min_down(void)  { click(); clock_adjust_alarm_min(-1); }
+
+static void start_set_alarm(void)
+{
+    clock_enable_alarm();
+    clock_enter_set_alarm();
+}
+
+static void finish_set_time(void)
+{
+    clock_exit_set_time();
+    tone_play(&tone_pattern_confirm, TONE_PRIO_NOTIFY, NULL);
+    resync_switch = true;
+}
+
+static void finish_set_alarm(void)
+{
+    clock_exit_set_alarm();
+    tone_play(&tone_pattern_confirm, TONE_PRIO_NOTIFY, NULL);
+}
+
+static void cancel_set_alarm(void)
+{
+    clock_cancel_set_alarm();
+    clock_disable_alarm();
+}
+
+/* The first row matching the state and input whose guard passes is taken */
+static const transition_t transitions[] = {
+    { UI_NORMAL,         INPUT_CTRL,       alarm_ringing, clock_snooze_alarm,    UI_NORMAL },
+    { UI_NORMAL,         INPUT_CTRL,       NULL,          clock_enter_set_time,  UI_SET_TIME_HOUR },
+    { UI_NORMAL,         INPUT_SWITCH_ON,  alarm_off,     start_set_alarm,       UI_SET_ALARM_HOUR },
+    { UI_NORMAL,         INPUT_SWITCH_OFF, NULL,          clock_disable_alarm,   UI_NORMAL },
+
+    { UI_SET_TIME_HOUR,  INPUT_UP,         NULL,          time_hour_up,          UI_SET_TIME_HOUR },
+    { UI_SET_TIME_HOUR,  INPUT_DOWN,       NULL,          time_hour_down,        UI_SET_TIME_HOUR },
+    { UI_SET_TIME_HOUR,  INPUT_CTRL,       NULL,          NULL,                  UI_SET_TIME_MIN },
+    { UI_SET_TIME_MIN,   INPUT_UP,         NULL,          time_min_up,           UI_SET_TIME_MIN },
+    { UI_SET_TIME_MIN,   INPUT_DOWN,       NULL,          time_min_down,         UI_SET_TIME_MIN },
+    { UI_SET_TIME_MIN,   INPUT_CTRL,       NULL,          finish_set_time,       UI_NORMAL },
+
+    { UI_SET_ALARM_HOUR, INPUT_UP,         NULL,          alarm_hour_up,         UI_SET_ALARM_HOUR },
+    { UI_SET_ALARM_HOUR, INPUT_DOWN,       NULL,          alarm_hour_down,       UI_SET_ALARM_HOUR },
+    { UI_SET_ALARM_HOUR, INPUT_CTRL,       NULL,          NULL,                  UI_SET_ALARM_MIN },
+    { UI_SET_ALARM_HOUR, INPUT_SWITCH_OFF, NULL,          cancel_set_alarm,      UI_NORMAL },
+    { UI_SET_ALARM_MIN,  INPUT_UP,         NULL,          alarm_min_up,          UI_SET_ALARM_MIN },
+    { UI_SET_ALARM_MIN,  INPUT_DOWN,       NULL,          alarm_min_down,        UI_SET_ALARM_MIN },
+    { UI_SET_ALARM_MIN,  INPUT_CTRL,       NULL,          finish_set_alarm,      UI_NORMAL },
+    { UI_SET_ALARM_MIN,  INPUT_SWITCH_OFF, NULL,          cancel_set_alarm,      UI_NORMAL },
+};
+
+static ui_input_t button_input(const button_event_t *event)
+{
+    switch (event->button) {
+        case BUTTON_CTRL:
+            return event->type == BUTTON_EVENT_PRESS ? INPUT_CTRL : INPUT_NONE;
+        case BUTTON_UP:
+            return event->type == BUTTON_EVENT_PRESS || event->type == BUTTON_EVENT_REPEAT ? INPUT_UP : INPUT_NONE;
+        case BUTTON_DOWN:
+            return event->type == BUTTON_EVENT_PRESS || event->type == BUTTON_EVENT_REPEAT ? INPUT_DOWN : INPUT_NONE;
+        case BUTTON_SWITCH:
+            if (event->type == BUTTON_EVENT_PRESS) return INPUT_SWITCH_ON;
+            if (event->type == BUTTON_EVENT_RELEASE) return INPUT_SWITCH_OFF;
+            return INPUT_NONE;
+        default:
+            return INPUT_NONE;
+    }
+}
+
+static void dispatch(ui_input_t input)
+{
+    for (size_t i = 0; i < sizeof(transitions) / sizeof(transitions[0]); i++) {
+        const transition_t *t = &transitions[i];
+
+        if (t->state != state || t->input != input) continue;
+        if (t->guard && !t->guard()) continue;
+
+        if (t->action) t->action();
+
+        if (t->next != state) {
+            TLOGD(TAG, "state %d -> %d", state, t->next);
+            state = t->next;
+        }
+
+        return;
+    }
+}
+
+/* The switch edge that brings the alarm in line with the switch level, if any */
+static ui_input_t switch_input(void)
+{
+    bool on = buttons_is_pressed(BUTTON_SWITCH);
+
+    if (on && !clock_is_alarm_on()) return INPUT_SWITCH_ON;
+    if (!on && clock_is_alarm_on()) return INPUT_SWITCH_OFF;
+    return INPUT_NONE;
+}
+
+static void controller_task(void *arg)
+{
+    button_event_t event;
+    int64_t latency_us, max_latency_us = 0;
+
+    for(;;) {
+        xQueueReceive(event_queue, &event, portMAX_DELAY);
+
+        latency_us = esp_timer_get_time() - event.timestamp_us;
+        max_latency_us = MAX(max_latency_us, latency_us);
+        TLOGD(TAG, "button %u event %u latency %" PRId64 " us (max %" PRId64 " us)",
+                 event.button, event.type, latency_us, max_latency_us);
+
+        sched_trace_begin(SCHED_SPAN_BUTTON);
+        dispatch(button_input(&event));
+        if (resync_switch && state == UI_NORMAL) {
+            resync_switch = false;
+            dispatch(switch_input());
+        }
+        sched_trace_end(SCHED_SPAN_BUTTON);
+    }
+
+    vTaskDelete(NULL);
+}
+
+void controller_post_button(const button_event_t *event)
+{
+    if (xQueueSend(event_queue, event, 0) != pdTRUE) {
+        TLOGW(TAG, "Event queue full, button event dropped");
+    }
+}
+
+esp_err_t controller_init(void)
+{
+    TaskHandle_t task;
+
+    event_queue = xQueueCreateStatic(CONTROLLER_QUEUE_LEN, sizeof(button_event_t), event_queue_storage, &event_queue_buf);
+    memory_account("controller", "event queue", sizeof(event_queue_storage) + sizeof(event_queue_buf));
+
+    task = xTaskCreateStatic(controller_task, "controller_task", CONTROLLER_TASK_STACK_SIZE, NULL, 4, controller_stack, &controller_tcb);
+    memory_account_task("controller", task, sizeof(controller_stack) + sizeof(controller_tcb));
+
+    return ESP_OK;
+}
@@ -0,0 +1,23 @@
+#ifndef CONTROLLER_H
+#define CONTROLLER_H
+
+#include "esp_err.h"
+
+#include "buttons.h"
+
+/*
+ * User interface controller.
+ *
+ * A single task owns the UI state and runs every input event through a
+ * static transition table; entering or leaving a mode allocates nothing.
+ */
+
+/*
+ * Posts a button event to the controller, suitable as a buttons_event_cb_t.
+ * Never blocks, the event is dropped if the queue is full.
+ */
+void controller_post_button(const button_event_t *event);
+
+esp_err_t controller_init(void);
+
+#endif
@@ -0,0 +1,200 @@
+#include <stdint.h>
+
+#include "derived.h"
+
+#define Q               28
+#define ONE_Q           ((int64_t) 1 << Q)
+#define STEP_SHIFT      (Q - 6)             /* Tables every 1/64 */
+#define STEP_MASK       (((int64_t) 1 << STEP_SHIFT) - 1)
+
+#define LN2_Q           186065279LL
+#define LN10000_Q       2472381918LL        /* ln of 100 % in 0.01 % */
+
+/* Magnus over water: b = 17.62, c = 243.12 °C, es(0 °C) = 611.2 Pa */
+#define MAGNUS_B_Q      4729832735LL
+#define MAGNUS_B_X100   1762
+#define MAGNUS_C        24312               /* 0.01 °C */
+#define MAGNUS_ES0      611200              /* mPa */
+
+/* g / R_d with T in 0.01 K, so that g h / (R_d T) = HYPSO_Q * h / T */
+#define HYPSO_Q         917071090LL
+
+/* exp(i / 64) for i / 64 < ln 2, in Q28 */
+static const uint32_t exp_table[] = {
+    268435456, 272662699, 276956512, 281317943, 285748055, 290247933,
+    294818672, 299461391, 304177222, 308967316, 313832843, 318774991,
+    323794967, 328893996, 334073323, 339334212, 344677948, 350105836,
+    355619201, 361219388, 366907766, 372685723, 378554669, 384516037,
+    390571284, 396721887, 402969347, 409315191, 415760967, 422308250,
+    428958637, 435713753, 442575246, 449544792, 456624093, 463814876,
+    471118897, 478537940, 486073816, 493728365, 501503456, 509400986,
+    517422884, 525571109, 533847650,
+};
+
+/* ln(1 + i / 64) in Q28 */
+static const uint32_t ln_table[] = {
+    0, 4161873, 8260204, 12296904, 16273798, 20192633,
+    24055081, 27862740, 31617143, 35319760, 38971999, 42575214,
+    46130702, 49639712, 53103444, 56523050, 59899641, 63234286,
+    66528014, 69781817, 72996651, 76173439, 79313071, 82416405,
+    85484273, 88517474, 91516784, 94482952, 97416702, 100318735,
+    103189730, 106030343, 108841211, 111622951, 114376159, 117101415,
+    119799282, 122470304, 125115009, 127733912, 130327512, 132896292,
+    135440723, 137961262, 140458354, 142932431, 145383913, 147813210,
+    150220719, 152606828, 154971913, 157316343, 159640474, 161944655,
+    164229226, 166494517, 168740852, 170968545, 173177903, 175369225,
+    177542803, 179698923, 181837862, 183959893, 186065279,
+};
+
+static int64_t div_round(int64_t n, int64_t d)
+{
+    return n >= 0 ? (n + d / 2) / d : -((-n + d / 2) / d);
+}
+
+static int32_t clamp(int32_t v, int32_t min, int32_t max)
+{
+    return v < min ? min : v > max ? max : v;
+}
+
+/* ln(v) in Q28, for v >= 1 */
+static int64_t ln_q(uint32_t v)
+{
+    int k = 31 - __builtin_clz(v);
+    int64_t m = ((int64_t) v << (Q - k)) - ONE_Q;  /* Mantissa - 1, in [0, 1) */
+    int64_t i = m >> STEP_SHIFT;
+    int64_t u;
+
+    /* ln(1 + i/64 + f) = ln(1 + i/64) + ln(1 + u), u = f / (1 + i/64) < 1/64 */
+    u = ((m & STEP_MASK) << Q) / (ONE_Q + (i << STEP_SHIFT));
+
+    return k * LN2_Q + ln_table[i] + u - ((u * u) >> (Q + 1));
+}
+
+/* round(v exp(x)) for v >= 0 and x in Q28 */
+static int64_t scale_exp(int64_t v, int64_t x)
+{
+    int64_t k = x / LN2_Q;
+    int64_t r, f, m;
+    int shift;
+
+    if (x - k * LN2_Q < 0) k--;
+    r = x - k * LN2_Q;                      /* In [0, ln 2) */
+    f = r & STEP_MASK;
+
+    /* exp(i/64 + f) = exp(i/64) (1 + f + f²/2), f < 1/64 */
+    m = exp_table[r >> STEP_SHIFT];
+    m += (m * (f + ((f * f) >> (Q + 1)))) >> Q;
+
+    shift = Q - (int) k;
+    if (shift >= 63) return 0;
+    if (shift <= 0) return v * m << -shift;
+
+    return (v * m + ((int64_t) 1 << (shift - 1))) >> shift;
+}
+
+/* ln(e / es(0 °C)) of the vapour pressure e, in Q28 */
+static int64_t magnus_gamma(int32_t temperature, int32_t humidity)
+{
+    int64_t t = clamp(temperature, DERIVED_T_MIN, DERIVED_T_MAX);
+
+    return ln_q(clamp(humidity, 1, 10000)) - LN10000_Q + (MAGNUS_B_X100 * t << Q) / (100 * (MAGNUS_C + t));
+}
+
+static int32_t dew_point(int64_t gamma)
+{
+    return (int32_t) div_round(MAGNUS_C * gamma, MAGNUS_B_Q - gamma);
+}
+
+static int32_t absolute_humidity(int64_t gamma, int32_t temperature)
+{
+    int64_t e = scale_exp(MAGNUS_ES0, gamma);   /* mPa */
+    int64_t kelvin = clamp(temperature, DERIVED_T_MIN, DERIVED_T_MAX) + 27315;
+
+    /* rho = e M_w / (R T) = 2.16679 g K / (m³ Pa) * e / T */
+    return (int32_t) div_round(e * 216679, kelvin * 10000);
+}
+
+int32_t derived_dew_point(int32_t temperature, int32_t humidity)
+{
+    return dew_point(magnus_gamma(temperature, humidity));
+}
+
+int32_t derived_absolute_humidity(int32_t temperature, int32_t humidity)
+{
+    return absolute_humidity(magnus_gamma(temperature, humidity), temperature);
+}
+
+static int64_t isqrt64(int64_t v)
+{
+    int64_t r = 0, bit = (int64_t) 1 << 62;
+
+    if (v <= 0) return 0;
+
+    while (bit > v) bit >>= 2;
+
+    while (bit != 0) {
+        if (v >= r + bit) {
+            v -= r + bit;
+            r = (r >> 1) + bit;
+        } else {
+            r >>= 1;
+        }
+        bit >>= 2;
+    }
+
+    return r;
+}
+
+int32_t derived_heat_index(int32_t temperature, int32_t humidity)
+{
+    /* The NOAA formulas are in °F; t in 0.001 °F (exact), r in 0.01 % */
+    int64_t t = (int64_t) clamp(temperature, DERIVED_T_MIN, DERIVED_T_MAX) * 18 + 32000;
+    int64_t r = clamp(humidity, 0, 10000);
+    int64_t hi, a, b, c;
+
+    /* Steadman: 0.5 (T + 61 + 1.2 (T - 68) + 0.094 RH) */
+    hi = div_round(t + 61000 + div_round((t - 68000) * 6, 5) + div_round(r * 94, 100), 2);
+
+    if (hi + t >= 160000) {
+        /* Rothfusz, with the coefficients in 1e-8 and grouped by powers of T */
+        a = -4237900000LL + 1014333127LL * r / 100 - 5481717LL * r * r / 10000;
+        b = 204901523LL - 22475541LL * r / 100 + 85282LL * r * r / 10000;
+        c = -683783LL + 122874LL * r / 100 - 199LL * r * r / 10000;
+
+        hi = div_round(a + div_round(b * t, 1000) + div_round(c * t * t, 1000000), 100000);
+
+        if (r < 1300 && t >= 80000 && t <= 112000) {
+            /* - (13 - RH) / 4 * sqrt((17 - |T - 95|) / 17) */
+            int64_t d = t < 95000 ? 95000 - t : t - 95000;
+            int64_t s = isqrt64((17000 - d) * 1000000000LL / 17);  /* In 1e-6 */
+
+            hi -= div_round((1300 - r) * s, 400000);
+        } else if (r > 8500 && t >= 80000 && t <= 87000) {
+            /* + (RH - 85) / 10 * (87 - T) / 5 */
+            hi += div_round((r - 8500) * (87000 - t), 5000);
+        }
+    }
+
+    return (int32_t) div_round(hi - 32000, 18);
+}
+
+int32_t derived_sea_level_pressure(int32_t pressure, int32_t temperature, int32_t altitude)
+{
+    /* Mean temperature of the air column below the station (6.5 K/km), 0.01 K / 40 */
+    int64_t mean = (clamp(temperature, DERIVED_T_MIN, DERIVED_T_MAX) + 27315) * 40 + (int64_t) altitude * 13;
+
+    if (altitude == 0 || pressure <= 0) return pressure;
+
+    /* p0 = p exp(g h / (R_d T_mean)) */
+    return (int32_t) scale_exp(pressure, HYPSO_Q * altitude * 40 / mean);
+}
+
+void derived_compute(const derived_input_t *in, derived_metrics_t *out)
+{
+    int64_t gamma = magnus_gamma(in->temperature, in->humidity);
+
+    out->dew_point = dew_point(gamma);
+    out->absolute_humidity = absolute_humidity(gamma, in->temperature);
+    out->heat_index = derived_heat_index(in->temperature, in->humidity);
+    out->sea_level_pressure = derived_sea_level_pressure(in->pressure, in->temperature, in->altitude);
+}
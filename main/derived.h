@@ -0,0 +1,51 @@
+#ifndef DERIVED_H
+#define DERIVED_H
+
+#include <stdint.h>
+
+/*
+ * Derived weather metrics in fixed point.
+ *
+ * The C3 has no FPU, so the exp and ln of the usual formulas are small Q28
+ * tables (every 1/64, with a second-order correction between entries) and
+ * everything else is integer arithmetic:
+ *
+ *  - the dew point and the vapour pressure follow the Magnus formula over
+ *    water (b = 17.62, c = 243.12 °C); both come from one ln(RH) and one
+ *    exp per sample;
+ *  - absolute humidity follows from the vapour pressure by the ideal gas law;
+ *  - the heat index is the NOAA one: Steadman below 80 °F, the Rothfusz
+ *    regression with its low and high humidity adjustments above;
+ *  - the sea-level pressure is the hypsometric reduction with the mean
+ *    temperature of the air column (6.5 K/km lapse rate).
+ *
+ * From -40 to +60 °C the error against the same formulas in double
+ * precision stays below 0.02 °C, 0.01 g/m³ and 5 Pa (host/derived checks
+ * it). Temperatures are clamped to DERIVED_T_MIN..DERIVED_T_MAX.
+ */
+
+#define DERIVED_T_MIN   (-9000)     /* 0.01 °C */
+#define DERIVED_T_MAX   9000
+
+typedef struct derived_input {
+    int32_t temperature;        /* 0.01 °C */
+    int32_t humidity;           /* 0.01 %RH */
+    int32_t pressure;           /* Pa, at the station */
+    int32_t altitude;           /* m above sea level */
+} derived_input_t;
+
+typedef struct derived_metrics {
+    int32_t dew_point;          /* 0.01 °C */
+    int32_t absolute_humidity;  /* 0.01 g/m³ */
+    int32_t heat_index;         /* 0.01 °C */
+    int32_t sea_level_pressure; /* Pa */
+} derived_metrics_t;
+
+int32_t derived_dew_point(int32_t temperature, int32_t humidity);
+int32_t derived_absolute_humidity(int32_t temperature, int32_t humidity);
+int32_t derived_heat_index(int32_t temperature, int32_t humidity);
+int32_t derived_sea_level_pressure(int32_t pressure, int32_t temperature, int32_t altitude);
+
+void derived_compute(const derived_input_t *in, derived_metrics_t *out);
+
+#endif
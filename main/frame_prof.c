@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "esp_timer.h"
+
+#include "frame_prof.h"
+#include "memory.h"
+
+#define FRAME_PROF_RING_LEN 64
+
+typedef struct frame_record {
+    uint32_t stage_us[FRAME_STAGE_MAX];
+} frame_record_t;
+
+static const char *stage_names[FRAME_STAGE_MAX] = {
+    [FRAME_STAGE_TIMERS] = "timers",
+    [FRAME_STAGE_RENDER] = "render",
+    [FRAME_STAGE_CONVERT] = "convert",
+    [FRAME_STAGE_TRANSFER] = "transfer",
+    [FRAME_STAGE_READY] = "ready",
+    [FRAME_STAGE_TOTAL] = "total",
+};
+
+/* Marks of the frame in progress, written by the LVGL task and the panel IO callback */
+static int64_t marks[FRAME_MARK_MAX];
+
+static portMUX_TYPE ring_lock = portMUX_INITIALIZER_UNLOCKED;
+static frame_record_t ring[FRAME_PROF_RING_LEN];
+static uint32_t n_frames = 0;
+static uint32_t n_overruns = 0;
+
+/* The ring as of the last report, static to keep it off the console task's stack */
+static frame_record_t copy[FRAME_PROF_RING_LEN];
+
+static uint32_t span(frame_mark_t from, frame_mark_t to)
+{
+    /* A missing mark (0) or marks out of order yield an empty stage */
+    return marks[from] != 0 && marks[to] > marks[from] ? marks[to] - marks[from] : 0;
+}
+
+static void push_frame(void)
+{
+    frame_record_t rec;
+
+    rec.stage_us[FRAME_STAGE_TIMERS] = span(FRAME_MARK_HANDLER_START, FRAME_MARK_REFR_START);
+    rec.stage_us[FRAME_STAGE_RENDER] = span(FRAME_MARK_REFR_START, FRAME_MARK_FLUSH_START);
+    rec.stage_us[FRAME_STAGE_CONVERT] = span(FRAME_MARK_FLUSH_START, FRAME_MARK_CONVERT_END);
+    rec.stage_us[FRAME_STAGE_TRANSFER] = span(FRAME_MARK_CONVERT_END, FRAME_MARK_FLUSH_READY);
+    rec.stage_us[FRAME_STAGE_READY] = span(FRAME_MARK_FLUSH_READY, FRAME_MARK_REFR_READY);
+    rec.stage_us[FRAME_STAGE_TOTAL] = span(FRAME_MARK_HANDLER_START, FRAME_MARK_REFR_READY);
+
+    portENTER_CRITICAL(&ring_lock);
+    ring[n_frames % FRAME_PROF_RING_LEN] = rec;
+    n_frames++;
+    n_overruns += rec.stage_us[FRAME_STAGE_TOTAL] > CONFIG_STATION_FRAME_BUDGET_MS * 1000;
+    portEXIT_CRITICAL(&ring_lock);
+}
+
+void frame_prof_mark(frame_mark_t mark)
+{
+    marks[mark] = esp_timer_get_time();
+
+    switch (mark) {
+        case FRAME_MARK_HANDLER_START:
+            /* Frames that never reached the panel are not recorded */
+            marks[FRAME_MARK_REFR_START] = 0;
+            marks[FRAME_MARK_FLUSH_START] = 0;
+            marks[FRAME_MARK_CONVERT_END] = 0;
+            marks[FRAME_MARK_FLUSH_READY] = 0;
+            break;
+        case FRAME_MARK_REFR_READY:
+            if (marks[FRAME_MARK_FLUSH_START] != 0) push_frame();
+            break;
+        default:
+            break;
+    }
+}
+
+static void sort(uint32_t *v, unsigned int n)
+{
+    for (unsigned int i = 1; i < n; i++) {
+        uint32_t x = v[i];
+        unsigned int j;
+
+        for (j = i; j > 0 && v[j - 1] > x; j--) {
+            v[j] = v[j - 1];
+        }
+
+        v[j] = x;
+    }
+}
+
+void frame_prof_init(void)
+{
+    memory_account("screen", "frame profiler", sizeof(ring) + sizeof(copy));
+}
+
+void frame_prof_report(void)
+{
+    uint32_t values[FRAME_PROF_RING_LEN];
+    uint32_t frames, overruns;
+    unsigned int n;
+
+    portENTER_CRITICAL(&ring_lock);
+    frames = n_frames;
+    overruns = n_overruns;
+    n = frames < FRAME_PROF_RING_LEN ? frames : FRAME_PROF_RING_LEN;
+    memcpy(copy, ring, sizeof(ring));
+    portEXIT_CRITICAL(&ring_lock);
+
+    printf("%" PRIu32 " frames, %" PRIu32 " over the %d ms budget\n", frames, overruns, CONFIG_STATION_FRAME_BUDGET_MS);
+
+    if (n == 0) return;
+
+    printf("last %u frames: %-8s %8s %8s %8s\n", n, "stage", "p50 us", "p90 us", "max us");
+
+    for (int s = 0; s < FRAME_STAGE_MAX; s++) {
+        for (unsigned int i = 0; i < n; i++) {
+            values[i] = copy[i].stage_us[s];
+        }
+
+        sort(values, n);
+
+        /* The ring is too short for a p99 other than the max */
+        printf("%*s%-8s %8" PRIu32 " %8" PRIu32 " %8" PRIu32 "\n", 16, "", stage_names[s],
+               values[n / 2], values[(n * 9) / 10], values[n - 1]);
+    }
+}
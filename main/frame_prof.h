@@ -0,0 +1,48 @@
+#ifndef FRAME_PROF_H
+#define FRAME_PROF_H
+
+#include <stdint.h>
+
+/*
+ * Display frame pipeline profiler.
+ *
+ * The LVGL port marks the boundaries of each stage; every frame that reached
+ * the panel is stored in a ring from which rolling percentiles are computed.
+ */
+
+typedef enum frame_mark {
+    FRAME_MARK_HANDLER_START = 0,   /* lv_timer_handler() called */
+    FRAME_MARK_REFR_START,          /* Display refresh begins, other LVGL timers are done */
+    FRAME_MARK_FLUSH_START,         /* Rendering done, flush callback entered */
+    FRAME_MARK_CONVERT_END,         /* I1 buffer converted to panel pages */
+    FRAME_MARK_FLUSH_READY,         /* Panel IO reported the transfer done */
+    FRAME_MARK_REFR_READY,          /* LVGL finished the frame */
+    FRAME_MARK_MAX
+} frame_mark_t;
+
+typedef enum frame_stage {
+    FRAME_STAGE_TIMERS = 0,
+    FRAME_STAGE_RENDER,
+    FRAME_STAGE_CONVERT,
+    FRAME_STAGE_TRANSFER,
+    FRAME_STAGE_READY,
+    FRAME_STAGE_TOTAL,
+    FRAME_STAGE_MAX
+} frame_stage_t;
+
+/* Accounts the ring with memory_account(); called by screen_init() */
+void frame_prof_init(void);
+
+/*
+ * Timestamps a stage boundary. FRAME_MARK_FLUSH_READY may be marked from
+ * the panel IO ISR.
+ */
+void frame_prof_mark(frame_mark_t mark);
+
+/*
+ * Prints p50/p90/max per stage over the last frames and the number of
+ * frames over budget to stdout.
+ */
+void frame_prof_report(void);
+
+#endif
@@ -0,0 +1,145 @@
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sys/param.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "esp_check.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "history.h"
+
+#if CONFIG_STATION_HISTORY
+
+#include "history_codec.h"
+#include "memory.h"
+#include "weather.h"
+
+static const char *TAG = "history";
+
+static history_sample_t ring[CONFIG_STATION_HISTORY_SIZE];
+static uint32_t total = 0;      /* Samples stored since boot, the newest is at (total - 1) % size */
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* Export staging: one block of samples and its encoding, never the whole ring */
+static history_sample_t block[HISTORY_BLOCK_SAMPLES];
+static uint8_t encoded[HISTORY_BLOCK_MAX];
+
+static void history_timer_cb(void *arg)
+{
+    /* No row of placeholders or stale values: a missing sensor leaves a gap */
+    if (!weather_is_current(WEATHER_SENSOR_AHT20) || !weather_is_current(WEATHER_SENSOR_BMP280)) return;
+
+    history_sample_t sample = {
+        .time = time(NULL),
+        .temperature = weather_get_temperature() * 100,
+        .humidity = weather_get_humidity() * 100,
+        .pressure = weather_get_pressure() * 100,
+    };
+
+    portENTER_CRITICAL(&lock);
+    ring[total % CONFIG_STATION_HISTORY_SIZE] = sample;
+    total++;
+    portEXIT_CRITICAL(&lock);
+}
+
+size_t history_count(void)
+{
+    uint32_t n;
+
+    portENTER_CRITICAL(&lock);
+    n = total;
+    portEXIT_CRITICAL(&lock);
+
+    return n < CONFIG_STATION_HISTORY_SIZE ? n : CONFIG_STATION_HISTORY_SIZE;
+}
+
+esp_err_t history_export(history_write_fn_t write, void *ctx, history_export_stats_t *stats)
+{
+    ESP_RETURN_ON_FALSE(write != NULL && stats != NULL, ESP_ERR_INVALID_ARG, TAG, "history_export: invalid argument");
+
+    int64_t start_us = esp_timer_get_time();
+    uint32_t pos, end;
+    size_t n;
+
+    memset(stats, 0, sizeof(*stats));
+
+    portENTER_CRITICAL(&lock);
+    end = total;
+    portEXIT_CRITICAL(&lock);
+    pos = end > CONFIG_STATION_HISTORY_SIZE ? end - CONFIG_STATION_HISTORY_SIZE : 0;
+
+    n = history_codec_header(encoded);
+    write(ctx, encoded, n);
+    stats->bytes += n;
+
+    while (pos < end) {
+        size_t count;
+
+        portENTER_CRITICAL(&lock);
+        /* The timer keeps storing samples; skip those overwritten since the export began */
+        if (total - pos > CONFIG_STATION_HISTORY_SIZE) {
+            uint32_t oldest = MIN(total - CONFIG_STATION_HISTORY_SIZE, end);
+
+            stats->skipped += oldest - pos;
+            pos = oldest;
+        }
+        count = MIN(end - pos, HISTORY_BLOCK_SAMPLES);
+        for (size_t i = 0; i < count; i++) {
+            block[i] = ring[(pos + i) % CONFIG_STATION_HISTORY_SIZE];
+        }
+        portEXIT_CRITICAL(&lock);
+
+        if (count == 0) break;
+
+        n = history_codec_encode_block(block, count, encoded);
+        write(ctx, encoded, n);
+
+        stats->samples += count;
+        stats->bytes += n;
+        pos += count;
+    }
+
+    stats->duration_us = esp_timer_get_time() - start_us;
+
+    return ESP_OK;
+}
+
+esp_err_t history_init(void)
+{
+    memory_account("history", "ring", sizeof(ring));
+    memory_account("history", "export buffers", sizeof(block) + sizeof(encoded));
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = &history_timer_cb,
+        .name = "history",
+        .skip_unhandled_events = true,
+    };
+    esp_timer_handle_t timer = NULL;
+
+    ESP_RETURN_ON_ERROR(esp_timer_create(&timer_args, &timer), TAG, "history_init: esp_timer_create failed");
+
+    return esp_timer_start_periodic(timer, (uint64_t) CONFIG_STATION_HISTORY_INTERVAL_S * 1000000);
+}
+
+#else /* !CONFIG_STATION_HISTORY */
+
+esp_err_t history_init(void)
+{
+    return ESP_OK;
+}
+
+size_t history_count(void)
+{
+    return 0;
+}
+
+esp_err_t history_export(history_write_fn_t write, void *ctx, history_export_stats_t *stats)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif
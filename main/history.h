@@ -0,0 +1,38 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+
+/*
+ * Sample history (CONFIG_STATION_HISTORY).
+ *
+ * The weather values are stored every CONFIG_STATION_HISTORY_INTERVAL_S
+ * into a RAM ring of CONFIG_STATION_HISTORY_SIZE samples, and exported in
+ * the compressed format of history_codec.h.
+ */
+
+typedef struct history_export_stats {
+    uint32_t samples;
+    uint32_t bytes;         /* Encoded size, header included */
+    uint32_t skipped;       /* Overwritten while the export ran */
+    uint32_t duration_us;   /* Encoding and writing */
+} history_export_stats_t;
+
+/* Receives the encoded stream one block at a time */
+typedef void (*history_write_fn_t)(void *ctx, const uint8_t *data, size_t len);
+
+esp_err_t history_init(void);
+
+/* Number of samples stored */
+size_t history_count(void);
+
+/*
+ * Encodes the stored samples, oldest first, block by block into `write`.
+ * Samples stored meanwhile are not part of the export. Not reentrant.
+ */
+esp_err_t history_export(history_write_fn_t write, void *ctx, history_export_stats_t *stats);
+
+#endif
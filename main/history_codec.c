@@ -0,0 +1,279 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "history_codec.h"
+
+typedef struct bit_writer {
+    uint8_t *out;
+    size_t pos;             /* Bytes completed */
+    uint32_t acc;
+    unsigned int bits;      /* Pending bits in acc, less than 8 between calls */
+} bit_writer_t;
+
+typedef struct bit_reader {
+    const uint8_t *in;
+    size_t len;
+    size_t pos;
+    uint32_t acc;
+    unsigned int bits;
+} bit_reader_t;
+
+/* Timestamp delta-of-delta classes: prefix, its length and the value bits */
+static const struct {
+    uint8_t prefix;
+    uint8_t prefix_bits;
+    uint8_t value_bits;
+} dod_classes[] = {
+    { 0x2, 2, 7 },
+    { 0x6, 3, 9 },
+    { 0xE, 4, 12 },
+};
+
+static void put_bits(bit_writer_t *w, uint32_t value, unsigned int n)
+{
+    /* At most 24 bits at a time, so that the accumulator never overflows */
+    if (n > 24) {
+        put_bits(w, value >> 16, n - 16);
+        put_bits(w, value & 0xFFFF, 16);
+        return;
+    }
+
+    w->acc = w->acc << n | (value & ((1u << n) - 1));
+    w->bits += n;
+
+    while (w->bits >= 8) {
+        w->bits -= 8;
+        w->out[w->pos++] = w->acc >> w->bits;
+    }
+}
+
+static size_t flush_bits(bit_writer_t *w)
+{
+    if (w->bits > 0) {
+        w->out[w->pos++] = w->acc << (8 - w->bits);
+        w->bits = 0;
+    }
+
+    return w->pos;
+}
+
+static bool get_bits(bit_reader_t *r, unsigned int n, uint32_t *value)
+{
+    uint32_t v = 0;
+
+    while (n > 0) {
+        unsigned int take;
+
+        if (r->bits == 0) {
+            if (r->pos == r->len) return false;
+            r->acc = r->in[r->pos++];
+            r->bits = 8;
+        }
+
+        take = n < r->bits ? n : r->bits;
+        v = v << take | ((r->acc >> (r->bits - take)) & ((1u << take) - 1));
+        r->bits -= take;
+        n -= take;
+    }
+
+    *value = v;
+    return true;
+}
+
+static uint32_t zigzag(int32_t v)
+{
+    return (uint32_t) v << 1 ^ (uint32_t) (v >> 31);
+}
+
+static int32_t unzigzag(uint32_t v)
+{
+    return (int32_t) (v >> 1) ^ -(int32_t) (v & 1);
+}
+
+static size_t put_varint(uint8_t *out, uint32_t v)
+{
+    size_t n = 0;
+
+    while (v > 0x7F) {
+        out[n++] = (v & 0x7F) | 0x80;
+        v >>= 7;
+    }
+    out[n++] = v;
+
+    return n;
+}
+
+static size_t get_varint(const uint8_t *in, size_t len, uint32_t *v)
+{
+    uint32_t value = 0;
+
+    for (size_t i = 0; i < len && i < 5; i++) {
+        value |= (uint32_t) (in[i] & 0x7F) << (7 * i);
+        if (!(in[i] & 0x80)) {
+            *v = value;
+            return i + 1;
+        }
+    }
+
+    return 0;
+}
+
+static void put_dod(bit_writer_t *w, int32_t dod)
+{
+    if (dod == 0) {
+        put_bits(w, 0, 1);
+        return;
+    }
+
+    for (size_t i = 0; i < sizeof(dod_classes) / sizeof(dod_classes[0]); i++) {
+        int32_t half = 1 << (dod_classes[i].value_bits - 1);
+
+        /* The class of n value bits holds [-(2^(n-1) - 1), 2^(n-1)] */
+        if (dod > -half && dod <= half) {
+            put_bits(w, dod_classes[i].prefix, dod_classes[i].prefix_bits);
+            put_bits(w, dod + half - 1, dod_classes[i].value_bits);
+            return;
+        }
+    }
+
+    put_bits(w, 0xF, 4);
+    put_bits(w, (uint32_t) dod, 32);
+}
+
+static bool get_dod(bit_reader_t *r, int32_t *dod)
+{
+    uint32_t bit, value;
+    size_t ones = 0;
+
+    /* Up to four prefix bits, ended early by a 0 */
+    while (ones < 4) {
+        if (!get_bits(r, 1, &bit)) return false;
+        if (bit == 0) break;
+        ones++;
+    }
+
+    if (ones == 0) {
+        *dod = 0;
+    } else if (ones < 4) {
+        int32_t half = 1 << (dod_classes[ones - 1].value_bits - 1);
+
+        if (!get_bits(r, dod_classes[ones - 1].value_bits, &value)) return false;
+        *dod = (int32_t) value - half + 1;
+    } else {
+        if (!get_bits(r, 32, &value)) return false;
+        *dod = (int32_t) value;
+    }
+
+    return true;
+}
+
+size_t history_codec_header(uint8_t *out)
+{
+    memcpy(out, HISTORY_CODEC_MAGIC, 4);
+    out[4] = HISTORY_CODEC_VERSION;
+    out[5] = out[6] = out[7] = 0;
+
+    return HISTORY_CODEC_HEADER_SIZE;
+}
+
+int history_codec_check_header(const uint8_t *in, size_t len)
+{
+    if (len < HISTORY_CODEC_HEADER_SIZE || memcmp(in, HISTORY_CODEC_MAGIC, 4) != 0) return -1;
+
+    return in[4];
+}
+
+size_t history_codec_encode_block(const history_sample_t *samples, size_t count, uint8_t *out)
+{
+    bit_writer_t w = { .out = out, .pos = HISTORY_BLOCK_HEADER_SIZE };
+    int32_t prev_delta = 0;
+    size_t n;
+
+    if (count == 0 || count > HISTORY_BLOCK_SAMPLES) return 0;
+
+    out[0] = count;
+    out[1] = samples[0].time;
+    out[2] = samples[0].time >> 8;
+    out[3] = samples[0].time >> 16;
+    out[4] = samples[0].time >> 24;
+
+    for (size_t i = 1; i < count; i++) {
+        int32_t delta = samples[i].time - samples[i - 1].time;
+
+        put_dod(&w, delta - prev_delta);
+        prev_delta = delta;
+    }
+
+    n = flush_bits(&w);
+
+    /* One pass per column keeps similar deltas together */
+    for (size_t i = 0; i < count; i++) {
+        n += put_varint(out + n, zigzag(samples[i].temperature - (i ? samples[i - 1].temperature : 0)));
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        n += put_varint(out + n, zigzag(samples[i].humidity - (i ? samples[i - 1].humidity : 0)));
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        n += put_varint(out + n, zigzag((int32_t) (samples[i].pressure - (i ? samples[i - 1].pressure : 0))));
+    }
+
+    return n;
+}
+
+size_t history_codec_decode_block(const uint8_t *in, size_t len, history_sample_t *samples, size_t *count)
+{
+    bit_reader_t r = { .in = in, .len = len, .pos = HISTORY_BLOCK_HEADER_SIZE };
+    int32_t delta = 0;
+    uint32_t v;
+    size_t n, used;
+
+    if (len < HISTORY_BLOCK_HEADER_SIZE) return 0;
+
+    n = in[0];
+    if (n == 0 || n > HISTORY_BLOCK_SAMPLES) return 0;
+
+    samples[0].time = in[1] | in[2] << 8 | in[3] << 16 | (uint32_t) in[4] << 24;
+
+    for (size_t i = 1; i < n; i++) {
+        int32_t dod;
+
+        if (!get_dod(&r, &dod)) return 0;
+        delta += dod;
+        samples[i].time = samples[i - 1].time + delta;
+    }
+
+    /* The bit stream ends on a byte boundary */
+    used = r.pos;
+
+    for (size_t i = 0; i < n; i++) {
+        size_t k = get_varint(in + used, len - used, &v);
+
+        if (k == 0) return 0;
+        used += k;
+        samples[i].temperature = (i ? samples[i - 1].temperature : 0) + unzigzag(v);
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        size_t k = get_varint(in + used, len - used, &v);
+
+        if (k == 0) return 0;
+        used += k;
+        samples[i].humidity = (i ? samples[i - 1].humidity : 0) + unzigzag(v);
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        size_t k = get_varint(in + used, len - used, &v);
+
+        if (k == 0) return 0;
+        used += k;
+        samples[i].pressure = (i ? samples[i - 1].pressure : 0) + unzigzag(v);
+    }
+
+    *count = n;
+
+    return used;
+}
@@ -0,0 +1,62 @@
+#ifndef HISTORY_CODEC_H
+#define HISTORY_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Compressed sample history format, shared by the firmware export and the
+ * host decoder.
+ *
+ * A stream is an 8-byte header (magic "WHST", version, 3 reserved bytes)
+ * followed by self-contained blocks of up to HISTORY_BLOCK_SAMPLES samples,
+ * stored column by column:
+ *
+ *  - the sample count (1 byte) and the first timestamp (u32 LE);
+ *  - the other timestamps as a bit stream of delta-of-deltas, as in
+ *    Gorilla: '0' for an unchanged interval, then '10', '110', '1110' with
+ *    7, 9 and 12 bits, or '1111' with 32 bits, padded to a byte;
+ *  - temperature, humidity and pressure, each as zig-zag varint deltas
+ *    from the previous sample of the block (from 0 for the first one).
+ *
+ * Periodic samples of slowly changing weather cost about 4 bytes instead
+ * of 12, and each block can be encoded as soon as its samples are known.
+ */
+
+#define HISTORY_CODEC_MAGIC         "WHST"
+#define HISTORY_CODEC_VERSION       1
+#define HISTORY_CODEC_HEADER_SIZE   8
+
+#define HISTORY_BLOCK_SAMPLES       64
+#define HISTORY_BLOCK_HEADER_SIZE   5
+/* Worst case: 36 bits per timestamp and three 5-byte varints per sample */
+#define HISTORY_BLOCK_MAX           (HISTORY_BLOCK_HEADER_SIZE + (HISTORY_BLOCK_SAMPLES * 36 + 7) / 8 + \
+                                     HISTORY_BLOCK_SAMPLES * 3 * 5)
+
+typedef struct history_sample {
+    uint32_t time;          /* Unix time, s */
+    int16_t temperature;    /* 0.01 °C */
+    uint16_t humidity;      /* 0.01 % */
+    uint32_t pressure;      /* Pa */
+} history_sample_t;
+
+/* Writes the stream header into `out`, returning its size */
+size_t history_codec_header(uint8_t *out);
+
+/* Returns the stream version, or -1 if `in` is not a history stream */
+int history_codec_check_header(const uint8_t *in, size_t len);
+
+/*
+ * Encodes 1 to HISTORY_BLOCK_SAMPLES samples as one block into `out` of
+ * HISTORY_BLOCK_MAX bytes. Returns the block size, 0 for a bad count.
+ */
+size_t history_codec_encode_block(const history_sample_t *samples, size_t count, uint8_t *out);
+
+/*
+ * Decodes the block at the start of `in` into `samples`, which holds
+ * HISTORY_BLOCK_SAMPLES entries. Returns the number of bytes consumed, or
+ * 0 if the block is truncated or malformed.
+ */
+size_t history_codec_decode_block(const uint8_t *in, size_t len, history_sample_t *samples, size_t *count);
+
+#endif
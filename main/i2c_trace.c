@@ -0,0 +1,346 @@
+#include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "driver/i2c_master.h"
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "i2c_trace.h"
+#include "memory.h"
+#include "power.h"
+#include "sensor_trace.h"
+
+#define I2C_TRACE_RING_LEN    128     /* Power of two */
+#define I2C_TRACE_MAX_DEVICES 8
+
+typedef struct device_stats {
+    i2c_master_dev_handle_t handle;
+    uint16_t addr;
+    uint32_t transactions;
+    uint32_t errors;
+    uint32_t bytes;
+    uint32_t max_us;
+    uint64_t busy_us;
+    uint32_t hist[I2C_TRACE_HIST_BUCKETS];
+} device_stats_t;
+
+esp_err_t __real_i2c_master_bus_add_device(i2c_master_bus_handle_t bus_handle, const i2c_device_config_t *dev_config,
+                                           i2c_master_dev_handle_t *ret_handle);
+esp_err_t __real_i2c_master_transmit(i2c_master_dev_handle_t i2c_dev, const uint8_t *write_buffer, size_t write_size,
+                                     int xfer_timeout_ms);
+esp_err_t __real_i2c_master_receive(i2c_master_dev_handle_t i2c_dev, uint8_t *read_buffer, size_t read_size,
+                                    int xfer_timeout_ms);
+esp_err_t __real_i2c_master_transmit_receive(i2c_master_dev_handle_t i2c_dev, const uint8_t *write_buffer, size_t write_size,
+                                             uint8_t *read_buffer, size_t read_size, int xfer_timeout_ms);
+esp_err_t __real_i2c_master_multi_buffer_transmit(i2c_master_dev_handle_t i2c_dev,
+                                                  i2c_master_transmit_multi_buffer_info_t *buffer_info_array,
+                                                  size_t array_size, int xfer_timeout_ms);
+
+#if CONFIG_STATION_I2C_TRACE
+
+static i2c_trace_record_t ring[I2C_TRACE_RING_LEN];
+static uint32_t ring_head = 0;  /* Records written since boot */
+
+static device_stats_t devices[I2C_TRACE_MAX_DEVICES];
+static uint32_t n_devices = 0;
+
+/*
+ * Guards the ring and the device table. The C3 has no atomic instructions,
+ * so this is cheaper than the libatomic calls __atomic_* would turn into,
+ * and it keeps the 64-bit busy time consistent with the other counters.
+ */
+static portMUX_TYPE trace_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static int64_t window_start_us = 0;
+
+/* Must be called with trace_lock held */
+static device_stats_t *find_device(i2c_master_dev_handle_t handle)
+{
+    for (uint32_t i = 0; i < n_devices; i++) {
+        if (devices[i].handle == handle) return &devices[i];
+    }
+
+    return NULL;
+}
+
+static unsigned int hist_bucket(uint32_t us)
+{
+    unsigned int bucket = us ? 31 - __builtin_clz(us) : 0;
+
+    return bucket < I2C_TRACE_HIST_BUCKETS ? bucket : I2C_TRACE_HIST_BUCKETS - 1;
+}
+
+static void record(i2c_master_dev_handle_t handle, i2c_trace_op_t op, size_t bytes, int64_t start_us, esp_err_t rc)
+{
+    uint32_t duration_us = esp_timer_get_time() - start_us;
+    unsigned int bucket = hist_bucket(duration_us);
+    device_stats_t *dev;
+
+    portENTER_CRITICAL(&trace_lock);
+
+    dev = find_device(handle);
+
+    ring[ring_head++ & (I2C_TRACE_RING_LEN - 1)] = (i2c_trace_record_t) {
+        .start_us = start_us,
+        .duration_us = duration_us,
+        .addr = dev ? dev->addr : 0xFFFF,
+        .bytes = bytes,
+        .op = op,
+        .rc = rc,
+    };
+
+    if (dev != NULL) {
+        dev->transactions++;
+        dev->bytes += bytes;
+        dev->busy_us += duration_us;
+        dev->hist[bucket]++;
+        if (rc != ESP_OK) dev->errors++;
+        if (duration_us > dev->max_us) dev->max_us = duration_us;
+    }
+
+    portEXIT_CRITICAL(&trace_lock);
+}
+
+/* Raw sensor data for the trace capture, keyed by address since the handles are private to the drivers */
+static void capture(i2c_master_dev_handle_t handle, const uint8_t *write, size_t write_size,
+                    const uint8_t *read, size_t read_size)
+{
+    device_stats_t *dev;
+    uint16_t addr = 0;
+
+    portENTER_CRITICAL(&trace_lock);
+    dev = find_device(handle);
+    if (dev != NULL) addr = dev->addr;
+    portEXIT_CRITICAL(&trace_lock);
+
+    if (dev != NULL) sensor_trace_capture(addr, write, write_size, read, read_size);
+}
+
+static void add_device(i2c_master_dev_handle_t handle, uint16_t addr)
+{
+    bool first;
+
+    portENTER_CRITICAL(&trace_lock);
+    first = n_devices == 0;
+    if (n_devices < I2C_TRACE_MAX_DEVICES) {
+        devices[n_devices].handle = handle;
+        devices[n_devices].addr = addr;
+        n_devices++;
+    }
+    portEXIT_CRITICAL(&trace_lock);
+
+    /* The tracer has no init; the first device is the panel, added before the memory report */
+    if (first) memory_account("i2c_trace", "ring and devices", sizeof(ring) + sizeof(devices));
+}
+
+#else /* !CONFIG_STATION_I2C_TRACE */
+
+static inline void record(i2c_master_dev_handle_t handle, i2c_trace_op_t op, size_t bytes, int64_t start_us, esp_err_t rc)
+{
+}
+
+static inline void capture(i2c_master_dev_handle_t handle, const uint8_t *write, size_t write_size,
+                           const uint8_t *read, size_t read_size)
+{
+}
+
+static inline void add_device(i2c_master_dev_handle_t handle, uint16_t addr)
+{
+}
+
+#endif
+
+#if CONFIG_STATION_I2C_TRACE || CONFIG_STATION_POWER_SAVE
+
+/*
+ * The I2C controller does not run in light sleep, so the lock is held for
+ * each transfer here rather than by the drivers, which wait between their
+ * transfers (e.g. for an AHT20 conversion) and may sleep meanwhile.
+ */
+
+esp_err_t __wrap_i2c_master_bus_add_device(i2c_master_bus_handle_t bus_handle, const i2c_device_config_t *dev_config,
+                                           i2c_master_dev_handle_t *ret_handle)
+{
+    esp_err_t rc = __real_i2c_master_bus_add_device(bus_handle, dev_config, ret_handle);
+
+    if (rc == ESP_OK) add_device(*ret_handle, dev_config->device_address);
+
+    return rc;
+}
+
+esp_err_t __wrap_i2c_master_transmit(i2c_master_dev_handle_t i2c_dev, const uint8_t *write_buffer, size_t write_size,
+                                     int xfer_timeout_ms)
+{
+    int64_t start_us;
+    esp_err_t rc;
+
+    power_lock_acquire(POWER_LOCK_I2C);
+    start_us = esp_timer_get_time();
+    rc = __real_i2c_master_transmit(i2c_dev, write_buffer, write_size, xfer_timeout_ms);
+    power_lock_release(POWER_LOCK_I2C);
+
+    record(i2c_dev, I2C_TRACE_TX, write_size, start_us, rc);
+
+    return rc;
+}
+
+esp_err_t __wrap_i2c_master_receive(i2c_master_dev_handle_t i2c_dev, uint8_t *read_buffer, size_t read_size,
+                                    int xfer_timeout_ms)
+{
+    int64_t start_us;
+    esp_err_t rc;
+
+    power_lock_acquire(POWER_LOCK_I2C);
+    start_us = esp_timer_get_time();
+    rc = __real_i2c_master_receive(i2c_dev, read_buffer, read_size, xfer_timeout_ms);
+    power_lock_release(POWER_LOCK_I2C);
+
+    record(i2c_dev, I2C_TRACE_RX, read_size, start_us, rc);
+    if (rc == ESP_OK) capture(i2c_dev, NULL, 0, read_buffer, read_size);
+
+    return rc;
+}
+
+esp_err_t __wrap_i2c_master_transmit_receive(i2c_master_dev_handle_t i2c_dev, const uint8_t *write_buffer, size_t write_size,
+                                             uint8_t *read_buffer, size_t read_size, int xfer_timeout_ms)
+{
+    int64_t start_us;
+    esp_err_t rc;
+
+    power_lock_acquire(POWER_LOCK_I2C);
+    start_us = esp_timer_get_time();
+    rc = __real_i2c_master_transmit_receive(i2c_dev, write_buffer, write_size, read_buffer, read_size, xfer_timeout_ms);
+    power_lock_release(POWER_LOCK_I2C);
+
+    record(i2c_dev, I2C_TRACE_TX_RX, write_size + read_size, start_us, rc);
+    if (rc == ESP_OK) capture(i2c_dev, write_buffer, write_size, read_buffer, read_size);
+
+    return rc;
+}
+
+/* Used by the panel IO to send the command byte and the pixels in one transaction */
+esp_err_t __wrap_i2c_master_multi_buffer_transmit(i2c_master_dev_handle_t i2c_dev,
+                                                  i2c_master_transmit_multi_buffer_info_t *buffer_info_array,
+                                                  size_t array_size, int xfer_timeout_ms)
+{
+    int64_t start_us;
+    esp_err_t rc;
+    size_t bytes = 0;
+
+    power_lock_acquire(POWER_LOCK_I2C);
+    start_us = esp_timer_get_time();
+    rc = __real_i2c_master_multi_buffer_transmit(i2c_dev, buffer_info_array, array_size, xfer_timeout_ms);
+    power_lock_release(POWER_LOCK_I2C);
+
+    for (size_t i = 0; i < array_size; i++) {
+        bytes += buffer_info_array[i].buffer_size;
+    }
+
+    record(i2c_dev, I2C_TRACE_TX, bytes, start_us, rc);
+
+    return rc;
+}
+
+#endif
+
+#if CONFIG_STATION_I2C_TRACE
+
+size_t i2c_trace_snapshot(i2c_trace_record_t *out, size_t max)
+{
+    uint32_t head, first;
+    size_t n = 0;
+
+    portENTER_CRITICAL(&trace_lock);
+    head = ring_head;
+    portEXIT_CRITICAL(&trace_lock);
+
+    first = head > I2C_TRACE_RING_LEN ? head - I2C_TRACE_RING_LEN : 0;
+    if (head - first > max) first = head - max;
+
+    /* One record per critical section; skip those overwritten in the meantime */
+    for (uint32_t idx = first; idx != head; idx++) {
+        portENTER_CRITICAL(&trace_lock);
+        if (ring_head - idx <= I2C_TRACE_RING_LEN) {
+            out[n++] = ring[idx & (I2C_TRACE_RING_LEN - 1)];
+        }
+        portEXIT_CRITICAL(&trace_lock);
+    }
+
+    return n;
+}
+
+void i2c_trace_report(void)
+{
+    int64_t elapsed_us = esp_timer_get_time() - window_start_us;
+    uint64_t bus_busy_us = 0;
+    device_stats_t dev;
+
+    for (uint32_t i = 0;; i++) {
+        /* Copied so that the counters printed together are consistent */
+        portENTER_CRITICAL(&trace_lock);
+        if (i >= n_devices) {
+            portEXIT_CRITICAL(&trace_lock);
+            break;
+        }
+        dev = devices[i];
+        portEXIT_CRITICAL(&trace_lock);
+
+        bus_busy_us += dev.busy_us;
+
+        printf("0x%02x: %" PRIu32 " transactions, %" PRIu32 " errors, %" PRIu32 " B, busy %" PRIu64 " us, avg %" PRIu64 " us, max %" PRIu32 " us\n",
+               dev.addr, dev.transactions, dev.errors, dev.bytes, dev.busy_us,
+               dev.transactions ? dev.busy_us / dev.transactions : 0, dev.max_us);
+
+        for (int b = 0; b < I2C_TRACE_HIST_BUCKETS; b++) {
+            if (dev.hist[b] == 0) continue;
+            printf("  %7lu us+ %" PRIu32 "\n", 1UL << b, dev.hist[b]);
+        }
+    }
+
+    /* Durations include waiting for the bus lock, so contention inflates this */
+    printf("bus busy %" PRIu64 " us over %" PRId64 " ms (%.2f %%)\n", bus_busy_us, elapsed_us / 1000,
+           elapsed_us > 0 ? 100.0 * bus_busy_us / elapsed_us : 0.0);
+}
+
+void i2c_trace_reset(void)
+{
+    portENTER_CRITICAL(&trace_lock);
+
+    for (uint32_t i = 0; i < n_devices; i++) {
+        device_stats_t *dev = &devices[i];
+
+        dev->transactions = 0;
+        dev->errors = 0;
+        dev->bytes = 0;
+        dev->max_us = 0;
+        dev->busy_us = 0;
+        memset(dev->hist, 0, sizeof(dev->hist));
+    }
+
+    window_start_us = esp_timer_get_time();
+
+    portEXIT_CRITICAL(&trace_lock);
+}
+
+#else /* !CONFIG_STATION_I2C_TRACE */
+
+size_t i2c_trace_snapshot(i2c_trace_record_t *out, size_t max)
+{
+    return 0;
+}
+
+void i2c_trace_report(void)
+{
+    printf("I2C tracing disabled (CONFIG_STATION_I2C_TRACE)\n");
+}
+
+void i2c_trace_reset(void)
+{
+}
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef I2C_TRACE_H
+#define I2C_TRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+
+/*
+ * I2C transaction tracer (CONFIG_STATION_I2C_TRACE).
+ *
+ * The i2c_master_* transfer functions are wrapped at link time (--wrap), so
+ * every transaction of the sensor drivers and of the panel IO goes through
+ * here without changes to their code. Each transaction is recorded into a
+ * ring and accounted in a per-device log2 latency histogram, both under a
+ * short critical section.
+ *
+ * With CONFIG_STATION_POWER_SAVE the wrappers are linked in as well and
+ * hold POWER_LOCK_I2C for each transfer, also without the tracer.
+ */
+
+#define I2C_TRACE_HIST_BUCKETS 20   /* Bucket n counts latencies in [2^n, 2^(n+1)) us */
+
+typedef enum i2c_trace_op {
+    I2C_TRACE_TX = 0,
+    I2C_TRACE_RX,
+    I2C_TRACE_TX_RX,
+} i2c_trace_op_t;
+
+typedef struct i2c_trace_record {
+    int64_t start_us;
+    uint32_t duration_us;
+    uint16_t addr;
+    uint16_t bytes;
+    uint8_t op;             /* i2c_trace_op_t */
+    esp_err_t rc;
+} i2c_trace_record_t;
+
+/*
+ * Copies up to `max` of the most recent records, oldest first.
+ * Returns the number of records copied.
+ */
+size_t i2c_trace_snapshot(i2c_trace_record_t *out, size_t max);
+
+/*
+ * Prints per-device counts, histograms and the bus utilization since the
+ * last reset to stdout.
+ */
+void i2c_trace_report(void);
+
+void i2c_trace_reset(void);
+
+#endif
@@ -1,4 +1,5 @@
 #include <string.h>
+#include <math.h>
 #include <stdio.h>
 
 #include "driver/gpio.h"
@@ -12,10 +13,11 @@
 #include "weather_images.h"
 #include "weather.h"
 #include "clock.h"
+#include "screen.h"
+#include "settings.h"
+#include "ui_format.h"
 
-#define DEGREE_SYMBOL "\u00B0"
-
-#define WEATHER_SCREEN_REFRESH_RATE CONFIG_WEATHER_SCREEN_REFRESH_RATE_MS
+#define DEGREE_SYMBOL UI_DEGREE_SYMBOL
 
 static lv_obj_t *text_label_alarm;
 static lv_obj_t *text_label_time;
@@ -30,53 +32,44 @@ static char *get_time(bool *is_being_modified)
     clock_time_t stime;
     static char buf[SENSOR_VAL_BUF_SZ];
 
-    memset(buf, 0, sizeof(buf));
-
     ESP_ERROR_CHECK(clock_get_time(&stime, is_being_modified));
 
-    sprintf(buf, "%02d:%02d:%02d", stime.hour, stime.min, stime.sec);
+    ui_format_time(buf, sizeof(buf), &stime);
 
     return buf;
 }
 
 static char *get_temperature(void)
 {
-    float temp;
     static char buf[SENSOR_VAL_BUF_SZ];
 
-    memset(buf, 0, SENSOR_VAL_BUF_SZ);
+    bool valid = weather_has_reading(WEATHER_SENSOR_AHT20) || weather_has_reading(WEATHER_SENSOR_BMP280);
 
-    temp = weather_get_temperature();
-
-    snprintf(buf, SENSOR_VAL_BUF_SZ - 1, "%.1f" DEGREE_SYMBOL, temp);
+    ui_format_temperature(buf, sizeof(buf), valid ? weather_get_temperature() : NAN);
 
     return buf;
 }
 
 static char *get_humidity(void)
 {
-    float humidity;
     static char buf[SENSOR_VAL_BUF_SZ];
 
-    memset(buf, 0, SENSOR_VAL_BUF_SZ);
-
-    humidity = weather_get_humidity();
-
-    snprintf(buf, SENSOR_VAL_BUF_SZ - 1, "%.0f%%", humidity);
+    ui_format_humidity(buf, sizeof(buf), weather_has_reading(WEATHER_SENSOR_AHT20) ? weather_get_humidity() : NAN);
 
     return buf;
 }
 
 static char *get_pressure(void)
 {
-    float pressure;
     static char buf[SENSOR_VAL_BUF_SZ];
+    derived_metrics_t derived;
 
-    memset(buf, 0, SENSOR_VAL_BUF_SZ);
-
-    pressure = weather_get_pressure();
-
-    snprintf(buf, SENSOR_VAL_BUF_SZ - 1, "%.0f hPa", pressure);
+    /* Reduced to sea level as soon as the humidity is known too, as barometers show it */
+    if (weather_get_derived(&derived)) {
+        ui_format_pressure(buf, sizeof(buf), derived.sea_level_pressure / 100.0f);
+    } else {
+        ui_format_pressure(buf, sizeof(buf), weather_has_reading(WEATHER_SENSOR_BMP280) ? weather_get_pressure() : NAN);
+    }
 
     return buf;
 }
@@ -87,13 +80,26 @@ static int is_alarm_set(void)
 }
 
 static uint8_t time_display_toggle = 0;
+static uint8_t panel_contrast = SCREEN_CONTRAST_NORMAL;
+static uint32_t timer_period;
 
-static void timer_cb(lv_timer_t * timer)
+/* Only changes reach the panel, two command bytes each */
+static void set_contrast(uint8_t contrast)
 {
-    LV_UNUSED(timer);
+    if (contrast != panel_contrast && screen_set_contrast(contrast) == ESP_OK) panel_contrast = contrast;
+}
 
+static void timer_cb(lv_timer_t * timer)
+{
     char *time_str;
     bool time_is_being_modified;
+    uint32_t period = settings_get(SETTING_SCREEN_REFRESH_MS);
+
+    /* Follows changes of the setting from the next tick on */
+    if (period != timer_period) {
+        lv_timer_set_period(timer, period);
+        timer_period = period;
+    }
 
     lv_label_set_text(text_label_temperature, get_temperature());
     lv_label_set_text(text_label_humidity, get_humidity());
@@ -101,16 +107,17 @@ static void timer_cb(lv_timer_t * timer)
     lv_label_set_text(text_label_alarm, is_alarm_set() ? LV_SYMBOL_VOLUME_MAX : "");
 
     time_str = get_time(&time_is_being_modified);
+    lv_label_set_text(text_label_time, time_str);
 
+    /*
+     * Blink while the time is set, dimming the panel every 4 increments: the
+     * controller does it, where hiding the label cost two full frames
+     */
     if (time_is_being_modified) {
-        /* Hide text every 4 increments */
-        if (time_display_toggle++ & 0b100) {
-            lv_label_set_text(text_label_time, time_str);
-        } else {
-            lv_label_set_text(text_label_time, "");
-        }
+        set_contrast(time_display_toggle++ & 0b100 ? SCREEN_CONTRAST_NORMAL : SCREEN_CONTRAST_DIM);
     } else {
-        lv_label_set_text(text_label_time, time_str);
+        time_display_toggle = 0;
+        set_contrast(SCREEN_CONTRAST_NORMAL);
     }
 }
 
@@ -155,6 +162,7 @@ void lv_create_main_gui(void)
   lv_obj_align(text_label_alarm, LV_ALIGN_TOP_RIGHT, 0, 0);
   lv_obj_set_style_text_font((lv_obj_t*) text_label_alarm, &lv_font_montserrat_16, 0);
 
-  lv_timer_t * timer = lv_timer_create(timer_cb, WEATHER_SCREEN_REFRESH_RATE, NULL);
+  timer_period = settings_get(SETTING_SCREEN_REFRESH_MS);
+  lv_timer_t * timer = lv_timer_create(timer_cb, timer_period, NULL);
   lv_timer_ready(timer);
 }
\ No newline at end of file
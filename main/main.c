@@ -15,15 +15,37 @@
 #include "esp_err.h"
 #include "esp_log.h"
 
+#include "nvs_flash.h"
+
 #include "lwip/sys.h"
 
+#include "boot.h"
+#include "buttons.h"
 #include "clock.h"
+#include "console.h"
+#include "controller.h"
+#include "memory.h"
 #include "weather.h"
 #include "screen.h"
 #include "buzzer.h"
+#include "power.h"
+#include "settings.h"
+#include "telemetry.h"
+#include "tlog.h"
+#include "history.h"
+#include "uplink.h"
+#include "sched_trace.h"
+#include "sensor_trace.h"
 
 static const char *TAG = "MAIN";
 
+#define SENSOR_PROBE_TASK_STACK_SIZE (3 * 1024)
+/* Both sensors are read right after their probe; this only bounds the boot report */
+#define SENSOR_FIRST_READING_TIMEOUT_MS 5000
+
+static StackType_t sensor_probe_stack[SENSOR_PROBE_TASK_STACK_SIZE];
+static StaticTask_t sensor_probe_tcb;
+
 #define BUTTON_CTRL_GPIO GPIO_NUM_0
 #define BUTTON_UP_GPIO GPIO_NUM_1
 #define BUTTON_DOWN_GPIO GPIO_NUM_2
@@ -37,54 +59,6 @@ static const char *TAG = "MAIN";
 #define I2C_PIN_NUM_SDA GPIO_NUM_8
 #define I2C_PIN_NUM_SCL GPIO_NUM_9
 
-#define STATE_NORMAL 0
-#define STATE_SET_TIME 1
-#define STATE_SET_ALARM 2
-
-#define MAX_SET_TIME_STAGE 2
-
-enum set_time_stage {
-    SET_HOURS = 0,
-    SET_MINUTES = 1
-};
-
-uint8_t set_time_done;
-static enum set_time_stage stage;
-
-uint8_t station_state = STATE_NORMAL;
-
-static int button_pressed = 0;
-static int button_up_pressed = 0;
-static int button_down_pressed = 0;
-static int switch_on = 0;
-
-static int consume_is_btn_pressed(void)
-{
-    int val = button_pressed;
-    button_pressed = 0;
-    return val;
-}
-
-static int consume_is_btn_up_pressed(void)
-{
-    int val = button_up_pressed;
-    button_up_pressed = 0;
-    return val;
-}
-
-static int consume_is_btn_down_pressed(void)
-{
-    int val = button_down_pressed;
-    button_down_pressed = 0;
-    return val;
-}
-
-static int get_is_switch_on(void)
-{
-    return switch_on;
-}
-
-
 static esp_err_t init_i2c_master_bus(i2c_master_bus_handle_t *i2c_bus_handle)
 {
     ESP_RETURN_ON_FALSE(i2c_bus_handle != NULL, ESP_ERR_INVALID_ARG, TAG, "init_i2c_master_bus: pointer to I2C master bus handle is NULL");
@@ -103,154 +77,108 @@ static esp_err_t init_i2c_master_bus(i2c_master_bus_handle_t *i2c_bus_handle)
     return i2c_new_master_bus(&i2c_bus_config, i2c_bus_handle);
 }
 
-static void set_time_task(void *arg)
+static esp_err_t init_nvs(void)
 {
-    int ctrl = 0, up = 0, down = 0;
-    void (*enter_set)(void);
-    void (*exit_set)(void);
-    void (*adjust_hour)(int32_t);
-    void (*adjust_min)(int32_t);
-
-    stage = SET_HOURS;
-
-    switch (station_state) {
-        case STATE_SET_TIME:
-            enter_set = clock_enter_set_time;
-            exit_set = clock_exit_set_time;
-            adjust_hour = clock_adjust_time_hour;
-            adjust_min = clock_adjust_time_min;
-            break;
-        case STATE_SET_ALARM:
-            enter_set = clock_enter_set_alarm;
-            exit_set = clock_exit_set_alarm;
-            adjust_hour = clock_adjust_alarm_hour;
-            adjust_min = clock_adjust_alarm_min;
-            break;
-        default:
-            vTaskDelete(NULL);
-            return;
-    }
+    esp_err_t rc = nvs_flash_init();
 
-    enter_set();
-
-    while (!set_time_done) {
-        ctrl = consume_is_btn_pressed();
-        up = consume_is_btn_up_pressed();
-        down = consume_is_btn_down_pressed();
-
-        if (up) {
-            switch (stage) {
-                case SET_HOURS:
-                    adjust_hour(1);
-                    break;
-                case SET_MINUTES:
-                    adjust_min(1);
-                    break;
-                default: break;
-            }
-        } else if (down) {
-            switch (stage) {
-                case SET_HOURS:
-                    adjust_hour(-1);
-                    break;
-                case SET_MINUTES:
-                    adjust_min(-1);
-                    break;
-                default: break;
-            }
-        } else if (ctrl) {
-            stage++;
-        }
-
-        set_time_done = stage >= MAX_SET_TIME_STAGE;
-
-        vTaskDelay(pdMS_TO_TICKS(50));
-    } 
-
-    exit_set();
+    if (rc == ESP_ERR_NVS_NO_FREE_PAGES || rc == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_LOGW(TAG, "NVS partition was truncated and needs to be erased");
+        ESP_RETURN_ON_ERROR(nvs_flash_erase(), TAG, "init_nvs: erasing NVS failed");
+        rc = nvs_flash_init();
+    }
 
-    vTaskDelete(NULL);
+    return rc;
 }
 
-
-static void button_task(void *arg)
+static esp_err_t init_control_buttons(void)
 {
-    uint8_t debounce;
-
-    for(;;) {
-        button_pressed |= !gpio_get_level(BUTTON_CTRL_GPIO);
-        button_up_pressed |= !gpio_get_level(BUTTON_UP_GPIO);
-        button_down_pressed |= !gpio_get_level(BUTTON_DOWN_GPIO);
-        switch_on = !gpio_get_level(SWITCH_GPIO);
-
-        debounce = button_pressed | button_up_pressed | button_down_pressed;
-
-        switch (station_state) {
-            case STATE_NORMAL:
-                if (get_is_switch_on() && !clock_is_alarm_on()) {
-                    set_time_done = 0;
-                    station_state = STATE_SET_ALARM;
-                    clock_enable_alarm();
-                    xTaskCreate(set_time_task, "set_time_task", configMINIMAL_STACK_SIZE, NULL, 3, NULL);
-                } else if (!get_is_switch_on()) {
-                    clock_disable_alarm();
-                }
-                
-                if (consume_is_btn_pressed()) {
-                    set_time_done = 0;
-                    station_state = STATE_SET_TIME;
-                    xTaskCreate(set_time_task, "set_time_task", configMINIMAL_STACK_SIZE, NULL, 3, NULL);
-                }
-
-                break;
-            case STATE_SET_TIME:
-                if (set_time_done) {
-                    station_state = STATE_NORMAL;
-                }
-                break;
-            case STATE_SET_ALARM:
-                if (set_time_done) {
-                    station_state = STATE_NORMAL;
-                }
-                break;
-            default:
-                break;
-        }
-
-        vTaskDelay(pdMS_TO_TICKS(50 + 300 * debounce));
-    }
+    const buttons_config_t buttons_config = {
+        .gpio = {
+            [BUTTON_CTRL] = BUTTON_CTRL_GPIO,
+            [BUTTON_UP] = BUTTON_UP_GPIO,
+            [BUTTON_DOWN] = BUTTON_DOWN_GPIO,
+            [BUTTON_SWITCH] = SWITCH_GPIO,
+        },
+        .repeat_mask = (1 << BUTTON_UP) | (1 << BUTTON_DOWN),
+    };
 
-    vTaskDelete(NULL);
+    ESP_RETURN_ON_ERROR(controller_init(), TAG, "init_control_buttons: controller_init failed");
+
+    return buttons_init(&buttons_config, controller_post_button);
 }
 
-static void init_control_buttons(void)
+/*
+ * Probes the sensors off the boot path: a missing sensor costs its I2C
+ * timeouts here instead of delaying the first frame. The readings show up
+ * on the screen as soon as the poll tasks get them.
+ */
+static void sensor_probe_task(void *arg)
 {
-    gpio_config_t io_conf = {
-        .pin_bit_mask = (1ULL << BUTTON_CTRL_GPIO) | (1ULL << BUTTON_UP_GPIO) | (1ULL << BUTTON_DOWN_GPIO) | (1ULL << SWITCH_GPIO),
-        .mode = GPIO_MODE_INPUT,
-        .pull_up_en = GPIO_PULLUP_ENABLE,
-        .pull_down_en = GPIO_PULLDOWN_DISABLE,
-        .intr_type = GPIO_INTR_DISABLE,
-    };
+    i2c_master_bus_handle_t i2c_bus_handle = arg;
+    esp_err_t rc;
+
+    /* The drivers allocate their handles, possibly after memory_seal() */
+    memory_allow_alloc_begin();
+    rc = weather_init_sensors(i2c_bus_handle, AHT20_STATUS_LED_GPIO, BMP280_STATUS_LED_GPIO);
+    memory_allow_alloc_end();
+
+    if (rc != ESP_OK) ESP_LOGE(TAG, "Sensor initialization failed (%s)", esp_err_to_name(rc));
+    boot_mark(BOOT_PHASE_SENSORS);
 
-    gpio_config(&io_conf);
+    if (!boot_wait(BOOT_PHASE_FIRST_READING, SENSOR_FIRST_READING_TIMEOUT_MS)) {
+        ESP_LOGW(TAG, "No sensor reading %d ms after probing", SENSOR_FIRST_READING_TIMEOUT_MS);
+    }
+    boot_wait(BOOT_PHASE_FIRST_FRAME, SENSOR_FIRST_READING_TIMEOUT_MS);
+    boot_report();
 
-    xTaskCreate(button_task, "button_task", configMINIMAL_STACK_SIZE, NULL, 4, NULL);
+    vTaskDelete(NULL);
 }
 
 void app_main(void)
 {
     i2c_master_bus_handle_t i2c_bus_handle = NULL;
 
-    station_state = STATE_NORMAL;
+    ESP_ERROR_CHECK(boot_init());
+
+    ESP_ERROR_CHECK(tlog_init());
+
+    ESP_ERROR_CHECK(init_nvs());
+
+    ESP_ERROR_CHECK(settings_init());
+    boot_mark(BOOT_PHASE_STORAGE);
+
+    ESP_ERROR_CHECK(power_init());
 
     ESP_ERROR_CHECK(init_i2c_master_bus(&i2c_bus_handle));
 
     clock_init(CLOCK_STATUS_LED_GPIO, ALARM_BUZZER_GPIO);
+    boot_mark(BOOT_PHASE_CLOCK);
 
-    init_control_buttons();
+    /* The first frame, with placeholders for the values, goes out while the sensors are probed */
+    screen_init(i2c_bus_handle);
+    boot_mark(BOOT_PHASE_DISPLAY);
 
-    weather_init_sensors(i2c_bus_handle, AHT20_STATUS_LED_GPIO, BMP280_STATUS_LED_GPIO);
+    TaskHandle_t probe_task = xTaskCreateStatic(sensor_probe_task, "sensor_probe", SENSOR_PROBE_TASK_STACK_SIZE,
+                                                i2c_bus_handle, 1, sensor_probe_stack, &sensor_probe_tcb);
+    memory_account_task("weather", probe_task, sizeof(sensor_probe_stack) + sizeof(sensor_probe_tcb));
 
-    screen_init(i2c_bus_handle);
+    ESP_ERROR_CHECK(init_control_buttons());
+    boot_mark(BOOT_PHASE_INPUT);
+
+    ESP_ERROR_CHECK(history_init());
+
+    ESP_ERROR_CHECK(console_init());
+
+    ESP_ERROR_CHECK(telemetry_init());
+
+    ESP_ERROR_CHECK(uplink_init());
+
+    /* The traces have no task and start from the console, their buffers are static */
+    sched_trace_init();
+    sensor_trace_init();
+
+    boot_mark(BOOT_PHASE_SERVICES);
+
+    memory_report();
+    memory_seal();
 }
@@ -0,0 +1,203 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_rom_sys.h"
+
+#include "memory.h"
+
+#define MEMORY_MAX_ENTRIES 24
+/* Tasks inside an allow section at the same time */
+#define MEMORY_MAX_ALLOW_TASKS 6
+
+typedef struct memory_entry {
+    const char *subsystem;
+    const char *name;
+    size_t size;
+    TaskHandle_t task;
+} memory_entry_t;
+
+typedef struct allow_entry {
+    TaskHandle_t task;          /* NULL for a free slot */
+    unsigned int depth;
+} allow_entry_t;
+
+/* Section boundaries from the linker script */
+extern int _data_start, _data_end;
+extern int _bss_start, _bss_end;
+
+static const char *TAG = "MEMORY";
+
+static portMUX_TYPE entries_lock = portMUX_INITIALIZER_UNLOCKED;
+static memory_entry_t entries[MEMORY_MAX_ENTRIES];
+static unsigned int n_entries = 0;
+static unsigned int n_dropped_entries = 0;
+
+static volatile bool sealed = false;
+static allow_entry_t allowed[MEMORY_MAX_ALLOW_TASKS];
+static portMUX_TYPE allow_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void add_entry(const char *subsystem, const char *name, size_t size, TaskHandle_t task)
+{
+    portENTER_CRITICAL(&entries_lock);
+
+    if (n_entries < MEMORY_MAX_ENTRIES) {
+        entries[n_entries++] = (memory_entry_t) {
+            .subsystem = subsystem,
+            .name = name,
+            .size = size,
+            .task = task,
+        };
+    } else {
+        n_dropped_entries++;
+    }
+
+    portEXIT_CRITICAL(&entries_lock);
+}
+
+void memory_account(const char *subsystem, const char *name, size_t size)
+{
+    add_entry(subsystem, name, size, NULL);
+}
+
+void memory_account_task(const char *subsystem, TaskHandle_t task, size_t size)
+{
+    add_entry(subsystem, pcTaskGetName(task), size, task);
+}
+
+void memory_report(void)
+{
+    size_t data_sz = (size_t) ((char *) &_data_end - (char *) &_data_start);
+    size_t bss_sz = (size_t) ((char *) &_bss_end - (char *) &_bss_start);
+    size_t accounted = 0;
+
+    ESP_LOGI(TAG, "DRAM static: .data %u B, .bss %u B", (unsigned int) data_sz, (unsigned int) bss_sz);
+
+    for (unsigned int i = 0; i < n_entries; i++) {
+        size_t subsystem_sz = 0;
+        bool first = true;
+
+        /* Print each subsystem once, at its first entry */
+        for (unsigned int j = 0; j < i && first; j++) {
+            first = strcmp(entries[j].subsystem, entries[i].subsystem) != 0;
+        }
+
+        if (!first) continue;
+
+        for (unsigned int j = i; j < n_entries; j++) {
+            if (strcmp(entries[j].subsystem, entries[i].subsystem) == 0) {
+                subsystem_sz += entries[j].size;
+            }
+        }
+
+        ESP_LOGI(TAG, "  %-10s %6u B", entries[i].subsystem, (unsigned int) subsystem_sz);
+        accounted += subsystem_sz;
+
+        for (unsigned int j = i; j < n_entries; j++) {
+            const memory_entry_t *e = &entries[j];
+
+            if (strcmp(e->subsystem, entries[i].subsystem) != 0) continue;
+
+            if (e->task) {
+                ESP_LOGI(TAG, "    task %-16s %6u B, stack never below %u B free", e->name,
+                         (unsigned int) e->size, (unsigned int) uxTaskGetStackHighWaterMark(e->task));
+            } else {
+                ESP_LOGI(TAG, "    %-21s %6u B", e->name, (unsigned int) e->size);
+            }
+        }
+    }
+
+    ESP_LOGI(TAG, "  %-10s %6u B", "other", (unsigned int) (data_sz + bss_sz - MIN(accounted, data_sz + bss_sz)));
+    if (n_dropped_entries) {
+        ESP_LOGW(TAG, "%u entries not accounted, raise MEMORY_MAX_ENTRIES", n_dropped_entries);
+    }
+
+    ESP_LOGI(TAG, "Heap (internal): %u B total, %u B free, %u B minimum free, %u B largest block",
+             (unsigned int) heap_caps_get_total_size(MALLOC_CAP_INTERNAL),
+             (unsigned int) heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
+             (unsigned int) heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL),
+             (unsigned int) heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL));
+    ESP_LOGI(TAG, "%u tasks running", (unsigned int) uxTaskGetNumberOfTasks());
+}
+
+void memory_seal(void)
+{
+    sealed = true;
+}
+
+unsigned int memory_get_dropped_entries(void)
+{
+    return n_dropped_entries;
+}
+
+/*
+ * Without a free slot the task is not allowed and its allocation trips the
+ * trap, which names it.
+ */
+void memory_allow_alloc_begin(void)
+{
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    allow_entry_t *slot = NULL;
+
+    portENTER_CRITICAL(&allow_lock);
+    for (unsigned int i = 0; i < MEMORY_MAX_ALLOW_TASKS; i++) {
+        if (allowed[i].task == task) {
+            slot = &allowed[i];
+            break;
+        }
+        if (slot == NULL && allowed[i].task == NULL) slot = &allowed[i];
+    }
+    if (slot) {
+        slot->task = task;
+        slot->depth++;
+    }
+    portEXIT_CRITICAL(&allow_lock);
+}
+
+void memory_allow_alloc_end(void)
+{
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+
+    portENTER_CRITICAL(&allow_lock);
+    for (unsigned int i = 0; i < MEMORY_MAX_ALLOW_TASKS; i++) {
+        if (allowed[i].task == task) {
+            if (--allowed[i].depth == 0) allowed[i].task = NULL;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&allow_lock);
+}
+
+#if CONFIG_STATION_HEAP_TRAP
+/*
+ * Called by the heap component after every allocation. Logging would itself
+ * allocate, hence the ROM printf.
+ */
+void esp_heap_trace_alloc_hook(void *ptr, size_t size, uint32_t caps)
+{
+    TaskHandle_t task;
+
+    if (!sealed) return;
+
+    /* Only the task itself adds or removes its slot, no lock needed to find it */
+    task = xTaskGetCurrentTaskHandle();
+    for (unsigned int i = 0; i < MEMORY_MAX_ALLOW_TASKS; i++) {
+        if (allowed[i].task == task) return;
+    }
+
+    esp_rom_printf("\n%s: %u B heap allocation after boot in task %s (caps 0x%x)\n", TAG, (unsigned int) size,
+                   pcTaskGetName(task), (unsigned int) caps);
+    abort();
+}
+
+void esp_heap_trace_free_hook(void *ptr)
+{
+}
+#endif
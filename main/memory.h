@@ -0,0 +1,49 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <stddef.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/*
+ * Static memory accounting and the allocation trap.
+ *
+ * Tasks, queues and buffers are statically allocated by their subsystem and
+ * declared here so the boot report can break DRAM usage down and show the
+ * stack high-water mark of every task.
+ */
+
+/*
+ * Declares a static buffer of `size` bytes owned by `subsystem`.
+ */
+void memory_account(const char *subsystem, const char *name, size_t size);
+
+/*
+ * Declares a statically allocated task, `size` covers its stack and TCB.
+ */
+void memory_account_task(const char *subsystem, TaskHandle_t task, size_t size);
+
+/*
+ * Logs static usage per subsystem, stack high-water marks and heap state.
+ */
+void memory_report(void);
+
+/*
+ * Declarations beyond MEMORY_MAX_ENTRIES, missing from the report.
+ */
+unsigned int memory_get_dropped_entries(void);
+
+/*
+ * With CONFIG_STATION_HEAP_TRAP, any heap allocation after this call aborts.
+ */
+void memory_seal(void);
+
+/*
+ * Brackets rare operations known to allocate (e.g. NVS writes) once sealed.
+ * Sections nest and only allow the calling task to allocate.
+ */
+void memory_allow_alloc_begin(void);
+void memory_allow_alloc_end(void);
+
+#endif
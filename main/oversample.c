@@ -0,0 +1,129 @@
+#include <math.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "oversample.h"
+
+/* Smoothing of the noise estimate over the readings, 1/8 */
+#define NOISE_WEIGHT    0.125f
+
+/* Conversions needed per unit of (noise / target)², relative to a plain mean */
+static float efficiency_factor(oversample_reduce_t reduce)
+{
+    return reduce == OVERSAMPLE_MEDIAN ? (float) M_PI / 2 : 1.2f;
+}
+
+void oversample_init(oversample_t *os, oversample_reduce_t reduce, unsigned int channels, const float *target,
+                     unsigned int max)
+{
+    memset(os, 0, sizeof(*os));
+    os->reduce = reduce;
+    os->channels = MIN(channels, OVERSAMPLE_CHANNELS);
+    os->max = MAX(1, MIN(max, OVERSAMPLE_MAX));
+
+    for (unsigned int c = 0; c < os->channels; c++) {
+        os->target[c] = target[c];
+        os->noise[c] = NAN;
+        os->last[c] = NAN;
+    }
+}
+
+unsigned int oversample_begin(oversample_t *os, unsigned int limit)
+{
+    unsigned int planned = 1;
+
+    os->limit = MAX(1, MIN(limit, os->max));
+
+    for (unsigned int c = 0; c < os->channels; c++) {
+        float ratio = os->noise[c] / os->target[c];
+        float n = efficiency_factor(os->reduce) * ratio * ratio;
+
+        /* Also false for an unknown noise */
+        if (n > planned) planned = n >= os->limit ? os->limit : (unsigned int) ceilf(n);
+    }
+
+    os->count = 0;
+    os->planned = planned;
+
+    return planned;
+}
+
+bool oversample_add(oversample_t *os, const float *values)
+{
+    if (os->count == os->limit) return true;
+
+    for (unsigned int c = 0; c < os->channels; c++) {
+        float spread = fmaxf(os->noise[c], os->target[c]);
+
+        os->samples[c][os->count] = values[c];
+
+        /* A lone outlier: take enough conversions for the reduction to reject it */
+        if (os->count < 3 && fabsf(values[c] - os->last[c]) > OVERSAMPLE_SPIKE_SIGMAS * spread) {
+            os->planned = MIN(MAX(os->planned, 3), os->limit);
+        }
+    }
+
+    os->count++;
+
+    return os->count >= os->planned;
+}
+
+static void sort(float *v, unsigned int n)
+{
+    for (unsigned int i = 1; i < n; i++) {
+        float x = v[i];
+        unsigned int j = i;
+
+        for (; j > 0 && v[j - 1] > x; j--) v[j] = v[j - 1];
+        v[j] = x;
+    }
+}
+
+static float reduce(oversample_reduce_t how, float *v, unsigned int n)
+{
+    unsigned int trim;
+    float sum = 0;
+
+    sort(v, n);
+
+    if (how == OVERSAMPLE_MEDIAN) return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+
+    trim = MIN((n + 2) / 4, (n - 1) / 2);
+    for (unsigned int i = trim; i < n - trim; i++) sum += v[i];
+
+    return sum / (n - 2 * trim);
+}
+
+static void update_noise(oversample_t *os, unsigned int c)
+{
+    const float *v = os->samples[c];
+    float estimate, sum = 0;
+
+    if (os->count >= 2) {
+        /* E|x1 - x2| = 2 sigma / sqrt(pi) for normal noise */
+        for (unsigned int i = 1; i < os->count; i++) sum += fabsf(v[i] - v[i - 1]);
+        estimate = sum / (os->count - 1) * sqrtf((float) M_PI) / 2;
+    } else if (!isnan(os->last[c])) {
+        /* Against a reading of last_count conversions: E|d| = sigma sqrt(2 / pi) sqrt(1 + 1 / last_count) */
+        estimate = fabsf(v[0] - os->last[c]) * sqrtf((float) M_PI / 2) / sqrtf(1 + 1.0f / os->last_count);
+    } else {
+        return;
+    }
+
+    os->noise[c] = isnan(os->noise[c]) ? estimate : os->noise[c] + NOISE_WEIGHT * (estimate - os->noise[c]);
+}
+
+unsigned int oversample_end(oversample_t *os, float *out)
+{
+    if (os->count == 0) return 0;
+
+    for (unsigned int c = 0; c < os->channels; c++) {
+        update_noise(os, c);
+        out[c] = os->count == 1 ? os->samples[c][0] : reduce(os->reduce, os->samples[c], os->count);
+        os->last[c] = out[c];
+    }
+
+    os->last_count = os->count;
+
+    return os->count;
+}
@@ -0,0 +1,64 @@
+#ifndef OVERSAMPLE_H
+#define OVERSAMPLE_H
+
+#include <stdbool.h>
+
+/*
+ * Burst oversampling of a sensor reading.
+ *
+ * A published reading is reduced from a burst of back-to-back conversions
+ * by their median or their interquartile mean, both computed in place on
+ * the burst without allocating. The burst size follows the noise observed
+ * so far: it is the number of conversions needed to bring the standard
+ * error of each channel down to its target, so a quiet sensor costs one
+ * conversion per reading. A conversion further than OVERSAMPLE_SPIKE_SIGMAS
+ * from the last published value extends the burst to at least three, so
+ * that a single spike never gets published on its own.
+ *
+ * The noise of one conversion is estimated from the absolute differences
+ * between consecutive conversions of a burst, or with the last published
+ * value for single conversions, smoothed over the readings.
+ */
+
+#define OVERSAMPLE_MAX          16
+#define OVERSAMPLE_CHANNELS     2
+#define OVERSAMPLE_SPIKE_SIGMAS 4
+
+typedef enum oversample_reduce {
+    OVERSAMPLE_MEDIAN,
+    OVERSAMPLE_TRIMMED_MEAN,    /* Drops a quarter at each end, rounded up */
+} oversample_reduce_t;
+
+typedef struct oversample {
+    oversample_reduce_t reduce;
+    unsigned int channels;
+    unsigned int max;                           /* Burst size limit, up to OVERSAMPLE_MAX */
+    float target[OVERSAMPLE_CHANNELS];          /* Wanted standard error of a reading */
+    float noise[OVERSAMPLE_CHANNELS];           /* Standard deviation of one conversion */
+    float last[OVERSAMPLE_CHANNELS];            /* Last reading, NAN before the first */
+    unsigned int last_count;
+    float samples[OVERSAMPLE_CHANNELS][OVERSAMPLE_MAX];
+    unsigned int count;
+    unsigned int planned;
+    unsigned int limit;
+} oversample_t;
+
+void oversample_init(oversample_t *os, oversample_reduce_t reduce, unsigned int channels, const float *target,
+                     unsigned int max);
+
+/*
+ * Starts a burst and returns its planned size; `limit` lowers the maximum
+ * for this burst, e.g. to bound the self-heating of the sensor.
+ */
+unsigned int oversample_begin(oversample_t *os, unsigned int limit);
+
+/* Adds a conversion, one value per channel; true when the burst is complete */
+bool oversample_add(oversample_t *os, const float *values);
+
+/*
+ * Reduces the burst into `out` and updates the noise estimate. Returns the
+ * number of conversions, 0 if there was none and `out` is unchanged.
+ */
+unsigned int oversample_end(oversample_t *os, float *out);
+
+#endif
@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "driver/gpio.h"
+
+#include "esp_check.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_pm.h"
+#include "esp_sleep.h"
+
+#include "power.h"
+
+static const char *TAG = "POWER";
+
+#if CONFIG_STATION_POWER_SAVE
+
+typedef struct power_lock_stats {
+    esp_pm_lock_handle_t handle;
+    const char *name;
+    uint32_t holders;
+    int64_t held_since_us;
+    int64_t held_total_us;
+} power_lock_stats_t;
+
+static power_lock_stats_t locks[POWER_LOCK_MAX] = {
+    [POWER_LOCK_I2C] = { .name = "i2c" },
+    [POWER_LOCK_BUZZER] = { .name = "buzzer" },
+};
+
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+#if CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+static int64_t sleep_total_us = 0;
+static uint32_t sleep_count = 0;
+
+static bool light_sleep_exit_cb(int64_t sleep_time_us, void *arg)
+{
+    sleep_total_us += sleep_time_us;
+    sleep_count++;
+    return true;
+}
+#endif
+
+void power_lock_acquire(power_lock_t lock)
+{
+    power_lock_stats_t *l = &locks[lock];
+
+    if (l->handle == NULL) return;
+
+    esp_pm_lock_acquire(l->handle);
+
+    portENTER_CRITICAL(&stats_lock);
+    if (l->holders++ == 0) {
+        l->held_since_us = esp_timer_get_time();
+    }
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+void power_lock_release(power_lock_t lock)
+{
+    power_lock_stats_t *l = &locks[lock];
+
+    if (l->handle == NULL) return;
+
+    portENTER_CRITICAL(&stats_lock);
+    if (l->holders > 0 && --l->holders == 0) {
+        l->held_total_us += esp_timer_get_time() - l->held_since_us;
+    }
+    portEXIT_CRITICAL(&stats_lock);
+
+    esp_pm_lock_release(l->handle);
+}
+
+esp_err_t power_enable_gpio_wakeup(uint32_t gpio, int level)
+{
+    ESP_RETURN_ON_ERROR(gpio_wakeup_enable(gpio, level ? GPIO_INTR_HIGH_LEVEL : GPIO_INTR_LOW_LEVEL),
+                        TAG, "power_enable_gpio_wakeup: gpio_wakeup_enable failed");
+
+    return esp_sleep_enable_gpio_wakeup();
+}
+
+void power_report(void)
+{
+    int64_t uptime_us = esp_timer_get_time();
+
+#if CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+    ESP_LOGI(TAG, "uptime %" PRId64 " s, light sleep %" PRId64 "%% (%" PRIu32 " entries), active %" PRId64 "%%",
+             uptime_us / 1000000, sleep_total_us * 100 / uptime_us, sleep_count,
+             100 - sleep_total_us * 100 / uptime_us);
+#else
+    ESP_LOGI(TAG, "uptime %" PRId64 " s", uptime_us / 1000000);
+#endif
+
+    for (int i = 0; i < POWER_LOCK_MAX; i++) {
+        int64_t held_us = locks[i].held_total_us;
+
+        if (locks[i].holders) {
+            held_us += uptime_us - locks[i].held_since_us;
+        }
+
+        ESP_LOGI(TAG, "lock %-6s held %" PRId64 " ms (%" PRId64 "%%)", locks[i].name,
+                 held_us / 1000, held_us * 100 / uptime_us);
+    }
+
+#if CONFIG_PM_PROFILING
+    esp_pm_dump_locks(stdout);
+#endif
+}
+
+static void power_report_timer_cb(void *arg)
+{
+    power_report();
+}
+
+esp_err_t power_init(void)
+{
+    ESP_LOGI(TAG, "Enabling automatic light sleep");
+
+    esp_pm_config_t pm_config = {
+        .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = CONFIG_XTAL_FREQ,
+        .light_sleep_enable = true,
+    };
+
+    ESP_RETURN_ON_ERROR(esp_pm_configure(&pm_config), TAG, "power_init: esp_pm_configure failed");
+
+    for (int i = 0; i < POWER_LOCK_MAX; i++) {
+        ESP_RETURN_ON_ERROR(esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, locks[i].name, &locks[i].handle),
+                            TAG, "power_init: esp_pm_lock_create failed");
+    }
+
+#if CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+    esp_pm_sleep_cbs_register_config_t cbs_conf = {
+        .exit_cb = light_sleep_exit_cb,
+    };
+    ESP_RETURN_ON_ERROR(esp_pm_light_sleep_register_cbs(&cbs_conf), TAG, "power_init: registering sleep callbacks failed");
+#endif
+
+    const esp_timer_create_args_t report_timer_args = {
+        .callback = &power_report_timer_cb,
+        .name = "power_report",
+        .skip_unhandled_events = true,
+    };
+    esp_timer_handle_t report_timer = NULL;
+
+    ESP_RETURN_ON_ERROR(esp_timer_create(&report_timer_args, &report_timer), TAG, "power_init: esp_timer_create failed");
+
+    return esp_timer_start_periodic(report_timer, (uint64_t) CONFIG_STATION_POWER_REPORT_INTERVAL_S * 1000000);
+}
+
+#else /* !CONFIG_STATION_POWER_SAVE */
+
+void power_lock_acquire(power_lock_t lock)
+{
+}
+
+void power_lock_release(power_lock_t lock)
+{
+}
+
+esp_err_t power_enable_gpio_wakeup(uint32_t gpio, int level)
+{
+    return ESP_OK;
+}
+
+void power_report(void)
+{
+    ESP_LOGI(TAG, "Power management disabled");
+}
+
+esp_err_t power_init(void)
+{
+    return ESP_OK;
+}
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef POWER_H
+#define POWER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+
+/*
+ * Automatic light sleep (CONFIG_STATION_POWER_SAVE).
+ *
+ * The chip sleeps whenever every task is blocked. Code driving a peripheral
+ * that does not run in light sleep holds the matching lock for the duration
+ * of the transfer. POWER_LOCK_I2C is taken for every I2C transfer by the
+ * wrappers in i2c_trace.c, so drivers waiting between transfers do not keep
+ * the chip awake. Without power management all functions are no-ops.
+ */
+
+typedef enum power_lock {
+    POWER_LOCK_I2C = 0,
+    POWER_LOCK_BUZZER,
+    POWER_LOCK_MAX
+} power_lock_t;
+
+void power_lock_acquire(power_lock_t lock);
+void power_lock_release(power_lock_t lock);
+
+/*
+ * Wakes the chip from light sleep while `gpio` is at `level`.
+ */
+esp_err_t power_enable_gpio_wakeup(uint32_t gpio, int level);
+
+/*
+ * Logs the share of time spent in light sleep and the time each lock was
+ * held since boot.
+ */
+void power_report(void);
+
+esp_err_t power_init(void);
+
+#endif
@@ -0,0 +1,279 @@
+#include <stdint.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_attr.h"
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+
+#include "memory.h"
+#include "sched_trace.h"
+#include "sched_trace_hooks.h"
+
+#if CONFIG_STATION_SCHED_TRACE
+
+#define RING_WORDS              (CONFIG_STATION_SCHED_TRACE_BUF_SIZE / 4)
+#define RECORD_MAX_WORDS        (2 + SCHED_TRACE_NAME_WORDS)
+#define VALUE_MASK              0xFFFFFF
+
+/* About 0.1 s at 160 MHz, well within the 32-bit wrap of the cycle counter */
+#define SYNC_INTERVAL_CYCLES    (1u << 24)
+
+/*
+ * A task's FreeRTOS task number holds the trace generation above its
+ * index: starting a trace makes every task new again, so that its name
+ * is recorded before its first switch.
+ */
+#define TASK_INDEX_BITS         8
+#define TASK_INDEX_MAX          ((1u << TASK_INDEX_BITS) - 1)
+
+static const char *const span_names[SCHED_SPAN_MAX] = {
+    [SCHED_SPAN_AHT20] = "aht20",
+    [SCHED_SPAN_BMP280] = "bmp280",
+    [SCHED_SPAN_RENDER] = "render",
+    [SCHED_SPAN_FLUSH] = "flush",
+    [SCHED_SPAN_ALARM] = "alarm",
+    [SCHED_SPAN_TONE] = "tone",
+    [SCHED_SPAN_BUTTON] = "button",
+};
+
+static uint32_t ring[RING_WORDS];
+static size_t head = 0;         /* Next word to write */
+static size_t used = 0;
+static bool recording = false;
+static uint32_t n_records = 0;
+static uint32_t n_dropped = 0;
+static uint32_t pending_dropped = 0;
+static uint32_t generation = 0;
+static unsigned int next_index;
+static uint32_t last_sync;
+static TaskHandle_t idle_task;
+static bool idle_running;
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void IRAM_ATTR put(const uint32_t *words, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        ring[head] = words[i];
+        head = head + 1 == RING_WORDS ? 0 : head + 1;
+    }
+
+    used += n;
+}
+
+/* Called with the lock held. A record is written whole or not at all, so the stream stays decodable */
+static bool IRAM_ATTR append(const uint32_t *words, size_t n)
+{
+    uint32_t dropped[2];
+
+    if (used + n + (pending_dropped ? 2 : 0) > RING_WORDS) {
+        n_dropped++;
+        pending_dropped++;
+        return false;
+    }
+
+    if (pending_dropped) {
+        dropped[0] = words[0];
+        dropped[1] = SCHED_TRACE_DROPPED << 24 | MIN(pending_dropped, VALUE_MASK);
+        put(dropped, 2);
+        pending_dropped = 0;
+    }
+
+    put(words, n);
+    n_records++;
+
+    return true;
+}
+
+static void IRAM_ATTR sync(uint32_t cycles)
+{
+    int64_t now = esp_timer_get_time();
+    uint32_t words[4] = {
+        cycles,
+        SCHED_TRACE_SYNC << 24 | esp_rom_get_cpu_ticks_per_us(),
+        (uint32_t) now,
+        (uint32_t) (now >> 32),
+    };
+
+    if (append(words, 4)) last_sync = cycles;
+}
+
+static bool IRAM_ATTR append_name(uint8_t type, uint32_t value, const char *name, uint32_t cycles)
+{
+    uint32_t words[RECORD_MAX_WORDS] = { cycles, type << 24 | value };
+
+    strncpy((char *) &words[2], name, SCHED_TRACE_NAME_WORDS * 4);
+
+    return append(words, RECORD_MAX_WORDS);
+}
+
+/* The task's number in this trace, 0 when it could not get one */
+static uint32_t IRAM_ATTR task_number(TaskHandle_t task, uint32_t cycles)
+{
+    uint32_t number = uxTaskGetTaskNumber(task);
+
+    if (number >> TASK_INDEX_BITS == generation) return number;
+
+    if (next_index > TASK_INDEX_MAX || !append_name(SCHED_TRACE_TASK_NAME, next_index, pcTaskGetName(task), cycles)) {
+        return 0;
+    }
+
+    number = generation << TASK_INDEX_BITS | next_index++;
+    vTaskSetTaskNumber(task, number);
+
+    return number;
+}
+
+/* traceTASK_SWITCHED_IN(), in the scheduler with the interrupts masked */
+void IRAM_ATTR sched_trace_switched_in(void)
+{
+    TaskHandle_t task;
+    uint32_t cycles, number, words[2];
+
+    if (!recording) return;
+
+    task = xTaskGetCurrentTaskHandle();
+    cycles = esp_cpu_get_cycle_count();
+
+    portENTER_CRITICAL_SAFE(&lock);
+
+    /* The cycle counter stops in light sleep, which the idle task enters */
+    if (idle_running || cycles - last_sync >= SYNC_INTERVAL_CYCLES) sync(cycles);
+    idle_running = task == idle_task;
+
+    number = task_number(task, cycles);
+    if (number != 0) {
+        words[0] = cycles;
+        words[1] = SCHED_TRACE_SWITCH << 24 | (number & TASK_INDEX_MAX);
+        append(words, 2);
+    }
+
+    portEXIT_CRITICAL_SAFE(&lock);
+}
+
+static void IRAM_ATTR span(sched_trace_type_t type, sched_span_t span)
+{
+    uint32_t words[2];
+
+    if (!recording) return;
+
+    words[0] = esp_cpu_get_cycle_count();
+    words[1] = type << 24 | span;
+
+    portENTER_CRITICAL_SAFE(&lock);
+    append(words, 2);
+    portEXIT_CRITICAL_SAFE(&lock);
+}
+
+void IRAM_ATTR sched_trace_begin(sched_span_t s)
+{
+    span(SCHED_TRACE_BEGIN, s);
+}
+
+void IRAM_ATTR sched_trace_end(sched_span_t s)
+{
+    span(SCHED_TRACE_END, s);
+}
+
+void sched_trace_init(void)
+{
+    memory_account("sched", "trace ring", sizeof(ring));
+}
+
+void sched_trace_start(void)
+{
+    static const uint32_t header[2] = {
+        'S' | 'C' << 8 | 'H' << 16 | (uint32_t) 'T' << 24,
+        SCHED_TRACE_VERSION,
+    };
+    uint32_t cycles = esp_cpu_get_cycle_count();
+
+    portENTER_CRITICAL(&lock);
+    recording = false;
+    head = 0;
+    used = 0;
+    n_records = 0;
+    n_dropped = 0;
+    pending_dropped = 0;
+
+    /* Never 0, the number of a task no trace has seen yet */
+    generation = (generation + 1) & VALUE_MASK;
+    if (generation == 0) generation = 1;
+    next_index = 1;
+    idle_task = xTaskGetIdleTaskHandle();
+    idle_running = false;
+
+    put(header, 2);
+    for (int i = 0; i < SCHED_SPAN_MAX; i++) append_name(SCHED_TRACE_SPAN_NAME, i, span_names[i], cycles);
+    sync(cycles);
+    recording = true;
+    portEXIT_CRITICAL(&lock);
+}
+
+void sched_trace_stop(void)
+{
+    portENTER_CRITICAL(&lock);
+    recording = false;
+    portEXIT_CRITICAL(&lock);
+}
+
+size_t sched_trace_read(uint8_t *out, size_t max)
+{
+    size_t n;
+
+    portENTER_CRITICAL(&lock);
+    n = MIN(used, max / 4);
+    for (size_t i = 0; i < n; i++) {
+        uint32_t w = ring[(head + RING_WORDS - used + i) % RING_WORDS];
+
+        out[4 * i] = w;
+        out[4 * i + 1] = w >> 8;
+        out[4 * i + 2] = w >> 16;
+        out[4 * i + 3] = w >> 24;
+    }
+    used -= n;
+    portEXIT_CRITICAL(&lock);
+
+    return n * 4;
+}
+
+void sched_trace_get_status(sched_trace_status_t *status)
+{
+    portENTER_CRITICAL(&lock);
+    status->recording = recording;
+    status->records = n_records;
+    status->dropped = n_dropped;
+    status->used = used * 4;
+    status->size = sizeof(ring);
+    portEXIT_CRITICAL(&lock);
+}
+
+#else /* !CONFIG_STATION_SCHED_TRACE */
+
+void sched_trace_init(void)
+{
+}
+
+void sched_trace_start(void)
+{
+}
+
+void sched_trace_stop(void)
+{
+}
+
+size_t sched_trace_read(uint8_t *out, size_t max)
+{
+    return 0;
+}
+
+void sched_trace_get_status(sched_trace_status_t *status)
+{
+    memset(status, 0, sizeof(*status));
+}
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef SCHED_TRACE_H
+#define SCHED_TRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * Scheduler trace (CONFIG_STATION_SCHED_TRACE).
+ *
+ * Records every context switch, through the FreeRTOS traceTASK_SWITCHED_IN
+ * hook of sched_trace_hooks.h, and the spans of the sensor, render, flush,
+ * alarm and button paths into a RAM ring, timestamped with the CPU cycle
+ * counter. Sync records pair the cycle counter with esp_timer every few
+ * million cycles and whenever the idle task is left, so that the host gets
+ * the time right across frequency changes and light sleep. host/sched
+ * converts a dump into Chrome trace JSON for Perfetto.
+ *
+ * Trace format: 32-bit little-endian words. The magic "SCHT" and the
+ * version start a trace, then come records of a cycle count and a word
+ * with the type in its top byte and a 24-bit value below, followed by
+ * type-specific words. Several dumps of one capture concatenate into a
+ * valid trace.
+ */
+
+#define SCHED_TRACE_MAGIC       "SCHT"
+#define SCHED_TRACE_VERSION     1
+#define SCHED_TRACE_NAME_WORDS  4       /* 16 characters, NUL-padded */
+
+typedef enum sched_trace_type {
+    SCHED_TRACE_SWITCH = 1,     /* Value: task number */
+    SCHED_TRACE_TASK_NAME,      /* Value: task number, then the name */
+    SCHED_TRACE_SPAN_NAME,      /* Value: span, then the name */
+    SCHED_TRACE_BEGIN,          /* Value: span, in the running task */
+    SCHED_TRACE_END,
+    SCHED_TRACE_SYNC,           /* Value: CPU MHz, then esp_timer in us, low and high word */
+    SCHED_TRACE_DROPPED,        /* Value: records lost before this one */
+} sched_trace_type_t;
+
+/* Words of a record, 0 for an unknown type */
+static inline size_t sched_trace_record_words(uint8_t type)
+{
+    switch (type) {
+        case SCHED_TRACE_SWITCH:
+        case SCHED_TRACE_BEGIN:
+        case SCHED_TRACE_END:
+        case SCHED_TRACE_DROPPED:
+            return 2;
+        case SCHED_TRACE_TASK_NAME:
+        case SCHED_TRACE_SPAN_NAME:
+            return 2 + SCHED_TRACE_NAME_WORDS;
+        case SCHED_TRACE_SYNC:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+typedef enum sched_span {
+    SCHED_SPAN_AHT20,           /* One AHT20 reading, burst included */
+    SCHED_SPAN_BMP280,
+    SCHED_SPAN_RENDER,          /* lv_timer_handler(), flush included */
+    SCHED_SPAN_FLUSH,
+    SCHED_SPAN_ALARM,
+    SCHED_SPAN_TONE,            /* A step of the tone sequencer */
+    SCHED_SPAN_BUTTON,          /* Dispatch of a button event */
+    SCHED_SPAN_MAX
+} sched_span_t;
+
+typedef struct sched_trace_status {
+    bool recording;
+    uint32_t records;
+    uint32_t dropped;           /* Records lost because the buffer was full */
+    size_t used;                /* Bytes waiting to be dumped */
+    size_t size;
+} sched_trace_status_t;
+
+#if CONFIG_STATION_SCHED_TRACE
+
+void sched_trace_begin(sched_span_t span);
+void sched_trace_end(sched_span_t span);
+
+#else
+
+static inline void sched_trace_begin(sched_span_t span)
+{
+}
+
+static inline void sched_trace_end(sched_span_t span)
+{
+}
+
+#endif
+
+/* Accounts the ring with memory_account(); called once at boot */
+void sched_trace_init(void);
+
+/* Discards what was not dumped and starts a new trace */
+void sched_trace_start(void);
+void sched_trace_stop(void);
+
+/* Moves up to `max` bytes of the trace out of the buffer, whole words only */
+size_t sched_trace_read(uint8_t *out, size_t max);
+
+void sched_trace_get_status(sched_trace_status_t *status);
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef SCHED_TRACE_HOOKS_H
+#define SCHED_TRACE_HOOKS_H
+
+/*
+ * FreeRTOS trace hooks of the scheduler trace (sched_trace.h). The project
+ * CMakeLists.txt includes this header ahead of every C source, so that the
+ * kernel sees the hook before defining its empty default.
+ */
+
+#include "sdkconfig.h"
+
+#if CONFIG_STATION_SCHED_TRACE
+
+void sched_trace_switched_in(void);
+
+#define traceTASK_SWITCHED_IN() sched_trace_switched_in()
+
+#endif
+
+#endif
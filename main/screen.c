@@ -9,6 +9,7 @@
 #include "driver/gpio.h"
 
 #include "esp_timer.h"
+#include "esp_check.h"
 #include "esp_err.h"
 #include "esp_log.h"
 
@@ -16,7 +17,14 @@
 #include "esp_lcd_panel_io.h"
 #include "esp_lcd_panel_ops.h"
 
+#include "boot.h"
+#include "frame_prof.h"
+#include "memory.h"
+#include "power.h"
+#include "sched_trace.h"
 #include "screen.h"
+#include "screen_cmd.h"
+#include "screen_conv.h"
 
 #if CONFIG_EXAMPLE_LCD_CONTROLLER_SH1107
 #include "esp_lcd_sh1107.h"
@@ -43,33 +51,108 @@
 #define EXAMPLE_LCD_CMD_BITS           8
 #define EXAMPLE_LCD_PARAM_BITS         8
 
-#define EXAMPLE_LVGL_TICK_PERIOD_MS    5
 #define EXAMPLE_LVGL_TASK_STACK_SIZE   (4 * 1024)
 #define EXAMPLE_LVGL_TASK_PRIORITY     2
 #define EXAMPLE_LVGL_PALETTE_SIZE      8
 #define EXAMPLE_LVGL_TASK_MAX_DELAY_MS 500
 #define EXAMPLE_LVGL_TASK_MIN_DELAY_MS 1000 / CONFIG_FREERTOS_HZ
 
+/* Column and page range commands of a bitmap write, and the data control byte */
+#define FLUSH_ADDRESSING_BYTES         9
+
+#if CONFIG_EXAMPLE_LCD_CONTROLLER_SH1107
+#define PANEL_INVERTED                 true     /* Set by screen_init() */
+#define PANEL_HAS_SCROLL               false
+#else
+#define PANEL_INVERTED                 false
+#define PANEL_HAS_SCROLL               true
+#endif
+
+/* User context of the transfer-done callback; a flush around the scroll takes two transfers */
+typedef struct flush_ctx {
+    lv_display_t *disp;
+    unsigned int pending;   /* Transfers of the current flush not completed yet */
+} flush_ctx_t;
+
 static const char *TAG = "SCREEN";
 
 // To use LV_COLOR_FORMAT_I1, we need an extra buffer to hold the converted data
 static uint8_t oled_buffer[EXAMPLE_LCD_H_RES * EXAMPLE_LCD_V_RES / 8];
+// LVGL reserves 2 x 4 bytes in the buffer, as these are assumed to be used as a palette.
+#define EXAMPLE_LVGL_DRAW_BUFFER_SIZE  (EXAMPLE_LCD_H_RES * EXAMPLE_LCD_V_RES / 8 + EXAMPLE_LVGL_PALETTE_SIZE)
+static uint8_t lvgl_draw_buffer[EXAMPLE_LVGL_DRAW_BUFFER_SIZE] __attribute__((aligned(4)));
+static StackType_t lvgl_task_stack[EXAMPLE_LVGL_TASK_STACK_SIZE];
+static StaticTask_t lvgl_task_tcb;
+static screen_stats_t stats;
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
 // LVGL library is not thread-safe, this example will call LVGL APIs from different tasks, so use a mutex to protect it
 static _lock_t lvgl_api_lock;
+// Orders the effect commands with the flushes; never held while taking lvgl_api_lock
+static _lock_t panel_lock;
+static esp_lcd_panel_io_handle_t panel_io;
+static struct {
+    bool active;
+    uint8_t first_page, last_page;
+} scroll;
+static volatile bool redraw_pending;
+static flush_ctx_t flush_ctx;
 
 extern void example_lvgl_demo_ui(lv_disp_t *disp);
 extern void lv_create_main_gui(void);
 
 static bool example_notify_lvgl_flush_ready(esp_lcd_panel_io_handle_t io_panel, esp_lcd_panel_io_event_data_t *edata, void *user_ctx)
 {
-    lv_display_t *disp = (lv_display_t *)user_ctx;
-    lv_display_flush_ready(disp);
+    flush_ctx_t *ctx = user_ctx;
+
+    /* The flush is ready once its last band is on the panel */
+    if (ctx->pending > 0 && --ctx->pending > 0) return false;
+
+    frame_prof_mark(FRAME_MARK_FLUSH_READY);
+    lv_display_flush_ready(ctx->disp);
     return false;
 }
 
+/*
+ * The controller shifts the scrolling pages in its GDDRAM, and the data
+ * sheet forbids writing them meanwhile: only the pages above and below the
+ * scroll are written, each band from its offset in the converted buffer.
+ */
+static esp_err_t flush_around_scroll(esp_lcd_panel_handle_t panel_handle, int x1, int y1, int x2, int y2,
+                                     uint32_t *bytes)
+{
+    int width = x2 - x1 + 1, first = y1 / 8, last = y2 / 8;
+    int bands[2][2] = {
+        { first, MIN(last, scroll.first_page - 1) },
+        { MAX(first, scroll.last_page + 1), last },
+    };
+    esp_err_t rc = ESP_OK;
+
+    *bytes = 0;
+
+    flush_ctx.pending = 0;
+    for (int i = 0; i < 2; i++) {
+        flush_ctx.pending += bands[i][0] <= bands[i][1];
+    }
+
+    for (int i = 0; i < 2 && rc == ESP_OK; i++) {
+        if (bands[i][0] > bands[i][1]) continue;
+
+        rc = esp_lcd_panel_draw_bitmap(panel_handle, x1, bands[i][0] * 8, x2 + 1, (bands[i][1] + 1) * 8,
+                                       oled_buffer + (bands[i][0] - first) * width);
+        *bytes += (bands[i][1] - bands[i][0] + 1) * width + FLUSH_ADDRESSING_BYTES;
+    }
+
+    return rc;
+}
+
 static void example_lvgl_flush_cb(lv_display_t *disp, const lv_area_t *area, uint8_t *px_map)
 {
     esp_lcd_panel_handle_t panel_handle = lv_display_get_user_data(disp);
+    uint32_t bytes;
+    esp_err_t rc;
+
+    frame_prof_mark(FRAME_MARK_FLUSH_START);
+    sched_trace_begin(SCHED_SPAN_FLUSH);
 
     // This is necessary because LVGL reserves 2 x 4 bytes in the buffer, as these are assumed to be used as a palette. Skip the palette here
     // More information about the monochrome, please refer to https://docs.lvgl.io/9.2/porting/display.html#monochrome-displays
@@ -81,34 +164,166 @@ static void example_lvgl_flush_cb(lv_display_t *disp, const lv_area_t *area, uin
     int y1 = area->y1;
     int y2 = area->y2;
 
-    for (int y = y1; y <= y2; y++) {
-        for (int x = x1; x <= x2; x++) {
-            /* The order of bits is MSB first
-                        MSB           LSB
-               bits      7 6 5 4 3 2 1 0
-               pixels    0 1 2 3 4 5 6 7
-                        Left         Right
-            */
-            bool chroma_color = (px_map[(hor_res >> 3) * y  + (x >> 3)] & 1 << (7 - x % 8));
-
-            /* Write to the buffer as required for the display.
-            * It writes only 1-bit for monochrome displays mapped vertically.*/
-            uint8_t *buf = oled_buffer + hor_res * (y >> 3) + (x);
-            if (chroma_color) {
-                (*buf) &= ~(1 << (y % 8));
-            } else {
-                (*buf) |= (1 << (y % 8));
-            }
-        }
-    }
+    screen_conv_i1_to_pages(px_map, hor_res, x1, y1, x2, y2, oled_buffer);
+    frame_prof_mark(FRAME_MARK_CONVERT_END);
+
     // pass the draw buffer to the driver
-    esp_lcd_panel_draw_bitmap(panel_handle, x1, y1, x2 + 1, y2 + 1, oled_buffer);
+    _lock_acquire(&panel_lock);
+    power_lock_acquire(POWER_LOCK_I2C);
+    if (!scroll.active) {
+        flush_ctx.pending = 1;
+        rc = esp_lcd_panel_draw_bitmap(panel_handle, x1, y1, x2 + 1, y2 + 1, oled_buffer);
+        bytes = (x2 - x1 + 1) * (y2 - y1 + 1) / 8 + FLUSH_ADDRESSING_BYTES;
+    } else {
+        rc = flush_around_scroll(panel_handle, x1, y1, x2, y2, &bytes);
+        /* Nothing went to the panel, so no transfer completes to report it */
+        if (bytes == 0) lv_display_flush_ready(disp);
+    }
+    power_lock_release(POWER_LOCK_I2C);
+    _lock_release(&panel_lock);
+
+    portENTER_CRITICAL(&stats_lock);
+    stats.frames++;
+    stats.flush_errors += rc != ESP_OK;
+    stats.frame_bytes += bytes;
+    portEXIT_CRITICAL(&stats_lock);
+
+    sched_trace_end(SCHED_SPAN_FLUSH);
+
+    /* The I2C panel IO transfers synchronously: the frame is on the panel */
+    if (rc == ESP_OK) boot_mark(BOOT_PHASE_FIRST_FRAME);
+}
+
+static void example_lvgl_refr_event_cb(lv_event_t *e)
+{
+    frame_prof_mark(lv_event_get_code(e) == LV_EVENT_REFR_START ? FRAME_MARK_REFR_START : FRAME_MARK_REFR_READY);
+}
+
+void screen_get_stats(screen_stats_t *out)
+{
+    portENTER_CRITICAL(&stats_lock);
+    *out = stats;
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+/* Sends the commands of an effect; panel_lock held */
+static esp_err_t send_commands(const screen_cmd_t *cmds, size_t count)
+{
+    esp_err_t rc = ESP_OK;
+
+    power_lock_acquire(POWER_LOCK_I2C);
+    for (size_t i = 0; i < count && rc == ESP_OK; i++) {
+        rc = esp_lcd_panel_io_tx_param(panel_io, cmds[i].cmd, cmds[i].len ? cmds[i].params : NULL, cmds[i].len);
+    }
+    power_lock_release(POWER_LOCK_I2C);
+
+    portENTER_CRITICAL(&stats_lock);
+    stats.effects += count;
+    stats.effect_bytes += screen_cmd_bus_bytes(cmds, count);
+    stats.effect_errors += rc != ESP_OK;
+    portEXIT_CRITICAL(&stats_lock);
+
+    return rc;
+}
+
+esp_err_t screen_set_contrast(uint8_t contrast)
+{
+    screen_cmd_t cmd;
+    esp_err_t rc;
+
+    ESP_RETURN_ON_FALSE(panel_io != NULL, ESP_ERR_INVALID_STATE, TAG, "screen_set_contrast: panel not initialized");
+
+    screen_cmd_contrast(&cmd, contrast);
+
+    _lock_acquire(&panel_lock);
+    rc = send_commands(&cmd, 1);
+    _lock_release(&panel_lock);
+
+    return rc;
+}
+
+esp_err_t screen_set_inverted(bool inverted)
+{
+    screen_cmd_t cmd;
+    esp_err_t rc;
+
+    ESP_RETURN_ON_FALSE(panel_io != NULL, ESP_ERR_INVALID_STATE, TAG, "screen_set_inverted: panel not initialized");
+
+    /* Relative to the panel's normal polarity */
+    screen_cmd_invert(&cmd, inverted != PANEL_INVERTED);
+
+    _lock_acquire(&panel_lock);
+    rc = send_commands(&cmd, 1);
+    _lock_release(&panel_lock);
+
+    return rc;
 }
 
-static void example_increase_lvgl_tick(void *arg)
+esp_err_t screen_scroll_start(bool left, uint8_t first_page, uint8_t last_page, screen_scroll_interval_t interval)
 {
-    /* Tell LVGL how many milliseconds has elapsed */
-    lv_tick_inc(EXAMPLE_LVGL_TICK_PERIOD_MS);
+    screen_cmd_t cmds[SCREEN_CMD_SCROLL_CMDS];
+    size_t n;
+    esp_err_t rc;
+
+    ESP_RETURN_ON_FALSE(PANEL_HAS_SCROLL, ESP_ERR_NOT_SUPPORTED, TAG, "screen_scroll_start: not supported by the panel");
+    ESP_RETURN_ON_FALSE(panel_io != NULL, ESP_ERR_INVALID_STATE, TAG, "screen_scroll_start: panel not initialized");
+    ESP_RETURN_ON_FALSE(first_page <= last_page && last_page < EXAMPLE_LCD_V_RES / 8, ESP_ERR_INVALID_ARG, TAG,
+                        "screen_scroll_start: invalid page range");
+
+    n = screen_cmd_scroll(cmds, left, first_page, last_page, interval);
+
+    _lock_acquire(&panel_lock);
+    rc = send_commands(cmds, n);
+    scroll.active = rc == ESP_OK;
+    scroll.first_page = first_page;
+    scroll.last_page = last_page;
+    _lock_release(&panel_lock);
+
+    return rc;
+}
+
+esp_err_t screen_scroll_stop(void)
+{
+    screen_cmd_t cmd;
+    esp_err_t rc;
+
+    ESP_RETURN_ON_FALSE(PANEL_HAS_SCROLL, ESP_ERR_NOT_SUPPORTED, TAG, "screen_scroll_stop: not supported by the panel");
+    ESP_RETURN_ON_FALSE(panel_io != NULL, ESP_ERR_INVALID_STATE, TAG, "screen_scroll_stop: panel not initialized");
+
+    screen_cmd_scroll_stop(&cmd);
+
+    _lock_acquire(&panel_lock);
+    rc = send_commands(&cmd, 1);
+    if (rc == ESP_OK) scroll.active = false;
+    _lock_release(&panel_lock);
+
+    /* The scrolled pages stay shifted in the GDDRAM until the next full redraw */
+    if (rc == ESP_OK) redraw_pending = true;
+
+    return rc;
+}
+
+esp_err_t screen_set_start_line(uint8_t line)
+{
+    screen_cmd_t cmd;
+    esp_err_t rc;
+
+    ESP_RETURN_ON_FALSE(PANEL_HAS_SCROLL, ESP_ERR_NOT_SUPPORTED, TAG, "screen_set_start_line: not supported by the panel");
+    ESP_RETURN_ON_FALSE(panel_io != NULL, ESP_ERR_INVALID_STATE, TAG, "screen_set_start_line: panel not initialized");
+
+    screen_cmd_start_line(&cmd, line);
+
+    _lock_acquire(&panel_lock);
+    rc = send_commands(&cmd, 1);
+    _lock_release(&panel_lock);
+
+    return rc;
+}
+
+static uint32_t example_lvgl_tick_get(void)
+{
+    /* Read the tick from esp_timer instead of a periodic timer, so that the chip is not woken up every few ms */
+    return esp_timer_get_time() / 1000;
 }
 
 static void example_lvgl_port_task(void *arg)
@@ -117,7 +332,14 @@ static void example_lvgl_port_task(void *arg)
     uint32_t time_till_next_ms = 0;
     for(;;) {
         _lock_acquire(&lvgl_api_lock);
+        frame_prof_mark(FRAME_MARK_HANDLER_START);
+        if (redraw_pending) {
+            redraw_pending = false;
+            lv_obj_invalidate(lv_screen_active());
+        }
+        sched_trace_begin(SCHED_SPAN_RENDER);
         time_till_next_ms = lv_timer_handler();
+        sched_trace_end(SCHED_SPAN_RENDER);
         _lock_release(&lvgl_api_lock);
         // in case of triggering a task watch dog time out
         time_till_next_ms = MAX(time_till_next_ms, EXAMPLE_LVGL_TASK_MIN_DELAY_MS);
@@ -172,6 +394,8 @@ void screen_init(i2c_master_bus_handle_t i2c_bus_handle)
 #if CONFIG_EXAMPLE_LCD_CONTROLLER_SH1107
     ESP_ERROR_CHECK(esp_lcd_panel_invert_color(panel_handle, true));
 #endif
+    /* Effects go straight to the IO from now on */
+    panel_io = io_handle;
 
     ESP_LOGI(TAG, "Initialize LVGL");
     lv_init();
@@ -179,39 +403,35 @@ void screen_init(i2c_master_bus_handle_t i2c_bus_handle)
     lv_display_t *display = lv_display_create(EXAMPLE_LCD_H_RES, EXAMPLE_LCD_V_RES);
     // associate the i2c panel handle to the display
     lv_display_set_user_data(display, panel_handle);
-    // create draw buffer
-    void *buf = NULL;
-    ESP_LOGI(TAG, "Allocate separate LVGL draw buffers");
-    // LVGL reserves 2 x 4 bytes in the buffer, as these are assumed to be used as a palette.
-    size_t draw_buffer_sz = EXAMPLE_LCD_H_RES * EXAMPLE_LCD_V_RES / 8 + EXAMPLE_LVGL_PALETTE_SIZE;
-    buf = heap_caps_calloc(1, draw_buffer_sz, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
-    assert(buf);
+    memory_account("screen", "draw buffer", sizeof(lvgl_draw_buffer));
+    memory_account("screen", "oled buffer", sizeof(oled_buffer));
+    frame_prof_init();
 
     // LVGL9 suooprt new monochromatic format.
     lv_display_set_color_format(display, LV_COLOR_FORMAT_I1);
     // initialize LVGL draw buffers
-    lv_display_set_buffers(display, buf, NULL, draw_buffer_sz, LV_DISPLAY_RENDER_MODE_FULL);
+    lv_display_set_buffers(display, lvgl_draw_buffer, NULL, sizeof(lvgl_draw_buffer), LV_DISPLAY_RENDER_MODE_FULL);
     // set the callback which can copy the rendered image to an area of the display
     lv_display_set_flush_cb(display, example_lvgl_flush_cb);
+    // timestamp the refresh stages for the frame profiler
+    lv_display_add_event_cb(display, example_lvgl_refr_event_cb, LV_EVENT_REFR_START, NULL);
+    lv_display_add_event_cb(display, example_lvgl_refr_event_cb, LV_EVENT_REFR_READY, NULL);
 
     ESP_LOGI(TAG, "Register io panel event callback for LVGL flush ready notification");
     const esp_lcd_panel_io_callbacks_t cbs = {
         .on_color_trans_done = example_notify_lvgl_flush_ready,
     };
     /* Register done callback */
-    esp_lcd_panel_io_register_event_callbacks(io_handle, &cbs, display);
+    flush_ctx.disp = display;
+    esp_lcd_panel_io_register_event_callbacks(io_handle, &cbs, &flush_ctx);
 
-    ESP_LOGI(TAG, "Use esp_timer as LVGL tick timer");
-    const esp_timer_create_args_t lvgl_tick_timer_args = {
-        .callback = &example_increase_lvgl_tick,
-        .name = "lvgl_tick"
-    };
-    esp_timer_handle_t lvgl_tick_timer = NULL;
-    ESP_ERROR_CHECK(esp_timer_create(&lvgl_tick_timer_args, &lvgl_tick_timer));
-    ESP_ERROR_CHECK(esp_timer_start_periodic(lvgl_tick_timer, EXAMPLE_LVGL_TICK_PERIOD_MS * 1000));
+    ESP_LOGI(TAG, "Use esp_timer as LVGL tick source");
+    lv_tick_set_cb(example_lvgl_tick_get);
 
     ESP_LOGI(TAG, "Create LVGL task");
-    xTaskCreate(example_lvgl_port_task, "LVGL", EXAMPLE_LVGL_TASK_STACK_SIZE, NULL, EXAMPLE_LVGL_TASK_PRIORITY, NULL);
+    TaskHandle_t lvgl_task = xTaskCreateStatic(example_lvgl_port_task, "LVGL", EXAMPLE_LVGL_TASK_STACK_SIZE, NULL,
+                                               EXAMPLE_LVGL_TASK_PRIORITY, lvgl_task_stack, &lvgl_task_tcb);
+    memory_account_task("screen", lvgl_task, sizeof(lvgl_task_stack) + sizeof(lvgl_task_tcb));
 
     ESP_LOGI(TAG, "Display LVGL Scroll Text");
     // Lock the mutex due to the LVGL APIs are not thread-safe
@@ -1,8 +1,45 @@
 #ifndef SCREEN_H
 #define SCREEN_H
 
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "driver/i2c_master.h"
+
 #include "esp_err.h"
 
+#include "screen_cmd.h"
+
+typedef struct screen_stats {
+    uint32_t frames;            /* Flushes to the panel */
+    uint32_t flush_errors;
+    uint32_t frame_bytes;       /* On the bus, with the addressing commands */
+    uint32_t effects;           /* Panel effect commands sent */
+    uint32_t effect_bytes;
+    uint32_t effect_errors;
+} screen_stats_t;
+
+void screen_get_stats(screen_stats_t *stats);
+
+/*
+ * Panel effects, done by the controller on the GDDRAM it already holds: a
+ * few command bytes each instead of a redrawn frame. They can be called
+ * from any task, including LVGL timers.
+ */
+esp_err_t screen_set_contrast(uint8_t contrast);
+esp_err_t screen_set_inverted(bool inverted);
+
+/*
+ * Scrolls pages first..last horizontally, wrapping around, until stopped.
+ * The flushes leave these pages alone meanwhile, and the whole screen is
+ * redrawn once the scroll stops. SSD1306 only.
+ */
+esp_err_t screen_scroll_start(bool left, uint8_t first_page, uint8_t last_page, screen_scroll_interval_t interval);
+esp_err_t screen_scroll_stop(void);
+
+/* Row of the GDDRAM shown at the top, for vertical transitions. SSD1306 only */
+esp_err_t screen_set_start_line(uint8_t line);
+
 void screen_init(i2c_master_bus_handle_t i2c_bus_handle);
 
 #endif
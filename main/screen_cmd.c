@@ -0,0 +1,63 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "screen_cmd.h"
+
+#define CMD_CONTRAST        0x81
+#define CMD_NORMAL          0xA6
+#define CMD_INVERTED        0xA7
+#define CMD_START_LINE      0x40
+#define CMD_SCROLL_RIGHT    0x26
+#define CMD_SCROLL_LEFT     0x27
+#define CMD_SCROLL_STOP     0x2E
+#define CMD_SCROLL_START    0x2F
+
+#define PAGES               8
+#define LINES               64
+
+void screen_cmd_contrast(screen_cmd_t *cmd, uint8_t contrast)
+{
+    *cmd = (screen_cmd_t) { .cmd = CMD_CONTRAST, .len = 1, .params = { contrast } };
+}
+
+void screen_cmd_invert(screen_cmd_t *cmd, bool inverted)
+{
+    *cmd = (screen_cmd_t) { .cmd = inverted ? CMD_INVERTED : CMD_NORMAL };
+}
+
+void screen_cmd_start_line(screen_cmd_t *cmd, uint8_t line)
+{
+    *cmd = (screen_cmd_t) { .cmd = CMD_START_LINE | (line % LINES) };
+}
+
+size_t screen_cmd_scroll(screen_cmd_t *cmds, bool left, uint8_t first_page, uint8_t last_page,
+                         screen_scroll_interval_t interval)
+{
+    screen_cmd_scroll_stop(&cmds[0]);
+
+    /* Dummy byte, start page, interval, end page, and the two fixed bytes */
+    cmds[1] = (screen_cmd_t) {
+        .cmd = left ? CMD_SCROLL_LEFT : CMD_SCROLL_RIGHT,
+        .len = 6,
+        .params = { 0x00, first_page % PAGES, interval & 7, last_page % PAGES, 0x00, 0xFF },
+    };
+
+    cmds[2] = (screen_cmd_t) { .cmd = CMD_SCROLL_START };
+
+    return SCREEN_CMD_SCROLL_CMDS;
+}
+
+void screen_cmd_scroll_stop(screen_cmd_t *cmd)
+{
+    *cmd = (screen_cmd_t) { .cmd = CMD_SCROLL_STOP };
+}
+
+size_t screen_cmd_bus_bytes(const screen_cmd_t *cmds, size_t count)
+{
+    size_t n = 0;
+
+    for (size_t i = 0; i < count; i++) n += 2 + cmds[i].len;
+
+    return n;
+}
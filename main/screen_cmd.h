@@ -0,0 +1,57 @@
+#ifndef SCREEN_CMD_H
+#define SCREEN_CMD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * SSD1306 command sequences of the panel effects. Each command is the
+ * command byte and its parameters, as esp_lcd_panel_io_tx_param() sends
+ * them; an effect costs a few bytes on the bus where redrawing costs a
+ * 1 KiB frame.
+ */
+
+#define SCREEN_CMD_PARAMS_MAX   6
+#define SCREEN_CMD_SCROLL_CMDS  3
+
+#define SCREEN_CONTRAST_NORMAL  0x7F        /* Reset value */
+#define SCREEN_CONTRAST_DIM     0x01
+
+typedef struct screen_cmd {
+    uint8_t cmd;
+    uint8_t len;
+    uint8_t params[SCREEN_CMD_PARAMS_MAX];
+} screen_cmd_t;
+
+/* Frames between two scroll steps of one column, in the controller's encoding */
+typedef enum screen_scroll_interval {
+    SCREEN_SCROLL_5_FRAMES = 0,
+    SCREEN_SCROLL_64_FRAMES = 1,
+    SCREEN_SCROLL_128_FRAMES = 2,
+    SCREEN_SCROLL_256_FRAMES = 3,
+    SCREEN_SCROLL_3_FRAMES = 4,
+    SCREEN_SCROLL_4_FRAMES = 5,
+    SCREEN_SCROLL_25_FRAMES = 6,
+    SCREEN_SCROLL_2_FRAMES = 7,
+} screen_scroll_interval_t;
+
+void screen_cmd_contrast(screen_cmd_t *cmd, uint8_t contrast);
+void screen_cmd_invert(screen_cmd_t *cmd, bool inverted);
+
+/* Shows the GDDRAM from row `line` (0..63) at the top, wrapping around */
+void screen_cmd_start_line(screen_cmd_t *cmd, uint8_t line);
+
+/*
+ * Continuous horizontal scroll of pages first..last (8 rows each). Fills
+ * SCREEN_CMD_SCROLL_CMDS commands: the data sheet requires stopping any
+ * scroll before setting up another, then the setup and the activation.
+ */
+size_t screen_cmd_scroll(screen_cmd_t *cmds, bool left, uint8_t first_page, uint8_t last_page,
+                         screen_scroll_interval_t interval);
+void screen_cmd_scroll_stop(screen_cmd_t *cmd);
+
+/* Bytes on the bus for the commands, with the control byte of each transaction */
+size_t screen_cmd_bus_bytes(const screen_cmd_t *cmds, size_t count);
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef SCREEN_CONV_H
+#define SCREEN_CONV_H
+
+#include <stdint.h>
+
+/*
+ * Converts the area (x1, y1)-(x2, y2) of an LVGL I1 buffer (rows of pixels,
+ * MSB first, palette already skipped) to the SSD1306 page layout, where each
+ * byte holds 8 vertical pixels. Lit pixels in LVGL are cleared bits on the
+ * panel.
+ */
+void screen_conv_i1_to_pages(const uint8_t *px_map, uint16_t hor_res,
+                             int x1, int y1, int x2, int y2, uint8_t *pages);
+
+#endif
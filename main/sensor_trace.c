@@ -0,0 +1,209 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "esp_timer.h"
+
+#include "memory.h"
+#include "sensor_trace.h"
+
+#define BMP280_REG_CALIB    0x88
+#define BMP280_REG_ADC      0xF7
+
+#define CALIB_COMPLETE      ((1u << 24) - 1)
+#define ADC_COMPLETE        ((1u << 6) - 1)
+
+#if CONFIG_STATION_OVERSAMPLE
+#define BURST_MAX           CONFIG_STATION_OVERSAMPLE_MAX
+#else
+#define BURST_MAX           1
+#endif
+
+#if CONFIG_STATION_SENSOR_TRACE
+
+static uint8_t buf[CONFIG_STATION_SENSOR_TRACE_BUF_SIZE];
+static size_t head = 0;         /* Next byte to write */
+static size_t used = 0;
+static bool recording = false;
+static uint32_t n_records = 0;
+static uint32_t n_dropped = 0;
+static int64_t last_us = 0;     /* Time base of the next record's delta */
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* BMP280 registers as last read; calibration is read once at boot, possibly before the trace starts */
+static uint8_t calib[24];
+static uint32_t calib_mask = 0;
+static uint8_t adc[6];
+static uint32_t adc_mask = 0;
+
+static void put(const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        buf[head] = data[i];
+        head = (head + 1) % sizeof(buf);
+    }
+
+    used += len;
+}
+
+/* Called with the lock held */
+static void append(uint8_t type, const uint8_t *payload)
+{
+    size_t size = sensor_trace_payload_size(type);
+    int64_t now = esp_timer_get_time();
+    uint32_t delta_ms = now > last_us ? (now - last_us) / 1000 : 0;
+    uint32_t v = delta_ms;
+    uint8_t hdr[6];
+    size_t n = 0;
+
+    hdr[n++] = type;
+    do {
+        hdr[n++] = (v & 0x7F) | (v > 0x7F ? 0x80 : 0);
+        v >>= 7;
+    } while (v);
+
+    /* A record is written whole or not at all, so the stream stays decodable */
+    if (used + n + size > sizeof(buf)) {
+        n_dropped++;
+        return;
+    }
+
+    /* Advance by the encoded delta, so that rounding errors do not accumulate */
+    last_us += (int64_t) delta_ms * 1000;
+
+    put(hdr, n);
+    put(payload, size);
+    n_records++;
+}
+
+static void capture_bmp280(uint8_t reg, const uint8_t *read, size_t read_size)
+{
+    bool calib_read = false;
+    bool adc_done = false;
+
+    for (size_t i = 0; i < read_size; i++, reg++) {
+        if (reg >= BMP280_REG_CALIB && reg < BMP280_REG_CALIB + sizeof(calib)) {
+            calib[reg - BMP280_REG_CALIB] = read[i];
+            calib_mask |= 1u << (reg - BMP280_REG_CALIB);
+            calib_read = true;
+        } else if (reg >= BMP280_REG_ADC && reg < BMP280_REG_ADC + sizeof(adc)) {
+            adc[reg - BMP280_REG_ADC] = read[i];
+            adc_mask |= 1u << (reg - BMP280_REG_ADC);
+            /* The temperature XLSB is the last register of a result */
+            adc_done |= reg == BMP280_REG_ADC + sizeof(adc) - 1;
+        }
+    }
+
+    if (recording && calib_read && calib_mask == CALIB_COMPLETE) {
+        append(SENSOR_TRACE_BMP280_CALIB, calib);
+    }
+
+    if (adc_done && adc_mask == ADC_COMPLETE) {
+        if (recording) append(SENSOR_TRACE_BMP280_ADC, adc);
+        adc_mask = 0;
+    }
+}
+
+void sensor_trace_capture(uint16_t addr, const uint8_t *write, size_t write_size,
+                          const uint8_t *read, size_t read_size)
+{
+    portENTER_CRITICAL(&lock);
+
+    if ((addr == SENSOR_TRACE_AHT20_ADDR || addr == SENSOR_TRACE_AHT20_ADDR + 1) && read_size == 7) {
+        if (recording) append(SENSOR_TRACE_AHT20_FRAME, read);
+    } else if ((addr == SENSOR_TRACE_BMP280_ADDR_LO || addr == SENSOR_TRACE_BMP280_ADDR_HI) && write_size == 1) {
+        capture_bmp280(write[0], read, read_size);
+    }
+
+    portEXIT_CRITICAL(&lock);
+}
+
+void sensor_trace_init(void)
+{
+    memory_account("weather", "sensor trace", sizeof(buf));
+}
+
+void sensor_trace_start(void)
+{
+    static const uint8_t header[SENSOR_TRACE_HEADER_SIZE] = {
+        'W', 'T', 'R', 'C', SENSOR_TRACE_VERSION, BURST_MAX, 0, 0,
+    };
+
+    portENTER_CRITICAL(&lock);
+    head = 0;
+    used = 0;
+    n_records = 0;
+    n_dropped = 0;
+    last_us = esp_timer_get_time();
+    put(header, sizeof(header));
+    recording = true;
+
+    /* Replay needs the calibration before the first ADC record */
+    if (calib_mask == CALIB_COMPLETE) append(SENSOR_TRACE_BMP280_CALIB, calib);
+    portEXIT_CRITICAL(&lock);
+}
+
+void sensor_trace_stop(void)
+{
+    portENTER_CRITICAL(&lock);
+    recording = false;
+    portEXIT_CRITICAL(&lock);
+}
+
+size_t sensor_trace_read(uint8_t *out, size_t max)
+{
+    size_t n;
+
+    portENTER_CRITICAL(&lock);
+    n = used < max ? used : max;
+    for (size_t i = 0; i < n; i++) {
+        out[i] = buf[(head + sizeof(buf) - used + i) % sizeof(buf)];
+    }
+    used -= n;
+    portEXIT_CRITICAL(&lock);
+
+    return n;
+}
+
+void sensor_trace_get_status(sensor_trace_status_t *status)
+{
+    portENTER_CRITICAL(&lock);
+    status->recording = recording;
+    status->records = n_records;
+    status->dropped = n_dropped;
+    status->used = used;
+    status->size = sizeof(buf);
+    portEXIT_CRITICAL(&lock);
+}
+
+#else /* !CONFIG_STATION_SENSOR_TRACE */
+
+void sensor_trace_init(void)
+{
+}
+
+void sensor_trace_capture(uint16_t addr, const uint8_t *write, size_t write_size,
+                          const uint8_t *read, size_t read_size)
+{
+}
+
+void sensor_trace_start(void)
+{
+}
+
+void sensor_trace_stop(void)
+{
+}
+
+size_t sensor_trace_read(uint8_t *out, size_t max)
+{
+    return 0;
+}
+
+void sensor_trace_get_status(sensor_trace_status_t *status)
+{
+    memset(status, 0, sizeof(*status));
+}
+
+#endif
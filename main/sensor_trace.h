@@ -0,0 +1,76 @@
+#ifndef SENSOR_TRACE_H
+#define SENSOR_TRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * Raw sensor trace capture (CONFIG_STATION_SENSOR_TRACE).
+ *
+ * The I2C tracer hands every successful read to sensor_trace_capture(),
+ * which keeps the raw AHT20 frames and the BMP280 calibration and ADC
+ * registers, so that a day of weather can be replayed through weather.c on
+ * the host and gives bit-identical results.
+ *
+ * Trace format: an 8-byte header (magic "WTRC", version, the most
+ * conversions weather.c takes per reading, 2 reserved bytes) followed by
+ * records made of a type byte, the time since the previous record in ms as
+ * an unsigned LEB128 and a payload whose size depends on the type.
+ * Several dumps of one capture concatenate into a valid trace.
+ */
+
+#define SENSOR_TRACE_MAGIC          "WTRC"
+#define SENSOR_TRACE_VERSION        1
+#define SENSOR_TRACE_HEADER_SIZE    8
+#define SENSOR_TRACE_HEADER_BURST   5   /* 0 in traces of older firmware */
+
+#define SENSOR_TRACE_AHT20_ADDR     0x38
+#define SENSOR_TRACE_BMP280_ADDR_LO 0x76
+#define SENSOR_TRACE_BMP280_ADDR_HI 0x77
+
+typedef enum sensor_trace_type {
+    SENSOR_TRACE_AHT20_FRAME = 1,   /* Status, 20-bit humidity and temperature, CRC */
+    SENSOR_TRACE_BMP280_CALIB,      /* Registers 0x88..0x9F */
+    SENSOR_TRACE_BMP280_ADC,        /* Registers 0xF7..0xFC, pressure then temperature */
+} sensor_trace_type_t;
+
+/* Payload size of a record type, 0 for an unknown type */
+static inline size_t sensor_trace_payload_size(uint8_t type)
+{
+    switch (type) {
+        case SENSOR_TRACE_AHT20_FRAME: return 7;
+        case SENSOR_TRACE_BMP280_CALIB: return 24;
+        case SENSOR_TRACE_BMP280_ADC: return 6;
+        default: return 0;
+    }
+}
+
+typedef struct sensor_trace_status {
+    bool recording;
+    uint32_t records;
+    uint32_t dropped;       /* Records lost because the buffer was full */
+    size_t used;            /* Bytes waiting to be dumped */
+    size_t size;
+} sensor_trace_status_t;
+
+/*
+ * Called by the I2C tracer after each successful read from `addr`, with
+ * the register address written before it if any.
+ */
+void sensor_trace_capture(uint16_t addr, const uint8_t *write, size_t write_size,
+                          const uint8_t *read, size_t read_size);
+
+/* Accounts the buffer with memory_account(); called once at boot */
+void sensor_trace_init(void);
+
+/* Discards what was not dumped and starts a new trace */
+void sensor_trace_start(void);
+void sensor_trace_stop(void);
+
+/* Moves up to `max` bytes of the trace out of the buffer */
+size_t sensor_trace_read(uint8_t *out, size_t max);
+
+void sensor_trace_get_status(sensor_trace_status_t *status);
+
+#endif
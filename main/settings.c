@@ -0,0 +1,275 @@
+#include <inttypes.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/lock.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "esp_check.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+
+#include "memory.h"
+#include "settings.h"
+#include "tz_rule.h"
+
+#define SETTINGS_NVS_NAMESPACE  "settings"
+#define SETTINGS_SCHEMA_KEY     "schema"
+#define SETTINGS_TIMEZONE_KEY   "timezone"
+/*
+ * 1: sensors_ms, screen_ms, snooze_min, timezone; altitude_m, a new key.
+ * Bump it when a stored value changes meaning and migrate in settings_load().
+ */
+#define SETTINGS_SCHEMA_VERSION 1
+
+static const char *TAG = "settings";
+
+static const setting_desc_t descs[SETTING_COUNT] = {
+    [SETTING_SENSORS_REFRESH_MS] = { "sensors_ms", "ms", 1000, 3600000, SETTING_SENSORS_REFRESH_MS_DEFAULT },
+    [SETTING_SCREEN_REFRESH_MS] = { "screen_ms", "ms", 100, 60000, CONFIG_WEATHER_SCREEN_REFRESH_RATE_MS },
+    [SETTING_SNOOZE_MIN] = { "snooze_min", "min", 1, 60, CONFIG_STATION_ALARM_SNOOZE_MIN },
+    [SETTING_ALTITUDE_M] = { "altitude_m", "m", 0, 5000, CONFIG_STATION_ALTITUDE_M },
+};
+
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t values[SETTING_COUNT];
+static char current_tz[SETTINGS_TIMEZONE_MAX];
+
+/* What the next boot would load: the stored values, or the defaults for missing keys */
+static uint32_t saved[SETTING_COUNT];
+static char saved_tz[SETTINGS_TIMEZONE_MAX];
+static uint8_t saved_schema = 0;
+
+static _lock_t save_lock;
+static esp_timer_handle_t save_timer = NULL;
+static settings_stats_t stats;
+
+static esp_err_t settings_load(void)
+{
+    nvs_handle_t nvs;
+    char tz[SETTINGS_TIMEZONE_MAX];
+    size_t len = sizeof(tz);
+    tz_rule_t rule;
+    uint32_t v;
+    esp_err_t rc;
+
+    rc = nvs_open(SETTINGS_NVS_NAMESPACE, NVS_READONLY, &nvs);
+    /* Nothing saved yet */
+    if (rc == ESP_ERR_NVS_NOT_FOUND) return ESP_OK;
+    ESP_RETURN_ON_ERROR(rc, TAG, "settings_load: opening NVS failed");
+
+    rc = nvs_get_u8(nvs, SETTINGS_SCHEMA_KEY, &saved_schema);
+    if (rc != ESP_OK || saved_schema > SETTINGS_SCHEMA_VERSION) {
+        /* Written by a newer firmware: its values may mean something else */
+        ESP_LOGW(TAG, "Unsupported settings schema %u, using the defaults", saved_schema);
+        nvs_close(nvs);
+        return ESP_ERR_INVALID_VERSION;
+    }
+
+    /* Schema 1 is the first layout, nothing to migrate yet */
+
+    for (unsigned int id = 0; id < SETTING_COUNT; id++) {
+        rc = nvs_get_u32(nvs, descs[id].name, &v);
+        if (rc == ESP_ERR_NVS_NOT_FOUND) continue;
+
+        if (rc != ESP_OK || v < descs[id].min || v > descs[id].max) {
+            ESP_LOGW(TAG, "Ignoring stored %s (%s)", descs[id].name, rc == ESP_OK ? "out of range" : esp_err_to_name(rc));
+            continue;
+        }
+
+        values[id] = saved[id] = v;
+    }
+
+    rc = nvs_get_str(nvs, SETTINGS_TIMEZONE_KEY, tz, &len);
+    if (rc == ESP_OK && tz_rule_parse(tz, &rule)) {
+        strlcpy(current_tz, tz, sizeof(current_tz));
+        strlcpy(saved_tz, tz, sizeof(saved_tz));
+    } else if (rc != ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGW(TAG, "Ignoring stored %s", SETTINGS_TIMEZONE_KEY);
+    }
+
+    nvs_close(nvs);
+
+    return ESP_OK;
+}
+
+/* Writes the keys that differ from flash, in one commit */
+static esp_err_t settings_save(void)
+{
+    uint32_t current[SETTING_COUNT];
+    char tz[SETTINGS_TIMEZONE_MAX];
+    unsigned int dirty = 0;
+    nvs_handle_t nvs;
+    esp_err_t rc = ESP_OK;
+
+    _lock_acquire(&save_lock);
+
+    portENTER_CRITICAL(&lock);
+    memcpy(current, values, sizeof(current));
+    memcpy(tz, current_tz, sizeof(tz));
+    portEXIT_CRITICAL(&lock);
+
+    for (unsigned int id = 0; id < SETTING_COUNT; id++) dirty += current[id] != saved[id];
+    dirty += strcmp(tz, saved_tz) != 0;
+
+    if (dirty == 0) {
+        _lock_release(&save_lock);
+        return ESP_OK;
+    }
+
+    /* NVS allocates its handles */
+    memory_allow_alloc_begin();
+
+    rc = nvs_open(SETTINGS_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (rc == ESP_OK) {
+        if (saved_schema != SETTINGS_SCHEMA_VERSION) rc = nvs_set_u8(nvs, SETTINGS_SCHEMA_KEY, SETTINGS_SCHEMA_VERSION);
+
+        for (unsigned int id = 0; rc == ESP_OK && id < SETTING_COUNT; id++) {
+            if (current[id] != saved[id]) rc = nvs_set_u32(nvs, descs[id].name, current[id]);
+        }
+
+        if (rc == ESP_OK && strcmp(tz, saved_tz) != 0) rc = nvs_set_str(nvs, SETTINGS_TIMEZONE_KEY, tz);
+        if (rc == ESP_OK) rc = nvs_commit(nvs);
+
+        nvs_close(nvs);
+    }
+
+    memory_allow_alloc_end();
+
+    if (rc == ESP_OK) {
+        memcpy(saved, current, sizeof(saved));
+        memcpy(saved_tz, tz, sizeof(saved_tz));
+        saved_schema = SETTINGS_SCHEMA_VERSION;
+    }
+
+    portENTER_CRITICAL(&lock);
+    if (rc == ESP_OK) {
+        stats.saves++;
+        stats.keys_written += dirty;
+    } else {
+        stats.errors++;
+    }
+    portEXIT_CRITICAL(&lock);
+
+    _lock_release(&save_lock);
+
+    ESP_RETURN_ON_ERROR(rc, TAG, "settings_save: writing NVS failed");
+    ESP_LOGI(TAG, "Saved %u settings", dirty);
+
+    return ESP_OK;
+}
+
+static void save_timer_cb(void *arg)
+{
+    settings_save();
+}
+
+/* Restarts the delay, so that only the last of a burst of changes saves */
+static void schedule_save(void)
+{
+    esp_timer_stop(save_timer);
+    esp_timer_start_once(save_timer, (uint64_t) CONFIG_STATION_SETTINGS_SAVE_DELAY_MS * 1000);
+}
+
+uint32_t settings_get(setting_id_t id)
+{
+    if (id >= SETTING_COUNT) return 0;
+
+    return values[id];
+}
+
+esp_err_t settings_set(setting_id_t id, uint32_t value)
+{
+    ESP_RETURN_ON_FALSE(id < SETTING_COUNT, ESP_ERR_INVALID_ARG, TAG, "settings_set: unknown setting %d", id);
+    ESP_RETURN_ON_FALSE(value >= descs[id].min && value <= descs[id].max, ESP_ERR_INVALID_ARG, TAG,
+                        "settings_set: %s must be within %" PRIu32 "..%" PRIu32, descs[id].name, descs[id].min,
+                        descs[id].max);
+
+    portENTER_CRITICAL(&lock);
+    values[id] = value;
+    stats.sets++;
+    portEXIT_CRITICAL(&lock);
+
+    schedule_save();
+
+    return ESP_OK;
+}
+
+const setting_desc_t *settings_desc(setting_id_t id)
+{
+    return id < SETTING_COUNT ? &descs[id] : NULL;
+}
+
+setting_id_t settings_find(const char *name)
+{
+    unsigned int id;
+
+    for (id = 0; id < SETTING_COUNT; id++) {
+        if (strcmp(descs[id].name, name) == 0) break;
+    }
+
+    return id;
+}
+
+void settings_get_timezone(char *buf, size_t len)
+{
+    portENTER_CRITICAL(&lock);
+    strlcpy(buf, current_tz, len);
+    portEXIT_CRITICAL(&lock);
+}
+
+esp_err_t settings_set_timezone(const char *tz)
+{
+    tz_rule_t rule;
+
+    ESP_RETURN_ON_FALSE(tz != NULL && strlen(tz) < SETTINGS_TIMEZONE_MAX && tz_rule_parse(tz, &rule), ESP_ERR_INVALID_ARG,
+                        TAG, "settings_set_timezone: invalid POSIX TZ rule");
+
+    portENTER_CRITICAL(&lock);
+    strlcpy(current_tz, tz, sizeof(current_tz));
+    stats.sets++;
+    portEXIT_CRITICAL(&lock);
+
+    schedule_save();
+
+    return ESP_OK;
+}
+
+esp_err_t settings_flush(void)
+{
+    esp_timer_stop(save_timer);
+
+    return settings_save();
+}
+
+void settings_get_stats(settings_stats_t *out)
+{
+    portENTER_CRITICAL(&lock);
+    *out = stats;
+    portEXIT_CRITICAL(&lock);
+}
+
+esp_err_t settings_init(void)
+{
+    const esp_timer_create_args_t timer_args = {
+        .callback = &save_timer_cb,
+        .name = "settings_save",
+    };
+    esp_err_t rc;
+
+    for (unsigned int id = 0; id < SETTING_COUNT; id++) {
+        values[id] = saved[id] = descs[id].def;
+    }
+    strlcpy(current_tz, CONFIG_STATION_TIMEZONE, sizeof(current_tz));
+    strlcpy(saved_tz, CONFIG_STATION_TIMEZONE, sizeof(saved_tz));
+
+    /* A bad store is not fatal, the defaults apply */
+    rc = settings_load();
+    if (rc != ESP_OK) ESP_LOGW(TAG, "Loading the settings failed (%s)", esp_err_to_name(rc));
+
+    ESP_RETURN_ON_ERROR(esp_timer_create(&timer_args, &save_timer), TAG, "settings_init: esp_timer_create failed");
+
+    return ESP_OK;
+}
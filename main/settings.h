@@ -0,0 +1,73 @@
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+
+/*
+ * Runtime settings, persisted in NVS.
+ *
+ * The values live in RAM: reads never touch flash and are cheap enough for
+ * hot paths. A change is written behind, CONFIG_STATION_SETTINGS_SAVE_DELAY_MS
+ * after the last one, and only the keys whose value differs from flash are
+ * written, so a burst of adjustments costs a single commit. Anything set
+ * within the delay before a reset is lost.
+ *
+ * Each setting is its own NVS key, so settings can be added without touching
+ * the stored ones; the "schema" key records the layout for the migrations in
+ * settings.c. The Kconfig values are the factory defaults.
+ */
+
+#define SETTINGS_TIMEZONE_MAX 48
+
+/* The others default to their Kconfig value */
+#define SETTING_SENSORS_REFRESH_MS_DEFAULT 10000
+
+typedef enum setting_id {
+    SETTING_SENSORS_REFRESH_MS,
+    SETTING_SCREEN_REFRESH_MS,
+    SETTING_SNOOZE_MIN,
+    SETTING_ALTITUDE_M,
+    SETTING_COUNT,
+} setting_id_t;
+
+typedef struct setting_desc {
+    const char *name;       /* NVS key and console name */
+    const char *unit;
+    uint32_t min;
+    uint32_t max;
+    uint32_t def;
+} setting_desc_t;
+
+typedef struct settings_stats {
+    uint32_t sets;          /* Accepted changes */
+    uint32_t saves;         /* Debounced saves that wrote to flash */
+    uint32_t keys_written;
+    uint32_t errors;
+} settings_stats_t;
+
+/* Loads the settings from NVS; must run after nvs_flash_init() and before their users */
+esp_err_t settings_init(void);
+
+uint32_t settings_get(setting_id_t id);
+
+/* ESP_ERR_INVALID_ARG if the value is out of the setting's range */
+esp_err_t settings_set(setting_id_t id, uint32_t value);
+
+const setting_desc_t *settings_desc(setting_id_t id);
+
+/* Returns SETTING_COUNT for an unknown name */
+setting_id_t settings_find(const char *name);
+
+/* The POSIX TZ rule; takes effect at the next boot */
+void settings_get_timezone(char *buf, size_t len);
+esp_err_t settings_set_timezone(const char *tz);
+
+/* Writes pending changes now instead of after the delay */
+esp_err_t settings_flush(void);
+
+void settings_get_stats(settings_stats_t *stats);
+
+#endif
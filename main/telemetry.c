@@ -0,0 +1,136 @@
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "esp_check.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "telemetry.h"
+
+#if CONFIG_STATION_TELEMETRY
+
+#include "driver/usb_serial_jtag.h"
+
+#include "esp_heap_caps.h"
+
+#include "telemetry_frame.h"
+
+#define TELEMETRY_TX_BUFFER_SIZE 1024
+
+static const char *TAG = "telemetry";
+
+static uint16_t seq = 0;
+static uint32_t frames_sent = 0;
+static uint32_t frames_dropped = 0;
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void send(telemetry_type_t type, const uint8_t *payload, size_t len)
+{
+    uint8_t frame[TELEMETRY_FRAME_MAX];
+    telemetry_header_t hdr = {
+        .type = type,
+        .time_ms = esp_timer_get_time() / 1000,
+    };
+    size_t n;
+    bool sent;
+
+    portENTER_CRITICAL(&lock);
+    hdr.seq = seq++;
+    portEXIT_CRITICAL(&lock);
+
+    n = telemetry_frame_encode(&hdr, payload, len, frame);
+
+    /* Never wait: without a host reading, the TX ring fills up and frames are dropped whole */
+    sent = usb_serial_jtag_is_connected() && usb_serial_jtag_write_bytes(frame, n, 0) == n;
+
+    portENTER_CRITICAL(&lock);
+    if (sent) {
+        frames_sent++;
+    } else {
+        frames_dropped++;
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+void telemetry_sample(weather_sensor_t sensor, esp_err_t rc, float temperature, float humidity, float pressure,
+                      uint32_t read_us)
+{
+    uint8_t payload[TELEMETRY_SAMPLE_SIZE];
+    telemetry_sample_t sample = {
+        .sensor = sensor,
+        .flags = rc == ESP_OK ? TELEMETRY_SAMPLE_OK : 0,
+        .temperature = temperature,
+        .humidity = humidity,
+        .pressure = pressure,
+        .read_us = read_us,
+    };
+
+    send(TELEMETRY_SAMPLE, payload, telemetry_sample_pack(&sample, payload));
+}
+
+static void telemetry_timer_cb(void *arg)
+{
+    uint8_t payload[TELEMETRY_PAYLOAD_MAX];
+    telemetry_health_t health = {
+        .uptime_s = esp_timer_get_time() / 1000000,
+        .heap_free = heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
+        .heap_min_free = heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL),
+    };
+    telemetry_metrics_t metrics;
+
+    portENTER_CRITICAL(&lock);
+    health.frames_sent = frames_sent;
+    health.frames_dropped = frames_dropped;
+    portEXIT_CRITICAL(&lock);
+
+    send(TELEMETRY_HEALTH, payload, telemetry_health_pack(&health, payload));
+
+    for (int i = 0; i < WEATHER_SENSOR_MAX; i++) {
+        weather_sensor_stats_t stats;
+
+        weather_get_stats(i, &stats);
+        metrics.sensor[i].reads = stats.reads;
+        metrics.sensor[i].errors = stats.errors;
+        metrics.sensor[i].last_us = stats.last_us;
+        metrics.sensor[i].max_us = stats.max_us;
+    }
+
+    send(TELEMETRY_METRICS, payload, telemetry_metrics_pack(&metrics, payload));
+}
+
+esp_err_t telemetry_init(void)
+{
+    if (!usb_serial_jtag_is_driver_installed()) {
+        usb_serial_jtag_driver_config_t config = USB_SERIAL_JTAG_DRIVER_CONFIG_DEFAULT();
+
+        config.tx_buffer_size = TELEMETRY_TX_BUFFER_SIZE;
+        ESP_RETURN_ON_ERROR(usb_serial_jtag_driver_install(&config), TAG, "telemetry_init: installing the USB-Serial-JTAG driver failed");
+    }
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = &telemetry_timer_cb,
+        .name = "telemetry",
+        .skip_unhandled_events = true,
+    };
+    esp_timer_handle_t timer = NULL;
+
+    ESP_RETURN_ON_ERROR(esp_timer_create(&timer_args, &timer), TAG, "telemetry_init: esp_timer_create failed");
+
+    return esp_timer_start_periodic(timer, (uint64_t) CONFIG_STATION_TELEMETRY_INTERVAL_S * 1000000);
+}
+
+#else /* !CONFIG_STATION_TELEMETRY */
+
+esp_err_t telemetry_init(void)
+{
+    return ESP_OK;
+}
+
+void telemetry_sample(weather_sensor_t sensor, esp_err_t rc, float temperature, float humidity, float pressure,
+                      uint32_t read_us)
+{
+}
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#include "weather.h"
+
+/*
+ * Binary telemetry over USB-Serial-JTAG (CONFIG_STATION_TELEMETRY).
+ *
+ * Every sensor read goes out as a TELEMETRY_SAMPLE frame straight from the
+ * acquisition path, without any formatting, and health and metrics frames
+ * follow every CONFIG_STATION_TELEMETRY_INTERVAL_S. Frames never wait for
+ * the host: while it is not connected or not reading, they are dropped and
+ * counted. See telemetry_frame.h for the format and host/telemetry for the
+ * decoder.
+ */
+
+/* Installs the USB-Serial-JTAG driver unless the console already did */
+esp_err_t telemetry_init(void);
+
+/* Called by weather.c after each read; values a sensor does not measure are NaN */
+void telemetry_sample(weather_sensor_t sensor, esp_err_t rc, float temperature, float humidity, float pressure,
+                      uint32_t read_us);
+
+#endif
@@ -0,0 +1,244 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "telemetry_frame.h"
+
+static void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static void put_u64(uint8_t *p, uint64_t v)
+{
+    put_u32(p, v);
+    put_u32(p + 4, v >> 32);
+}
+
+static void put_f32(uint8_t *p, float f)
+{
+    uint32_t v;
+
+    memcpy(&v, &f, sizeof(v));
+    put_u32(p, v);
+}
+
+static uint16_t get_u16(const uint8_t *p)
+{
+    return p[0] | p[1] << 8;
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+static uint64_t get_u64(const uint8_t *p)
+{
+    return get_u32(p) | (uint64_t) get_u32(p + 4) << 32;
+}
+
+static float get_f32(const uint8_t *p)
+{
+    uint32_t v = get_u32(p);
+    float f;
+
+    memcpy(&f, &v, sizeof(f));
+    return f;
+}
+
+uint16_t telemetry_crc16(const uint8_t *data, size_t len)
+{
+    uint16_t crc = 0xFFFF;
+
+    /* Polynomial 0x1021 a byte at a time, without a table */
+    for (size_t i = 0; i < len; i++) {
+        uint8_t x = crc >> 8 ^ data[i];
+
+        x ^= x >> 4;
+        crc = crc << 8 ^ (uint16_t) x << 12 ^ (uint16_t) x << 5 ^ x;
+    }
+
+    return crc;
+}
+
+size_t telemetry_cobs_encode(const uint8_t *in, size_t len, uint8_t *out)
+{
+    size_t code_pos = 0;
+    size_t n = 1;
+    uint8_t code = 1;
+
+    for (size_t i = 0; i < len; i++) {
+        if (in[i] != 0) {
+            out[n++] = in[i];
+            code++;
+        }
+
+        /* A zero, or a run of 254 non-zero bytes, closes the block */
+        if (in[i] == 0 || code == 0xFF) {
+            out[code_pos] = code;
+            code_pos = n++;
+            code = 1;
+        }
+    }
+
+    out[code_pos] = code;
+
+    return n;
+}
+
+size_t telemetry_cobs_decode(const uint8_t *in, size_t len, uint8_t *out, size_t max)
+{
+    size_t n = 0;
+    size_t i = 0;
+
+    while (i < len) {
+        uint8_t code = in[i++];
+
+        if (code == 0 || i + code - 1 > len) return 0;
+
+        for (uint8_t j = 1; j < code; j++) {
+            if (in[i] == 0 || n == max) return 0;
+            out[n++] = in[i++];
+        }
+
+        /* Blocks shorter than 254 bytes stand for a zero, except the last one */
+        if (code != 0xFF && i < len) {
+            if (n == max) return 0;
+            out[n++] = 0;
+        }
+    }
+
+    return n;
+}
+
+size_t telemetry_sample_pack(const telemetry_sample_t *sample, uint8_t *out)
+{
+    out[0] = sample->sensor;
+    out[1] = sample->flags;
+    put_f32(out + 2, sample->temperature);
+    put_f32(out + 6, sample->humidity);
+    put_f32(out + 10, sample->pressure);
+    put_u32(out + 14, sample->read_us);
+
+    return TELEMETRY_SAMPLE_SIZE;
+}
+
+bool telemetry_sample_unpack(const uint8_t *payload, size_t len, telemetry_sample_t *sample)
+{
+    if (len < TELEMETRY_SAMPLE_SIZE) return false;
+
+    sample->sensor = payload[0];
+    sample->flags = payload[1];
+    sample->temperature = get_f32(payload + 2);
+    sample->humidity = get_f32(payload + 6);
+    sample->pressure = get_f32(payload + 10);
+    sample->read_us = get_u32(payload + 14);
+
+    return true;
+}
+
+size_t telemetry_health_pack(const telemetry_health_t *health, uint8_t *out)
+{
+    put_u32(out, health->uptime_s);
+    put_u32(out + 4, health->heap_free);
+    put_u32(out + 8, health->heap_min_free);
+    put_u32(out + 12, health->frames_sent);
+    put_u32(out + 16, health->frames_dropped);
+
+    return TELEMETRY_HEALTH_SIZE;
+}
+
+bool telemetry_health_unpack(const uint8_t *payload, size_t len, telemetry_health_t *health)
+{
+    if (len < TELEMETRY_HEALTH_SIZE) return false;
+
+    health->uptime_s = get_u32(payload);
+    health->heap_free = get_u32(payload + 4);
+    health->heap_min_free = get_u32(payload + 8);
+    health->frames_sent = get_u32(payload + 12);
+    health->frames_dropped = get_u32(payload + 16);
+
+    return true;
+}
+
+size_t telemetry_metrics_pack(const telemetry_metrics_t *metrics, uint8_t *out)
+{
+    for (int i = 0; i < TELEMETRY_METRICS_SENSORS; i++, out += 16) {
+        put_u32(out, metrics->sensor[i].reads);
+        put_u32(out + 4, metrics->sensor[i].errors);
+        put_u32(out + 8, metrics->sensor[i].last_us);
+        put_u32(out + 12, metrics->sensor[i].max_us);
+    }
+
+    return TELEMETRY_METRICS_SIZE;
+}
+
+bool telemetry_metrics_unpack(const uint8_t *payload, size_t len, telemetry_metrics_t *metrics)
+{
+    if (len < TELEMETRY_METRICS_SIZE) return false;
+
+    for (int i = 0; i < TELEMETRY_METRICS_SENSORS; i++, payload += 16) {
+        metrics->sensor[i].reads = get_u32(payload);
+        metrics->sensor[i].errors = get_u32(payload + 4);
+        metrics->sensor[i].last_us = get_u32(payload + 8);
+        metrics->sensor[i].max_us = get_u32(payload + 12);
+    }
+
+    return true;
+}
+
+size_t telemetry_frame_encode(const telemetry_header_t *hdr, const uint8_t *payload, size_t len, uint8_t *out)
+{
+    uint8_t raw[TELEMETRY_RAW_MAX];
+    size_t n = TELEMETRY_HEADER_SIZE + len;
+
+    if (len > TELEMETRY_PAYLOAD_MAX) return 0;
+
+    raw[0] = TELEMETRY_VERSION;
+    raw[1] = hdr->type;
+    put_u16(raw + 2, hdr->seq);
+    put_u64(raw + 4, hdr->time_ms);
+    memcpy(raw + TELEMETRY_HEADER_SIZE, payload, len);
+    put_u16(raw + n, telemetry_crc16(raw, n));
+    n += TELEMETRY_CRC_SIZE;
+
+    /* The leading delimiter ends whatever was sent before */
+    out[0] = 0;
+    n = 1 + telemetry_cobs_encode(raw, n, out + 1);
+    out[n++] = 0;
+
+    return n;
+}
+
+bool telemetry_frame_decode(const uint8_t *in, size_t len, telemetry_header_t *hdr,
+                            uint8_t *payload, size_t *payload_len)
+{
+    uint8_t raw[TELEMETRY_RAW_MAX];
+    size_t n = telemetry_cobs_decode(in, len, raw, sizeof(raw));
+
+    if (n < TELEMETRY_HEADER_SIZE + TELEMETRY_CRC_SIZE) return false;
+
+    n -= TELEMETRY_CRC_SIZE;
+    if (telemetry_crc16(raw, n) != get_u16(raw + n)) return false;
+    if (raw[0] != TELEMETRY_VERSION) return false;
+
+    hdr->version = raw[0];
+    hdr->type = raw[1];
+    hdr->seq = get_u16(raw + 2);
+    hdr->time_ms = get_u64(raw + 4);
+    *payload_len = n - TELEMETRY_HEADER_SIZE;
+    memcpy(payload, raw + TELEMETRY_HEADER_SIZE, *payload_len);
+
+    return true;
+}
@@ -0,0 +1,114 @@
+#ifndef TELEMETRY_FRAME_H
+#define TELEMETRY_FRAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * Binary telemetry framing, shared by the firmware and the host decoder.
+ *
+ * A message is a 12-byte header (version, type, sequence number, time since
+ * boot in ms as 64 bits, which do not wrap), a payload of little-endian fields and a CRC-16/CCITT-FALSE
+ * over both. It goes on the wire COBS-encoded between two 0x00 delimiters,
+ * so a decoder resynchronizes on the next delimiter after any garbage, e.g.
+ * console text sharing the port. A gap in the sequence numbers counts the
+ * frames dropped in between.
+ *
+ * New fields are only ever appended to a payload within a version: decoders
+ * accept payloads longer than they know and skip unknown types.
+ */
+
+#define TELEMETRY_VERSION       2       /* 1 had a 32-bit time, which wrapped after 49.7 days */
+#define TELEMETRY_HEADER_SIZE   12
+#define TELEMETRY_CRC_SIZE      2
+#define TELEMETRY_PAYLOAD_MAX   64
+#define TELEMETRY_RAW_MAX       (TELEMETRY_HEADER_SIZE + TELEMETRY_PAYLOAD_MAX + TELEMETRY_CRC_SIZE)
+/* COBS adds a byte per 254 and one more, plus both delimiters */
+#define TELEMETRY_FRAME_MAX     (TELEMETRY_RAW_MAX + TELEMETRY_RAW_MAX / 254 + 1 + 2)
+
+typedef enum telemetry_type {
+    TELEMETRY_SAMPLE = 1,   /* One sensor read */
+    TELEMETRY_HEALTH,       /* Uptime, heap and the telemetry's own counters */
+    TELEMETRY_METRICS,      /* Sensor read counters and latencies */
+} telemetry_type_t;
+
+typedef struct telemetry_header {
+    uint8_t version;
+    uint8_t type;
+    uint16_t seq;
+    uint64_t time_ms;
+} telemetry_header_t;
+
+#define TELEMETRY_SAMPLE_OK     0x01    /* The read succeeded, the values are valid */
+
+/* Fields a sensor does not measure are NaN */
+typedef struct telemetry_sample {
+    uint8_t sensor;         /* weather_sensor_t */
+    uint8_t flags;
+    float temperature;      /* °C */
+    float humidity;         /* % */
+    float pressure;         /* hPa */
+    uint32_t read_us;
+} telemetry_sample_t;
+
+typedef struct telemetry_health {
+    uint32_t uptime_s;
+    uint32_t heap_free;
+    uint32_t heap_min_free;
+    uint32_t frames_sent;
+    uint32_t frames_dropped; /* Host not connected or not reading */
+} telemetry_health_t;
+
+#define TELEMETRY_METRICS_SENSORS 2
+
+typedef struct telemetry_metrics {
+    struct {
+        uint32_t reads;
+        uint32_t errors;
+        uint32_t last_us;
+        uint32_t max_us;
+    } sensor[TELEMETRY_METRICS_SENSORS];
+} telemetry_metrics_t;
+
+#define TELEMETRY_SAMPLE_SIZE   18
+#define TELEMETRY_HEALTH_SIZE   20
+#define TELEMETRY_METRICS_SIZE  (16 * TELEMETRY_METRICS_SENSORS)
+
+uint16_t telemetry_crc16(const uint8_t *data, size_t len);
+
+/* `out` holds at least len + len / 254 + 1 bytes. Returns the encoded size. */
+size_t telemetry_cobs_encode(const uint8_t *in, size_t len, uint8_t *out);
+
+/*
+ * Decodes the bytes between two delimiters into `out`, which holds `max`
+ * bytes. Returns the decoded size, or 0 if the input is not valid COBS.
+ */
+size_t telemetry_cobs_decode(const uint8_t *in, size_t len, uint8_t *out, size_t max);
+
+/* Serialize a payload, returning its size */
+size_t telemetry_sample_pack(const telemetry_sample_t *sample, uint8_t *out);
+size_t telemetry_health_pack(const telemetry_health_t *health, uint8_t *out);
+size_t telemetry_metrics_pack(const telemetry_metrics_t *metrics, uint8_t *out);
+
+/* Deserialize a payload; false if it is shorter than the version's fields */
+bool telemetry_sample_unpack(const uint8_t *payload, size_t len, telemetry_sample_t *sample);
+bool telemetry_health_unpack(const uint8_t *payload, size_t len, telemetry_health_t *health);
+bool telemetry_metrics_unpack(const uint8_t *payload, size_t len, telemetry_metrics_t *metrics);
+
+/*
+ * Builds a complete frame, delimiters included, into `out` of at least
+ * TELEMETRY_FRAME_MAX bytes. The version of `hdr` is ignored. Returns the
+ * frame size, or 0 if the payload is too large.
+ */
+size_t telemetry_frame_encode(const telemetry_header_t *hdr, const uint8_t *payload, size_t len, uint8_t *out);
+
+/*
+ * Checks and splits the COBS bytes between two delimiters. `payload` holds
+ * TELEMETRY_PAYLOAD_MAX bytes. Returns false on a COBS, size, CRC or version
+ * error.
+ */
+bool telemetry_frame_decode(const uint8_t *in, size_t len, telemetry_header_t *hdr,
+                            uint8_t *payload, size_t *payload_len);
+
+#endif
@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <sys/time.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "esp_check.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "tz_rule.h"
+#include "timekeeping.h"
+
+#define SECS_PER_DAY 86400
+#define US_PER_SEC   1000000LL
+
+static const char *TAG = "TIMEKEEPING";
+
+static tz_rule_t tz_rule;
+
+static portMUX_TYPE cache_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* Calendar of the current local day, tm_hour/tm_min/tm_sec are not used */
+static struct tm cached_day;
+/* Monotonic instant of the current local midnight */
+static int64_t day_start_us;
+/* Monotonic instant of the next midnight or DST transition, whichever first */
+static int64_t valid_until_us;
+static int64_t next_transition;
+static bool cache_valid = false;
+
+static void recompute_calendar(void)
+{
+    struct timeval tv;
+    struct tm day = { 0 };
+    int64_t now_us, local, days, sod, change, next_midnight_us, transition_us;
+    int32_t offset, year;
+    uint32_t month, mday;
+    bool is_dst;
+
+    gettimeofday(&tv, NULL);
+    now_us = esp_timer_get_time();
+
+    offset = tz_rule_utc_offset(&tz_rule, tv.tv_sec, &change, &is_dst);
+
+    local = (int64_t) tv.tv_sec + offset;
+    days = local / SECS_PER_DAY - (local % SECS_PER_DAY < 0);
+    sod = local - days * SECS_PER_DAY;
+
+    tz_civil_from_days((int32_t) days, &year, &month, &mday);
+
+    day.tm_year = year - 1900;
+    day.tm_mon = month - 1;
+    day.tm_mday = mday;
+    day.tm_wday = ((days + 4) % 7 + 7) % 7;
+    day.tm_yday = (int) (days - tz_days_from_civil(year, 1, 1));
+    day.tm_isdst = is_dst;
+
+    next_midnight_us = now_us + (SECS_PER_DAY - sod) * US_PER_SEC - tv.tv_usec;
+    transition_us = change == INT64_MAX ? INT64_MAX : now_us + (change - tv.tv_sec) * US_PER_SEC - tv.tv_usec;
+
+    portENTER_CRITICAL(&cache_lock);
+    cached_day = day;
+    day_start_us = now_us - sod * US_PER_SEC - tv.tv_usec;
+    valid_until_us = MIN(next_midnight_us, transition_us);
+    next_transition = change == INT64_MAX ? 0 : change;
+    cache_valid = true;
+    portEXIT_CRITICAL(&cache_lock);
+}
+
+void timekeeping_localtime(struct tm *timeinfo)
+{
+    int64_t now_us, sod;
+
+    for (;;) {
+        now_us = esp_timer_get_time();
+
+        portENTER_CRITICAL(&cache_lock);
+        if (cache_valid && now_us < valid_until_us) {
+            *timeinfo = cached_day;
+            sod = (now_us - day_start_us) / US_PER_SEC;
+            portEXIT_CRITICAL(&cache_lock);
+            break;
+        }
+        portEXIT_CRITICAL(&cache_lock);
+
+        recompute_calendar();
+    }
+
+    timeinfo->tm_hour = sod / 3600;
+    timeinfo->tm_min = (sod / 60) % 60;
+    timeinfo->tm_sec = sod % 60;
+}
+
+time_t timekeeping_next_transition(void)
+{
+    struct tm timeinfo;
+
+    /* Makes sure the cache is up to date */
+    timekeeping_localtime(&timeinfo);
+
+    return (time_t) next_transition;
+}
+
+void timekeeping_invalidate(void)
+{
+    portENTER_CRITICAL(&cache_lock);
+    cache_valid = false;
+    portEXIT_CRITICAL(&cache_lock);
+}
+
+const tz_rule_t *timekeeping_get_rule(void)
+{
+    return &tz_rule;
+}
+
+esp_err_t timekeeping_init(const char *posix_tz)
+{
+    ESP_RETURN_ON_FALSE(posix_tz != NULL, ESP_ERR_INVALID_ARG, TAG, "timekeeping_init: Pointer argument is NULL");
+
+    if (!tz_rule_parse(posix_tz, &tz_rule)) {
+        ESP_LOGE(TAG, "Invalid POSIX TZ rule \"%s\", falling back to UTC", posix_tz);
+        tz_rule_parse("UTC0", &tz_rule);
+        posix_tz = "UTC0";
+    }
+
+    setenv("TZ", posix_tz, 1);
+    tzset();
+
+    timekeeping_invalidate();
+
+    ESP_LOGI(TAG, "Time zone %s/%s (UTC%+ld s)", tz_rule.std_name,
+             tz_rule.has_dst ? tz_rule.dst_name : "-", (long) tz_rule.std_offset);
+
+    return ESP_OK;
+}
@@ -0,0 +1,47 @@
+#ifndef TIMEKEEPING_H
+#define TIMEKEEPING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "esp_err.h"
+
+#include "tz_rule.h"
+
+/*
+ * Local time derived from the monotonic clock.
+ *
+ * The POSIX TZ rule is compiled once at init. A full calendar computation
+ * only happens at local midnight, on a DST transition or after the wall
+ * clock was set; in between, the time of day is the elapsed esp_timer time
+ * since the cached local midnight.
+ */
+
+/*
+ * Fills `timeinfo` with the current local time. tm_yday, tm_wday and
+ * tm_isdst are valid as well.
+ */
+void timekeeping_localtime(struct tm *timeinfo);
+
+/*
+ * Returns the next UTC instant at which the UTC offset changes, or 0 if the
+ * time zone has no DST.
+ */
+time_t timekeeping_next_transition(void);
+
+/*
+ * Drops the cached calendar. Must be called after settimeofday().
+ */
+void timekeeping_invalidate(void);
+
+/* The compiled rule, UTC until timekeeping_init() */
+const tz_rule_t *timekeeping_get_rule(void);
+
+/*
+ * Compiles the POSIX TZ rule and exports it as the TZ environment variable
+ * so that libc (mktime(), localtime_r()) agrees with it.
+ */
+esp_err_t timekeeping_init(const char *posix_tz);
+
+#endif
@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_err.h"
+#include "esp_timer.h"
+
+#include "memory.h"
+#include "tlog.h"
+
+#if CONFIG_STATION_TLOG
+
+#define TLOG_TASK_STACK_SIZE    (2 * 1024)
+#define TLOG_RECORD_MAX         (TLOG_HEADER_WORDS + TLOG_ARGS_MAX)
+#define RING_WORDS              (CONFIG_STATION_TLOG_BUF_SIZE / 4)
+
+static uint32_t ring[RING_WORDS];
+static size_t head = 0;         /* Next word to reserve */
+static size_t tail = 0;         /* Next word to drain */
+static size_t used = 0;
+static uint32_t n_records = 0;
+static uint32_t n_dropped = 0;
+static uint32_t n_drained_bytes = 0;
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+static StackType_t tlog_stack[TLOG_TASK_STACK_SIZE];
+static StaticTask_t tlog_tcb;
+
+static inline size_t next(size_t i)
+{
+    return i + 1 == RING_WORDS ? 0 : i + 1;
+}
+
+/*
+ * Only the reservation is in a critical section, a few instructions long:
+ * the C3 has no atomic instructions to make it lock-free. The record is
+ * copied afterwards and published by its token, which is never 0 and goes
+ * in last; the drain zeroes the words it consumed.
+ */
+void tlog_write(esp_log_level_t level, const char *format, const char *tag, const uint32_t *args, unsigned int n)
+{
+    uint32_t header[TLOG_HEADER_WORDS - 1];
+    size_t len, start, i;
+
+    if (n > TLOG_ARGS_MAX) n = TLOG_ARGS_MAX;
+
+    header[0] = level | n << 4;
+    header[1] = (uint32_t) esp_timer_get_time();
+    header[2] = tlog_pointer(tag);
+    len = TLOG_HEADER_WORDS + n;
+
+    portENTER_CRITICAL_SAFE(&lock);
+    if (used + len > RING_WORDS) {
+        n_dropped++;
+        portEXIT_CRITICAL_SAFE(&lock);
+        return;
+    }
+    start = head;
+    head += len;
+    if (head >= RING_WORDS) head -= RING_WORDS;
+    used += len;
+    n_records++;
+    portEXIT_CRITICAL_SAFE(&lock);
+
+    i = next(start);
+    for (size_t k = 0; k < TLOG_HEADER_WORDS - 1; k++, i = next(i)) ring[i] = header[k];
+    for (size_t k = 0; k < n; k++, i = next(i)) ring[i] = args[k];
+
+    __atomic_store_n(&ring[start], tlog_pointer(format), __ATOMIC_RELEASE);
+}
+
+/* An "L:" line with the record's bytes in memory order */
+static void emit(const uint32_t *words, size_t len)
+{
+    static const char hex[] = "0123456789abcdef";
+    char line[2 + TLOG_RECORD_MAX * 8 + 1];
+    size_t n = 0;
+
+    line[n++] = 'L';
+    line[n++] = ':';
+    for (size_t i = 0; i < len; i++) {
+        for (int b = 0; b < 32; b += 8) {
+            line[n++] = hex[(words[i] >> (b + 4)) & 0xF];
+            line[n++] = hex[(words[i] >> b) & 0xF];
+        }
+    }
+    line[n++] = '\n';
+
+    fwrite(line, 1, n, stdout);
+
+    portENTER_CRITICAL(&lock);
+    n_drained_bytes += n;
+    portEXIT_CRITICAL(&lock);
+}
+
+static void drain(void)
+{
+    static uint32_t reported_dropped = 0;
+    uint32_t words[TLOG_RECORD_MAX], dropped;
+    size_t len, i;
+
+    /* Up to the first record still being written */
+    while ((words[0] = __atomic_load_n(&ring[tail], __ATOMIC_ACQUIRE)) != 0) {
+        words[1] = ring[next(tail)];
+        len = TLOG_HEADER_WORDS + ((words[1] >> 4) & 0xF);
+
+        ring[tail] = 0;
+        for (i = 1, tail = next(tail); i < len; i++, tail = next(tail)) {
+            words[i] = ring[tail];
+            ring[tail] = 0;
+        }
+
+        portENTER_CRITICAL(&lock);
+        used -= len;
+        portEXIT_CRITICAL(&lock);
+
+        emit(words, len);
+    }
+
+    portENTER_CRITICAL(&lock);
+    dropped = n_dropped;
+    portEXIT_CRITICAL(&lock);
+
+    /* Token 0 reports the records dropped since the last drain */
+    if (dropped != reported_dropped) {
+        words[0] = 0;
+        words[1] = ESP_LOG_WARN | 1 << 4;
+        words[2] = (uint32_t) esp_timer_get_time();
+        words[3] = 0;
+        words[4] = dropped - reported_dropped;
+        emit(words, TLOG_HEADER_WORDS + 1);
+        reported_dropped = dropped;
+    }
+
+    fflush(stdout);
+}
+
+static void tlog_task(void *arg)
+{
+    for (;;) {
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_STATION_TLOG_DRAIN_MS));
+        drain();
+    }
+}
+
+esp_err_t tlog_init(void)
+{
+    memory_account("tlog", "ring", sizeof(ring));
+
+    TaskHandle_t task = xTaskCreateStatic(tlog_task, "tlog_task", TLOG_TASK_STACK_SIZE, NULL, tskIDLE_PRIORITY,
+                                          tlog_stack, &tlog_tcb);
+    memory_account_task("tlog", task, sizeof(tlog_stack) + sizeof(tlog_tcb));
+
+    return ESP_OK;
+}
+
+void tlog_get_stats(tlog_stats_t *stats)
+{
+    portENTER_CRITICAL(&lock);
+    stats->records = n_records;
+    stats->dropped = n_dropped;
+    stats->drained_bytes = n_drained_bytes;
+    portEXIT_CRITICAL(&lock);
+}
+
+#else /* !CONFIG_STATION_TLOG */
+
+esp_err_t tlog_init(void)
+{
+    return ESP_OK;
+}
+
+void tlog_get_stats(tlog_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+#endif
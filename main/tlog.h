@@ -0,0 +1,120 @@
+#ifndef TLOG_H
+#define TLOG_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "esp_err.h"
+#include "esp_log.h"
+
+/*
+ * Tokenized logging (CONFIG_STATION_TLOG).
+ *
+ * TLOGx() puts its format string into the .tlog_fmt section, which tlog.ld
+ * keeps in the ELF without loading it: the address of the string is its
+ * token. A call only copies the token, the time, the tag pointer and the
+ * raw arguments into a RAM ring, without formatting anything; a task at
+ * idle priority drains the ring as "L:" hex lines and host/tlog turns them
+ * back into log lines with the ELF. The host also reads %s arguments and
+ * the tags from the ELF, so they must point to constant strings: literals,
+ * TAG, esp_err_to_name().
+ *
+ * Each argument is a 32-bit word: floats as their bits, doubles narrowed to
+ * float and 64-bit integers to their low half. Up to TLOG_ARGS_MAX.
+ * Without the option, TLOGx() are ESP_LOGx() of the same format.
+ */
+
+#define TLOG_ARGS_MAX 8
+
+#if CONFIG_STATION_TLOG
+
+/* Record words before the arguments: token, level and count, time in us, tag */
+#define TLOG_HEADER_WORDS 4
+
+void tlog_write(esp_log_level_t level, const char *format, const char *tag, const uint32_t *args, unsigned int n);
+
+static inline uint32_t tlog_float(float v)
+{
+    uint32_t w;
+
+    memcpy(&w, &v, sizeof(w));
+
+    return w;
+}
+
+static inline uint32_t tlog_double(double v)
+{
+    return tlog_float((float) v);
+}
+
+static inline uint32_t tlog_pointer(const void *p)
+{
+    return (uint32_t) (uintptr_t) p;
+}
+
+static inline uint32_t tlog_integer(long long v)
+{
+    return (uint32_t) v;
+}
+
+#define TLOG_WORD(x) _Generic((x),                                                      \
+        float: tlog_float,                                                              \
+        double: tlog_double,                                                            \
+        char *: tlog_pointer,                                                           \
+        const char *: tlog_pointer,                                                     \
+        void *: tlog_pointer,                                                           \
+        const void *: tlog_pointer,                                                     \
+        default: tlog_integer)(x)
+
+#define TLOG_NARGS(...) TLOG_NARGS_(_, ##__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define TLOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, n, ...) n
+
+#define TLOG_CAT(a, b) TLOG_CAT_(a, b)
+#define TLOG_CAT_(a, b) a##b
+
+/* One initializer per argument, each followed by a comma */
+#define TLOG_WORDS(...) TLOG_CAT(TLOG_WORDS_, TLOG_NARGS(__VA_ARGS__))(__VA_ARGS__)
+#define TLOG_WORDS_0()
+#define TLOG_WORDS_1(a) TLOG_WORD(a),
+#define TLOG_WORDS_2(a, ...) TLOG_WORD(a), TLOG_WORDS_1(__VA_ARGS__)
+#define TLOG_WORDS_3(a, ...) TLOG_WORD(a), TLOG_WORDS_2(__VA_ARGS__)
+#define TLOG_WORDS_4(a, ...) TLOG_WORD(a), TLOG_WORDS_3(__VA_ARGS__)
+#define TLOG_WORDS_5(a, ...) TLOG_WORD(a), TLOG_WORDS_4(__VA_ARGS__)
+#define TLOG_WORDS_6(a, ...) TLOG_WORD(a), TLOG_WORDS_5(__VA_ARGS__)
+#define TLOG_WORDS_7(a, ...) TLOG_WORD(a), TLOG_WORDS_6(__VA_ARGS__)
+#define TLOG_WORDS_8(a, ...) TLOG_WORD(a), TLOG_WORDS_7(__VA_ARGS__)
+
+#define TLOG_LEVEL(level, tag, format, ...) do {                                        \
+        if ((level) <= LOG_LOCAL_LEVEL) {                                               \
+            static const char tlog_format[] __attribute__((section(".tlog_fmt"))) = format; \
+            const uint32_t tlog_args[] = { TLOG_WORDS(__VA_ARGS__) 0 };                 \
+            tlog_write((level), tlog_format, (tag), tlog_args, TLOG_NARGS(__VA_ARGS__)); \
+        }                                                                               \
+    } while (0)
+
+#define TLOGE(tag, format, ...) TLOG_LEVEL(ESP_LOG_ERROR, tag, format, ##__VA_ARGS__)
+#define TLOGW(tag, format, ...) TLOG_LEVEL(ESP_LOG_WARN, tag, format, ##__VA_ARGS__)
+#define TLOGI(tag, format, ...) TLOG_LEVEL(ESP_LOG_INFO, tag, format, ##__VA_ARGS__)
+#define TLOGD(tag, format, ...) TLOG_LEVEL(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
+
+#else /* !CONFIG_STATION_TLOG */
+
+#define TLOGE(tag, format, ...) ESP_LOGE(tag, format, ##__VA_ARGS__)
+#define TLOGW(tag, format, ...) ESP_LOGW(tag, format, ##__VA_ARGS__)
+#define TLOGI(tag, format, ...) ESP_LOGI(tag, format, ##__VA_ARGS__)
+#define TLOGD(tag, format, ...) ESP_LOGD(tag, format, ##__VA_ARGS__)
+
+#endif
+
+typedef struct tlog_stats {
+    uint32_t records;
+    uint32_t dropped;           /* Ring full */
+    uint32_t drained_bytes;     /* Hex lines written, with their prefix */
+} tlog_stats_t;
+
+/* Starts the drain task; records written before it are kept */
+esp_err_t tlog_init(void);
+
+void tlog_get_stats(tlog_stats_t *stats);
+
+#endif
@@ -0,0 +1,281 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "esp_check.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "buzzer.h"
+#include "sched_trace.h"
+#include "tone.h"
+
+#define TONE_QUEUE_LEN 4
+
+typedef struct tone_entry {
+    const tone_pattern_t *pattern;
+    tone_note_cb_t note_cb;
+    uint8_t prio;
+} tone_entry_t;
+
+enum tone_phase {
+    PHASE_NOTE = 0,
+    PHASE_GAP,
+};
+
+static const tone_note_t notes_alarm[] = {
+    { 1000, 200, 100 },
+    { 1000, 200, 100 },
+    { 1000, 200, 100 },
+};
+
+static const tone_note_t notes_click[] = {
+    { 4000, 8, 0 },
+};
+
+static const tone_note_t notes_confirm[] = {
+    { 2000, 60, 40 },
+    { 3000, 80, 0 },
+};
+
+const tone_pattern_t tone_pattern_alarm = {
+    .notes = notes_alarm,
+    .n_notes = sizeof(notes_alarm) / sizeof(notes_alarm[0]),
+    .repeat = 0,
+    .pause = 500,
+    .volume = 40,
+    .volume_step = 20,
+};
+
+const tone_pattern_t tone_pattern_click = {
+    .notes = notes_click,
+    .n_notes = sizeof(notes_click) / sizeof(notes_click[0]),
+    .repeat = 1,
+    .volume = 60,
+};
+
+const tone_pattern_t tone_pattern_confirm = {
+    .notes = notes_confirm,
+    .n_notes = sizeof(notes_confirm) / sizeof(notes_confirm[0]),
+    .repeat = 1,
+    .volume = 80,
+};
+
+static const char *TAG = "TONE";
+
+static esp_timer_handle_t step_timer = NULL;
+
+/* Pending patterns sorted by decreasing priority, protected by queue_lock */
+static portMUX_TYPE queue_lock = portMUX_INITIALIZER_UNLOCKED;
+static tone_entry_t queue[TONE_QUEUE_LEN];
+static unsigned int queue_len = 0;
+static bool stop_current = false;
+
+/* Playback state, only modified from the step timer callback */
+static tone_entry_t current = { 0 };
+static uint8_t phase;
+static uint8_t note_idx;
+static uint8_t plays;
+static uint8_t volume;
+
+/* Must be called with queue_lock held */
+static bool enqueue(const tone_entry_t *entry)
+{
+    unsigned int i;
+
+    if (queue_len == TONE_QUEUE_LEN) {
+        /* Drop the least important pending pattern if the new one beats it */
+        if (queue[queue_len - 1].prio >= entry->prio) return false;
+        queue_len--;
+    }
+
+    /* FIFO among patterns of the same priority */
+    for (i = queue_len; i > 0 && queue[i - 1].prio < entry->prio; i--) {
+        queue[i] = queue[i - 1];
+    }
+
+    queue[i] = *entry;
+    queue_len++;
+
+    return true;
+}
+
+/* Must be called with queue_lock held */
+static void dequeue(tone_entry_t *entry)
+{
+    *entry = queue[0];
+    memmove(&queue[0], &queue[1], (--queue_len) * sizeof(tone_entry_t));
+}
+
+static void kick(void)
+{
+    esp_timer_stop(step_timer);
+    esp_timer_start_once(step_timer, 0);
+}
+
+static void step(void)
+{
+    const tone_note_t *note;
+    tone_entry_t preempted = { 0 };
+    tone_note_cb_t silenced_cb = NULL;
+    bool silence = false, pending;
+    uint32_t delay_ms = 0;
+
+    portENTER_CRITICAL(&queue_lock);
+
+    if (current.pattern != NULL && (stop_current || (queue_len > 0 && queue[0].prio > current.prio))) {
+        /* Looping patterns resume once the preempting one is done */
+        if (!stop_current && current.pattern->repeat == 0) {
+            preempted = current;
+        }
+
+        silence = true;
+        silenced_cb = current.note_cb;
+        current.pattern = NULL;
+    }
+
+    stop_current = false;
+
+    if (current.pattern == NULL && queue_len > 0) {
+        dequeue(&current);
+        phase = PHASE_NOTE;
+        note_idx = 0;
+        plays = 0;
+        volume = current.pattern->volume;
+    }
+
+    if (preempted.pattern != NULL) {
+        enqueue(&preempted);
+    }
+
+    portEXIT_CRITICAL(&queue_lock);
+
+    if (silence) {
+        buzzer_stop();
+        if (silenced_cb) silenced_cb(false);
+    }
+
+    if (current.pattern == NULL) return;
+
+    note = &current.pattern->notes[note_idx];
+
+    switch (phase) {
+        case PHASE_NOTE:
+            if (note->freq) {
+                buzzer_tone(note->freq, note->duration, volume);
+                if (current.note_cb) current.note_cb(true);
+            }
+
+            delay_ms = note->duration;
+            phase = PHASE_GAP;
+            break;
+        case PHASE_GAP:
+            if (note->freq && current.note_cb) current.note_cb(false);
+
+            delay_ms = note->gap;
+            phase = PHASE_NOTE;
+
+            if (++note_idx < current.pattern->n_notes) break;
+
+            note_idx = 0;
+            plays++;
+            volume = MIN(100, volume + current.pattern->volume_step);
+
+            if (current.pattern->repeat != 0 && plays >= current.pattern->repeat) {
+                /* Done, the next step picks the next pending pattern */
+                portENTER_CRITICAL(&queue_lock);
+                current.pattern = NULL;
+                pending = queue_len > 0;
+                portEXIT_CRITICAL(&queue_lock);
+
+                if (!pending) return;
+            } else {
+                delay_ms += current.pattern->pause;
+            }
+            break;
+        default:
+            break;
+    }
+
+    esp_timer_start_once(step_timer, (uint64_t) delay_ms * 1000);
+}
+
+static void step_timer_cb(void *arg)
+{
+    sched_trace_begin(SCHED_SPAN_TONE);
+    step();
+    sched_trace_end(SCHED_SPAN_TONE);
+}
+
+esp_err_t tone_play(const tone_pattern_t *pattern, tone_priority_t prio, tone_note_cb_t note_cb)
+{
+    tone_entry_t entry = { .pattern = pattern, .note_cb = note_cb, .prio = prio };
+    bool queued, start, busy;
+
+    ESP_RETURN_ON_FALSE(pattern != NULL && pattern->n_notes > 0, ESP_ERR_INVALID_ARG, TAG, "tone_play: invalid pattern");
+    ESP_RETURN_ON_FALSE(step_timer != NULL, ESP_ERR_INVALID_STATE, TAG, "tone_play: not initialized");
+
+    portENTER_CRITICAL(&queue_lock);
+    start = current.pattern == NULL || prio > current.prio;
+    /* A late key click is worse than none, clicks are never kept pending */
+    busy = !start && prio == TONE_PRIO_CLICK;
+    queued = !busy && enqueue(&entry);
+    portEXIT_CRITICAL(&queue_lock);
+
+    if (busy) return ESP_ERR_INVALID_STATE;
+    if (!queued) return ESP_ERR_NO_MEM;
+
+    if (start) {
+        kick();
+    }
+
+    return ESP_OK;
+}
+
+void tone_stop(const tone_pattern_t *pattern)
+{
+    unsigned int i, j;
+    bool stop;
+
+    portENTER_CRITICAL(&queue_lock);
+
+    for (i = 0, j = 0; i < queue_len; i++) {
+        if (pattern != NULL && queue[i].pattern != pattern) {
+            queue[j++] = queue[i];
+        }
+    }
+    queue_len = j;
+
+    stop = current.pattern != NULL && (pattern == NULL || current.pattern == pattern);
+    stop_current |= stop;
+
+    portEXIT_CRITICAL(&queue_lock);
+
+    if (stop) {
+        kick();
+    }
+}
+
+bool tone_is_playing(const tone_pattern_t *pattern)
+{
+    bool playing;
+
+    portENTER_CRITICAL(&queue_lock);
+    playing = current.pattern != NULL && (pattern == NULL || current.pattern == pattern);
+    portEXIT_CRITICAL(&queue_lock);
+
+    return playing;
+}
+
+esp_err_t tone_init(void)
+{
+    const esp_timer_create_args_t step_timer_args = {
+        .callback = &step_timer_cb,
+        .name = "tone"
+    };
+
+    return esp_timer_create(&step_timer_args, &step_timer);
+}
@@ -0,0 +1,59 @@
+#ifndef TONE_H
+#define TONE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+
+/*
+ * Tone pattern sequencer on top of the buzzer.
+ *
+ * Patterns are const tables of notes played by a timer driven state machine,
+ * no task is involved. Pending patterns are queued by priority; a pattern of
+ * higher priority preempts the one playing.
+ */
+
+typedef struct tone_note {
+    uint16_t freq;      /* Hz, 0 is a rest */
+    uint16_t duration;  /* ms */
+    uint16_t gap;       /* ms of silence after the note */
+} tone_note_t;
+
+typedef struct tone_pattern {
+    const tone_note_t *notes;
+    uint8_t n_notes;
+    uint8_t repeat;         /* Number of plays, 0 loops until tone_stop() */
+    uint16_t pause;         /* ms of silence between two plays */
+    uint8_t volume;         /* Volume of the first play, in percent */
+    uint8_t volume_step;    /* Added to the volume after each play, up to 100 */
+} tone_pattern_t;
+
+typedef enum tone_priority {
+    TONE_PRIO_CLICK = 0,
+    TONE_PRIO_NOTIFY,
+    TONE_PRIO_ALARM,
+} tone_priority_t;
+
+/*
+ * Called from the esp_timer task when a note starts (on = true) and ends.
+ */
+typedef void (*tone_note_cb_t)(bool on);
+
+extern const tone_pattern_t tone_pattern_alarm;
+extern const tone_pattern_t tone_pattern_click;
+extern const tone_pattern_t tone_pattern_confirm;
+
+esp_err_t tone_play(const tone_pattern_t *pattern, tone_priority_t prio, tone_note_cb_t note_cb);
+
+/*
+ * Stops the pattern if it is playing and drops it from the queue.
+ * NULL stops everything.
+ */
+void tone_stop(const tone_pattern_t *pattern);
+
+bool tone_is_playing(const tone_pattern_t *pattern);
+
+esp_err_t tone_init(void);
+
+#endif
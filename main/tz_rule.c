@@ -0,0 +1,278 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "tz_rule.h"
+
+#define SECS_PER_DAY 86400
+
+static const uint8_t days_in_month[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+static bool is_leap(int32_t year)
+{
+    return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+/*
+ * Howard Hinnant's civil calendar algorithms, valid for any 32 bits day count.
+ */
+int32_t tz_days_from_civil(int32_t year, uint32_t month, uint32_t day)
+{
+    year -= month <= 2;
+
+    const int32_t era = (year >= 0 ? year : year - 399) / 400;
+    const uint32_t yoe = (uint32_t) (year - era * 400);
+    const uint32_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    const uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+    return era * 146097 + (int32_t) doe - 719468;
+}
+
+void tz_civil_from_days(int32_t days, int32_t *year, uint32_t *month, uint32_t *day)
+{
+    days += 719468;
+
+    const int32_t era = (days >= 0 ? days : days - 146096) / 146097;
+    const uint32_t doe = (uint32_t) (days - era * 146097);
+    const uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const uint32_t mp = (5 * doy + 2) / 153;
+
+    *day = doy - (153 * mp + 2) / 5 + 1;
+    *month = mp < 10 ? mp + 3 : mp - 9;
+    *year = (int32_t) yoe + era * 400 + (*month <= 2);
+}
+
+static const char *parse_name(const char *p, char *name, size_t sz)
+{
+    size_t len = 0;
+
+    if (*p == '<') {
+        p++;
+        while (*p && *p != '>') {
+            if (len < sz - 1) name[len++] = *p;
+            p++;
+        }
+        if (*p != '>') return NULL;
+        p++;
+    } else {
+        while (isalpha((unsigned char) *p)) {
+            if (len < sz - 1) name[len++] = *p;
+            p++;
+        }
+    }
+
+    name[len] = '\0';
+
+    return len >= 3 ? p : NULL;
+}
+
+static const char *parse_number(const char *p, int32_t *out, int32_t max)
+{
+    int32_t val = 0;
+
+    if (!isdigit((unsigned char) *p)) return NULL;
+
+    while (isdigit((unsigned char) *p)) {
+        val = val * 10 + (*p++ - '0');
+        if (val > max) return NULL;
+    }
+
+    *out = val;
+
+    return p;
+}
+
+/* [+-]hh[:mm[:ss]], returned in seconds */
+static const char *parse_time(const char *p, int32_t *out)
+{
+    int32_t sign = 1, hh = 0, mm = 0, ss = 0;
+
+    if (*p == '+' || *p == '-') {
+        sign = *p == '-' ? -1 : 1;
+        p++;
+    }
+
+    p = parse_number(p, &hh, 167);
+    if (p == NULL) return NULL;
+
+    if (*p == ':') {
+        p = parse_number(p + 1, &mm, 59);
+        if (p == NULL) return NULL;
+
+        if (*p == ':') {
+            p = parse_number(p + 1, &ss, 59);
+            if (p == NULL) return NULL;
+        }
+    }
+
+    *out = sign * (hh * 3600 + mm * 60 + ss);
+
+    return p;
+}
+
+static const char *parse_date_rule(const char *p, tz_date_rule_t *rule)
+{
+    int32_t a, b, c;
+
+    if (*p == 'M') {
+        p = parse_number(p + 1, &a, 12);
+        if (p == NULL || *p != '.') return NULL;
+        p = parse_number(p + 1, &b, 5);
+        if (p == NULL || *p != '.') return NULL;
+        p = parse_number(p + 1, &c, 6);
+        if (p == NULL || a < 1 || b < 1) return NULL;
+
+        rule->type = TZ_DATE_MONTH_WEEK_DAY;
+        rule->month = a;
+        rule->week = b;
+        rule->wday = c;
+    } else if (*p == 'J') {
+        p = parse_number(p + 1, &a, 365);
+        if (p == NULL || a < 1) return NULL;
+
+        rule->type = TZ_DATE_JULIAN_NO_LEAP;
+        rule->day = a;
+    } else {
+        p = parse_number(p, &a, 365);
+        if (p == NULL) return NULL;
+
+        rule->type = TZ_DATE_JULIAN;
+        rule->day = a;
+    }
+
+    /* Transitions happen at 02:00 local time unless specified */
+    rule->time = 2 * 3600;
+
+    if (*p == '/') {
+        p = parse_time(p + 1, &rule->time);
+    }
+
+    return p;
+}
+
+bool tz_rule_parse(const char *spec, tz_rule_t *rule)
+{
+    const char *p = spec;
+    int32_t offset;
+
+    if (spec == NULL || rule == NULL) return false;
+
+    memset(rule, 0, sizeof(tz_rule_t));
+
+    p = parse_name(p, rule->std_name, sizeof(rule->std_name));
+    if (p == NULL) return false;
+
+    /* POSIX offsets are positive west of Greenwich */
+    p = parse_time(p, &offset);
+    if (p == NULL) return false;
+    rule->std_offset = -offset;
+    rule->dst_offset = rule->std_offset;
+
+    if (*p == '\0') return true;
+
+    p = parse_name(p, rule->dst_name, sizeof(rule->dst_name));
+    if (p == NULL) return false;
+
+    rule->has_dst = true;
+    rule->dst_offset = rule->std_offset + 3600;
+
+    if (*p != ',' && *p != '\0') {
+        p = parse_time(p, &offset);
+        if (p == NULL) return false;
+        rule->dst_offset = -offset;
+    }
+
+    if (*p == '\0') {
+        /* No transition rule given, use the POSIX default (US rules) */
+        return parse_date_rule("M3.2.0", &rule->start) != NULL &&
+               parse_date_rule("M11.1.0", &rule->end) != NULL;
+    }
+
+    if (*p != ',') return false;
+    p = parse_date_rule(p + 1, &rule->start);
+    if (p == NULL || *p != ',') return false;
+    p = parse_date_rule(p + 1, &rule->end);
+
+    return p != NULL && *p == '\0';
+}
+
+/* Day since epoch on which a date rule falls in the given year */
+static int32_t rule_day(const tz_date_rule_t *rule, int32_t year)
+{
+    int32_t jan1 = tz_days_from_civil(year, 1, 1);
+    int32_t first, first_wday, day, mdays;
+
+    switch (rule->type) {
+        case TZ_DATE_JULIAN_NO_LEAP:
+            return jan1 + rule->day - 1 + (is_leap(year) && rule->day >= 60);
+        case TZ_DATE_JULIAN:
+            return jan1 + rule->day;
+        default:
+            break;
+    }
+
+    first = tz_days_from_civil(year, rule->month, 1);
+    /* 1970-01-01 was a Thursday */
+    first_wday = ((first + 4) % 7 + 7) % 7;
+    day = (rule->wday - first_wday + 7) % 7 + (rule->week - 1) * 7;
+
+    mdays = days_in_month[rule->month - 1] + (rule->month == 2 && is_leap(year));
+    while (day >= mdays) {
+        day -= 7;
+    }
+
+    return first + day;
+}
+
+/* DST start and end instants (UTC) in the given year */
+static void transitions(const tz_rule_t *rule, int32_t year, int64_t *start, int64_t *end)
+{
+    /* The start is expressed in standard time, the end in daylight time */
+    *start = (int64_t) rule_day(&rule->start, year) * SECS_PER_DAY + rule->start.time - rule->std_offset;
+    *end = (int64_t) rule_day(&rule->end, year) * SECS_PER_DAY + rule->end.time - rule->dst_offset;
+}
+
+int32_t tz_rule_utc_offset(const tz_rule_t *rule, int64_t utc, int64_t *next_change, bool *is_dst)
+{
+    int64_t start, end, next_start, next_end, change;
+    int32_t year;
+    uint32_t month, day;
+    bool dst;
+
+    if (!rule->has_dst) {
+        if (next_change) *next_change = INT64_MAX;
+        if (is_dst) *is_dst = false;
+        return rule->std_offset;
+    }
+
+    int64_t days = utc / SECS_PER_DAY - (utc % SECS_PER_DAY < 0);
+    tz_civil_from_days((int32_t) days, &year, &month, &day);
+
+    transitions(rule, year, &start, &end);
+
+    if (start < end) {
+        /* Northern hemisphere, DST within the year */
+        dst = utc >= start && utc < end;
+    } else {
+        /* Southern hemisphere, DST across the new year */
+        dst = !(utc >= end && utc < start);
+    }
+
+    if (next_change) {
+        transitions(rule, year + 1, &next_start, &next_end);
+
+        change = INT64_MAX;
+        if (start > utc && start < change) change = start;
+        if (end > utc && end < change) change = end;
+        if (next_start > utc && next_start < change) change = next_start;
+        if (next_end > utc && next_end < change) change = next_end;
+
+        *next_change = change;
+    }
+
+    if (is_dst) *is_dst = dst;
+
+    return dst ? rule->dst_offset : rule->std_offset;
+}
@@ -0,0 +1,56 @@
+#ifndef TZ_RULE_H
+#define TZ_RULE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Compiled POSIX TZ rule, e.g. "CET-1CEST,M3.5.0,M10.5.0/3".
+ *
+ * Pure computation without any libc time zone state, so that it can be
+ * evaluated from hot paths and built on the host.
+ */
+
+enum tz_date_type {
+    TZ_DATE_MONTH_WEEK_DAY = 0, /* Mm.w.d */
+    TZ_DATE_JULIAN_NO_LEAP,     /* Jn, 1 <= n <= 365, Feb 29 is never counted */
+    TZ_DATE_JULIAN,             /* n, 0 <= n <= 365, Feb 29 is counted */
+};
+
+typedef struct tz_date_rule {
+    uint8_t type;
+    uint8_t month;      /* 1..12 */
+    uint8_t week;       /* 1..5, 5 is the last week of the month */
+    uint8_t wday;       /* 0..6, 0 is Sunday */
+    uint16_t day;       /* Julian day for the J and plain forms */
+    int32_t time;       /* Local wall time of the transition, in seconds */
+} tz_date_rule_t;
+
+typedef struct tz_rule {
+    char std_name[8];
+    char dst_name[8];
+    int32_t std_offset; /* Seconds east of UTC */
+    int32_t dst_offset; /* Seconds east of UTC */
+    bool has_dst;
+    tz_date_rule_t start;
+    tz_date_rule_t end;
+} tz_rule_t;
+
+/*
+ * Compiles a POSIX TZ string. Returns false if the string is not a valid
+ * POSIX rule (e.g. an Olson name such as "Europe/Zurich").
+ */
+bool tz_rule_parse(const char *spec, tz_rule_t *rule);
+
+/*
+ * Returns the UTC offset in effect at `utc`. If `next_change` is not NULL
+ * it receives the next instant after `utc` at which the offset changes, or
+ * INT64_MAX for a rule without DST.
+ */
+int32_t tz_rule_utc_offset(const tz_rule_t *rule, int64_t utc, int64_t *next_change, bool *is_dst);
+
+/* Days since 1970-01-01 of a proleptic Gregorian date and back */
+int32_t tz_days_from_civil(int32_t year, uint32_t month, uint32_t day);
+void tz_civil_from_days(int32_t days, int32_t *year, uint32_t *month, uint32_t *day);
+
+#endif
@@ -0,0 +1,40 @@
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+
+#include "ui_format.h"
+
+void ui_format_time(char *buf, size_t size, const clock_time_t *time)
+{
+    snprintf(buf, size, "%02u:%02u:%02u", time->hour, time->min, time->sec);
+}
+
+void ui_format_temperature(char *buf, size_t size, float temperature)
+{
+    if (isnan(temperature)) {
+        snprintf(buf, size, "--.-" UI_DEGREE_SYMBOL);
+        return;
+    }
+
+    snprintf(buf, size, "%.1f" UI_DEGREE_SYMBOL, temperature);
+}
+
+void ui_format_humidity(char *buf, size_t size, float humidity)
+{
+    if (isnan(humidity)) {
+        snprintf(buf, size, "--%%");
+        return;
+    }
+
+    snprintf(buf, size, "%.0f%%", humidity);
+}
+
+void ui_format_pressure(char *buf, size_t size, float pressure)
+{
+    if (isnan(pressure)) {
+        snprintf(buf, size, "---- hPa");
+        return;
+    }
+
+    snprintf(buf, size, "%.0f hPa", pressure);
+}
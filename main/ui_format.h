@@ -0,0 +1,20 @@
+#ifndef UI_FORMAT_H
+#define UI_FORMAT_H
+
+#include <stddef.h>
+
+#include "clock.h"
+
+/*
+ * Text of the main screen labels. Pure functions, `buf` is always
+ * NUL-terminated. A NAN value, for a sensor not read yet, shows as dashes.
+ */
+
+#define UI_DEGREE_SYMBOL "\u00B0"
+
+void ui_format_time(char *buf, size_t size, const clock_time_t *time);
+void ui_format_temperature(char *buf, size_t size, float temperature);
+void ui_format_humidity(char *buf, size_t size, float humidity);
+void ui_format_pressure(char *buf, size_t size, float pressure);
+
+#endif
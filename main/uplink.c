@@ -0,0 +1,337 @@
+#include <inttypes.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+
+#include "esp_check.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "uplink.h"
+
+#if CONFIG_STATION_UPLINK
+
+#include "esp_event.h"
+#include "esp_netif.h"
+#include "esp_wifi.h"
+#if CONFIG_STATION_UPLINK_MQTT
+#include "mqtt_client.h"
+#else
+#include "esp_http_client.h"
+#endif
+
+#include "memory.h"
+#include "weather.h"
+
+#define UPLINK_TASK_STACK_SIZE (6 * 1024)
+
+#define WIFI_CONNECTED_BIT  BIT0
+#define MQTT_CONNECTED_BIT  BIT1
+#define MQTT_PUBLISHED_BIT  BIT2
+#define MQTT_ERROR_BIT      BIT3
+
+static const char *TAG = "uplink";
+
+static uplink_t uplink;
+static history_sample_t spool[CONFIG_STATION_UPLINK_SPOOL_SIZE];
+
+static StackType_t uplink_stack[UPLINK_TASK_STACK_SIZE];
+static StaticTask_t uplink_tcb;
+
+static StaticEventGroup_t events_buf;
+static EventGroupHandle_t events;
+static bool radio_wanted = false;
+
+#if CONFIG_STATION_UPLINK_MQTT
+static esp_mqtt_client_handle_t mqtt_client = NULL;
+static int pending_msg_id = -1;
+#endif
+
+static void sample_timer_cb(void *arg)
+{
+    /* As in the history, a missing sensor leaves a gap rather than a row of zeros */
+    if (!weather_is_current(WEATHER_SENSOR_AHT20) || !weather_is_current(WEATHER_SENSOR_BMP280)) return;
+
+    history_sample_t sample = {
+        .time = time(NULL),
+        .temperature = weather_get_temperature() * 100,
+        .humidity = weather_get_humidity() * 100,
+        .pressure = weather_get_pressure() * 100,
+    };
+
+    uplink_core_push(&uplink, &sample);
+}
+
+static void wifi_event_handler(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+    if (base == WIFI_EVENT && id == WIFI_EVENT_STA_START) {
+        esp_wifi_connect();
+    } else if (base == WIFI_EVENT && id == WIFI_EVENT_STA_DISCONNECTED) {
+        xEventGroupClearBits(events, WIFI_CONNECTED_BIT);
+        /* Keep trying until the session gives up and stops the radio */
+        if (radio_wanted) esp_wifi_connect();
+    } else if (base == IP_EVENT && id == IP_EVENT_STA_GOT_IP) {
+        xEventGroupSetBits(events, WIFI_CONNECTED_BIT);
+    }
+}
+
+static esp_err_t radio_up(void)
+{
+    EventBits_t bits;
+
+    radio_wanted = true;
+    ESP_RETURN_ON_ERROR(esp_wifi_start(), TAG, "radio_up: esp_wifi_start failed");
+
+    bits = xEventGroupWaitBits(events, WIFI_CONNECTED_BIT, pdFALSE, pdTRUE,
+                               pdMS_TO_TICKS(CONFIG_STATION_UPLINK_CONNECT_TIMEOUT_MS));
+
+    return bits & WIFI_CONNECTED_BIT ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+static void radio_down(void)
+{
+    radio_wanted = false;
+    esp_wifi_stop();
+    xEventGroupClearBits(events, WIFI_CONNECTED_BIT);
+}
+
+#if CONFIG_STATION_UPLINK_MQTT
+
+static void mqtt_event_handler(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+    esp_mqtt_event_handle_t event = data;
+
+    switch ((esp_mqtt_event_id_t) id) {
+        case MQTT_EVENT_CONNECTED:
+            xEventGroupSetBits(events, MQTT_CONNECTED_BIT);
+            break;
+        case MQTT_EVENT_DISCONNECTED:
+            xEventGroupClearBits(events, MQTT_CONNECTED_BIT);
+            xEventGroupSetBits(events, MQTT_ERROR_BIT);
+            break;
+        case MQTT_EVENT_PUBLISHED:
+            if (event->msg_id == pending_msg_id) xEventGroupSetBits(events, MQTT_PUBLISHED_BIT);
+            break;
+        case MQTT_EVENT_ERROR:
+            xEventGroupSetBits(events, MQTT_ERROR_BIT);
+            break;
+        default:
+            break;
+    }
+}
+
+static esp_err_t transport_open(void *ctx)
+{
+    EventBits_t bits;
+
+    ESP_RETURN_ON_ERROR(radio_up(), TAG, "no Wi-Fi connection");
+
+    xEventGroupClearBits(events, MQTT_CONNECTED_BIT | MQTT_PUBLISHED_BIT | MQTT_ERROR_BIT);
+    ESP_RETURN_ON_ERROR(esp_mqtt_client_start(mqtt_client), TAG, "esp_mqtt_client_start failed");
+
+    bits = xEventGroupWaitBits(events, MQTT_CONNECTED_BIT | MQTT_ERROR_BIT, pdFALSE, pdFALSE,
+                               pdMS_TO_TICKS(CONFIG_STATION_UPLINK_CONNECT_TIMEOUT_MS));
+    ESP_RETURN_ON_FALSE(bits & MQTT_CONNECTED_BIT, ESP_ERR_TIMEOUT, TAG, "broker not reachable");
+
+    return ESP_OK;
+}
+
+/* QoS 1: the batch only leaves the spool once the broker acknowledged it */
+static esp_err_t transport_send(void *ctx, const uint8_t *payload, size_t len)
+{
+    EventBits_t bits;
+
+    xEventGroupClearBits(events, MQTT_PUBLISHED_BIT);
+    pending_msg_id = esp_mqtt_client_publish(mqtt_client, CONFIG_STATION_UPLINK_MQTT_TOPIC, (const char *) payload,
+                                             len, 1, 0);
+    ESP_RETURN_ON_FALSE(pending_msg_id >= 0, ESP_FAIL, TAG, "publish failed");
+
+    bits = xEventGroupWaitBits(events, MQTT_PUBLISHED_BIT | MQTT_ERROR_BIT, pdFALSE, pdFALSE,
+                               pdMS_TO_TICKS(CONFIG_STATION_UPLINK_CONNECT_TIMEOUT_MS));
+    ESP_RETURN_ON_FALSE(bits & MQTT_PUBLISHED_BIT, ESP_ERR_TIMEOUT, TAG, "no PUBACK");
+
+    return ESP_OK;
+}
+
+static void transport_close(void *ctx)
+{
+    esp_mqtt_client_stop(mqtt_client);
+    radio_down();
+}
+
+static esp_err_t transport_init(void)
+{
+    const esp_mqtt_client_config_t mqtt_cfg = {
+        .broker.address.uri = CONFIG_STATION_UPLINK_MQTT_URI,
+    };
+
+    mqtt_client = esp_mqtt_client_init(&mqtt_cfg);
+    ESP_RETURN_ON_FALSE(mqtt_client != NULL, ESP_FAIL, TAG, "esp_mqtt_client_init failed");
+
+    return esp_mqtt_client_register_event(mqtt_client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
+}
+
+#else /* CONFIG_STATION_UPLINK_HTTP */
+
+static esp_err_t transport_open(void *ctx)
+{
+    return radio_up();
+}
+
+static esp_err_t transport_send(void *ctx, const uint8_t *payload, size_t len)
+{
+    esp_http_client_config_t http_cfg = {
+        .url = CONFIG_STATION_UPLINK_HTTP_URL,
+        .method = HTTP_METHOD_POST,
+        .timeout_ms = CONFIG_STATION_UPLINK_CONNECT_TIMEOUT_MS,
+    };
+    esp_http_client_handle_t client = esp_http_client_init(&http_cfg);
+    esp_err_t rc;
+    int status;
+
+    ESP_RETURN_ON_FALSE(client != NULL, ESP_FAIL, TAG, "esp_http_client_init failed");
+
+    esp_http_client_set_header(client, "Content-Type", "application/octet-stream");
+    esp_http_client_set_post_field(client, (const char *) payload, len);
+    rc = esp_http_client_perform(client);
+    status = esp_http_client_get_status_code(client);
+    esp_http_client_cleanup(client);
+
+    ESP_RETURN_ON_ERROR(rc, TAG, "POST failed");
+    ESP_RETURN_ON_FALSE(status >= 200 && status < 300, ESP_FAIL, TAG, "POST rejected with status %d", status);
+
+    return ESP_OK;
+}
+
+static void transport_close(void *ctx)
+{
+    radio_down();
+}
+
+static esp_err_t transport_init(void)
+{
+    return ESP_OK;
+}
+
+#endif
+
+static const uplink_transport_t transport = {
+    .open = transport_open,
+    .send = transport_send,
+    .close = transport_close,
+};
+
+static void uplink_task(void *arg)
+{
+    uplink_stats_t stats;
+    uint32_t delay_ms;
+
+    for (;;) {
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_STATION_UPLINK_PERIOD_S * 1000));
+
+        do {
+            /*
+             * Covers the allocations of this task only; those of the Wi-Fi,
+             * lwIP and MQTT tasks are why STATION_HEAP_TRAP excludes the uplink.
+             */
+            memory_allow_alloc_begin();
+            delay_ms = uplink_core_session(&uplink, &transport);
+            memory_allow_alloc_end();
+            uplink_core_get_stats(&uplink, &stats);
+
+            if (stats.last_error != ESP_OK) {
+                ESP_LOGW(TAG, "Session failed (%s), retrying in %" PRIu32 " s, %u samples spooled",
+                         esp_err_to_name(stats.last_error), delay_ms / 1000, (unsigned int) uplink_core_pending(&uplink));
+                vTaskDelay(pdMS_TO_TICKS(delay_ms));
+            } else if (stats.last_batches > 0) {
+                ESP_LOGI(TAG, "%" PRIu32 " batches sent, radio on %" PRIu32 " ms (%" PRIu32 " ms per batch)",
+                         stats.last_batches, stats.last_radio_on_us / 1000,
+                         stats.last_radio_on_us / 1000 / stats.last_batches);
+            }
+        } while (stats.last_error != ESP_OK);
+    }
+}
+
+void uplink_get_stats(uplink_stats_t *stats)
+{
+    uplink_core_get_stats(&uplink, stats);
+}
+
+size_t uplink_pending(void)
+{
+    return uplink_core_pending(&uplink);
+}
+
+esp_err_t uplink_init(void)
+{
+    const uplink_config_t config = {
+        .period_ms = CONFIG_STATION_UPLINK_PERIOD_S * 1000,
+        .backoff_min_ms = CONFIG_STATION_UPLINK_BACKOFF_MIN_S * 1000,
+        .backoff_max_ms = CONFIG_STATION_UPLINK_BACKOFF_MAX_S * 1000,
+        .batch_samples = UPLINK_BATCH_MAX,
+    };
+    wifi_init_config_t wifi_init_cfg = WIFI_INIT_CONFIG_DEFAULT();
+    wifi_config_t wifi_cfg = {
+        .sta = {
+            .ssid = CONFIG_STATION_UPLINK_WIFI_SSID,
+            .password = CONFIG_STATION_UPLINK_WIFI_PASSWORD,
+        },
+    };
+
+    uplink_core_init(&uplink, &config, spool, CONFIG_STATION_UPLINK_SPOOL_SIZE);
+    memory_account("uplink", "spool", sizeof(spool));
+
+    events = xEventGroupCreateStatic(&events_buf);
+
+    ESP_RETURN_ON_ERROR(esp_netif_init(), TAG, "uplink_init: esp_netif_init failed");
+    ESP_RETURN_ON_ERROR(esp_event_loop_create_default(), TAG, "uplink_init: esp_event_loop_create_default failed");
+    ESP_RETURN_ON_FALSE(esp_netif_create_default_wifi_sta() != NULL, ESP_FAIL, TAG, "uplink_init: creating the Wi-Fi interface failed");
+    ESP_RETURN_ON_ERROR(esp_wifi_init(&wifi_init_cfg), TAG, "uplink_init: esp_wifi_init failed");
+    ESP_RETURN_ON_ERROR(esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, wifi_event_handler, NULL), TAG,
+                        "uplink_init: registering the Wi-Fi handler failed");
+    ESP_RETURN_ON_ERROR(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, wifi_event_handler, NULL), TAG,
+                        "uplink_init: registering the IP handler failed");
+    ESP_RETURN_ON_ERROR(esp_wifi_set_mode(WIFI_MODE_STA), TAG, "uplink_init: esp_wifi_set_mode failed");
+    ESP_RETURN_ON_ERROR(esp_wifi_set_config(WIFI_IF_STA, &wifi_cfg), TAG, "uplink_init: esp_wifi_set_config failed");
+    ESP_RETURN_ON_ERROR(transport_init(), TAG, "uplink_init: transport init failed");
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = &sample_timer_cb,
+        .name = "uplink_sample",
+        .skip_unhandled_events = true,
+    };
+    esp_timer_handle_t timer = NULL;
+
+    ESP_RETURN_ON_ERROR(esp_timer_create(&timer_args, &timer), TAG, "uplink_init: esp_timer_create failed");
+    ESP_RETURN_ON_ERROR(esp_timer_start_periodic(timer, (uint64_t) CONFIG_STATION_UPLINK_SAMPLE_INTERVAL_S * 1000000),
+                        TAG, "uplink_init: esp_timer_start_periodic failed");
+
+    TaskHandle_t task = xTaskCreateStatic(uplink_task, "uplink_task", UPLINK_TASK_STACK_SIZE, NULL, 1, uplink_stack, &uplink_tcb);
+    memory_account_task("uplink", task, sizeof(uplink_stack) + sizeof(uplink_tcb));
+
+    return ESP_OK;
+}
+
+#else /* !CONFIG_STATION_UPLINK */
+
+esp_err_t uplink_init(void)
+{
+    return ESP_OK;
+}
+
+void uplink_get_stats(uplink_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+size_t uplink_pending(void)
+{
+    return 0;
+}
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef UPLINK_H
+#define UPLINK_H
+
+#include "esp_err.h"
+
+#include "uplink_core.h"
+
+/*
+ * Wi-Fi uplink (CONFIG_STATION_UPLINK).
+ *
+ * The weather values are spooled every CONFIG_STATION_UPLINK_SAMPLE_INTERVAL_S
+ * and published in batches every CONFIG_STATION_UPLINK_PERIOD_S over MQTT or
+ * HTTP, with the radio on only for the duration of a session. See
+ * uplink_core.h for the spooling and retry logic.
+ */
+
+esp_err_t uplink_init(void);
+
+void uplink_get_stats(uplink_stats_t *stats);
+
+/* Samples waiting in the spool */
+size_t uplink_pending(void);
+
+#endif
@@ -0,0 +1,140 @@
+#include <stdint.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "esp_err.h"
+#include "esp_timer.h"
+
+#include "history_codec.h"
+#include "uplink_core.h"
+
+void uplink_core_init(uplink_t *u, const uplink_config_t *config, history_sample_t *storage, size_t size)
+{
+    memset(u, 0, sizeof(*u));
+    u->config = *config;
+    if (u->config.batch_samples == 0 || u->config.batch_samples > UPLINK_BATCH_MAX) {
+        u->config.batch_samples = UPLINK_BATCH_MAX;
+    }
+    u->spool = storage;
+    u->size = size;
+    u->backoff_ms = config->backoff_min_ms;
+    portMUX_INITIALIZE(&u->lock);
+}
+
+void uplink_core_push(uplink_t *u, const history_sample_t *sample)
+{
+    portENTER_CRITICAL(&u->lock);
+    if (u->head - u->tail == u->size) {
+        u->tail++;
+        u->stats.dropped++;
+    }
+    u->spool[u->head % u->size] = *sample;
+    u->head++;
+    portEXIT_CRITICAL(&u->lock);
+}
+
+size_t uplink_core_pending(uplink_t *u)
+{
+    size_t n;
+
+    portENTER_CRITICAL(&u->lock);
+    n = u->head - u->tail;
+    portEXIT_CRITICAL(&u->lock);
+
+    return n;
+}
+
+/*
+ * Encodes the oldest pending samples. Returns the payload size, 0 when the
+ * spool is empty; `first` identifies the batch for commit_batch().
+ */
+static size_t take_batch(uplink_t *u, uint8_t *payload, uint32_t *first, size_t *count)
+{
+    history_sample_t batch[UPLINK_BATCH_MAX];
+    size_t n;
+
+    portENTER_CRITICAL(&u->lock);
+    *first = u->tail;
+    *count = MIN(u->head - u->tail, u->config.batch_samples);
+    for (size_t i = 0; i < *count; i++) {
+        batch[i] = u->spool[(*first + i) % u->size];
+    }
+    portEXIT_CRITICAL(&u->lock);
+
+    if (*count == 0) return 0;
+
+    n = history_codec_header(payload);
+
+    return n + history_codec_encode_block(batch, *count, payload + n);
+}
+
+static void commit_batch(uplink_t *u, uint32_t first, size_t count, size_t bytes)
+{
+    portENTER_CRITICAL(&u->lock);
+    /* Samples dropped by a full spool while the batch was in flight are already gone */
+    if ((int32_t) (u->tail - first) < (int32_t) count) u->tail = first + count;
+    u->stats.batches++;
+    u->stats.samples_sent += count;
+    u->stats.bytes_sent += bytes;
+    portEXIT_CRITICAL(&u->lock);
+}
+
+uint32_t uplink_core_session(uplink_t *u, const uplink_transport_t *transport)
+{
+    static uint8_t payload[UPLINK_PAYLOAD_MAX];
+    uint32_t batches = 0;
+    int64_t start_us;
+    uint32_t radio_on_us;
+    esp_err_t rc;
+
+    if (uplink_core_pending(u) == 0) return u->config.period_ms;
+
+    start_us = esp_timer_get_time();
+    rc = transport->open(transport->ctx);
+
+    while (rc == ESP_OK) {
+        uint32_t first;
+        size_t count;
+        size_t len = take_batch(u, payload, &first, &count);
+
+        if (len == 0) break;
+
+        rc = transport->send(transport->ctx, payload, len);
+        if (rc == ESP_OK) {
+            commit_batch(u, first, count, len);
+            batches++;
+        }
+    }
+
+    transport->close(transport->ctx);
+    radio_on_us = esp_timer_get_time() - start_us;
+
+    portENTER_CRITICAL(&u->lock);
+    u->stats.sessions++;
+    u->stats.failures += rc != ESP_OK;
+    u->stats.radio_on_us += radio_on_us;
+    u->stats.last_batches = batches;
+    u->stats.last_radio_on_us = radio_on_us;
+    u->stats.last_error = rc;
+    portEXIT_CRITICAL(&u->lock);
+
+    if (rc == ESP_OK) {
+        u->backoff_ms = u->config.backoff_min_ms;
+        return u->config.period_ms;
+    }
+
+    uint32_t delay_ms = u->backoff_ms;
+
+    u->backoff_ms = MIN((uint64_t) u->backoff_ms * 2, u->config.backoff_max_ms);
+
+    return delay_ms;
+}
+
+void uplink_core_get_stats(uplink_t *u, uplink_stats_t *stats)
+{
+    portENTER_CRITICAL(&u->lock);
+    *stats = u->stats;
+    portEXIT_CRITICAL(&u->lock);
+}
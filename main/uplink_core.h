@@ -0,0 +1,83 @@
+#ifndef UPLINK_CORE_H
+#define UPLINK_CORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "esp_err.h"
+
+#include "history_codec.h"
+
+/*
+ * Batching, spooling and retry logic of the uplink, independent of the
+ * radio and the protocol so that it runs on the host as well.
+ *
+ * Samples are pushed into a bounded spool; when it is full the oldest one
+ * is dropped. A session opens the link, sends the spooled samples as
+ * batches of up to `batch_samples` and closes the link again, so the radio
+ * is only on while there is something to send. A batch is removed from the
+ * spool once the transport acknowledged it; after a failure the next
+ * session comes after an exponential backoff instead of the period.
+ *
+ * A batch payload is a history stream (history_codec.h) of one block.
+ */
+
+#define UPLINK_BATCH_MAX    HISTORY_BLOCK_SAMPLES
+#define UPLINK_PAYLOAD_MAX  (HISTORY_CODEC_HEADER_SIZE + HISTORY_BLOCK_MAX)
+
+typedef struct uplink_transport {
+    esp_err_t (*open)(void *ctx);   /* Radio on, connected to the broker or server */
+    esp_err_t (*send)(void *ctx, const uint8_t *payload, size_t len);   /* Returns once acknowledged */
+    void (*close)(void *ctx);       /* Disconnected, radio off */
+    void *ctx;
+} uplink_transport_t;
+
+typedef struct uplink_config {
+    uint32_t period_ms;             /* Between sessions while the link works */
+    uint32_t backoff_min_ms;        /* First retry delay after a failure, doubled on each failure */
+    uint32_t backoff_max_ms;
+    size_t batch_samples;           /* 1..UPLINK_BATCH_MAX */
+} uplink_config_t;
+
+typedef struct uplink_stats {
+    uint32_t sessions;
+    uint32_t failures;              /* Sessions ended by an open or send error */
+    uint32_t batches;
+    uint32_t samples_sent;
+    uint32_t bytes_sent;
+    uint32_t dropped;               /* Samples lost to a full spool */
+    uint64_t radio_on_us;
+    uint32_t last_batches;          /* Of the last session */
+    uint32_t last_radio_on_us;
+    esp_err_t last_error;
+} uplink_stats_t;
+
+typedef struct uplink {
+    uplink_config_t config;
+    history_sample_t *spool;
+    size_t size;
+    uint32_t head;                  /* Samples pushed */
+    uint32_t tail;                  /* Samples acknowledged or dropped */
+    uint32_t backoff_ms;
+    uplink_stats_t stats;
+    portMUX_TYPE lock;
+} uplink_t;
+
+void uplink_core_init(uplink_t *u, const uplink_config_t *config, history_sample_t *storage, size_t size);
+
+/* Called from any task; drops the oldest sample when the spool is full */
+void uplink_core_push(uplink_t *u, const history_sample_t *sample);
+
+size_t uplink_core_pending(uplink_t *u);
+
+/*
+ * Runs a session if samples are pending. Returns the delay until the next
+ * session: the period after a success, the backoff after a failure.
+ */
+uint32_t uplink_core_session(uplink_t *u, const uplink_transport_t *transport);
+
+void uplink_core_get_stats(uplink_t *u, uplink_stats_t *stats);
+
+#endif
@@ -1,6 +1,8 @@
 #include <stdio.h>
+#include <math.h>
 #include <unistd.h>
 #include <string.h>
+#include <sys/param.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -11,17 +13,55 @@
 #include "esp_err.h"
 #include "esp_log.h"
 #include "esp_check.h"
+#include "esp_timer.h"
 
 #include "aht20.h"
 #include "bmp280.h"
 
+#include "boot.h"
+#include "derived.h"
+#include "memory.h"
+#include "oversample.h"
+#include "sched_trace.h"
+#include "settings.h"
+#include "telemetry.h"
+#include "tlog.h"
 #include "weather.h"
 
 #define I2C_MASTER_FREQ_HZ 100000
 #define ADDR AHT_I2C_ADDRESS_GND
 #define AHT_TYPE AHT_TYPE_AHT20
 
-#define SENSORS_REFRESH_RATE 10000
+/*
+ * The former configMINIMAL_STACK_SIZE * 8, kept until the high-water marks of
+ * the boot report are measured: float formatting in the logs needs about
+ * 2 KiB on its own
+ */
+#define WEATHER_TASK_STACK_SIZE (6 * 1024)
+
+/* A conversion takes 80 ms; the sensor should stay idle 90 % of the time against self-heating */
+#define AHT20_CONVERSION_MS     80
+/* New results every 250 ms standby plus the 13.3 ms conversion of I2C_BMP280_CONFIG_DEFAULT */
+#define BMP280_PERIOD_MS        264
+
+#if CONFIG_STATION_OVERSAMPLE
+#define BURST_MAX               CONFIG_STATION_OVERSAMPLE_MAX
+#define TARGET_TEMPERATURE      (CONFIG_STATION_OVERSAMPLE_TARGET_TEMPERATURE / 100.0f)
+#define TARGET_HUMIDITY         (CONFIG_STATION_OVERSAMPLE_TARGET_HUMIDITY / 100.0f)
+#define TARGET_PRESSURE         ((float) CONFIG_STATION_OVERSAMPLE_TARGET_PRESSURE)
+#else
+/* Single conversions */
+#define BURST_MAX               1
+#define TARGET_TEMPERATURE      INFINITY
+#define TARGET_HUMIDITY         INFINITY
+#define TARGET_PRESSURE         INFINITY
+#endif
+
+#if CONFIG_STATION_OVERSAMPLE_MEDIAN
+#define BURST_REDUCE            OVERSAMPLE_MEDIAN
+#else
+#define BURST_REDUCE            OVERSAMPLE_TRIMMED_MEAN
+#endif
 
 static const char *TAG = "weather";
 
@@ -33,10 +73,28 @@ static float bmp280_pressure;
 
 static uint32_t aht20_status_led_gpio;
 static uint32_t bmp280_status_led_gpio;
-static bool aht20_failure;
-static bool bmp280_failure;
+/* Set until the first successful read */
+static bool aht20_failure = true;
+static bool bmp280_failure = true;
+static bool has_reading[WEATHER_SENSOR_MAX];
+
+/* Recomputed on every reading, so that the UI only copies them */
+static derived_metrics_t derived;
+static portMUX_TYPE derived_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* Temperature and humidity, temperature and pressure in Pa */
+static oversample_t aht20_burst;
+static oversample_t bmp280_burst;
+
+static weather_sensor_stats_t sensor_stats[WEATHER_SENSOR_MAX];
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
 
 static aht20_dev_handle_t aht20_handle = NULL;
+
+static StackType_t aht20_stack[WEATHER_TASK_STACK_SIZE];
+static StaticTask_t aht20_tcb;
+static StackType_t bmp280_stack[WEATHER_TASK_STACK_SIZE];
+static StaticTask_t bmp280_tcb;
 static bmp280_handle_t bmp280_handle = NULL;
 
 static void init_status_led(unsigned int led_gpio)
@@ -52,30 +110,104 @@ static void init_status_led(unsigned int led_gpio)
     gpio_config(&io_conf);
 }
 
-static void bmp280_poll_task(void *arg)
+static void record_read(weather_sensor_t sensor, uint32_t duration_us, esp_err_t rc, unsigned int conversions)
+{
+    weather_sensor_stats_t *stats = &sensor_stats[sensor];
+
+    portENTER_CRITICAL(&stats_lock);
+    stats->reads++;
+    stats->errors += rc != ESP_OK;
+    stats->conversions += conversions;
+    stats->last_conversions = conversions;
+    stats->last_us = duration_us;
+    stats->max_us = MAX(stats->max_us, duration_us);
+    stats->total_us += duration_us;
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+void weather_get_stats(weather_sensor_t sensor, weather_sensor_stats_t *stats)
+{
+    portENTER_CRITICAL(&stats_lock);
+    *stats = sensor_stats[sensor];
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+static void update_derived(void)
+{
+    derived_input_t in;
+    derived_metrics_t out;
+
+    if (!has_reading[WEATHER_SENSOR_AHT20] || !has_reading[WEATHER_SENSOR_BMP280]) return;
+
+    in.temperature = lroundf(weather_get_temperature() * 100);
+    in.humidity = lroundf(aht20_humidity * 100);
+    in.pressure = lroundf(bmp280_pressure * 100);
+    in.altitude = settings_get(SETTING_ALTITUDE_M);
+    derived_compute(&in, &out);
+
+    portENTER_CRITICAL(&derived_lock);
+    derived = out;
+    portEXIT_CRITICAL(&derived_lock);
+}
+
+static void poll_bmp280(void)
 {
     esp_err_t rc;
-    float temp, pressure;
+    float v[2] = { NAN, NAN }, temp, pressure;
+    unsigned int count;
+    int64_t start_us;
+    uint32_t read_us = 0;
+
+    oversample_begin(&bmp280_burst, BURST_MAX);
+
+    for (;;) {
+        start_us = esp_timer_get_time();
+        rc = bmp280_get_measurements(bmp280_handle, &v[0], &v[1]);
+        read_us += esp_timer_get_time() - start_us;
+
+        if (rc != ESP_OK || oversample_add(&bmp280_burst, v)) break;
+
+        /* In normal mode the result registers only change once per period */
+        vTaskDelay(pdMS_TO_TICKS(BMP280_PERIOD_MS));
+    }
+
+    /* A failure within a burst still publishes the conversions before it */
+    count = oversample_end(&bmp280_burst, v);
+    if (count > 0) rc = ESP_OK;
+    temp = v[0];
+    pressure = v[1];
+    record_read(WEATHER_SENSOR_BMP280, read_us, rc, count);
 
+    if(rc != ESP_OK) {
+        TLOGE(TAG, "bmp280 device read failed (%s)", esp_err_to_name(rc));
+        gpio_set_level(bmp280_status_led_gpio, 1);
+        bmp280_failure = 1;
+        telemetry_sample(WEATHER_SENSOR_BMP280, rc, NAN, NAN, NAN, read_us);
+    } else {
+        pressure = pressure / 100;
+        telemetry_sample(WEATHER_SENSOR_BMP280, rc, temp, NAN, pressure, read_us);
+#if !CONFIG_STATION_TELEMETRY
+        TLOGI(TAG, "air temperature:     %.2f °C", temp);
+        TLOGI(TAG, "barometric pressure: %.2f hPa", pressure);
+#endif
+
+        bmp280_temperature = temp;
+        bmp280_pressure = pressure;
+        gpio_set_level(bmp280_status_led_gpio, 0);
+        bmp280_failure = 0;
+        has_reading[WEATHER_SENSOR_BMP280] = true;
+        update_derived();
+        boot_mark(BOOT_PHASE_FIRST_READING);
+    }
+}
+
+static void bmp280_poll_task(void *arg)
+{
     for(;;) {
-        rc = bmp280_get_measurements(bmp280_handle, &temp, &pressure);
-
-        if(rc != ESP_OK) {
-            ESP_LOGE(TAG, "bmp280 device read failed (%s)", esp_err_to_name(rc));
-            gpio_set_level(bmp280_status_led_gpio, 1);
-            bmp280_failure = 1;
-        } else {
-            pressure = pressure / 100;
-            ESP_LOGI(TAG, "air temperature:     %.2f °C", temp);
-            ESP_LOGI(TAG, "barometric pressure: %.2f hPa", pressure);
-
-            bmp280_temperature = temp;
-            bmp280_pressure = pressure;
-            gpio_set_level(bmp280_status_led_gpio, 0);
-            bmp280_failure = 0;
-        }
-
-        vTaskDelay(pdMS_TO_TICKS(SENSORS_REFRESH_RATE));
+        sched_trace_begin(SCHED_SPAN_BMP280);
+        poll_bmp280();
+        sched_trace_end(SCHED_SPAN_BMP280);
+        vTaskDelay(pdMS_TO_TICKS(settings_get(SETTING_SENSORS_REFRESH_MS)));
     }
 
     bmp280_delete(bmp280_handle);
@@ -92,6 +224,9 @@ static esp_err_t init_bmp280(i2c_master_bus_handle_t i2c_bus_handle, uint32_t le
     init_status_led(led_status_gpio);
 
     bmp280_config_t dev_cfg = I2C_BMP280_CONFIG_DEFAULT;
+    const float target[] = { TARGET_TEMPERATURE, TARGET_PRESSURE };
+
+    oversample_init(&bmp280_burst, BURST_REDUCE, 2, target, BURST_MAX);
 
     rc = bmp280_init(i2c_bus_handle, &dev_cfg, &bmp280_handle);
 
@@ -101,34 +236,74 @@ static esp_err_t init_bmp280(i2c_master_bus_handle_t i2c_bus_handle, uint32_t le
         return rc;
     }
 
-    xTaskCreate(bmp280_poll_task, "bmp280_poll_task", configMINIMAL_STACK_SIZE * 8, NULL, 1, NULL);
+    TaskHandle_t task = xTaskCreateStatic(bmp280_poll_task, "bmp280_poll_task", WEATHER_TASK_STACK_SIZE, NULL, 1, bmp280_stack, &bmp280_tcb);
+    memory_account_task("weather", task, sizeof(bmp280_stack) + sizeof(bmp280_tcb));
 
     return ESP_OK;
 }
 
-static void aht20_poll_task(void *arg)
+/* Conversions per reading within the AHT20's duty cycle at the poll interval */
+static unsigned int aht20_burst_limit(void)
+{
+    return MAX(1, settings_get(SETTING_SENSORS_REFRESH_MS) / (10 * AHT20_CONVERSION_MS));
+}
+
+static void poll_aht20(void)
 {
     esp_err_t rc;
-    float temp, hum;
+    float v[2] = { NAN, NAN }, temp, hum;
+    unsigned int count;
+    int64_t start_us;
+    uint32_t read_us;
+
+    oversample_begin(&aht20_burst, MIN(BURST_MAX, aht20_burst_limit()));
+
+    /*
+     * Each read starts a conversion and polls its status every 10 ms, leaving
+     * the bus to the others. The I2C power lock is only held per transfer
+     * (i2c_trace.c), so the chip may light-sleep during the conversions.
+     */
+    start_us = esp_timer_get_time();
+    do {
+        rc = aht20_read_float(aht20_handle, &v[0], &v[1]);
+    } while (rc == ESP_OK && !oversample_add(&aht20_burst, v));
+    read_us = esp_timer_get_time() - start_us;
+
+    count = oversample_end(&aht20_burst, v);
+    if (count > 0) rc = ESP_OK;
+    temp = v[0];
+    hum = v[1];
+    record_read(WEATHER_SENSOR_AHT20, read_us, rc, count);
+
+    if (rc != ESP_OK) {
+        TLOGE(TAG, "Reading AHT20 device failed: %s", esp_err_to_name(rc));
+        gpio_set_level(aht20_status_led_gpio, 1);
+        aht20_failure = 1;
+        telemetry_sample(WEATHER_SENSOR_AHT20, rc, NAN, NAN, NAN, read_us);
+    } else {
+        telemetry_sample(WEATHER_SENSOR_AHT20, rc, temp, hum, NAN, read_us);
+#if !CONFIG_STATION_TELEMETRY
+        TLOGI(TAG, "Humidity      : %2.2f %%", hum);
+        TLOGI(TAG, "Temperature   : %2.2f degC", temp);
+#endif
+
+        aht20_temperature = temp;
+        aht20_humidity = hum;
+        gpio_set_level(aht20_status_led_gpio, 0);
+        aht20_failure = 0;
+        has_reading[WEATHER_SENSOR_AHT20] = true;
+        update_derived();
+        boot_mark(BOOT_PHASE_FIRST_READING);
+    }
+}
 
+static void aht20_poll_task(void *arg)
+{
     for(;;) {
-        rc = aht20_read_float(aht20_handle, &temp, &hum);
-
-        if (rc != ESP_OK) {
-            ESP_LOGE(TAG, "Reading AHT20 device failed: %s", esp_err_to_name(rc));
-            gpio_set_level(aht20_status_led_gpio, 1);
-            aht20_failure = 1;
-        } else {
-            ESP_LOGI(TAG, "Humidity      : %2.2f %%", hum);
-            ESP_LOGI(TAG, "Temperature   : %2.2f degC", temp);
-
-            aht20_temperature = temp;
-            aht20_humidity = hum;
-            gpio_set_level(aht20_status_led_gpio, 0);
-            aht20_failure = 0;
-        }
-
-        vTaskDelay(pdMS_TO_TICKS(SENSORS_REFRESH_RATE));
+        sched_trace_begin(SCHED_SPAN_AHT20);
+        poll_aht20();
+        sched_trace_end(SCHED_SPAN_AHT20);
+        vTaskDelay(pdMS_TO_TICKS(settings_get(SETTING_SENSORS_REFRESH_MS)));
     }
 
     aht20_del_sensor(&aht20_handle);
@@ -144,6 +319,10 @@ static esp_err_t init_aht20(i2c_master_bus_handle_t i2c_bus_handle, uint32_t led
     aht20_status_led_gpio = led_status_gpio;
     init_status_led(led_status_gpio);
 
+    const float target[] = { TARGET_TEMPERATURE, TARGET_HUMIDITY };
+
+    oversample_init(&aht20_burst, BURST_REDUCE, 2, target, BURST_MAX);
+
     i2c_aht20_config_t aht20_i2c_config = {
         .i2c_config.device_address = AHT20_ADDRESS_0,
         .i2c_config.scl_speed_hz = I2C_MASTER_FREQ_HZ,
@@ -158,7 +337,8 @@ static esp_err_t init_aht20(i2c_master_bus_handle_t i2c_bus_handle, uint32_t led
         return rc;
     }
 
-    xTaskCreate(aht20_poll_task, "aht20_poll_task", configMINIMAL_STACK_SIZE * 8, NULL, 1, NULL);
+    TaskHandle_t task = xTaskCreateStatic(aht20_poll_task, "aht20_poll_task", WEATHER_TASK_STACK_SIZE, NULL, 1, aht20_stack, &aht20_tcb);
+    memory_account_task("weather", task, sizeof(aht20_stack) + sizeof(aht20_tcb));
 
     return ESP_OK;
 }
@@ -173,6 +353,7 @@ esp_err_t weather_init_sensors(i2c_master_bus_handle_t i2c_bus_handle,
 
     rc1 = init_aht20(i2c_bus_handle, sensor1_led_status_gpio);
     rc2 = init_bmp280(i2c_bus_handle, sensor2_led_status_gpio);
+    memory_account("weather", "bursts", sizeof(aht20_burst) + sizeof(bmp280_burst));
 
     if (rc1 != ESP_OK) {
         return rc1;
@@ -181,6 +362,27 @@ esp_err_t weather_init_sensors(i2c_master_bus_handle_t i2c_bus_handle,
     return rc2;
 }
 
+void weather_poll(weather_sensor_t sensor)
+{
+    if (sensor == WEATHER_SENSOR_AHT20) {
+        poll_aht20();
+    } else {
+        poll_bmp280();
+    }
+}
+
+bool weather_has_reading(weather_sensor_t sensor)
+{
+    return sensor < WEATHER_SENSOR_MAX && has_reading[sensor];
+}
+
+bool weather_is_current(weather_sensor_t sensor)
+{
+    if (sensor == WEATHER_SENSOR_AHT20) return !aht20_failure;
+    if (sensor == WEATHER_SENSOR_BMP280) return !bmp280_failure;
+    return false;
+}
+
 float weather_get_temperature(void)
 {
     if (aht20_failure) {
@@ -203,3 +405,14 @@ float weather_get_humidity(void)
 {
     return aht20_humidity;
 }
+
+bool weather_get_derived(derived_metrics_t *out)
+{
+    if (!has_reading[WEATHER_SENSOR_AHT20] || !has_reading[WEATHER_SENSOR_BMP280]) return false;
+
+    portENTER_CRITICAL(&derived_lock);
+    *out = derived;
+    portEXIT_CRITICAL(&derived_lock);
+
+    return true;
+}
@@ -1,16 +1,64 @@
 #ifndef WEATHER_H
 #define WEATHER_H
 
+#include <stdint.h>
+#include <stdbool.h>
+
 #include "driver/i2c_master.h"
 
 #include "esp_err.h"
 
+#include "derived.h"
+
+typedef enum weather_sensor {
+    WEATHER_SENSOR_AHT20 = 0,
+    WEATHER_SENSOR_BMP280,
+    WEATHER_SENSOR_MAX
+} weather_sensor_t;
+
+/* A read is one published reading, reduced from a burst of conversions */
+typedef struct weather_sensor_stats {
+    uint32_t reads;
+    uint32_t errors;
+    uint32_t conversions;
+    uint32_t last_conversions;
+    uint32_t last_us;       /* Time in the driver for the last read */
+    uint32_t max_us;
+    uint64_t total_us;
+} weather_sensor_stats_t;
+
 esp_err_t weather_init_sensors(i2c_master_bus_handle_t i2c_bus_handle,
                                uint32_t sensor1_led_status_gpio,
                                uint32_t sensor2_led_status_gpio);
 
+/*
+ * Reads one sensor and updates the values, as its poll task does every
+ * SETTING_SENSORS_REFRESH_MS: a burst of conversions with
+ * CONFIG_STATION_OVERSAMPLE, sized to the noise seen so far, otherwise a
+ * single one. Lets the host replay drive the acquisition.
+ */
+void weather_poll(weather_sensor_t sensor);
+
+/* False until the sensor was read successfully once */
+bool weather_has_reading(weather_sensor_t sensor);
+
+/*
+ * True while the last read of the sensor succeeded. Otherwise its values
+ * are stale, or placeholders (0) before the first reading.
+ */
+bool weather_is_current(weather_sensor_t sensor);
+
 float weather_get_temperature(void);
 float weather_get_pressure(void);
 float weather_get_humidity(void);
 
+/*
+ * Dew point, absolute humidity, heat index and sea-level pressure of the
+ * latest readings, computed once per reading. False until both sensors were
+ * read.
+ */
+bool weather_get_derived(derived_metrics_t *metrics);
+
+void weather_get_stats(weather_sensor_t sensor, weather_sensor_stats_t *stats);
+
 #endif
\ No newline at end of file